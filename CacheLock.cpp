@@ -0,0 +1,121 @@
+#include <Windows.h>
+
+#include <sstream>
+#include <chrono>
+
+#include "CacheLock.h"
+#include "Log.h"
+#include "Stats.h"
+
+namespace {
+    constexpr DWORD pollIntervalMs = 100;
+};
+
+CacheLock::~CacheLock()
+{
+    Release();
+}
+
+std::wstring CacheLock::Acquire(const std::filesystem::path& entryPath, uint32_t timeoutMs)
+{
+    Release();
+
+    m_lockPath = entryPath;
+    m_lockPath += L".lock";
+
+    {
+        std::error_code ec;
+        std::filesystem::create_directories(m_lockPath.parent_path(), ec);
+    }
+
+    // Lock files are never deleted. Deleting one while another process waits on it would let two owners in.
+    m_hFile = CreateFileW(m_lockPath.wstring().c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (m_hFile == INVALID_HANDLE_VALUE) {
+        std::wstringstream ss;
+        ss << L"Failed to open a lock file \"" << m_lockPath.wstring() << L"\".";
+        return ss.str();
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    bool waiting = false;
+    for (;;) {
+        OVERLAPPED ov = {};
+        if (LockFileEx(m_hFile, LOCKFILE_EXCLUSIVE_LOCK | LOCKFILE_FAIL_IMMEDIATELY, 0, 1, 0, &ov)) {
+            return std::wstring();
+        }
+
+        DWORD err = GetLastError();
+        if (err != ERROR_LOCK_VIOLATION) {
+            CloseHandle(m_hFile);
+            m_hFile = INVALID_HANDLE_VALUE;
+
+            std::wstringstream ss;
+            ss << L"Failed to lock \"" << m_lockPath.wstring() << L"\". Error code: " << err;
+            return ss.str();
+        }
+
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+        if (elapsed >= timeoutMs) {
+            CloseHandle(m_hFile);
+            m_hFile = INVALID_HANDLE_VALUE;
+
+            std::wstringstream ss;
+            ss << L"Timed out waiting for another process holding \"" << m_lockPath.wstring() << L"\".";
+            return ss.str();
+        }
+
+        if (!waiting) {
+            Log::Info([&](Log::Message& m) { m << L"Waiting for another process downloading.. " << m_lockPath; });
+            waiting = true;
+        }
+        Sleep(pollIntervalMs);
+    }
+}
+
+void CacheLock::Release()
+{
+    if (m_hFile != INVALID_HANDLE_VALUE) {
+        OVERLAPPED ov = {};
+        UnlockFileEx(m_hFile, 0, 1, 0, &ov);
+        CloseHandle(m_hFile);
+        m_hFile = INVALID_HANDLE_VALUE;
+    }
+}
+
+std::wstring CacheLock::Download(const std::wstring& url, const std::filesystem::path& entryPath, uint32_t timeoutMs, const HttpGet::Validator& validator, Outcome& outcome)
+{
+    CacheLock lock;
+    {
+        Stats::Scope lockStats(L"cache_lock_wait");
+        auto errStr = lock.Acquire(entryPath, timeoutMs);
+        if (!errStr.empty()) {
+            outcome = Outcome::LockFailed;
+            return errStr;
+        }
+    }
+
+    bool replacing = false;
+    if (std::filesystem::exists(entryPath)) {
+        auto errStr = validator ? validator(entryPath) : std::wstring();
+        if (errStr.empty()) {
+            outcome = Outcome::Reused;
+            return std::wstring();
+        }
+
+        // Written by something which doesn't validate, i.e. an older version of this tool. HttpGet::Get() replaces
+        // it only once the new download has been validated, so the readers of the old file are not disturbed.
+        Log::Warning([&](Log::Message& m) { m << L"Downloading again the cache entry which was rejected. " << entryPath << L" " << errStr; });
+        replacing = true;
+    }
+
+    Log::Info([&](Log::Message& m) { m << L"[HttpGet]:" << url; });
+    auto errStr = HttpGet::Get(url, entryPath, validator);
+    if (!errStr.empty()) {
+        outcome = Outcome::DownloadFailed;
+        return errStr;
+    }
+
+    outcome = replacing ? Outcome::Replaced : Outcome::Downloaded;
+    return std::wstring();
+}
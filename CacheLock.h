@@ -0,0 +1,41 @@
+#pragma once
+#include <Windows.h>
+
+#include <string>
+#include <filesystem>
+
+#include "HttpGet.h"
+
+// An advisory lock on "<cache entry>.lock" shared by all resolver processes using the same cache.
+// The OS releases the lock when the owner process dies, so a crashed downloader never blocks the others.
+class CacheLock
+{
+public:
+	HANDLE                  m_hFile = INVALID_HANDLE_VALUE;
+	std::filesystem::path   m_lockPath;
+
+public:
+	// What Download() did to a cache entry.
+	enum class Outcome {
+		Downloaded,
+		Reused, // published by another process while this one waited for the lock.
+		Replaced, // already in the cache but rejected by the validator, and downloaded again over it.
+		LockFailed,
+		DownloadFailed,
+	};
+
+public:
+	CacheLock() = default;
+	CacheLock(const CacheLock&) = delete;
+	CacheLock& operator=(const CacheLock&) = delete;
+	~CacheLock();
+
+	// Block until the lock is acquired or timeoutMs has passed.
+	std::wstring Acquire(const std::filesystem::path& entryPath, uint32_t timeoutMs);
+	void Release();
+
+	// Download "url" into the cache entry while holding its lock, unless another process has published it meanwhile.
+	// An entry which fails the validation, i.e. truncated by a tool which wrote the cache in place, is downloaded
+	// again and swapped in atomically. It is never deleted first, since the other processes may be reading it.
+	static std::wstring Download(const std::wstring& url, const std::filesystem::path& entryPath, uint32_t timeoutMs, const HttpGet::Validator& validator, Outcome& outcome);
+};
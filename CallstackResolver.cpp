@@ -1,38 +1,28 @@
 // CallstackResolver.cpp : This file contains the 'main' function. Program execution begins and ends there.
 //
 #include <Windows.h>
-#include <DbgHelp.h>
 
 #include <string>
 #include <vector>
-#include <map>
+#include <list>
 #include <iostream>
+#include <sstream>
 #include <filesystem>
-#include <array>
+#include <thread>
+#include <io.h>
+#include <fcntl.h>
 
 #include "Context.h"
-#include "HttpGet.h"
-
-#pragma comment(lib, "dbghelp.lib")
+#include "CompressedStream.h"
+#include "Resolver.h"
+#include "Stats.h"
+#include "Trace.h"
+#include "SyntheticCorpus.h"
+#include "OutputFormatter.h"
+#include "StackAggregator.h"
+#include "Log.h"
 
 namespace {
-	std::wstring GetLastErrorAsWString()
-	{
-		DWORD errorMessageID = ::GetLastError();
-		if (errorMessageID == 0) {
-			return std::wstring();
-		}
-
-		LPWSTR messageBuffer = nullptr;
-		size_t size = FormatMessageW(FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS,
-			NULL, errorMessageID, MAKELANGID(LANG_NEUTRAL, SUBLANG_DEFAULT), (LPWSTR)&messageBuffer, 0, NULL);
-
-		std::wstring message(messageBuffer, size);
-		LocalFree(messageBuffer);
-
-		return message;
-	}
-
 	std::filesystem::path GetExePath()
 	{
 		std::vector<wchar_t>    u16buf(1024, L'\0');
@@ -93,20 +83,42 @@ namespace {
 		return { targetPath, retStr };
 	}
 
-	std::wstring ParseArguments(const int argc, const wchar_t** argv, bool& verbose, bool& json, bool& cin, std::wstring& configFile, std::wstring& textFile)
+	std::wstring ParseArguments(const int argc, const wchar_t** argv, Log::Level& logLevel, OutputFormat& outputFormat, bool& cin, bool& traceStages, bool& simplifyNames, bool& noLines, std::wstring& configFile, std::wstring& textFile, std::wstring& statsFormat, std::wstring& traceFile, std::wstring& corpusFrames, std::wstring& foldFile, std::wstring& dumpFile, std::wstring& backendName, std::wstring& outputFile)
 	{
-		constexpr std::wstring_view flags[] = {L"--verbose", L"--json", L"--cin", L"--config", L"--text", };
+		constexpr std::wstring_view flags[] = {L"--verbose", L"--json", L"--cin", L"--config", L"--text", L"--trace-stages", L"--stats", L"--trace", L"--generate-corpus", L"--csv", L"--binary", L"--fold", L"--simplify-names", L"--dump", L"--log-level", L"--no-lines", L"--backend", L"--output", };
 		enum flagIdx : size_t {
 			eVerbose = 0,
 			eJson,
 			eCin,
 			eConfg,
-			eText
+			eText,
+			eTraceStages,
+			eStats,
+			eTrace,
+			eGenerateCorpus,
+			eCsv,
+			eBinary,
+			eFold,
+			eSimplifyNames,
+			eDump,
+			eLogLevel,
+			eNoLines,
+			eBackend,
+			eOutput
 		};
 
-		verbose = json = cin = false;
+		logLevel = Log::Level::Off;
+		cin = traceStages = simplifyNames = noLines = false;
+		outputFormat = OutputFormat::Readable;
 		configFile.clear();
 		textFile.clear();
+		statsFormat.clear();
+		traceFile.clear();
+		corpusFrames.clear();
+		foldFile.clear();
+		dumpFile.clear();
+		backendName.clear();
+		outputFile.clear();
 
 		if (argc < 2)
 			return std::wstring();
@@ -154,7 +166,7 @@ namespace {
 			auto& arg(*itr);
 
 			auto checkFlag = [&](const std::wstring_view flag) -> bool {
-				if (arg.rfind(flag, 0) == 0) {
+				if (arg == flag) {
 					itr = args.erase(itr);
 					return true;
 				}
@@ -179,17 +191,37 @@ namespace {
 				};
 
 			if (checkFlag(flags[eVerbose])) {
-				verbose = true;
+				logLevel = Log::Level::Debug;
 				continue;
 			}
 			if (checkFlag(flags[eJson])) {
-				json = true;
+				outputFormat = OutputFormat::Json;
+				continue;
+			}
+			if (checkFlag(flags[eCsv])) {
+				outputFormat = OutputFormat::Csv;
+				continue;
+			}
+			if (checkFlag(flags[eBinary])) {
+				outputFormat = OutputFormat::Binary;
 				continue;
 			}
 			if (checkFlag(flags[eCin])) {
 				cin = true;
 				continue;
 			}
+			if (checkFlag(flags[eTraceStages])) {
+				traceStages = true;
+				continue;
+			}
+			if (checkFlag(flags[eSimplifyNames])) {
+				simplifyNames = true;
+				continue;
+			}
+			if (checkFlag(flags[eNoLines])) {
+				noLines = true;
+				continue;
+			}
 			if (checkFlagAndArg(flags[eConfg], configFile)) {
 				if (!errStr.empty()) {
 					return errStr;
@@ -202,12 +234,75 @@ namespace {
 				}
 				continue;
 			}
+			if (checkFlagAndArg(flags[eStats], statsFormat)) {
+				if (!errStr.empty()) {
+					return errStr;
+				}
+				if (statsFormat != L"json") {
+					std::wstringstream ss;
+					ss << L"Unsupported stats format \"" << statsFormat << L"\". Only \"json\" is supported.";
+					return ss.str();
+				}
+				continue;
+			}
+			if (checkFlagAndArg(flags[eTrace], traceFile)) {
+				if (!errStr.empty()) {
+					return errStr;
+				}
+				continue;
+			}
+			if (checkFlagAndArg(flags[eGenerateCorpus], corpusFrames)) {
+				if (!errStr.empty()) {
+					return errStr;
+				}
+				continue;
+			}
+			if (checkFlagAndArg(flags[eFold], foldFile)) {
+				if (!errStr.empty()) {
+					return errStr;
+				}
+				continue;
+			}
+			if (checkFlagAndArg(flags[eDump], dumpFile)) {
+				if (!errStr.empty()) {
+					return errStr;
+				}
+				continue;
+			}
+			if (checkFlagAndArg(flags[eBackend], backendName)) {
+				if (!errStr.empty()) {
+					return errStr;
+				}
+				continue;
+			}
+			if (checkFlagAndArg(flags[eOutput], outputFile)) {
+				if (!errStr.empty()) {
+					return errStr;
+				}
+				continue;
+			}
+			{
+				std::wstring levelName;
+				if (checkFlagAndArg(flags[eLogLevel], levelName)) {
+					if (!errStr.empty()) {
+						return errStr;
+					}
+					auto level = Log::ParseLevel(levelName);
+					if (!level.has_value()) {
+						std::wstringstream ss;
+						ss << L"Unknown log level \"" << levelName << L"\". It must be one of error, warning, info and debug.";
+						return ss.str();
+					}
+					logLevel = level.value();
+					continue;
+				}
+			}
 
 			++itr;
 		}
 
 		// If there are other arguments, they're input call stack string to resolve a symbol.
-		{
+		if (args.size() > 1) {
 			std::wstring uArgs;
 			for (auto itr = ++args.begin(); itr != args.end(); ++itr) {
 				uArgs += *itr + L" ";
@@ -219,623 +314,322 @@ namespace {
 
 		return std::wstring();
 	}
-};
-
-
-class CallstackResolver
-{
-public:
-	class ImageInfo {
-	public:
-		std::filesystem::path               m_imagePath;
-		size_t                              m_imageSize;
-		std::wstring                        m_pdbPathString;
-		GUID                                m_guid;
-		uint32_t                            m_age;
-		std::wstring                        m_pdbSignature;
-		std::wstring                        m_serchedPDBPathString;
-	};
 
-	class PDBInfo {
-	public:
-		std::filesystem::path               m_pdbPath;
-		uintptr_t                           m_allocatedMemAddr = 0;
-		size_t                              m_allocatedMemSize = 0;
-		std::map<uint64_t, std::wstring>    m_symbolTable;
-
-		virtual ~PDBInfo()
+	// Finishes the trace file whenever Run() returns, so that a failure doesn't leave its JSON unterminated.
+	// Declared before the spans of Run(), so they are recorded first. Trace::Write() does nothing once the
+	// trace is written, so the successful path can still write it itself to report an error.
+	struct TraceFinisher {
+		~TraceFinisher()
 		{
-			if (m_allocatedMemAddr != 0) {
-				free(reinterpret_cast<void*>(m_allocatedMemAddr));
-				m_allocatedMemAddr = 0;
-				m_allocatedMemSize = 0;
+			auto errStr = Trace::Write();
+			if (!errStr.empty()) {
+				std::wcerr << errStr << std::endl;
 			}
 		}
 	};
+};
 
-public:
-	std::wostream		m_verboseOut;
-
-	uintptr_t			m_allocatedMemAddr = 0; // dummy memory space used when mapping a PDB.
-	static const size_t		m_allocatedMemSize = 2048u * 1024u * 1024u; // 2GB
-	HANDLE				m_hDbgHelp = 0;
-
-	std::map<std::wstring, std::unique_ptr<ImageInfo>>      m_imageList;
-	std::map<std::wstring, std::unique_ptr<PDBInfo>>        m_loadedPDBList;
-	std::list<std::filesystem::path>                        m_pdbStorageList;
-	std::list<std::filesystem::path>                        m_pdbPathList;
-	std::list<std::tuple<std::wstring, std::filesystem::path>>                        m_symbolServerList;
 
-public:
-	CallstackResolver() :
-		m_verboseOut(nullptr)
-	{
-	};
-
-	~CallstackResolver()
-	{
-		// nullify before destruction.
-		m_verboseOut.rdbuf(nullptr);
-	};
-
-	std::wstring Init()
+int Run(int argc, const wchar_t** argv)
+{
+	Context ctx;
+	CallstackResolver cr;
+	TraceFinisher traceFinisher;
+
+	// Parse input arguments.
+	Log::Level logLevel = Log::Level::Off;
+	bool    use_cin = false, trace_stages = false, simplify_names = false, no_lines = false;
+	OutputFormat outputFormat = OutputFormat::Readable;
+	std::wstring argConfigFileStr, argTextFileStr, argStatsFormatStr, argTraceFileStr, argCorpusFramesStr, argFoldFileStr, argDumpFileStr, argBackendStr, argOutputFileStr;
 	{
-		if (m_hDbgHelp != 0) {
-			return L"Failed to initialize dbghelp module. It has already been initialized.";
+		// Stats are enabled by the arguments themselves, so the time is added afterwards.
+		auto begin = Stats::Clock::now();
+		auto errStr = ParseArguments(argc, argv, logLevel, outputFormat, use_cin, trace_stages, simplify_names, no_lines, argConfigFileStr, argTextFileStr, argStatsFormatStr, argTraceFileStr, argCorpusFramesStr, argFoldFileStr, argDumpFileStr, argBackendStr, argOutputFileStr);
+		if (!errStr.empty()) {
+			std::wcerr << L"Failed to parse arguments. " << errStr << std::endl;
+			return 1;
 		}
-
-		DWORD options;
-		options = SymGetOptions();
-		options &= ~SYMOPT_DEFERRED_LOADS;
-		options |= SYMOPT_LOAD_LINES;
-		options |= SYMOPT_IGNORE_NT_SYMPATH;
-		options |= SYMOPT_DEBUG;
-		options |= SYMOPT_UNDNAME;
-		SymSetOptions(options);
-
-		BOOL isOK = SymInitialize(m_hDbgHelp, NULL, FALSE);
-		if (!isOK) {
-			m_hDbgHelp = 0;
-			return L"Failed to initialize dbghelp module.";
+		if (!argStatsFormatStr.empty()) {
+			Stats::Enable();
+			Stats::AddTime(L"parse_arguments", begin, Stats::Clock::now());
 		}
-
-		m_allocatedMemAddr = reinterpret_cast<uintptr_t>(malloc(m_allocatedMemSize));
-
-		return std::wstring();
-	}
-
-	std::wstring Finalize()
-	{
-		std::wstringstream ss;
-
-		if (m_hDbgHelp != 0) {
-			for (auto& itr : m_loadedPDBList) {
-				if (!SymUnloadModule64(m_hDbgHelp, itr.second->m_allocatedMemAddr)) {
-					ss << L"Failed to unload module \"" << itr.second->m_pdbPath << L"\". The last error was: " << GetLastErrorAsWString() << L" ";
-				}
+		if (!argTraceFileStr.empty()) {
+			auto errStr = Trace::Enable(std::filesystem::absolute(argTraceFileStr));
+			if (!errStr.empty()) {
+				std::wcerr << errStr << std::endl;
+				return 1;
 			}
-			m_loadedPDBList.clear();
-
-			SymCleanup(m_hDbgHelp);
-			m_hDbgHelp = 0;
-		}
-
-		if (m_allocatedMemAddr != 0) {
-			free(reinterpret_cast<void*>(m_allocatedMemAddr));
-			m_allocatedMemAddr = 0;
 		}
-
-		return ss.str();
 	}
 
-	std::wstring LoadPDB(const std::filesystem::path& pdbFilePath_arg)
-	{
-		auto pdbFilePath = pdbFilePath_arg;
-		pdbFilePath = pdbFilePath.make_preferred().lexically_normal();
+	Log::SetLevel(logLevel);
 
-		if (pdbFilePath.extension() != L".pdb" && pdbFilePath.extension() != L".PDB") {
-			std::wstringstream ss;
-			ss << L"Invalid pdb/PDB file name detected. \"" << pdbFilePath << L"\". ";
-			return ss.str();
-		}
+	// Parse input config flie.
+	if (use_cin) {
+		// JSON will come from std::cin. It may be compressed, so it's read as it is.
+		_setmode(_fileno(stdin), _O_BINARY);
+		auto exePath = GetExePath();
 
-		// Already have loaded the PDB.
-		if (m_loadedPDBList.find(pdbFilePath.replace_extension(L".pdb")) != m_loadedPDBList.end()) {
-			return std::wstring();
+		Stats::Scope stats(L"parse_input_config");
+		auto errStr = ctx.ParseInputConfig(std::cin, exePath.parent_path());
+		if (!errStr.empty()) {
+			std::wcerr << L"Failed to parse input from the standard input. " << errStr << std::endl;
+			return 1;
 		}
-
-		m_verboseOut << L"Loading PDB..  " << pdbFilePath << std::endl;
-
+	}
+	else {
+		constexpr std::wstring_view config_default_name = L"config.json";
+		std::filesystem::path configPath;
 		{
-			uintptr_t baseAddr = SymLoadModuleExW(
-				m_hDbgHelp,							// handle to the process
-				NULL,								// file handle
-				pdbFilePath.wstring().c_str(),      // image name (.pdb, .dll, .exe ...)
-				NULL,								// module name (shortcut name)
-				m_allocatedMemAddr,					// base address. cannot be zero when loading a PDB.
-				(DWORD)m_allocatedMemSize,			// DLL size, this cannot be zero when loading a PDB.
-				NULL,								// pointer to MODLAOD_DATA. can be null.
-				0);									// flags.
-
-			if (baseAddr == 0) {
-				std::wstringstream ss;
-				ss << L"Failed to load a PDB file, \"" << pdbFilePath.wstring() << L"\". The last error was: " << GetLastErrorAsWString();
-				return ss.str();
+			auto [ret_configPath, errStr] = SearchFile(config_default_name, false, argConfigFileStr);
+			if (ret_configPath.empty()) {
+				std::wcerr << L"Failed to find a config file. " << errStr << std::endl;
+				return 1;
 			}
-		}
-
-		std::unique_ptr<PDBInfo> loadingPDB = std::make_unique<PDBInfo>();
-		loadingPDB->m_pdbPath = pdbFilePath;
-
-		// Estimate the DLL image size and allocate memory.
-		{
-			IMAGEHLP_SYMBOL64_PACKAGE lastSymbol = { sizeof(IMAGEHLP_SYMBOL64) , };
-			DWORD64 displacement = 0;
-			lastSymbol.sym.MaxNameLength = sizeof(IMAGEHLP_SYMBOL64_PACKAGE) - sizeof(IMAGEHLP_SYMBOL64);
-
-			if (!SymGetSymFromAddr64(m_hDbgHelp, m_allocatedMemAddr + m_allocatedMemSize - 1, &displacement, &lastSymbol.sym)) {
-				std::wstringstream ss;
-				ss << L"Failed to get the last symbol of the module \"" << pdbFilePath << "\". The last error was: " << GetLastErrorAsWString();
-				return ss.str();
+			std::swap(ret_configPath, configPath);
+			if (outputFormat == OutputFormat::Readable && errStr == L"DefaultFile") {
+				std::wcout << L"Using default config file, \"" << configPath.wstring() << "\"." << std::endl;
 			}
-
-			loadingPDB->m_allocatedMemSize = (((lastSymbol.sym.Address - m_allocatedMemAddr) >> 20) + 2) << 20; // + 1MB padding.
-
-			m_verboseOut << L"Estimated image size. 0x" << std::hex << loadingPDB->m_allocatedMemSize << L" (" << std::dec << loadingPDB->m_allocatedMemSize / (1024u * 1024u) << L" MB)" << std::endl;
-
-			loadingPDB->m_allocatedMemAddr = reinterpret_cast<uintptr_t>(malloc(loadingPDB->m_allocatedMemSize));
-			if (loadingPDB->m_allocatedMemAddr == 0) {
-				std::wstringstream ss;
-				ss << L"Failed to allocate memory for the module \"" << pdbFilePath << "\". ";
-				return ss.str();
-			}
-		}
-
-		// unload module once.
-		if (!SymUnloadModule64(m_hDbgHelp, m_allocatedMemAddr)) {
-			std::wstringstream ss;
-			ss << L"Failed to unload module \"" << pdbFilePath.wstring() << "\". The last error was: " << GetLastErrorAsWString();
-			return ss.str();
 		}
 
-		// load again with the newly allocated memory.
 		{
-			uintptr_t baseAddr = SymLoadModuleExW(
-				m_hDbgHelp,
-				NULL,
-				pdbFilePath.wstring().c_str(),
-				NULL,
-				loadingPDB->m_allocatedMemAddr,
-				(DWORD)loadingPDB->m_allocatedMemSize,
-				NULL,
-				0);
-
-			if (baseAddr == 0) {
-				std::wstringstream ss;
-				ss << L"Failed to load module \"" << pdbFilePath.wstring() << "\" The last error was: " << GetLastErrorAsWString();
-				return ss.str();
+			Stats::Scope stats(L"parse_input_config");
+			auto errStr = ctx.ParseInputConfig(configPath);
+			if (!errStr.empty()) {
+				std::wcerr << L"Failed to parse a config file, \"" << configPath.wstring() << L"\". " << errStr << std::endl;
+				return 1;
 			}
 		}
-
-		m_loadedPDBList.insert({ loadingPDB->m_pdbPath.replace_extension(L".pdb"), std::move(loadingPDB) });
-
-		return std::wstring();
 	}
 
-	std::wstring LoadImage(const std::filesystem::path& imageFilePath_arg)
-	{
-		auto imageFilePath = imageFilePath_arg;
-		imageFilePath = imageFilePath.make_preferred().lexically_normal();
-
-		std::unique_ptr<ImageInfo> imageInfo = std::make_unique<ImageInfo>();
-		imageInfo->m_imagePath = imageFilePath;
-
-		SYMSRV_INDEX_INFOW info = { sizeof(SYMSRV_INDEX_INFOW), };
-		if (!SymSrvGetFileIndexInfoW(imageFilePath.wstring().c_str(), &info, 0)) {
-			std::wstringstream ss;
-			ss << L"Failed to get an image file info for \"" << imageFilePath.wstring() << L"\". The last error was: " << GetLastErrorAsWString();
-			return ss.str();
-		}
-
-		imageInfo->m_pdbPathString = info.pdbfile;
-		imageInfo->m_imageSize = info.size;
-		imageInfo->m_guid = info.guid;
-		imageInfo->m_age = info.age;
-
-		// Build a PDB Sinature.
+	// Parse input text. (Optional)
+	if (!use_cin && ctx.callstacks.empty() && argDumpFileStr.empty()) { // When using cin, all input call stacks should come through the JSON format.
+		constexpr std::wstring_view text_default_name = L"callstacks.txt";
+		std::filesystem::path textPath;
 		{
-			std::vector<wchar_t>    u16buf(1024, L'\0');
-			auto& gid(imageInfo->m_guid);
-			swprintf_s(u16buf.data(), u16buf.size(), L"%08X%04X%04X%02X%02X%02X%02X%02X%02X%02X%02X%X",
-				gid.Data1, gid.Data2, gid.Data3,
-				gid.Data4[0], gid.Data4[1], gid.Data4[2], gid.Data4[3],
-				gid.Data4[4], gid.Data4[5], gid.Data4[6], gid.Data4[7], imageInfo->m_age);
-
-			imageInfo->m_pdbSignature = u16buf.data();
-		}
-
-		m_imageList.insert({ imageFilePath, std::move(imageInfo) });
-
-		return std::wstring();
-	}
-
-	std::wstring SearchPDBfromImage(Context::resolved_callstack& cs)
-	{
-		if (cs.pdb.has_value())
-			return std::wstring();
-
-		const auto& imageName = cs.image.value();
-
-		// load image if needed.
-		bool isFirstTime = false;
-		auto ilItr = m_imageList.find(imageName);
-		if (ilItr == m_imageList.end()) {
-			isFirstTime = true;
-			auto errStr = LoadImage(imageName);
-			if (!errStr.empty()) {
-				return errStr;
-			}
-			ilItr = m_imageList.find(imageName);
-		}
-		auto& imageInfo = ilItr->second;
-
-		// Already have the PDB information.
-		if (!imageInfo->m_serchedPDBPathString.empty()) {
-			// m_verboseOut << L"The PDB already has been loaded. " << imageInfo->m_serchedPDBPathString << std::endl;
-
-			cs.pdb = imageInfo->m_serchedPDBPathString;
-			cs.pdb_signature = imageInfo->m_pdbSignature;
-			return std::wstring();
-		}
-
-		std::filesystem::path pdbName(imageName);
-		pdbName = pdbName.filename().replace_extension(L".pdb");
-
-		std::filesystem::path symbolCacheDirName = pdbName / std::filesystem::path(imageInfo->m_pdbSignature) / pdbName;
-
-		// 1. Search under the the pdb cache storeages.
-		for (auto& pdbStorage : m_pdbStorageList) {
-			std::filesystem::path pdbFullpath = pdbStorage / symbolCacheDirName;
-
-			m_verboseOut << L"Checking PDB.. " << pdbFullpath << ". ";
-
-			if (std::filesystem::exists(pdbFullpath)) {
-				// found. update searched path.
-				m_verboseOut << L"Found. " << std::endl;
-
-				imageInfo->m_serchedPDBPathString = pdbFullpath.wstring();
-				cs.pdb = imageInfo->m_serchedPDBPathString;
-				cs.pdb_signature = imageInfo->m_pdbSignature;
-				return std::wstring();
+			auto [ret_textPath, errStr] = SearchFile(text_default_name, true, argTextFileStr);
+			if (ret_textPath.empty()) {
+				std::wcerr << L"Failed to find the input text file. " << errStr << std::endl;
+				return 1;
 			}
-			else {
-				// Not found.
-				m_verboseOut << std::endl;
+			std::swap(ret_textPath, textPath);
+			if (outputFormat == OutputFormat::Readable && errStr == L"DefaultFile") {
+				std::wcerr << L"Using default input callstack file, \"" << textPath.wstring() << "\"." << std::endl;
 			}
 		}
 
-		// 2. Search under the pdb path directly.
-		if (!cs.pdb.has_value()) {
-			for (auto& pdbPath : m_pdbPathList) {
-				std::filesystem::path pdbFullpath = pdbPath / pdbName;
-				m_verboseOut << L"Checking PDB.. " << pdbFullpath << ". ";
-
-				if (std::filesystem::exists(pdbFullpath)) {
-					m_verboseOut << L"Found. " << std::endl;
-
-					imageInfo->m_serchedPDBPathString = pdbFullpath.wstring();
-					cs.pdb = imageInfo->m_serchedPDBPathString;
-					cs.pdb_signature = imageInfo->m_pdbSignature;
-					return std::wstring();
-				}
-				else {
-					// Not found.
-					m_verboseOut << std::endl;
-				}
+		if (!textPath.empty()) {
+			// Found the input text.
+			Stats::Scope stats(L"parse_input_text");
+			auto errStr = ctx.ParseInputText(textPath);
+			if (!errStr.empty()) {
+				std::wcerr << L"Failed to parse an input text file, \"" << textPath.wstring() << L"\". " << errStr << std::endl;
+				return 1;
 			}
 		}
+	}
 
-		if (isFirstTime) {
-			// When the first time image load, try to access the symbol servers.
-			// 3. server
-			if (!cs.pdb.has_value()) {
-				for (const auto& [url, cache] : m_symbolServerList) {
-					// 1. Search under the path as a symbol cache storeage.
-					std::wstring getReqURL = url;
-					getReqURL += L"/";
-					getReqURL += pdbName;
-					getReqURL += L"/";
-					getReqURL += imageInfo->m_pdbSignature;
-					getReqURL += L"/";
-					getReqURL += pdbName;
-
-					std::filesystem::path destPath = cache;
-
-					if (!std::filesystem::exists(destPath)) {
-						std::wstringstream ss;
-						ss << L"Invalid synbol server cache detected.. \"" << destPath.wstring() << "\".";
-						return ss.str();
-					}
-					destPath /= symbolCacheDirName;
-					if (std::filesystem::exists(destPath)) {
-						std::wstringstream ss;
-						ss << L"Symbol server cache already have the PDB. \"" << destPath.wstring() << "\"";
-						return ss.str();
-					}
-					m_verboseOut << L"[HttpGet]:" << getReqURL << std::endl;
-
-					{
-						auto errStr = HttpGet::Get(getReqURL, destPath, m_verboseOut);
-						if (errStr.empty()) {
-							break;
-						}
-						else {
-							// Ignoring errors of HTTP Get request. i.e. 404
-							m_verboseOut << L"[HttpGet] Failed. " << errStr << std::endl;
-							continue;
-						}
-					}
-				}
-			}
-
-			// 4. Search under the the pdb cache storeages again.
-			for (auto& pdbStorage : m_pdbStorageList) {
-				std::filesystem::path pdbFullpath = pdbStorage / symbolCacheDirName;
-
-				m_verboseOut << L"Checking PDB.. " << pdbFullpath << ". ";
-
-				if (std::filesystem::exists(pdbFullpath)) {
-					// found. update searched path.
-					m_verboseOut << L"Found. " << std::endl;
-					imageInfo->m_serchedPDBPathString = pdbFullpath.wstring();
-					cs.pdb = imageInfo->m_serchedPDBPathString;
-					cs.pdb_signature = imageInfo->m_pdbSignature;
-					return std::wstring();
-				}
-				else {
-					// Not found.
-					m_verboseOut << std::endl;
-				}
-			}
+	// The results go to the standard output stream unless "--output" is given. The file is compressed by its extension.
+	CompressedOutput output;
+	if (!argOutputFileStr.empty()) {
+		auto errStr = output.Open(std::filesystem::absolute(argOutputFileStr));
+		if (!errStr.empty()) {
+			std::wcerr << L"Failed to open the output file. " << errStr << std::endl;
+			return 1;
 		}
-
-		std::wstringstream ss;
-		ss << L"Failed to find the PDB for \"" << imageName << "\".";
-		return ss.str();
 	}
+	std::wostream& wos = argOutputFileStr.empty() ? std::wcout : output.WideStream();
+	auto closeOutput = [&]() -> bool {
+		auto errStr = output.Close();
+		if (!errStr.empty()) {
+			std::wcerr << L"Failed to write the output file. " << errStr << std::endl;
+			return false;
+		}
+		return true;
+		};
 
-	std::wstring Resolve(Context::resolved_callstack& cs)
-	{
-		if (cs.isComment)
-			return std::wstring();
-
-		// Search and load the PDB.
-		if (!cs.pdb.has_value()) {
-			auto errStr = SearchPDBfromImage(cs);
-			if (!errStr.empty()) {
-				return errStr;
-			}
+	// Write a synthetic corpus over the images in "paths" instead of resolving.
+	if (!argCorpusFramesStr.empty()) {
+		size_t numFrames = 0;
+		try {
+			numFrames = std::stoull(argCorpusFramesStr);
 		}
-		{
-			auto errStr = LoadPDB(cs.pdb.value());
-			if (!errStr.empty()) {
-				return errStr;
-			}
+		catch (...) {
+			std::wcerr << L"\"--generate-corpus\" needs a number of frames. \"" << argCorpusFramesStr << L"\"." << std::endl;
+			return 1;
 		}
-
-		const auto& pdbName = cs.pdb.value();
-
-		// make sure the PDB has been loaded.
-		auto pdbItr = m_loadedPDBList.find(pdbName);
-		if (pdbItr == m_loadedPDBList.end()) {
-			std::wstringstream ss;
-			ss << L"Failed to find a loaded PDB to resolve a symbol \"" << pdbName << L"\".";
-			return ss.str();
+		auto errStr = SyntheticCorpus::Generate(ctx.paths, numFrames, SyntheticCorpus::s_defaultSeed, wos);
+		if (!errStr.empty()) {
+			std::wcerr << L"Failed to generate a synthetic corpus. " << errStr << std::endl;
+			return 1;
 		}
+		return closeOutput() ? 0 : 1;
+	}
 
-		const auto& offsetAddr = cs.values.image_offset.value();
-		DWORD64 targetAddr = pdbItr->second->m_allocatedMemAddr + offsetAddr;
-
-		// Search the address using the Sym function.
-		{
-			DWORD64 displacement = 0;
-			IMAGEHLP_SYMBOL64_PACKAGE symbol = { sizeof(IMAGEHLP_SYMBOL64) , };
-			symbol.sym.MaxNameLength = sizeof(IMAGEHLP_SYMBOL64_PACKAGE) - sizeof(IMAGEHLP_SYMBOL64);
-
-
-			if (!SymGetSymFromAddr64(m_hDbgHelp, targetAddr, &displacement, &symbol.sym)) {
-				std::wstringstream ss;
-				ss << L"Failed to get a symbol info in \"" << pdbName << L"\" with offset" << std::hex << L"0x" << offsetAddr << L". ";
-				return ss.str();
-			}
-
-			std::string u8name = symbol.sym.Name;
-			if (u8name.length() > 0) {
-				std::vector<wchar_t>    u16buf(u8name.size() + 16, L'\0');
-				if (MultiByteToWideChar(CP_UTF8, 0, u8name.c_str(), (int)u8name.length(), u16buf.data(), (int)u16buf.size()) > 0) {
-					cs.function = u16buf.data();
-					cs.values.function_offset = targetAddr - symbol.sym.Address;
-				}
-			}
+	// Profiler samples. Each distinct address becomes a call stack entry, so that it is resolved once.
+	std::unique_ptr<StackAggregator> aggregator;
+	if (!argFoldFileStr.empty()) {
+		auto [foldPath, errStr] = SearchFile(std::wstring_view(), false, argFoldFileStr);
+		if (foldPath.empty()) {
+			std::wcerr << L"Failed to find the sample file. " << errStr << std::endl;
+			return 1;
 		}
 
-		// Search line info if available.
-		{
-			DWORD displacement = 0;
-			IMAGEHLP_LINEW64 lineInfo = { sizeof(IMAGEHLP_LINEW64) , };
-
-			if (!SymGetLineFromAddrW64(m_hDbgHelp, targetAddr, &displacement, &lineInfo)) {
-				// A PDB which doesn't have line info.  
-				cs.line.reset();
-				cs.values.line_no.reset();
-				cs.values.line_offset.reset();
-			}
-			else {
-				cs.line = lineInfo.FileName;
-				cs.values.line_no = lineInfo.LineNumber;
-				cs.values.line_offset = targetAddr - lineInfo.Address;
-			}
+		Stats::Scope stats(L"fold_ingest");
+		Trace::Span span(L"fold_ingest", L"fold");
+		aggregator = std::make_unique<StackAggregator>();
+		errStr = aggregator->Ingest(foldPath, std::max<size_t>(std::thread::hardware_concurrency(), 1));
+		if (!errStr.empty()) {
+			std::wcerr << L"Failed to read the sample file. " << errStr << std::endl;
+			return 1;
 		}
-
-		return std::wstring();
+		ctx.callstacks.clear();
+		aggregator->AddressStrings(ctx.callstacks);
 	}
 
-	int Run(int argc, const wchar_t** argv)
-	{
-		Context ctx;
-
-		// Parse input arguments.
-		bool    verbose = false, json_out = false, use_cin = false;
-		std::wstring argConfigFileStr, argTextFileStr;
-		{
-			auto errStr = ParseArguments(argc, argv, verbose, json_out, use_cin, argConfigFileStr, argTextFileStr);
-			if (!errStr.empty()) {
-				std::wcerr << L"Failed to parse arguments. " << errStr << std::endl;
-				return 1;
-			}
+	// Threads of a minidump. Each thread becomes a call stack headed by a comment line.
+	if (!argDumpFileStr.empty()) {
+		auto [dumpPath, errStr] = SearchFile(std::wstring_view(), false, argDumpFileStr);
+		if (dumpPath.empty()) {
+			std::wcerr << L"Failed to find the minidump. " << errStr << std::endl;
+			return 1;
 		}
 
-		// Parse input config flie.
-		if (use_cin) {
-			// JSON will come from std::cin.
-			auto exePath = GetExePath();
-
-			auto errStr = ctx.ParseInputConfig(std::cin, exePath.parent_path());
-			if (!errStr.empty()) {
-				std::wcerr << L"Failed to parse input from the standard input. " << errStr << std::endl;
-				return 1;
-			}
+		Stats::Scope stats(L"parse_dump");
+		errStr = cr.AddDumpCallstacks(ctx, dumpPath);
+		if (!errStr.empty()) {
+			std::wcerr << L"Failed to read the minidump. " << errStr << std::endl;
+			return 1;
 		}
-		else {
-			constexpr std::wstring_view config_default_name = L"config.json";
-			std::filesystem::path configPath;
-			{
-				auto [ret_configPath, errStr] = SearchFile(config_default_name, false, argConfigFileStr);
-				if (ret_configPath.empty()) {
-					std::wcerr << L"Failed to find a config file. " << errStr << std::endl;
-					return 1;
-				}
-				std::swap(ret_configPath, configPath);
-				if (!json_out && errStr == L"DefaultFile") {
-					std::wcout << L"Using default config file, \"" << configPath.wstring() << "\"." << std::endl;
-				}
-			}
+	}
 
-			{
-				auto errStr = ctx.ParseInputConfig(configPath);
-				if (!errStr.empty()) {
-					std::wcerr << L"Failed to parse a config file, \"" << configPath.wstring() << L"\". " << errStr << std::endl;
-					return 1;
-				}
-			}
+	// Raw stacks captured by a crash handler.
+	if (!ctx.stacks.empty()) {
+		Stats::Scope stats(L"unwind");
+		auto errStr = cr.UnwindStacks(ctx);
+		if (!errStr.empty()) {
+			std::wcerr << L"Failed to unwind the stacks. " << errStr << std::endl;
+			return 1;
 		}
+	}
 
-		// Parse input text. (Optional)
-		if (!use_cin && ctx.callstacks.empty()) { // When using cin, all input call stacks should come through the JSON format.
-			constexpr std::wstring_view text_default_name = L"callstacks.txt";
-			std::filesystem::path textPath;
-			{
-				auto [ret_textPath, errStr] = SearchFile(text_default_name, true, argTextFileStr);
-				if (ret_textPath.empty()) {
-					std::wcerr << L"Failed to find the input text file. " << errStr << std::endl;
-					return 1;
-				}
-				std::swap(ret_textPath, textPath);
-				if (!json_out && errStr == L"DefaultFile") {
-					std::wcerr << L"Using default input callstack file, \"" << textPath.wstring() << "\"." << std::endl;
-				}
-			}
-
-			if (!textPath.empty()) {
-				// Found the input text.
-				auto errStr = ctx.ParseInputText(textPath);
-				if (!errStr.empty()) {
-					std::wcerr << L"Failed to parse an input text file, \"" << textPath.wstring() << L"\". " << errStr << std::endl;
-					return 1;
-				}
-			}
-		}
+	if (ctx.symbols.size() == 0) {
+		std::wcerr << L"There was no symbol storage in the configuration." << std::endl;
+		return 1;
+	}
+	if (ctx.callstacks.size() == 0 && ctx.resolved_callstacks.size() == 0) {
+		std::wcerr << L"There was no call stack to resolve." << std::endl;
+		return 1;
+	}
 
-		if (ctx.symbols.size() == 0) {
-			std::wcerr << L"There was no symbol storage in the configuration." << std::endl;
+	// Parse input call stack strings and add resolved_callstack objects here.
+	{
+		Stats::Scope stats(L"parse_callstacks");
+		auto errStr = ctx.ParseCallstacks(false);
+		if (!errStr.empty()) {
+			std::wcerr << errStr << std::endl;
 			return 1;
 		}
-		if (ctx.callstacks.size() == 0) {
-			std::wcerr << L"There was no call stack to resolve." << std::endl;
+	}
+
+	if (trace_stages) {
+		cr.m_stageTracer.Enable();
+	}
+	cr.m_symbolNames.m_simplify = simplify_names;
+	cr.m_withLines = !no_lines;
+	if (!argBackendStr.empty()) {
+		auto errStr = SymbolBackend::Create(argBackendStr, cr.m_backend);
+		if (!errStr.empty()) {
+			std::wcerr << errStr << std::endl;
 			return 1;
 		}
+	}
 
-		// Parse input call stack strings and add resolved_callstack objects here.
-		{
-			auto errStr = ctx.ParseCallstacks(false);
-			if (!errStr.empty()) {
-				std::wcerr << errStr << std::endl;
-				return 1;
-			}
-		}
+	// Formatting the whole input costs as much as the output. Skip it unless it's shown.
+	if (Log::Enabled(Log::Level::Debug)) {
+		std::wstringstream ss;
+		ss << ctx;
+		Log::WriteLine(L"--- input context ---");
+		Log::WriteCaptured(ss.str());
+		Log::WriteLine(L"---------------------");
+	}
 
-		if (verbose) {
-			// set verbose output.
-			m_verboseOut.rdbuf(std::wcout.rdbuf());
+	{
+		auto errStr = cr.Init(ctx.symbols);
+		if (!errStr.empty()) {
+			std::wcerr << L"Failed to initialize a CallstackResolver instance. Perhaps missing dbghelp.dll on your system. You may need to install a Windows SDK." << std::endl;
+			std::wcerr << errStr << std::endl;
+			return 1;
 		}
+	}
 
-		m_verboseOut << L"--- input context ---" << std::endl;
-		m_verboseOut << ctx;
-		m_verboseOut << L"---------------------" << std::endl;
-
-		{
-			auto errStr = Init();
-			if (!errStr.empty()) {
-				std::wcerr << L"Failed to initialize a CallstackResolver instance. Perhaps missing dbghelp.dll on your system. You may need to install a Windows SDK." << std::endl;
-				std::wcerr << errStr << std::endl;
-				return 1;
-			}
+	{
+		Trace::Span span(L"resolve_all", L"run");
+		CallstackResolver::FrameErrors errors;
+		cr.ResolveAll(ctx, errors);
+		for (const auto& e : errors) {
+			std::wcerr << L"Failed to resolve symbol. " << e.second << std::endl;
 		}
+	}
 
-		for (const auto& s : ctx.symbols) {
-			if (s.server.has_value() && s.cache.has_value()) {
-				m_symbolServerList.push_back({ s.server.value(), s.cache.value() });
-				m_symbolServerList.unique();
-				m_pdbStorageList.push_back(s.cache.value());
-				m_pdbStorageList.unique();
-			}
-			if (s.direct.has_value()) {
-				m_pdbPathList.push_back(s.direct.value());
-				m_pdbPathList.unique();
-			}
+	{
+		auto stageScope = cr.m_stageTracer.Begin(StageTracer::Stage::Format, L"format");
+		size_t numFrames = 0;
+		if (aggregator) {
+			numFrames = aggregator->WriteFolded(wos, ctx.resolved_callstacks);
 		}
-
-		for (auto& cs : ctx.resolved_callstacks) {
-			auto errStr = Resolve(cs);
-			if (!errStr.empty()) {
-				std::wcerr << L"Failed to resolve symbol. " << errStr << std::endl;
-				continue;
+		else {
+			switch (outputFormat) {
+			case OutputFormat::Readable:
+				numFrames = ResultFormatter<OutputFormat::Readable>::Write(wos, ctx);
+				break;
+			case OutputFormat::Json:
+				numFrames = ResultFormatter<OutputFormat::Json>::Write(wos, ctx);
+				break;
+			case OutputFormat::Csv:
+				numFrames = ResultFormatter<OutputFormat::Csv>::Write(wos, ctx);
+				break;
+			case OutputFormat::Binary:
+				if (!argOutputFileStr.empty()) {
+					numFrames = ResultFormatter<OutputFormat::Binary>::Write(output.Stream(), ctx);
+					break;
+				}
+				// Nothing else is written to stdout in this mode. The log goes to stderr.
+				_setmode(_fileno(stdout), _O_BINARY);
+				numFrames = ResultFormatter<OutputFormat::Binary>::Write(std::cout, ctx);
+				std::cout.flush();
+				break;
 			}
 		}
+		Stats::AddCount(L"format.frames", numFrames);
+		if (!closeOutput())
+			return 1;
+	}
+	cr.m_stageTracer.Dump(std::wcerr);
 
-		if (json_out) {
-			std::wcout << ctx;
-		}
-		else {
-			std::wcout << ctx.DumpResolvedInReadable();
+	{
+		Stats::Scope stats(L"finalize");
+		auto errStr = cr.Finalize();
+		if (!errStr.empty()) {
+			std::wcerr << L"Failed to finalize a CallstackResolver instance." << std::endl;
+			std::wcerr << errStr << std::endl;
+			return 1;
 		}
+	}
+	Stats::DumpJson(std::wcerr);
 
-		{
-			auto errStr = Finalize();
-			if (!errStr.empty()) {
-				std::wcerr << L"Failed to finalize a CallstackResolver instance." << std::endl;
-				std::wcerr << errStr << std::endl;
-				return 1;
-			}
+	{
+		auto errStr = Trace::Write();
+		if (!errStr.empty()) {
+			std::wcerr << errStr << std::endl;
+			return 1;
 		}
+	}
 
-		return 0;
-	};
-};
+	return 0;
+}
 
 int wmain(int argc, const wchar_t **argv)
 {
-    CallstackResolver cr;
-
-    return cr.Run(argc, argv);
+    return Run(argc, argv);
 }
@@ -0,0 +1,565 @@
+#include <string>
+#include <vector>
+#include <memory>
+#include <sstream>
+#include <cstring>
+#include <cwctype>
+#include <functional>
+#include <algorithm>
+
+// zlib and zstd come from vcpkg.json, and vcpkg links their libraries.
+#include <zlib.h>
+#include <zstd.h>
+
+#include "CompressedStream.h"
+#include "Stats.h"
+
+namespace {
+    constexpr uint8_t gzipMagic[] = { 0x1f, 0x8b };
+    constexpr uint8_t zstdMagic[] = { 0x28, 0xb5, 0x2f, 0xfd };
+
+    constexpr int gzipLevel = 6; // the default of gzip.
+    constexpr int gzipWindowBits = 15 + 16; // a 32 KB window in the gzip container.
+    constexpr int zstdLevel = 3;
+
+    // Reads up to "size" bytes into "dst". Returns the number of bytes read, 0 at the end of the input.
+    using ReadFn = std::function<size_t(uint8_t* dst, size_t size)>;
+    // Takes the produced bytes. Returns false to stop.
+    using WriteFn = std::function<bool(const uint8_t* data, size_t size)>;
+
+    double Milliseconds(Stats::Clock::duration d)
+    {
+        return std::chrono::duration<double, std::milli>(d).count();
+    }
+
+    void AppendUtf8(std::string& dst, uint32_t cp)
+    {
+        if (cp < 0x80) {
+            dst.push_back((char)cp);
+        }
+        else if (cp < 0x800) {
+            dst.push_back((char)(0xC0 | (cp >> 6)));
+            dst.push_back((char)(0x80 | (cp & 0x3F)));
+        }
+        else if (cp < 0x10000) {
+            dst.push_back((char)(0xE0 | (cp >> 12)));
+            dst.push_back((char)(0x80 | ((cp >> 6) & 0x3F)));
+            dst.push_back((char)(0x80 | (cp & 0x3F)));
+        }
+        else {
+            dst.push_back((char)(0xF0 | (cp >> 18)));
+            dst.push_back((char)(0x80 | ((cp >> 12) & 0x3F)));
+            dst.push_back((char)(0x80 | ((cp >> 6) & 0x3F)));
+            dst.push_back((char)(0x80 | (cp & 0x3F)));
+        }
+    }
+
+    std::wstring ZlibError(const wchar_t* message, const z_stream& zs)
+    {
+        std::wstringstream ss;
+        ss << message;
+        if (zs.msg != nullptr) {
+            const std::string msg(zs.msg);
+            ss << L" " << std::wstring(msg.begin(), msg.end());
+        }
+        return ss.str();
+    }
+
+    // Decompresses the gzip members of the input until its end. zlib checks the CRC and the size of each.
+    std::wstring GzipDecompress(const ReadFn& read, const WriteFn& write)
+    {
+        z_stream zs = {};
+        if (inflateInit2(&zs, gzipWindowBits) != Z_OK)
+            return L"Failed to create a gzip decompression stream.";
+        std::unique_ptr<z_stream, decltype(&inflateEnd)> guard(&zs, inflateEnd);
+
+        std::vector<uint8_t> in(ChunkQueue::s_chunkSize / 4);
+        std::vector<uint8_t> out(ChunkQueue::s_chunkSize);
+        int ret = Z_OK;
+        for (;;) {
+            const size_t size = read(in.data(), in.size());
+            if (size == 0)
+                break;
+
+            zs.next_in = in.data();
+            zs.avail_in = (uInt)size;
+            for (;;) {
+                if (ret == Z_STREAM_END) {
+                    if (zs.avail_in == 0)
+                        break;
+                    // The next member.
+                    inflateReset(&zs);
+                }
+                zs.next_out = out.data();
+                zs.avail_out = (uInt)out.size();
+                ret = inflate(&zs, Z_NO_FLUSH);
+                if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR)
+                    return ZlibError(L"Invalid gzip input.", zs);
+                const size_t produced = out.size() - zs.avail_out;
+                if (produced != 0 && !write(out.data(), produced))
+                    return std::wstring();
+                // A full output may leave more of this input to be written.
+                if (ret != Z_STREAM_END && zs.avail_in == 0 && zs.avail_out != 0)
+                    break;
+            }
+        }
+        if (ret != Z_STREAM_END)
+            return L"The gzip input ended in a member.";
+
+        return std::wstring();
+    }
+
+    // "pop" returns false after the last chunk. "written" is false if "write" failed.
+    std::wstring GzipCompress(const std::function<bool(std::vector<char>&)>& pop, const WriteFn& write, bool& written)
+    {
+        written = true;
+        z_stream zs = {};
+        if (deflateInit2(&zs, gzipLevel, Z_DEFLATED, gzipWindowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+            return L"Failed to create a gzip compression stream.";
+        std::unique_ptr<z_stream, decltype(&deflateEnd)> guard(&zs, deflateEnd);
+
+        std::vector<uint8_t> out(ChunkQueue::s_chunkSize / 4);
+        std::vector<char> chunk;
+        for (;;) {
+            const bool last = !pop(chunk);
+            zs.next_in = (Bytef*)chunk.data();
+            zs.avail_in = last ? 0 : (uInt)chunk.size();
+            for (;;) {
+                zs.next_out = out.data();
+                zs.avail_out = (uInt)out.size();
+                const int ret = deflate(&zs, last ? Z_FINISH : Z_NO_FLUSH);
+                if (ret == Z_STREAM_ERROR)
+                    return ZlibError(L"Failed to compress with gzip.", zs);
+                const size_t produced = out.size() - zs.avail_out;
+                if (produced != 0 && !write(out.data(), produced)) {
+                    written = false;
+                    return std::wstring();
+                }
+                if (last ? ret == Z_STREAM_END : zs.avail_in == 0)
+                    break;
+            }
+            if (last)
+                break;
+        }
+        return std::wstring();
+    }
+
+    std::wstring ZstdError(const wchar_t* message, size_t code)
+    {
+        const std::string name(ZSTD_getErrorName(code));
+        std::wstringstream ss;
+        ss << message << L" " << std::wstring(name.begin(), name.end());
+        return ss.str();
+    }
+
+    std::wstring ZstdDecompress(const ReadFn& read, const WriteFn& write)
+    {
+        std::unique_ptr<ZSTD_DStream, decltype(&ZSTD_freeDStream)> ds(ZSTD_createDStream(), ZSTD_freeDStream);
+        if (!ds)
+            return L"Failed to create a zstd decompression stream.";
+        ZSTD_initDStream(ds.get());
+
+        std::vector<uint8_t> in(ZSTD_DStreamInSize());
+        std::vector<uint8_t> out(ZSTD_DStreamOutSize());
+        size_t ret = 0;
+        for (;;) {
+            const size_t size = read(in.data(), in.size());
+            if (size == 0)
+                break;
+
+            ZSTD_inBuffer input = { in.data(), size, 0 };
+            while (input.pos < input.size) {
+                ZSTD_outBuffer output = { out.data(), out.size(), 0 };
+                ret = ZSTD_decompressStream(ds.get(), &output, &input);
+                if (ZSTD_isError(ret))
+                    return ZstdError(L"Invalid zstd input.", ret);
+                if (output.pos != 0 && !write(out.data(), output.pos))
+                    return std::wstring();
+            }
+        }
+        if (ret != 0)
+            return L"The zstd input ended in a frame.";
+
+        return std::wstring();
+    }
+
+    // "pop" returns false after the last chunk. "written" is false if "write" failed.
+    std::wstring ZstdCompress(const std::function<bool(std::vector<char>&)>& pop, const WriteFn& write, bool& written)
+    {
+        written = true;
+        std::unique_ptr<ZSTD_CStream, decltype(&ZSTD_freeCStream)> cs(ZSTD_createCStream(), ZSTD_freeCStream);
+        if (!cs)
+            return L"Failed to create a zstd compression stream.";
+        ZSTD_initCStream(cs.get(), zstdLevel);
+
+        std::vector<uint8_t> out(ZSTD_CStreamOutSize());
+        std::vector<char> chunk;
+        for (;;) {
+            const bool last = !pop(chunk);
+            ZSTD_inBuffer input = { chunk.data(), last ? 0 : chunk.size(), 0 };
+            for (;;) {
+                ZSTD_outBuffer output = { out.data(), out.size(), 0 };
+                const size_t remaining = ZSTD_compressStream2(cs.get(), &output, &input, last ? ZSTD_e_end : ZSTD_e_continue);
+                if (ZSTD_isError(remaining))
+                    return ZstdError(L"Failed to compress with zstd.", remaining);
+                if (output.pos != 0 && !write(out.data(), output.pos)) {
+                    written = false;
+                    return std::wstring();
+                }
+                if (last ? remaining == 0 : input.pos == input.size)
+                    break;
+            }
+            if (last)
+                break;
+        }
+        return std::wstring();
+    }
+};
+
+Compression DetectCompression(const uint8_t* prefix, size_t size)
+{
+    if (size >= sizeof(gzipMagic) && std::memcmp(prefix, gzipMagic, sizeof(gzipMagic)) == 0)
+        return Compression::Gzip;
+    if (size >= sizeof(zstdMagic) && std::memcmp(prefix, zstdMagic, sizeof(zstdMagic)) == 0)
+        return Compression::Zstd;
+    return Compression::None;
+}
+
+Compression CompressionFromExtension(const std::filesystem::path& path)
+{
+    std::wstring ext = path.extension().wstring();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](wchar_t c) { return (wchar_t)std::towlower(c); });
+    if (ext == L".gz")
+        return Compression::Gzip;
+    if (ext == L".zst")
+        return Compression::Zstd;
+    return Compression::None;
+}
+
+bool ChunkQueue::Push(std::vector<char>&& chunk)
+{
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [this]() { return m_cancelled || m_chunks.size() < s_maxChunks; });
+        if (m_cancelled)
+            return false;
+        m_chunks.push_back(std::move(chunk));
+    }
+    m_cv.notify_all();
+    return true;
+}
+
+bool ChunkQueue::Pop(std::vector<char>& chunk)
+{
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [this]() { return m_cancelled || m_closed || !m_chunks.empty(); });
+        if (m_cancelled || m_chunks.empty())
+            return false;
+        chunk = std::move(m_chunks.front());
+        m_chunks.pop_front();
+    }
+    m_cv.notify_all();
+    return true;
+}
+
+void ChunkQueue::Close()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closed = true;
+    }
+    m_cv.notify_all();
+}
+
+void ChunkQueue::Cancel()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_cancelled = true;
+        m_chunks.clear();
+    }
+    m_cv.notify_all();
+}
+
+DecompressedInput::DecompressedInput() :
+    m_stream(this)
+{
+}
+
+DecompressedInput::~DecompressedInput()
+{
+    Close();
+}
+
+std::wstring DecompressedInput::Open(std::istream& source)
+{
+    m_source = &source;
+    source.read((char*)m_prefix, sizeof(m_prefix));
+    m_prefixSize = (size_t)source.gcount();
+    m_prefixPos = 0;
+    if (source.bad())
+        return L"Failed to read the input.";
+
+    m_compression = DetectCompression(m_prefix, m_prefixSize);
+    if (m_compression == Compression::None)
+        return std::wstring();
+
+    m_thread = std::thread([this]() { Decompress(); });
+    return std::wstring();
+}
+
+std::wstring DecompressedInput::Close()
+{
+    if (m_thread.joinable()) {
+        m_queue.Cancel();
+        m_thread.join();
+    }
+    return m_errStr;
+}
+
+DecompressedInput::int_type DecompressedInput::underflow()
+{
+    if (gptr() < egptr())
+        return traits_type::to_int_type(*gptr());
+
+    if (m_compression == Compression::None) {
+        m_chunk.resize(ChunkQueue::s_chunkSize);
+        const size_t size = ReadSource((uint8_t*)m_chunk.data(), m_chunk.size());
+        m_chunk.resize(size);
+    }
+    else if (!m_queue.Pop(m_chunk)) {
+        m_chunk.clear();
+    }
+
+    if (m_chunk.empty())
+        return traits_type::eof();
+    setg(m_chunk.data(), m_chunk.data(), m_chunk.data() + m_chunk.size());
+    return traits_type::to_int_type(*gptr());
+}
+
+size_t DecompressedInput::ReadSource(uint8_t* dst, size_t size)
+{
+    size_t n = std::min<size_t>(size, m_prefixSize - m_prefixPos);
+    std::memcpy(dst, m_prefix + m_prefixPos, n);
+    m_prefixPos += n;
+
+    if (n < size && *m_source) {
+        m_source->read((char*)dst + n, (std::streamsize)(size - n));
+        n += (size_t)m_source->gcount();
+    }
+    return n;
+}
+
+void DecompressedInput::Decompress()
+{
+    // The time waiting for the parser is not the decompression's.
+    const auto begin = Stats::Clock::now();
+    Stats::Clock::duration waited(0);
+    uint64_t bytes = 0;
+
+    ReadFn read = [this](uint8_t* dst, size_t size) { return ReadSource(dst, size); };
+    WriteFn write = [&](const uint8_t* data, size_t size) {
+        bytes += size;
+        const auto pushBegin = Stats::Clock::now();
+        const bool ok = m_queue.Push(std::vector<char>(data, data + size));
+        waited += Stats::Clock::now() - pushBegin;
+        return ok;
+        };
+
+    if (m_compression == Compression::Gzip) {
+        m_errStr = GzipDecompress(read, write);
+    }
+    else if (m_compression == Compression::Zstd) {
+        m_errStr = ZstdDecompress(read, write);
+    }
+    m_queue.Close();
+
+    Stats::AddTime(L"decompress", Milliseconds(Stats::Clock::now() - begin - waited));
+    Stats::AddCount(L"decompress.bytes", bytes);
+}
+
+CompressedOutput::WideBuffer::WideBuffer(CompressedOutput* owner) :
+    m_owner(owner), m_buffer(s_bufferSize)
+{
+    setp(m_buffer.data(), m_buffer.data() + m_buffer.size());
+}
+
+CompressedOutput::WideBuffer::int_type CompressedOutput::WideBuffer::overflow(int_type c)
+{
+    if (!Encode())
+        return traits_type::eof();
+    if (!traits_type::eq_int_type(c, traits_type::eof())) {
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+    }
+    return traits_type::not_eof(c);
+}
+
+int CompressedOutput::WideBuffer::sync()
+{
+    return Encode() ? 0 : -1;
+}
+
+bool CompressedOutput::WideBuffer::Encode()
+{
+    m_utf8.clear();
+    for (const wchar_t* p = pbase(); p != pptr(); ++p) {
+        uint32_t cp = (uint32_t)*p;
+        if (m_highSurrogate != 0) {
+            if (cp >= 0xDC00 && cp <= 0xDFFF) {
+                cp = 0x10000 + ((m_highSurrogate - 0xD800) << 10) + (cp - 0xDC00);
+            }
+            else {
+                AppendUtf8(m_utf8, 0xFFFD);
+            }
+            m_highSurrogate = 0;
+        }
+        if (cp >= 0xD800 && cp <= 0xDBFF) {
+            m_highSurrogate = cp;
+            continue;
+        }
+        if ((cp >= 0xDC00 && cp <= 0xDFFF) || cp > 0x10FFFF) {
+            cp = 0xFFFD;
+        }
+        AppendUtf8(m_utf8, cp);
+    }
+    setp(m_buffer.data(), m_buffer.data() + m_buffer.size());
+
+    if (m_utf8.empty())
+        return true;
+    return m_owner->sputn(m_utf8.data(), (std::streamsize)m_utf8.size()) == (std::streamsize)m_utf8.size();
+}
+
+CompressedOutput::CompressedOutput() :
+    m_stream(this), m_wideBuffer(this), m_wideStream(&m_wideBuffer)
+{
+}
+
+CompressedOutput::~CompressedOutput()
+{
+    if (m_thread.joinable()) {
+        m_queue.Cancel();
+        m_thread.join();
+    }
+}
+
+std::wstring CompressedOutput::Open(const std::filesystem::path& path)
+{
+    m_path = path;
+    m_compression = CompressionFromExtension(path);
+
+    m_file.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!m_file) {
+        std::wstringstream ss;
+        ss << L"Failed to open file \"" << path.wstring() << L"\".";
+        return ss.str();
+    }
+
+    m_chunk.resize(ChunkQueue::s_chunkSize);
+    setp(m_chunk.data(), m_chunk.data() + m_chunk.size());
+    m_thread = std::thread([this]() { Compress(); });
+    return std::wstring();
+}
+
+std::wstring CompressedOutput::Close()
+{
+    if (!m_thread.joinable())
+        return std::wstring();
+
+    m_wideStream.flush();
+    const bool handedOver = HandOver();
+    m_queue.Close();
+    m_thread.join();
+    m_file.close();
+
+    if (!m_errStr.empty())
+        return m_errStr;
+    if (!handedOver || m_stream.bad() || m_wideStream.bad() || m_file.fail()) {
+        std::wstringstream ss;
+        ss << L"Failed to write file \"" << m_path.wstring() << L"\".";
+        return ss.str();
+    }
+    return std::wstring();
+}
+
+CompressedOutput::int_type CompressedOutput::overflow(int_type c)
+{
+    if (!HandOver())
+        return traits_type::eof();
+    if (!traits_type::eq_int_type(c, traits_type::eof())) {
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+    }
+    return traits_type::not_eof(c);
+}
+
+int CompressedOutput::sync()
+{
+    // A flush doesn't hand over a partial chunk. The writers flush at every line, and Close() hands over the rest.
+    return 0;
+}
+
+bool CompressedOutput::HandOver()
+{
+    const size_t size = (size_t)(pptr() - pbase());
+    if (size == 0)
+        return true;
+
+    m_chunk.resize(size);
+    const bool ok = m_queue.Push(std::move(m_chunk));
+    m_chunk = std::vector<char>(ChunkQueue::s_chunkSize);
+    setp(m_chunk.data(), m_chunk.data() + m_chunk.size());
+    return ok;
+}
+
+void CompressedOutput::Compress()
+{
+    // The time waiting for the formatter is not the compression's.
+    const auto begin = Stats::Clock::now();
+    Stats::Clock::duration waited(0);
+    uint64_t bytes = 0;
+
+    std::function<bool(std::vector<char>&)> pop = [&](std::vector<char>& chunk) {
+        const auto popBegin = Stats::Clock::now();
+        const bool ok = m_queue.Pop(chunk);
+        waited += Stats::Clock::now() - popBegin;
+        if (ok) {
+            bytes += chunk.size();
+        }
+        return ok;
+        };
+    WriteFn write = [this](const uint8_t* data, size_t size) {
+        m_file.write((const char*)data, (std::streamsize)size);
+        return !m_file.fail();
+        };
+
+    bool written = true;
+    std::vector<char> chunk;
+    switch (m_compression) {
+    case Compression::None:
+        while (written && pop(chunk)) {
+            written = write((const uint8_t*)chunk.data(), chunk.size());
+        }
+        break;
+    case Compression::Gzip:
+        m_errStr = GzipCompress(pop, write, written);
+        break;
+    case Compression::Zstd:
+        m_errStr = ZstdCompress(pop, write, written);
+        break;
+    }
+
+    if (!written) {
+        std::wstringstream ss;
+        ss << L"Failed to write file \"" << m_path.wstring() << L"\".";
+        m_errStr = ss.str();
+    }
+    if (!m_errStr.empty()) {
+        // Unblocks the writers. Their writes fail from here.
+        m_queue.Cancel();
+    }
+
+    Stats::AddTime(L"compress", Milliseconds(Stats::Clock::now() - begin - waited));
+    Stats::AddCount(L"compress.bytes", bytes);
+}
@@ -0,0 +1,141 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <streambuf>
+#include <istream>
+#include <ostream>
+#include <fstream>
+#include <filesystem>
+
+enum class Compression {
+	None,
+	Gzip,
+	Zstd,
+};
+
+// Gzip "1f 8b" and zstd "28 b5 2f fd" at the start of the data. "size" may be shorter than the magic.
+Compression DetectCompression(const uint8_t* prefix, size_t size);
+// ".gz" and ".zst", for the outputs which have no data to look at yet.
+Compression CompressionFromExtension(const std::filesystem::path& path);
+
+// Chunks of bytes between the thread running a codec and the one parsing or formatting.
+// Push() blocks while s_maxChunks are queued, so a fast producer doesn't hold the whole data.
+class ChunkQueue
+{
+public:
+	static constexpr size_t     s_chunkSize = 1u << 20;
+	static constexpr size_t     s_maxChunks = 8;
+
+	std::deque<std::vector<char>>   m_chunks;
+	std::mutex                      m_mutex;
+	std::condition_variable         m_cv;
+	bool                            m_closed = false; // no more Push().
+	bool                            m_cancelled = false; // no more Pop().
+
+public:
+	// Returns false once cancelled. The chunk is dropped then.
+	bool Push(std::vector<char>&& chunk);
+	// Returns false once closed and drained, or cancelled.
+	bool Pop(std::vector<char>& chunk);
+	void Close();
+	void Cancel();
+};
+
+// An istream over another one, decompressed when it starts with the magic of gzip or zstd and passed
+// through otherwise. The decompression runs on a thread of its own.
+//
+// DecompressedInput input;
+// input.Open(is);
+// Parse(input.Stream());
+// errStr = input.Close(); // the error of the decompression, which a parse error may have come from.
+class DecompressedInput : public std::streambuf
+{
+public:
+	std::istream*           m_source = nullptr;
+	Compression             m_compression = Compression::None;
+	uint8_t                 m_prefix[4] = {}; // read by Open() to detect the compression.
+	size_t                  m_prefixPos = 0;
+	size_t                  m_prefixSize = 0;
+	ChunkQueue              m_queue;
+	std::thread             m_thread;
+	std::wstring            m_errStr; // set by the thread.
+	std::vector<char>       m_chunk; // the get area.
+	std::istream            m_stream;
+
+public:
+	DecompressedInput();
+	DecompressedInput(const DecompressedInput&) = delete;
+	DecompressedInput& operator=(const DecompressedInput&) = delete;
+	~DecompressedInput();
+
+	std::wstring Open(std::istream& source);
+	std::istream& Stream() { return m_stream; }
+	// Stops the thread if the stream wasn't read to its end.
+	std::wstring Close();
+
+	int_type underflow() override;
+
+	// Used by Open() and underflow(). ReadSource() returns the prefix first.
+	size_t ReadSource(uint8_t* dst, size_t size);
+	void Decompress();
+};
+
+// A file written through Stream() or WideStream(), compressed by the extension of its name. The wide
+// stream is written as UTF-8. The compression and the writes run on a thread of its own.
+class CompressedOutput : public std::streambuf
+{
+public:
+	// Encodes to UTF-8 into the owner. A high surrogate at the end of a flush waits for its pair.
+	class WideBuffer : public std::wstreambuf {
+	public:
+		static constexpr size_t     s_bufferSize = 64u * 1024u;
+
+		CompressedOutput*       m_owner = nullptr;
+		std::vector<wchar_t>    m_buffer;
+		uint32_t                m_highSurrogate = 0;
+		std::string             m_utf8;
+
+	public:
+		explicit WideBuffer(CompressedOutput* owner);
+
+		int_type overflow(int_type c) override;
+		int sync() override;
+
+		// Used by overflow() and sync().
+		bool Encode();
+	};
+
+	std::filesystem::path   m_path;
+	std::ofstream           m_file;
+	Compression             m_compression = Compression::None;
+	ChunkQueue              m_queue;
+	std::thread             m_thread;
+	std::wstring            m_errStr; // set by the thread.
+	std::vector<char>       m_chunk; // the put area.
+	std::ostream            m_stream;
+	WideBuffer              m_wideBuffer;
+	std::wostream           m_wideStream;
+
+public:
+	CompressedOutput();
+	CompressedOutput(const CompressedOutput&) = delete;
+	CompressedOutput& operator=(const CompressedOutput&) = delete;
+	~CompressedOutput();
+
+	std::wstring Open(const std::filesystem::path& path);
+	std::ostream& Stream() { return m_stream; }
+	std::wostream& WideStream() { return m_wideStream; }
+	// Flushes both streams and finishes the file.
+	std::wstring Close();
+
+	int_type overflow(int_type c) override;
+	int sync() override;
+
+	// Used by overflow(), sync() and Close().
+	bool HandOver();
+	void Compress();
+};
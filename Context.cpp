@@ -7,21 +7,22 @@
 #include <iostream>
 #include <sstream>
 #include <iterator>
-#include <regex>
-
-#include "picojson/picojson.h"
+#include <algorithm>
+#include <cwctype>
+#include <charconv>
 
 #include "Context.h"
+#include "CompressedStream.h"
+#include "JsonReader.h"
+#include "OutputFormatter.h"
+#include "Stats.h"
 
 namespace {
-    constexpr std::string_view  symbols_s("symbols");
     constexpr std::wstring_view  symbols_ws(L"symbols");
-    constexpr std::string_view  paths_s("paths");
     constexpr std::wstring_view  paths_ws(L"paths");
-    constexpr std::string_view  callstacks_s("callstacks");
+    constexpr std::wstring_view  modules_ws(L"modules");
+    constexpr std::wstring_view  stacks_ws(L"stacks");
     constexpr std::wstring_view  callstacks_ws(L"callstacks");
-    constexpr std::string_view  resolved_callstacks_s("resolved_callstacks");
-    constexpr std::wstring_view  resolved_callstacks_ws(L"resolved_callstacks");
 
     std::wstring Utf8ToUtf16(const std::string& u8)
     {
@@ -49,36 +50,42 @@ namespace {
         return std::string();
     }
 
+    // The whole string as a number. Anything but the digits fails, as does a value beyond 64 bits.
+    std::optional<uint64_t> ToNumber(std::wstring_view s, int base)
+    {
+        // std::from_chars reads chars, so the digits are copied first.
+        char buf[64];
+        if (s.empty() || s.size() > sizeof(buf))
+            return std::nullopt;
+        for (size_t i = 0; i < s.size(); ++i) {
+            if (s[i] > 0x7F)
+                return std::nullopt;
+            buf[i] = (char)s[i];
+        }
+
+        uint64_t v = 0;
+        auto [ptr, ec] = std::from_chars(buf, buf + s.size(), v, base);
+        if (ec != std::errc() || ptr != buf + s.size())
+            return std::nullopt;
+        return v;
+    }
+
     std::optional<uint64_t> ParseNumber(const std::wstring& s)
     {
         try {
             auto toValue = [](const std::wstring &arg_s) -> std::optional<uint64_t> {
-                uint64_t v;
-
                 // Trim space
-                auto b = arg_s.find_first_not_of(L" ");
-                auto e = arg_s.find_last_not_of(L" ");
+                auto b = arg_s.find_first_not_of(L" \t");
+                auto e = arg_s.find_last_not_of(L" \t");
                 const std::wstring_view s = std::wstring_view(arg_s).substr(b, e - b + 1);
  
                 if (s.rfind(L"0x") == 0) {
                     // hex.
-                    std::wstringstream ss;
-                    ss << std::hex << s.substr(2, std::string::npos);
-                    ss >> v;
-                    if (ss.fail()) {
-                        return std::nullopt;
-                    }
-                    return v;
+                    return ToNumber(s.substr(2), 16);
                 }
                 else {
                     // dec.
-                    std::wstringstream ss;
-                    ss << std::dec << s;
-                    ss >> v;
-                    if (ss.fail()) {
-                        return std::nullopt;
-                    }
-                    return v;
+                    return ToNumber(s, 10);
                 }
             };
 
@@ -122,17 +129,21 @@ namespace {
         return std::nullopt;
     }
 
-    std::optional<std::wstring> ConvertToStr(const std::optional<uint64_t>& v, bool hex)
+    // A raw address in hex, with or without "0x". WinDbg writes 64 bit addresses as "00007ffa`1b2c3d4e".
+    std::optional<uint64_t> ParseAddress(const std::wstring& s)
     {
-        if (!v.has_value())
+        auto b = s.find_first_not_of(L" \t\"");
+        if (b == std::wstring::npos)
             return std::nullopt;
+        auto e = s.find_last_not_of(L" \t\"");
+        std::wstring addrStr = s.substr(b, e - b + 1);
 
-        std::wstringstream ss;
-        if (hex)
-            ss << L"0x" << std::hex;
-        ss << v.value();
-
-        return ss.str();
+        std::erase(addrStr, L'`');
+        std::wstring_view digits = addrStr;
+        if (digits.starts_with(L"0x") || digits.starts_with(L"0X")) {
+            digits.remove_prefix(2);
+        }
+        return ToNumber(digits, 16);
     }
 
     std::wstring ResolveDir(std::wstring& pathStr, const std::filesystem::path& rootPath, bool forceCreate = false)
@@ -196,35 +207,89 @@ namespace {
         return std::wstring();
     };
 
-    std::tuple<std::optional<Context::symbol>, std::wstring> parseSymbol(const picojson::object& o, const std::filesystem::path &rootPath)
-    {
-        Context::symbol s;
+    // The members of an object in "symbols" or "modules". Members of other types are not kept.
+    struct ObjectFields {
+        std::vector<std::pair<std::wstring, std::wstring>>  strings;
+        std::vector<std::pair<std::wstring, bool>>          bools;
 
-        for (picojson::object::const_iterator i = o.begin(); i != o.end(); ++i) {
-            const auto& key(i->first);
-            const auto& value(i->second);
+        void clear()
+        {
+            strings.clear();
+            bools.clear();
+        }
+    };
 
-            if (key == "force_create_cache_dir") {
-                s.force_create_cache_dir = value.get<bool>();
+    std::tuple<std::optional<Context::module>, std::wstring> parseModule(const ObjectFields& o)
+    {
+        Context::module m;
+        bool hasBase = false, hasSize = false;
+
+        // 64 bit addresses don't fit in a JSON number, so they are strings.
+        for (const auto& [key, value] : o.strings) {
+            if (key == L"base" || key == L"size") {
+                auto v = ParseAddress(value);
+                if (!v.has_value()) {
+                    std::wstringstream ss;
+                    ss << L"Failed to parse \"" << key << L"\" of a module, \"" << value << L"\".";
+                    return { std::nullopt, ss.str() };
+                }
+                if (key == L"base") {
+                    m.base = v.value();
+                    hasBase = true;
+                }
+                else {
+                    m.size = v.value();
+                    hasSize = true;
+                }
             }
+            else if (key == L"path") {
+                m.path = value;
+            }
+        }
+
+        if (!hasBase || !hasSize || m.size == 0 || m.path.empty()) {
+            return { std::nullopt, L"A module needs \"base\", non zero \"size\" and \"path\"." };
+        }
 
-            if (!value.is<std::string>())
-                continue;
+        return { m, std::wstring() };
+    }
 
-            if (key == "server") {
-                s.server = Utf8ToUtf16(value.get<std::string>());
+    std::tuple<std::optional<Context::symbol>, std::wstring> parseSymbol(const ObjectFields& o, const std::filesystem::path &rootPath)
+    {
+        Context::symbol s;
+
+        for (const auto& [key, value] : o.bools) {
+            if (key == L"force_create_cache_dir") {
+                s.force_create_cache_dir = value;
             }
-            else if (key == "cache") {
-                s.cache = Utf8ToUtf16(value.get<std::string>());
+            if (key == L"writable") {
+                s.writable = value;
             }
-            else if (key == "direct") {
-                s.direct = Utf8ToUtf16(value.get<std::string>());
+        }
+
+        for (const auto& [key, value] : o.strings) {
+            if (key == L"server") {
+                s.server = value;
+            }
+            else if (key == L"cache") {
+                s.cache = value;
+            }
+            else if (key == L"direct") {
+                s.direct = value;
+            }
+            else if (key == L"force_create_cache_dir" || key == L"writable") {
+                std::wstringstream ss;
+                ss << L"\"" << key << L"\" of a symbol storage needs to be true or false.";
+                return { std::nullopt, ss.str() };
             }
         }
 
         if (s.server != std::nullopt && s.cache == std::nullopt) {
             return { std::nullopt, L"Valid \"cache\" directory is needed when specifying a server." };
         }
+        if (s.server != std::nullopt && s.writable == false) {
+            return { std::nullopt, L"The \"cache\" directory of a server needs to be writable." };
+        }
         if (s.server == std::nullopt && s.cache == std::nullopt && s.direct == std::nullopt) {
             // empty but not an error.
             return {std::nullopt, std::wstring()};
@@ -251,194 +316,214 @@ namespace {
         return {s, std::wstring()};
     }
 
-    void prepareToWrite(Context::resolved_callstack& c)
-    {
-        c.image_offset = ConvertToStr(c.values.image_offset, true);
-        c.function_offset = ConvertToStr(c.values.function_offset, true);
-        c.line_no = ConvertToStr(c.values.line_no, false);
-        c.line_offset = ConvertToStr(c.values.line_offset, true);
-    }
-
-    std::wostream& operator<<(std::wostream& os, std::pair<std::wstring&, const Context::resolved_callstack&> p)
-    {
-        auto [prefix, c] = p;
-
-        os << prefix << L"{" << std::endl;
-        prefix += L"  ";
-        bool flushLine = false;
+    // Puts the members of a config into a Context while they are parsed. The elements of "symbols" and
+    // "modules" are collected until their object ends. Unknown members are skipped.
+    class ConfigHandler : public JsonReader::Handler {
+    public:
+        enum class Section {
+            None,
+            Symbols,
+            Paths,
+            Modules,
+            Stacks,
+            Callstacks,
+            Skipped,
+        };
 
-        auto outOptionalDQ = [&](const std::optional<std::wstring>& s, const wchar_t* name) {
-                if (s.has_value()) {
-                    if (flushLine) {
-                        os << "," << std::endl;
-                        flushLine = false;
-                    }
-                    os << prefix << L"\"" << name << "\" : \"" << std::regex_replace(*s, std::wregex(L"\\\\"), L"\\\\") << "\"";
-                    flushLine = true;
-                }
-            };
+        Context&                        m_ctx;
+        const std::filesystem::path&    m_rootPath;
+        const bool                      m_callstacks; // false when the command arguments gave the callstacks.
+        size_t                          m_depth = 0; // of the open objects and arrays.
+        Section                         m_section = Section::None; // of the member of the root being read.
+        std::wstring                    m_key; // of the member of an element being read.
+        ObjectFields                    m_fields;
 
-        if (c.isComment) {
-            outOptionalDQ(c.image, L"comment");
-        }
-        else {
-            outOptionalDQ(c.image, L"image");
-            outOptionalDQ(c.pdb, L"pdb");
-            outOptionalDQ(c.pdb_signature, L"pdb_signature");
-            outOptionalDQ(c.image_offset, L"image_offset");
-            outOptionalDQ(c.function, L"function");
-            outOptionalDQ(c.function_offset, L"function_offset");
-            outOptionalDQ(c.line, L"line");
-            outOptionalDQ(c.line_no, L"line_no");
-            outOptionalDQ(c.line_offset, L"line_offset");
+        ConfigHandler(Context& ctx, const std::filesystem::path& rootPath) :
+            m_ctx(ctx), m_rootPath(rootPath), m_callstacks(ctx.callstacks.empty())
+        {
         }
 
-        prefix = prefix.substr(0, prefix.length() - 2);
-        if (flushLine) {
-            os << std::endl;
+        std::wstring_view SectionName() const
+        {
+            switch (m_section) {
+            case Section::Symbols:      return symbols_ws;
+            case Section::Paths:        return paths_ws;
+            case Section::Modules:      return modules_ws;
+            case Section::Stacks:       return stacks_ws;
+            case Section::Callstacks:   return callstacks_ws;
+            default:                    return std::wstring_view();
+            }
         }
-        os << prefix << L"}";
 
-        return os;
-    }
-
-    std::wostream& operator<<(std::wostream& os, std::pair<std::wstring &, const Context::symbol&> p)
-    {
-        auto [prefix, s] = p;
-
-        os << prefix << L"{" << std::endl;
-        prefix += L"  ";
-        bool flushLine = false;
+        bool HasObjects() const
+        {
+            return m_section == Section::Symbols || m_section == Section::Modules;
+        }
 
-        auto outOptionalDQ = [&]<typename T>(const std::optional<T>&s, const wchar_t* name)
+        // A value which isn't allowed at the current depth of the section. Empty when it is.
+        std::wstring CheckValue(bool isObject, bool isArray, bool isString)
         {
-            if (s.has_value()) {
-                if (flushLine) {
-                    os << L"," << std::endl;
-                    flushLine = false;
-                }
-                os << prefix << L"\"" << name << "\" : \"" << std::regex_replace(*s, std::wregex(L"\\\\"), L"\\\\") << "\"";
-                flushLine = true;
+            if (m_depth == 0 && !isObject)
+                return L"Failed to parse input config. Root is not a JSON object.";
+            if (m_section == Section::None || m_section == Section::Skipped)
+                return std::wstring();
+
+            std::wstringstream ss;
+            if (m_depth == 1 && !isArray) {
+                ss << L"\"" << SectionName() << L"\" needs to be an array.";
+                return ss.str();
             }
-        };
-        auto outOptional = [&]<typename T>(const std::optional<T>&s, const wchar_t* name)
-        {
-            if (s.has_value()) {
-                if (flushLine) {
-                    os << L"," << std::endl;
-                    flushLine = false;
-                }
-                os << std::boolalpha << prefix << L"\"" << name << "\" : " << *s;
-                flushLine = true;
+            if (m_depth == 2 && HasObjects() && !isObject) {
+                ss << L"\"" << SectionName() << L"\" needs to be an array of objects.";
+                return ss.str();
             }
-        };
-
-        outOptionalDQ(s.server, L"server");
-        outOptionalDQ(s.cache, L"cache");
-        outOptionalDQ(s.direct, L"direct");
-        outOptional(s.force_create_cache_dir, L"force_create_cache_dir");
+            if (m_depth == 2 && !HasObjects() && !isString) {
+                ss << L"\"" << SectionName() << L"\" needs to be an array of strings.";
+                return ss.str();
+            }
+            return std::wstring();
+        }
 
-        prefix = prefix.substr(0, prefix.length() - 2);
-        if (flushLine) {
-            os << std::endl;
+        std::wstring StartObject() override
+        {
+            if (auto errStr = CheckValue(true, false, false); !errStr.empty())
+                return errStr;
+            if (m_depth == 2 && HasObjects()) {
+                m_fields.clear();
+            }
+            ++m_depth;
+            return std::wstring();
         }
-        os << prefix << L"}";
 
-        return os;
-    }
-};
+        std::wstring EndObject() override
+        {
+            --m_depth;
+            if (m_depth != 2)
+                return std::wstring();
 
-std::wostream& operator<<(std::wostream& os, Context& ctx)
-{
-    for (auto& c : ctx.resolved_callstacks) {
-        prepareToWrite(c);
-    }
+            if (m_section == Section::Symbols) {
+                auto [s, errStr] = parseSymbol(m_fields, m_rootPath);
+                if (!s.has_value())
+                    return errStr;
+                m_ctx.symbols.push_back(std::move(s.value()));
+            }
+            else if (m_section == Section::Modules) {
+                auto [m, errStr] = parseModule(m_fields);
+                if (!m.has_value())
+                    return errStr;
+                m_ctx.modules.push_back(std::move(m.value()));
+            }
+            return std::wstring();
+        }
 
-    std::wstring prefix;
+        std::wstring StartArray() override
+        {
+            if (auto errStr = CheckValue(false, true, false); !errStr.empty())
+                return errStr;
+            ++m_depth;
+            return std::wstring();
+        }
 
-    os << prefix << L"{" << std::endl;
+        std::wstring EndArray() override
+        {
+            --m_depth;
+            return std::wstring();
+        }
 
-    prefix += L"  ";
+        std::wstring Key(const std::wstring& key) override
+        {
+            if (m_depth == 1) {
+                if (key == symbols_ws)
+                    m_section = Section::Symbols;
+                else if (key == paths_ws)
+                    m_section = Section::Paths;
+                else if (key == modules_ws)
+                    m_section = Section::Modules;
+                else if (key == stacks_ws)
+                    m_section = Section::Stacks;
+                else if (key == callstacks_ws && m_callstacks)
+                    m_section = Section::Callstacks;
+                else
+                    m_section = Section::Skipped;
+            }
+            else if (m_depth == 3 && HasObjects()) {
+                m_key = key;
+            }
+            return std::wstring();
+        }
+
+        std::wstring String(const std::wstring& value) override
+        {
+            if (auto errStr = CheckValue(false, false, true); !errStr.empty())
+                return errStr;
 
-    // symobls
-    {
-        os << prefix << "\"" << symbols_ws << L"\" : [" << std::endl;
-        prefix += L"  ";
-        for (size_t i = 0; i < ctx.symbols.size(); ++i) {
-            os << std::pair<std::wstring&, const Context::symbol&>(prefix, ctx.symbols[i]);
-            if (i + 1 < ctx.symbols.size()) {
-                os << L"," << std::endl;
-            }
-            else {
-                os << std::endl;
+            if (m_depth == 3 && HasObjects()) {
+                m_fields.strings.emplace_back(m_key, value);
+                return std::wstring();
             }
-        }
-        prefix = prefix.substr(0, prefix.length() - 2);
-        os << prefix << L"]," << std::endl;
-    }
+            if (m_depth != 2)
+                return std::wstring();
 
-    // paths
-    {
-        os << prefix << L"\"" << paths_ws << L"\" : [" << std::endl;
-        prefix += L"  ";
-        size_t ip_size = ctx.paths.size();
-        size_t ip_idx = 0;
-        for (const auto& ip : ctx.paths) {
-            os << prefix << L"\"" << std::regex_replace(ip.second, std::wregex(L"\\\\"), L"\\\\") << L"\"";
-            if (ip_idx < ip_size - 1) {
-                os << L"," << std::endl;
+            // The strings are copied so that each fits its length. The reader keeps its buffer.
+            switch (m_section) {
+            case Section::Paths: {
+                std::filesystem::path p(value);
+                std::wstring filenameStr(p.filename().wstring());
+                if (value.empty() || filenameStr.empty()) {
+                    std::wstringstream ss;
+                    ss << L"Invalid path string detected in \"" << paths_ws << "\". \"" << value << "\". ";
+                    return ss.str();
+                }
+                m_ctx.paths.insert({ std::move(filenameStr), value });
+                break;
             }
-            else {
-                os << std::endl;
+            case Section::Stacks: {
+                Context::raw_stack rs;
+                auto errStr = Context::ParseStackString(value, rs);
+                if (!errStr.empty())
+                    return errStr;
+                m_ctx.stacks.push_back(std::move(rs));
+                break;
             }
-            ++ip_idx;
+            case Section::Callstacks:
+                m_ctx.callstacks.push_back(value);
+                break;
+            default:
+                break;
+            }
+            return std::wstring();
         }
-        prefix = prefix.substr(0, prefix.length() - 2);
-        os << prefix << L"]," << std::endl;
-    }
 
-    // callstacks
-    {
-        os << prefix << L"\"" << callstacks_ws << L"\" : [" << std::endl;
-        prefix += L"  ";
-        for (size_t i = 0; i < ctx.callstacks.size(); ++i) {
-            const auto& cs(ctx.callstacks[i]);
-            os << prefix << L"\"" << cs << L"\"";
-            if (i < ctx.callstacks.size() - 1) {
-                os << L"," << std::endl;
-            }
-            else {
-                os << std::endl;
+        std::wstring Bool(bool value) override
+        {
+            if (auto errStr = CheckValue(false, false, false); !errStr.empty())
+                return errStr;
+            if (m_depth == 3 && HasObjects()) {
+                m_fields.bools.emplace_back(m_key, value);
             }
+            return std::wstring();
         }
-        prefix = prefix.substr(0, prefix.length() - 2);
-        os << prefix << L"]," << std::endl;
-    }
 
-    // resolved_callstacks
-    {
-        os << prefix << L"\"" << resolved_callstacks_ws << L"\" : [" << std::endl;
-        prefix += L"  ";
-        for (size_t i = 0; i < ctx.resolved_callstacks.size(); ++i) {
-            os << std::pair<std::wstring&, const Context::resolved_callstack&>(prefix, ctx.resolved_callstacks[i]);
+        std::wstring Number(std::string_view text) override
+        {
+            return CheckValue(false, false, false);
+        }
 
-            if (i + 1 < ctx.callstacks.size()) {
-                os << L"," << std::endl;
-            }
-            else {
-                os << std::endl;
-            }
+        std::wstring Null() override
+        {
+            return CheckValue(false, false, false);
         }
-        prefix = prefix.substr(0, prefix.length() - 2);
-        os << prefix << L"]" << std::endl;
-    }
+    };
+};
 
-    os << L"}" << std::endl;
+std::wostream& operator<<(std::wostream& os, const Context& ctx)
+{
+    ResultFormatter<OutputFormat::Json>::Write(os, ctx);
 
     return os;
 }
 
-std::ostream& operator<<(std::ostream& os, Context& ctx)
+std::ostream& operator<<(std::ostream& os, const Context& ctx)
 {
     std::wstringstream ss;
     ss << ctx;
@@ -447,7 +532,7 @@ std::ostream& operator<<(std::ostream& os, Context& ctx)
     return os;
 }
 
-std::wstring Context::ParseCallstackString(const std::wstring& inputStr, std::wstring& imageStr, uint64_t& offsetVal, bool& isPDB)
+std::wstring Context::ParseCallstackString(const std::wstring& inputStr, std::wstring& imageStr, uint64_t& offsetVal, bool& isPDB, std::wstring& pdbSignature)
 {
     auto stripDQS = [](const std::wstring& src) -> std::wstring {
         auto b = src.find_first_not_of(L" \"");
@@ -473,6 +558,30 @@ std::wstring Context::ParseCallstackString(const std::wstring& inputStr, std::ws
         ss << L"Failed to parse a callstack string \"" << inputStr << "\". (Image file name was a empty string.)";
         return ss.str();
     }
+
+    // "name.pdb{GUIDAGE}" gives the PDB signature, so the image file isn't needed.
+    pdbSignature.clear();
+    if (imageStr.ends_with(L'}')) {
+        auto bpos = imageStr.rfind(L'{');
+        if (bpos == std::wstring::npos || bpos == 0) {
+            std::wstringstream ss;
+            ss << L"Failed to parse a callstack string \"" << inputStr << "\". (No \"{\" before \"}\".)";
+            return ss.str();
+        }
+        std::wstring sigStr = imageStr.substr(bpos + 1, imageStr.size() - bpos - 2);
+        std::erase(sigStr, L'-');
+        if (sigStr.size() < 33 || sigStr.size() > 40 || sigStr.find_first_not_of(L"0123456789abcdefABCDEF") != std::wstring::npos) {
+            std::wstringstream ss;
+            ss << L"Failed to parse a callstack string \"" << inputStr << "\". ";
+            ss << L"The PDB signature \"" << sigStr << L"\" needs to be 32 hex digits of the GUID followed by the age.";
+            return ss.str();
+        }
+        std::transform(sigStr.begin(), sigStr.end(), sigStr.begin(), [](wchar_t c) { return (wchar_t)towupper(c); });
+        pdbSignature = sigStr;
+
+        imageStr = imageStr.substr(0, bpos);
+        imageStr.erase(imageStr.find_last_not_of(L" ") + 1);
+    }
     if (ppos + 1 < inputStr.length() - 1) {
         offsetStr = stripDQS(inputStr.substr(ppos + 1));
     }
@@ -523,14 +632,147 @@ std::wstring Context::ParseCallstackString(const std::wstring& inputStr, std::ws
     return std::wstring();
 }
 
+std::wstring Context::ParseModuleString(const std::wstring& inputStr, module& m)
+{
+    // "base size path". The path may contain spaces.
+    std::wstringstream ss(inputStr);
+    std::wstring baseStr, sizeStr;
+    ss >> baseStr >> sizeStr;
+    std::getline(ss, m.path);
+    {
+        auto b = m.path.find_first_not_of(L" \t\"");
+        auto e = m.path.find_last_not_of(L" \t\"\r");
+        m.path = b == std::wstring::npos ? std::wstring() : m.path.substr(b, e - b + 1);
+    }
+
+    auto base = ParseAddress(baseStr);
+    auto size = ParseAddress(sizeStr);
+    if (!base.has_value() || !size.has_value() || size.value() == 0 || m.path.empty()) {
+        std::wstringstream es;
+        es << L"Failed to parse a module string \"" << inputStr << L"\". It needs to be \"base size path\".";
+        return es.str();
+    }
+    m.base = base.value();
+    m.size = size.value();
+
+    return std::wstring();
+}
+
+std::wstring Context::ParseStackString(const std::wstring& inputStr, raw_stack& s)
+{
+    // "rip=0x... rsp=0x... [other registers] [stack_base=0x...] stack=<hex bytes from stack_base>"
+    std::wstringstream ss(inputStr);
+    std::wstring token;
+    std::optional<uint64_t> stackBase;
+    while (ss >> token) {
+        auto eq = token.find(L'=');
+        if (eq == std::wstring::npos || eq == 0) {
+            std::wstringstream es;
+            es << L"Failed to parse a stack string. \"" << token << L"\" needs to be \"name=value\".";
+            return es.str();
+        }
+        std::wstring name = token.substr(0, eq);
+        std::wstring value = token.substr(eq + 1);
+        std::transform(name.begin(), name.end(), name.begin(), [](wchar_t c) { return (wchar_t)towlower(c); });
+
+        if (name == L"stack") {
+            if (value.size() % 2 != 0 || value.find_first_not_of(L"0123456789abcdefABCDEF") != std::wstring::npos) {
+                return L"Failed to parse a stack string. \"stack\" needs to be hex digits of the bytes.";
+            }
+            auto nibble = [](wchar_t c) -> uint8_t {
+                return (uint8_t)(c <= L'9' ? c - L'0' : (c | 0x20) - L'a' + 10);
+                };
+            s.stack.resize(value.size() / 2);
+            for (size_t i = 0; i < s.stack.size(); ++i) {
+                s.stack[i] = (uint8_t)(nibble(value[i * 2]) << 4 | nibble(value[i * 2 + 1]));
+            }
+            continue;
+        }
+
+        auto v = ParseAddress(value);
+        if (!v.has_value()) {
+            std::wstringstream es;
+            es << L"Failed to parse a stack string. \"" << value << L"\" of \"" << name << L"\" needs to be a number.";
+            return es.str();
+        }
+        if (name == L"stack_base") {
+            stackBase = v;
+        }
+        else {
+            s.registers[name] = v.value();
+        }
+    }
+
+    if (!s.registers.contains(L"rip") || !s.registers.contains(L"rsp") || s.stack.empty()) {
+        return L"Failed to parse a stack string. \"rip\", \"rsp\" and \"stack\" are needed.";
+    }
+    s.stack_base = stackBase.value_or(s.registers[L"rsp"]);
+
+    return std::wstring();
+}
+
+std::wstring Context::SortModules()
+{
+    std::sort(modules.begin(), modules.end(), [](const module& a, const module& b) { return a.base < b.base; });
+
+    for (size_t i = 1; i < modules.size(); ++i) {
+        const auto& prev = modules[i - 1];
+        if (modules[i].base - prev.base < prev.size) {
+            std::wstringstream ss;
+            ss << L"Modules \"" << prev.path << L"\" and \"" << modules[i].path << L"\" overlap in the module list.";
+            return ss.str();
+        }
+    }
+
+    return std::wstring();
+}
+
+const Context::module* Context::FindModule(uint64_t address) const
+{
+    // The last module which starts at or below the address.
+    auto itr = std::upper_bound(modules.begin(), modules.end(), address, [](uint64_t a, const module& m) { return a < m.base; });
+    if (itr == modules.begin())
+        return nullptr;
+    --itr;
+
+    return address - itr->base < itr->size ? &*itr : nullptr;
+}
+
 std::wstring Context::ParseCallstacks(bool strictParsing)
 {
+    {
+        auto errStr = SortModules();
+        if (!errStr.empty())
+            return errStr;
+    }
+
     for (const auto& csStr : callstacks) {
         std::wstring imageStr;
         uint64_t     imageOffset = 0;
         bool         isComment = false;
         bool         isPDB = false;
-        auto errStr = Context::ParseCallstackString(csStr, imageStr, imageOffset, isPDB);
+        bool         isRawAddress = false;
+        std::wstring pdbSignature;
+        auto errStr = Context::ParseCallstackString(csStr, imageStr, imageOffset, isPDB, pdbSignature);
+        if (!errStr.empty() && !modules.empty()) {
+            // Not "image + offset". It can be a raw address in one of the listed modules.
+            auto address = ParseAddress(csStr);
+            if (address.has_value()) {
+                const module* m = FindModule(address.value());
+                if (m != nullptr) {
+                    imageStr = m->path;
+                    imageOffset = address.value() - m->base;
+                    isPDB = false;
+                    isRawAddress = true;
+                    errStr.clear();
+                }
+                else {
+                    std::wstringstream ss;
+                    ss << L"The address \"" << csStr << L"\" was not in any module of the module list.";
+                    errStr = ss.str();
+                }
+            }
+        }
         if (!errStr.empty()) {
             if (strictParsing) {
                 return errStr;
@@ -540,7 +782,19 @@ std::wstring Context::ParseCallstacks(bool strictParsing)
 
         // Resolve the image path
         std::filesystem::path imagePath(imageStr);
-        if (imagePath.is_relative()) {
+        if (isRawAddress) {
+            // The module list has the paths on the machine which made the addresses. A local copy listed
+            // in "paths" comes first, then the path itself, then the file name in the current path.
+            auto itr = paths.find(imagePath.filename());
+            if (itr != paths.end()) {
+                imagePath = itr->second;
+            }
+            else if (imagePath.is_absolute() && !std::filesystem::exists(imagePath)) {
+                imagePath = imagePath.filename();
+            }
+        }
+        // A frame with the PDB signature doesn't need any file.
+        if (pdbSignature.empty() && imagePath.is_relative()) {
             // Image file with a relative path. Search from the path dict in the context.
             auto itr = paths.find(imagePath);
             if (itr != paths.end()) {
@@ -577,7 +831,11 @@ std::wstring Context::ParseCallstacks(bool strictParsing)
                 rcs.image = csStr;
             }
             else {
-                if (isPDB) {
+                if (!pdbSignature.empty()) {
+                    rcs.image = imageStr;
+                    rcs.pdb_signature = pdbSignature;
+                }
+                else if (isPDB) {
                     rcs.pdb = imagePath;
                 }
                 else {
@@ -597,108 +855,31 @@ std::wstring Context::ParseCallstacks(bool strictParsing)
 
 std::wstring Context::ParseInputConfig(std::istream& is, const std::filesystem::path& rootPath)
 {
-    // Parse Json stream.
-    picojson::value v;
-
-    is >> v;
+    // Streamed, so that a large input isn't held as a whole besides the strings it gives.
+    DecompressedInput input;
     {
-        std::string errStr = picojson::get_last_error();
-        if (errStr != "") {
-            std::wstringstream ss;
-            ss << L"Failed to parse input json stream. The last error was.." << std::endl;
-            ss << Utf8ToUtf16(errStr) << std::endl;
-            return ss.str();
-        }
-    }
-
-    if (!v.is<picojson::object>()) {
-        return L"Failed to parse input config. Root is not a JSON object.\n";
+        auto errStr = input.Open(is);
+        if (!errStr.empty())
+            return errStr;
     }
 
-    const picojson::object& rootObj = v.get<picojson::object>();
-
-    for (picojson::object::const_iterator i = rootObj.begin(); i != rootObj.end(); ++i) {
-        if (i->first == symbols_s) {
-            auto& e(i->second);
-            if (!e.is<picojson::array>()) {
-                std::wstringstream ss;
-                ss << L"\"" << symbols_ws << "\" needs to be an array.";
-                return ss.str();
-            }
-            const picojson::array& arr = e.get<picojson::array>();
-            for (picojson::array::const_iterator arrItr = arr.begin(); arrItr != arr.end(); ++arrItr) {
-                if (!arrItr->is<picojson::object>()) {
-                    std::wstringstream ss;
-                    ss << L"\"" << symbols_ws << "\" needs to be an array of ojects.";
-                    return ss.str();
-                }
-                auto [s, errStr] = parseSymbol(arrItr->get<picojson::object>(), rootPath);
-                if (!s.has_value())
-                    return errStr;
-
-                symbols.push_back(s.value());
-            }
-        }
-
-        if (i->first == paths_s) {
-            auto& e(i->second);
-            if (!e.is<picojson::array>()) {
-                std::wstringstream ss;
-                ss << L"\"" << paths_ws << "\" needs to be an array.";
-                return ss.str();
-            }
-            const picojson::array& arr = e.get<picojson::array>();
-            for (picojson::array::const_iterator arrItr = arr.begin(); arrItr != arr.end(); ++arrItr) {
-                if (!arrItr->is<std::string>()) {
-                    std::wstringstream ss;
-                    ss << L"\"" << paths_ws << "\" needs to be an array of strings.";
-                    return ss.str();
-                }
-
-                std::string pathStr(arrItr->get<std::string>());
-                std::filesystem::path p(pathStr);
-                std::string filenameStr(p.filename().string());
+    ConfigHandler handler(*this, rootPath);
+    JsonReader reader;
+    auto errStr = reader.Parse(input.Stream(), handler);
+    Stats::AddCount(L"parse_input_config.bytes", reader.m_offset);
 
-                if (!pathStr.empty() && !filenameStr.empty()) {
-                    paths.insert({ Utf8ToUtf16(filenameStr), Utf8ToUtf16(pathStr) });
-                }
-                else {
-                    std::wstringstream ss;
-                    ss << L"Invalid path string detected in \"" << paths_ws << "\". \"" << Utf8ToUtf16(pathStr) << "\". ";
-                    return ss.str();
-                }
-            }
-        }
-
-        // Parse callstacks if the command arguments didn't specify a callstack.
-        if (callstacks.empty()) {
-            if (i->first == callstacks_s) {
-                auto& e(i->second);
-                if (!e.is<picojson::array>()) {
-                    std::wstringstream ss;
-                    ss << L"\"" << callstacks_ws << "\" needs to be an array.";
-                    return ss.str();
-                }
-                const picojson::array& arr = e.get<picojson::array>();
-                for (picojson::array::const_iterator arrItr = arr.begin(); arrItr != arr.end(); ++arrItr) {
-                    if (!arrItr->is<std::string>()) {
-                        std::wstringstream ss;
-                        ss << L"\"" << callstacks_ws << "\" needs to be an array of strings.";
-                        return ss.str();
-                    }
-                    callstacks.push_back(Utf8ToUtf16(arrItr->get<std::string>()));
-                }
-            }
-        }
-    }
+    // A broken compressed input ends early, which is the cause of a parse error then.
+    auto decompressErrStr = input.Close();
+    if (!decompressErrStr.empty())
+        return decompressErrStr;
 
-    return std::wstring();
+    return errStr;
 }
 
 std::wstring Context::ParseInputConfig(const std::filesystem::path& inputPath)
 {
-    std::fstream s;
-    s.open(inputPath.wstring(), std::ios_base::in);
+    std::ifstream s;
+    s.open(inputPath, std::ios_base::in | std::ios_base::binary);
     if (!s) {
         std::wstringstream ss;
         ss << L"Failed to open file \"" << inputPath.wstring() << "\". ";
@@ -721,9 +902,25 @@ std::wstring Context::ParseInputText(std::istream& is, const std::filesystem::pa
     std::string line;
     constexpr std::wstring_view path_tag = L"--- paths";
     constexpr std::wstring_view callstacks_tag = L"--- callstacks";
+    constexpr std::wstring_view modules_tag = L"--- modules";
+    constexpr std::wstring_view stacks_tag = L"--- stacks";
+
+    DecompressedInput input;
+    {
+        auto errStr = input.Open(is);
+        if (!errStr.empty())
+            return errStr;
+    }
 
     int section = 0;
-    while (std::getline(is, line)) {
+    uint64_t numBytes = 0;
+    std::wstring errStr;
+    while (std::getline(input.Stream(), line)) {
+        numBytes += line.length() + 1;
+        // The input is read in binary, so that a compressed one isn't altered. CRLF is handled here.
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
         if (line.length() < 1)
             continue;
 
@@ -736,6 +933,14 @@ std::wstring Context::ParseInputText(std::istream& is, const std::filesystem::pa
             section = 2;
             continue;
         }
+        if (wLine.rfind(modules_tag, 0) == 0) {
+            section = 3;
+            continue;
+        }
+        if (wLine.rfind(stacks_tag, 0) == 0) {
+            section = 4;
+            continue;
+        }
         if (section == 1) {
             std::filesystem::path p(wLine);
             std::wstring filenameStr(p.filename().wstring());
@@ -746,21 +951,44 @@ std::wstring Context::ParseInputText(std::istream& is, const std::filesystem::pa
             else {
                 std::wstringstream ss;
                 ss << L"Invalid path string detected. \"" << wLine << "\".";
-                return ss.str();
+                errStr = ss.str();
+                break;
             }
         }
         if (section == 2) {
             callstacks.push_back(Utf8ToUtf16(line));
         }
+        if (section == 3) {
+            module m;
+            errStr = ParseModuleString(wLine, m);
+            if (!errStr.empty())
+                break;
+
+            modules.push_back(std::move(m));
+        }
+        if (section == 4) {
+            raw_stack rs;
+            errStr = ParseStackString(wLine, rs);
+            if (!errStr.empty())
+                break;
+
+            stacks.push_back(std::move(rs));
+        }
     }
+    Stats::AddCount(L"parse_input_text.bytes", numBytes);
 
-    return std::wstring();
+    // A broken compressed input ends early, which is the cause of a parse error then.
+    auto decompressErrStr = input.Close();
+    if (!decompressErrStr.empty())
+        return decompressErrStr;
+
+    return errStr;
 }
 
 std::wstring Context::ParseInputText(const std::filesystem::path& inputPath)
 {
-    std::fstream s;
-    s.open(inputPath.wstring(), std::ios_base::in);
+    std::ifstream s;
+    s.open(inputPath, std::ios_base::in | std::ios_base::binary);
     if (!s) {
         std::wstringstream ss;
         ss << L"Failed to open file \"" << inputPath.wstring() << "\". ";
@@ -778,43 +1006,10 @@ std::wstring Context::ParseInputText(const std::filesystem::path& inputPath)
     return std::wstring();
 }
 
-std::wstring Context::DumpResolvedInReadable()
+std::wstring Context::DumpResolvedInReadable() const
 {
-    for (auto& c : resolved_callstacks) {
-        prepareToWrite(c);
-    }
-
     std::wstringstream ss;
-
-    ss << "--- Resolved Callstacks ---" << std::endl;
-
-    for (const auto& cs : resolved_callstacks) {
-        std::wstring moduleName;
-
-        if (cs.isComment) {
-            if (cs.image.has_value()) {
-                ss << cs.image.value();
-            }
-        }
-        else {
-            if (cs.image.has_value()) {
-                moduleName = std::filesystem::path(cs.image.value()).filename();
-            }
-
-            ss << moduleName << L"!";
-            if (cs.function.has_value()) {
-                ss << cs.function.value() << L" + " << cs.function_offset.value();
-            }
-            else {
-                ss << cs.image_offset.value();
-            }
-            if (cs.line.has_value() && cs.function.has_value()) {
-                ss << L" [" << cs.line.value() << L" @ " << cs.line_no.value() << L"] + " << cs.line_offset.value();
-            }
-        }
-
-        ss << std::endl;
-    }
+    ResultFormatter<OutputFormat::Readable>::Write(ss, *this);
 
     return ss.str();
 }
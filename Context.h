@@ -12,20 +12,45 @@ struct Context {
         std::optional<std::wstring> cache;
         std::optional<std::wstring> direct;
         std::optional<bool> force_create_cache_dir;
+        std::optional<bool> writable;
+    };
+
+    // A module of the process which the raw addresses in "callstacks" came from.
+    struct module {
+        uint64_t        base = 0;
+        uint64_t        size = 0;
+        std::wstring    path;
+    };
+
+    // Registers and stack memory captured by a crash handler. The frames are found by unwinding.
+    struct raw_stack {
+        std::map<std::wstring, uint64_t>    registers; // "rip", "rsp", "rbp" and so on.
+        uint64_t                            stack_base = 0; // address of stack[0].
+        std::vector<uint8_t>                stack;
+    };
+
+    // A function inlined into the frame. "line" is the source line in that function.
+    struct inline_frame {
+        std::optional<std::wstring> function;
+        std::optional<std::wstring> line;
+
+        struct {
+            std::optional<uint64_t> line_no;
+        } values;
     };
 
     struct resolved_callstack {
         bool isComment = false;
 
         std::optional<std::wstring> image;
-        std::optional<std::wstring> image_offset;
         std::optional<std::wstring> pdb;
         std::optional<std::wstring> pdb_signature;
         std::optional<std::wstring> function;
-        std::optional<std::wstring> function_offset;
         std::optional<std::wstring> line;
-        std::optional<std::wstring> line_no;
-        std::optional<std::wstring> line_offset;
+
+        // Inlined callees at the address, the innermost first. "function" and "line" are the call site in the
+        // physical function when this is not empty.
+        std::vector<inline_frame>   inlines;
 
         struct {
             std::optional<uint64_t> image_offset;
@@ -37,20 +62,27 @@ struct Context {
 
     std::vector<symbol>                     symbols;
     std::map<std::wstring, std::wstring>    paths;
+    std::vector<module>                     modules; // sorted by the base address after ParseCallstacks().
     std::vector<std::wstring>               callstacks;
+    std::vector<raw_stack>                  stacks;
 
     std::vector<resolved_callstack>         resolved_callstacks;
 
 public:
-    static std::wstring ParseCallstackString(const std::wstring& inputStr, std::wstring& imageStr, uint64_t& offsetVal, bool& isPDB);
+    // "pdbSignature" is set for "name.pdb{GUIDAGE} + offset" and empty otherwise.
+    static std::wstring ParseCallstackString(const std::wstring& inputStr, std::wstring& imageStr, uint64_t& offsetVal, bool& isPDB, std::wstring& pdbSignature);
+    static std::wstring ParseModuleString(const std::wstring& inputStr, module& m);
+    static std::wstring ParseStackString(const std::wstring& inputStr, raw_stack& s);
+    std::wstring SortModules();
+    const module* FindModule(uint64_t address) const;
     std::wstring ParseCallstacks(bool strictParsing);
     std::wstring ParseInputConfig(std::istream& is, const std::filesystem::path& rootPath);
     std::wstring ParseInputConfig(const std::filesystem::path& inputPath);
     std::wstring ParseInputText(std::istream& is, const std::filesystem::path& rootPath);
     std::wstring ParseInputText(const std::filesystem::path& inputPath);
-    std::wstring DumpResolvedInReadable();
+    std::wstring DumpResolvedInReadable() const;
 };
 
-std::wostream& operator<<(std::wostream& os, Context& is);
-std::ostream& operator<<(std::ostream& os, Context& is);
+std::wostream& operator<<(std::wostream& os, const Context& is);
+std::ostream& operator<<(std::ostream& os, const Context& is);
 
@@ -0,0 +1,321 @@
+#include <Windows.h>
+#include <DbgHelp.h>
+
+#include <string>
+#include <sstream>
+#include <algorithm>
+
+#include "DbgHelpBackend.h"
+#include "Log.h"
+
+#pragma comment(lib, "dbghelp.lib")
+
+namespace {
+    std::wstring GetLastErrorAsWString()
+    {
+        DWORD errorMessageID = ::GetLastError();
+        if (errorMessageID == 0) {
+            return std::wstring();
+        }
+
+        LPWSTR messageBuffer = nullptr;
+        size_t size = FormatMessageW(FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS,
+            NULL, errorMessageID, MAKELANGID(LANG_NEUTRAL, SUBLANG_DEFAULT), (LPWSTR)&messageBuffer, 0, NULL);
+
+        std::wstring message(messageBuffer, size);
+        LocalFree(messageBuffer);
+
+        return message;
+    }
+};
+
+DbgHelpBackend::DbgHelpModule::~DbgHelpModule()
+{
+    if (m_allocatedMemAddr != 0) {
+        free(reinterpret_cast<void*>(m_allocatedMemAddr));
+        m_allocatedMemAddr = 0;
+        m_allocatedMemSize = 0;
+    }
+}
+
+std::wstring DbgHelpBackend::Init()
+{
+    if (m_hDbgHelp != 0) {
+        return L"Failed to initialize dbghelp module. It has already been initialized.";
+    }
+
+    DWORD options;
+    options = SymGetOptions();
+    options &= ~SYMOPT_DEFERRED_LOADS;
+    options |= SYMOPT_LOAD_LINES;
+    options |= SYMOPT_IGNORE_NT_SYMPATH;
+    options |= SYMOPT_DEBUG;
+    // Names are undecorated lazily by SymbolNames.
+    options &= ~SYMOPT_UNDNAME;
+    SymSetOptions(options);
+
+    // Not a process handle. dbghelp only needs a value which is unique among the resolvers of the process.
+    m_hDbgHelp = reinterpret_cast<HANDLE>(this);
+    BOOL isOK = SymInitialize(m_hDbgHelp, NULL, FALSE);
+    if (!isOK) {
+        m_hDbgHelp = 0;
+        return L"Failed to initialize dbghelp module.";
+    }
+
+    m_allocatedMemAddr = reinterpret_cast<uintptr_t>(malloc(m_allocatedMemSize));
+
+    return std::wstring();
+}
+
+std::wstring DbgHelpBackend::Finalize()
+{
+    if (m_hDbgHelp != 0) {
+        SymCleanup(m_hDbgHelp);
+        m_hDbgHelp = 0;
+    }
+
+    if (m_allocatedMemAddr != 0) {
+        free(reinterpret_cast<void*>(m_allocatedMemAddr));
+        m_allocatedMemAddr = 0;
+    }
+
+    return std::wstring();
+}
+
+void DbgHelpBackend::SetLoadOptions(bool publicsOnly, bool lines)
+{
+    DWORD options = SymGetOptions();
+    options = publicsOnly ? (options | SYMOPT_PUBLICS_ONLY) : (options & ~SYMOPT_PUBLICS_ONLY);
+    options = lines ? (options | SYMOPT_LOAD_LINES) : (options & ~SYMOPT_LOAD_LINES);
+    SymSetOptions(options);
+}
+
+std::wstring DbgHelpBackend::ReadImageSignature(const std::filesystem::path& imagePath, std::wstring& pdbName, GUID& guid, uint32_t& age, size_t& imageSize)
+{
+    SYMSRV_INDEX_INFOW info = { sizeof(SYMSRV_INDEX_INFOW), };
+    if (!SymSrvGetFileIndexInfoW(imagePath.wstring().c_str(), &info, 0)) {
+        std::wstringstream ss;
+        ss << L"Failed to get an image file info for \"" << imagePath.wstring() << L"\". The last error was: " << GetLastErrorAsWString();
+        return ss.str();
+    }
+
+    pdbName = info.pdbfile;
+    imageSize = info.size;
+    guid = info.guid;
+    age = info.age;
+
+    return std::wstring();
+}
+
+std::wstring DbgHelpBackend::LoadModule(const std::filesystem::path& pdbPath, bool publicsOnly, bool lines, std::unique_ptr<Module>& module)
+{
+    SetLoadOptions(publicsOnly, lines);
+
+    {
+        uintptr_t baseAddr = SymLoadModuleExW(
+            m_hDbgHelp,							// handle to the process
+            NULL,								// file handle
+            pdbPath.wstring().c_str(),          // image name (.pdb, .dll, .exe ...)
+            NULL,								// module name (shortcut name)
+            m_allocatedMemAddr,					// base address. cannot be zero when loading a PDB.
+            (DWORD)m_allocatedMemSize,			// DLL size, this cannot be zero when loading a PDB.
+            NULL,								// pointer to MODLAOD_DATA. can be null.
+            0);									// flags.
+
+        if (baseAddr == 0) {
+            std::wstringstream ss;
+            ss << L"Failed to load a PDB file, \"" << pdbPath.wstring() << L"\". The last error was: " << GetLastErrorAsWString();
+            return ss.str();
+        }
+    }
+
+    auto loading = std::make_unique<DbgHelpModule>();
+    loading->m_pdbPath = pdbPath;
+
+    // Estimate the DLL image size and allocate memory.
+    {
+        IMAGEHLP_SYMBOL64_PACKAGE lastSymbol = { sizeof(IMAGEHLP_SYMBOL64) , };
+        DWORD64 displacement = 0;
+        lastSymbol.sym.MaxNameLength = sizeof(IMAGEHLP_SYMBOL64_PACKAGE) - sizeof(IMAGEHLP_SYMBOL64);
+
+        if (!SymGetSymFromAddr64(m_hDbgHelp, m_allocatedMemAddr + m_allocatedMemSize - 1, &displacement, &lastSymbol.sym)) {
+            std::wstringstream ss;
+            ss << L"Failed to get the last symbol of the module \"" << pdbPath << "\". The last error was: " << GetLastErrorAsWString();
+            SymUnloadModule64(m_hDbgHelp, m_allocatedMemAddr);
+            return ss.str();
+        }
+
+        loading->m_allocatedMemSize = (((lastSymbol.sym.Address - m_allocatedMemAddr) >> 20) + 2) << 20; // + 1MB padding.
+
+        Log::Debug([&](Log::Message& m) { m << L"Estimated image size. 0x" << std::hex << loading->m_allocatedMemSize << L" (" << std::dec << loading->m_allocatedMemSize / (1024u * 1024u) << L" MB)"; });
+
+        loading->m_allocatedMemAddr = reinterpret_cast<uintptr_t>(malloc(loading->m_allocatedMemSize));
+        if (loading->m_allocatedMemAddr == 0) {
+            std::wstringstream ss;
+            ss << L"Failed to allocate memory for the module \"" << pdbPath << "\". ";
+            SymUnloadModule64(m_hDbgHelp, m_allocatedMemAddr);
+            return ss.str();
+        }
+    }
+
+    // unload module once.
+    if (!SymUnloadModule64(m_hDbgHelp, m_allocatedMemAddr)) {
+        std::wstringstream ss;
+        ss << L"Failed to unload module \"" << pdbPath.wstring() << "\". The last error was: " << GetLastErrorAsWString();
+        return ss.str();
+    }
+
+    // load again with the newly allocated memory.
+    {
+        uintptr_t baseAddr = SymLoadModuleExW(
+            m_hDbgHelp,
+            NULL,
+            pdbPath.wstring().c_str(),
+            NULL,
+            loading->m_allocatedMemAddr,
+            (DWORD)loading->m_allocatedMemSize,
+            NULL,
+            0);
+
+        if (baseAddr == 0) {
+            std::wstringstream ss;
+            ss << L"Failed to load module \"" << pdbPath.wstring() << "\" The last error was: " << GetLastErrorAsWString();
+            return ss.str();
+        }
+    }
+
+    module = std::move(loading);
+
+    return std::wstring();
+}
+
+std::wstring DbgHelpBackend::ReloadModule(Module& module, bool publicsOnly, bool lines)
+{
+    auto& m = static_cast<DbgHelpModule&>(module);
+
+    if (!SymUnloadModule64(m_hDbgHelp, m.m_allocatedMemAddr)) {
+        std::wstringstream ss;
+        ss << L"Failed to unload module \"" << m.m_pdbPath.wstring() << "\". The last error was: " << GetLastErrorAsWString();
+        return ss.str();
+    }
+
+    SetLoadOptions(publicsOnly, lines);
+    uintptr_t baseAddr = SymLoadModuleExW(m_hDbgHelp, NULL, m.m_pdbPath.wstring().c_str(), NULL, m.m_allocatedMemAddr, (DWORD)m.m_allocatedMemSize, NULL, 0);
+    if (baseAddr == 0) {
+        std::wstringstream ss;
+        ss << L"Failed to load module \"" << m.m_pdbPath.wstring() << "\" The last error was: " << GetLastErrorAsWString();
+        return ss.str();
+    }
+
+    return std::wstring();
+}
+
+std::wstring DbgHelpBackend::UnloadModule(Module& module)
+{
+    auto& m = static_cast<DbgHelpModule&>(module);
+
+    if (!SymUnloadModule64(m_hDbgHelp, m.m_allocatedMemAddr)) {
+        std::wstringstream ss;
+        ss << L"Failed to unload module \"" << m.m_pdbPath << L"\". The last error was: " << GetLastErrorAsWString();
+        return ss.str();
+    }
+    return std::wstring();
+}
+
+bool DbgHelpBackend::FindSymbol(Module& module, uint64_t offset, Symbol& symbol)
+{
+    auto& m = static_cast<DbgHelpModule&>(module);
+
+    DWORD64 displacement = 0;
+    auto si = QuerySymbol([&](SYMBOL_INFOW* si) {
+        return SymFromAddrW(m_hDbgHelp, m.m_allocatedMemAddr + offset, &displacement, si);
+        });
+    if (si == nullptr)
+        return false;
+
+    symbol.offset = si->Address - m.m_allocatedMemAddr;
+    symbol.size = si->Size;
+    symbol.name.assign(si->Name, std::min<size_t>(si->NameLen, si->MaxNameLen));
+    return true;
+}
+
+bool DbgHelpBackend::FindLine(Module& module, uint64_t offset, Line& line)
+{
+    auto& m = static_cast<DbgHelpModule&>(module);
+
+    DWORD displacement = 0;
+    IMAGEHLP_LINEW64 lineInfo = { sizeof(IMAGEHLP_LINEW64) , };
+    if (!SymGetLineFromAddrW64(m_hDbgHelp, m.m_allocatedMemAddr + offset, &displacement, &lineInfo)) {
+        // A PDB which doesn't have line info.
+        return false;
+    }
+
+    line.fileName = lineInfo.FileName;
+    line.lineNo = lineInfo.LineNumber;
+    line.offset = lineInfo.Address - m.m_allocatedMemAddr;
+    line.end = 0;
+    return true;
+}
+
+bool DbgHelpBackend::HasInlineFrames(Module& module, uint64_t offset)
+{
+    auto& m = static_cast<DbgHelpModule&>(module);
+    return SymAddrIncludeInlineTrace(m_hDbgHelp, m.m_allocatedMemAddr + offset) != 0;
+}
+
+bool DbgHelpBackend::FindInlineFrames(Module& module, uint64_t offset, std::vector<InlineFrame>& frames, std::optional<Line>& callSite)
+{
+    auto& m = static_cast<DbgHelpModule&>(module);
+
+    frames.clear();
+    callSite.reset();
+
+    const DWORD64 targetAddr = m.m_allocatedMemAddr + offset;
+    DWORD numInlines = SymAddrIncludeInlineTrace(m_hDbgHelp, targetAddr);
+    if (numInlines == 0)
+        return false;
+
+    DWORD inlineContext = 0, frameIdx = 0;
+    if (!SymQueryInlineTrace(m_hDbgHelp, targetAddr, 0, targetAddr, targetAddr, &inlineContext, &frameIdx))
+        return false;
+
+    // Contexts are consecutive from the innermost inlinee to the physical function.
+    for (DWORD i = 0; i <= numInlines; ++i, ++inlineContext) {
+        DWORD lineDisplacement = 0;
+        IMAGEHLP_LINEW64 lineInfo = { sizeof(IMAGEHLP_LINEW64) , };
+        bool hasLine = SymGetLineFromInlineContextW(m_hDbgHelp, targetAddr, inlineContext, 0, &lineDisplacement, &lineInfo);
+
+        std::optional<Line> line;
+        if (hasLine) {
+            line = Line{ lineInfo.FileName, (uint32_t)lineInfo.LineNumber, lineInfo.Address - m.m_allocatedMemAddr, 0 };
+        }
+
+        if (i == numInlines) {
+            // The call site in the physical function.
+            callSite = std::move(line);
+            break;
+        }
+
+        InlineFrame frame;
+        {
+            DWORD64 displacement = 0;
+            auto symbol = QuerySymbol([&](SYMBOL_INFOW* si) {
+                return SymFromInlineContextW(m_hDbgHelp, targetAddr, inlineContext, &displacement, si);
+                });
+            if (symbol != nullptr) {
+                frame.name.assign(symbol->Name, std::min<size_t>(symbol->NameLen, symbol->MaxNameLen));
+            }
+        }
+        if (line.has_value() && i == 0) {
+            // The line record of the innermost inlinee bounds the range.
+            IMAGEHLP_LINEW64 nextLine = lineInfo;
+            if (SymGetLineNextW64(m_hDbgHelp, &nextLine) && nextLine.Address > targetAddr) {
+                line->end = nextLine.Address - m.m_allocatedMemAddr;
+            }
+        }
+        frame.line = std::move(line);
+        frames.push_back(std::move(frame));
+    }
+
+    return true;
+}
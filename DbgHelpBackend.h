@@ -0,0 +1,62 @@
+#pragma once
+#include <Windows.h>
+#include <DbgHelp.h>
+
+#include <vector>
+
+#include "SymbolBackend.h"
+
+// Symbols read by dbghelp. A PDB without its image is loaded at the address of a memory block, so that
+// the addresses of its modules don't overlap.
+class DbgHelpBackend : public SymbolBackend
+{
+public:
+	class DbgHelpModule : public Module {
+	public:
+		uintptr_t               m_allocatedMemAddr = 0;
+		size_t                  m_allocatedMemSize = 0;
+
+		~DbgHelpModule() override;
+	};
+
+	HANDLE                  m_hDbgHelp = 0;
+	uintptr_t               m_allocatedMemAddr = 0; // dummy memory space used when mapping a PDB.
+	static const size_t     m_allocatedMemSize = 2048u * 1024u * 1024u; // 2GB
+	static const size_t     m_maxSymbolNameLen = 256u * 1024u; // in characters.
+	std::vector<uint8_t>    m_symbolBuffer; // SYMBOL_INFOW and its name.
+
+public:
+	std::wstring Init() override;
+	std::wstring Finalize() override;
+	std::wstring ReadImageSignature(const std::filesystem::path& imagePath, std::wstring& pdbName, GUID& guid, uint32_t& age, size_t& imageSize) override;
+	std::wstring LoadModule(const std::filesystem::path& pdbPath, bool publicsOnly, bool lines, std::unique_ptr<Module>& module) override;
+	std::wstring ReloadModule(Module& module, bool publicsOnly, bool lines) override;
+	std::wstring UnloadModule(Module& module) override;
+	bool FindSymbol(Module& module, uint64_t offset, Symbol& symbol) override;
+	bool FindLine(Module& module, uint64_t offset, Line& line) override;
+	bool HasInlineFrames(Module& module, uint64_t offset) override;
+	bool FindInlineFrames(Module& module, uint64_t offset, std::vector<InlineFrame>& frames, std::optional<Line>& callSite) override;
+
+	// Which symbols SymLoadModuleExW reads. dbghelp takes it from the global options at each load.
+	static void SetLoadOptions(bool publicsOnly, bool lines);
+
+	// Call SymFromAddrW or SymFromInlineContextW with a buffer which grows until the whole name fits.
+	// Returns nullptr when the query failed.
+	template<typename F>
+	const SYMBOL_INFOW* QuerySymbol(F&& query)
+	{
+		size_t maxNameLen = MAX_SYM_NAME;
+		for (;;) {
+			m_symbolBuffer.assign(sizeof(SYMBOL_INFOW) + maxNameLen * sizeof(wchar_t), 0);
+			auto* symbol = reinterpret_cast<SYMBOL_INFOW*>(m_symbolBuffer.data());
+			symbol->SizeOfStruct = sizeof(SYMBOL_INFOW);
+			symbol->MaxNameLen = (ULONG)maxNameLen;
+
+			if (!query(symbol))
+				return nullptr;
+			if (symbol->NameLen + 1 < maxNameLen || maxNameLen >= m_maxSymbolNameLen)
+				return symbol;
+			maxNameLen *= 4;
+		}
+	}
+};
@@ -1,3 +1,4 @@
+#include <Windows.h>
 #include <winrt/Windows.Foundation.h>
 #include <winrt/Windows.Foundation.Collections.h>
 #include <winrt/Windows.Storage.Streams.h>
@@ -7,15 +8,166 @@
 #include<iostream>
 #include<fstream>
 #include<sstream>
+#include<optional>
 
 #include "HttpGet.h"
+#include "Log.h"
+#include "Stats.h"
+#include "Trace.h"
 
 using namespace winrt;
 using namespace Windows::Foundation;
 using namespace Windows::Storage::Streams;
 using namespace Windows::Web::Http;
 
-std::wstring HttpGet::Get(const std::wstring& url, const std::filesystem::path& dest, std::wostream &verboseOut)
+namespace {
+    constexpr uint32_t maxAttempts = 4;
+    constexpr uint32_t readChunkSize = 1024u * 1024u;
+    constexpr uint32_t progressSteps = 10; // progress messages per download.
+
+    std::filesystem::path PartialPath(const std::filesystem::path& dest)
+    {
+        std::filesystem::path p = dest;
+        p += L".partial";
+        return p;
+    }
+
+    uint64_t PartialSize(const std::filesystem::path& partialPath)
+    {
+        std::error_code ec;
+        if (!std::filesystem::is_regular_file(partialPath, ec))
+            return 0;
+        auto siz = std::filesystem::file_size(partialPath, ec);
+        return ec ? 0 : siz;
+    }
+
+    // Send one GET request and write the body into the partial file.
+    // "done" is set when the body has been received completely. "restart" is set when the partial file was
+    // dropped because the server answered a range which doesn't continue it.
+    std::wstring Fetch(HttpClient& httpClient, const Uri& requestUri, const std::filesystem::path& partialPath, bool& done, bool& restart)
+    {
+        done = false;
+        restart = false;
+        uint64_t resumeFrom = PartialSize(partialPath);
+
+        HttpRequestMessage request(HttpMethod::Get(), requestUri);
+        if (resumeFrom > 0) {
+            std::wstringstream ss;
+            ss << L"bytes=" << resumeFrom << L"-";
+            request.Headers().TryAppendWithoutValidation(L"Range", ss.str());
+            Log::Info([&](Log::Message& m) { m << L"Resuming from " << resumeFrom / 1024 << L"(KB)."; });
+        }
+
+        HttpResponseMessage httpResponseMessage = httpClient.SendRequestAsync(request, HttpCompletionOption::ResponseHeadersRead).get();
+
+        std::ios::openmode mode = std::ios::out | std::ios::binary;
+        switch (httpResponseMessage.StatusCode()) {
+        case HttpStatusCode::PartialContent:
+        {
+            // Appending is right only when the body starts where the partial file ends.
+            std::optional<uint64_t> first;
+            auto contentRange = httpResponseMessage.Content().Headers().ContentRange();
+            if (contentRange && contentRange.FirstBytePosition()) {
+                first = contentRange.FirstBytePosition().Value();
+            }
+            if (first == resumeFrom) {
+                mode |= std::ios::app;
+                break;
+            }
+            if (first == 0) {
+                mode |= std::ios::trunc;
+                resumeFrom = 0;
+                break;
+            }
+
+            std::error_code ec;
+            std::filesystem::remove(partialPath, ec);
+            restart = true;
+
+            std::wstringstream ss;
+            ss << L"Content-Range ";
+            if (first.has_value())
+                ss << L"starting at " << first.value();
+            else
+                ss << L"missing";
+            ss << L" for a request from " << resumeFrom << L". Starting over.";
+            return ss.str();
+        }
+        case HttpStatusCode::Ok:
+            // The server ignored the Range header. Start over.
+            mode |= std::ios::trunc;
+            resumeFrom = 0;
+            break;
+        case HttpStatusCode::RequestedRangeNotSatisfiable:
+            // The partial file already has the whole body. The validator will tell if it is not.
+            done = true;
+            return std::wstring();
+        default:
+            httpResponseMessage.EnsureSuccessStatusCode();
+            {
+                std::wstringstream ss;
+                ss << L"Unexpected HTTP status " << (int)httpResponseMessage.StatusCode() << L".";
+                return ss.str();
+            }
+        }
+
+        uint64_t total = 0;
+        {
+            auto contentLength = httpResponseMessage.Content().Headers().ContentLength();
+            if (contentLength) {
+                total = resumeFrom + contentLength.Value();
+            }
+        }
+
+        std::ofstream fs(partialPath, mode);
+        if (!fs) {
+            std::wstringstream ss;
+            ss << L"Failed to open file to wirte: \"" << partialPath.wstring() << "\".";
+            return ss.str();
+        }
+
+        // Write each chunk as it arrives, so that a dropped connection leaves a resumable file.
+        IInputStream bodyStream = httpResponseMessage.Content().ReadAsInputStreamAsync().get();
+        Buffer buf(readChunkSize);
+        uint64_t received = resumeFrom;
+        uint32_t progressStep = 0;
+        for (;;) {
+            IBuffer chunk = bodyStream.ReadAsync(buf, buf.Capacity(), InputStreamOptions::Partial).get();
+            if (chunk.Length() == 0)
+                break;
+
+            fs.write(reinterpret_cast<const char*>(chunk.data()), chunk.Length());
+            if (!fs) {
+                std::wstringstream ss;
+                ss << L"Failed to write file: \"" << partialPath.wstring() << "\".";
+                return ss.str();
+            }
+            received += chunk.Length();
+            Stats::AddCount(L"http_get.bytes", chunk.Length());
+            Trace::Counter(L"http_get.received_bytes", partialPath.filename().native(), received);
+
+            if (total > 0 && Log::Enabled(Log::Level::Debug)) {
+                uint32_t step = (uint32_t)(received * progressSteps / total);
+                if (step > progressStep) {
+                    progressStep = step;
+                    Log::Debug([&](Log::Message& m) { m << L"Received Bytes: " << received / 1024 << L"(KB): " << (float)received * 100.f / (float)total << L"%"; });
+                }
+            }
+        }
+        fs.close();
+
+        if (total > 0 && received < total) {
+            std::wstringstream ss;
+            ss << L"Connection closed after " << received << L" of " << total << L" bytes.";
+            return ss.str();
+        }
+
+        done = true;
+        return std::wstring();
+    }
+};
+
+std::wstring HttpGet::Get(const std::wstring& url, const std::filesystem::path& dest, const Validator& validator)
 {
     Windows::Web::Http::HttpClient httpClient;
 
@@ -35,59 +187,79 @@ std::wstring HttpGet::Get(const std::wstring& url, const std::filesystem::path&
         return ss.str();
     }
 
-    Windows::Web::Http::HttpResponseMessage httpResponseMessage;
-    std::wstring httpResponseBody;
+    {
+        auto parentPath = dest.parent_path();
+        if (! std::filesystem::exists(parentPath)) {
+            std::filesystem::create_directories(parentPath);
+        }
+    }
 
+    const std::filesystem::path partialPath = PartialPath(dest);
     Uri requestUri{ url.c_str() };
-    IBuffer bodyBuf;
-    try {
-        // Send the GET request.
-        auto getAsync = httpClient.GetAsync(requestUri);
-        getAsync.Progress(
-            [&verboseOut](
-                IAsyncOperationWithProgress<HttpResponseMessage,
-                HttpProgress> const& /* sender */,
-                HttpProgress const& args)
-            {
-                if (args.BytesReceived > 16) {
-                    uint64_t siz = args.TotalBytesToReceive.GetUInt64();
-                    float progress = siz > 0 ? (float)args.BytesReceived / (float)siz : 0.f;
-
-                    verboseOut <<  L"\rReceived Bytes: " << args.BytesReceived / 1024 << "(KB): " << progress * 100.f << "%              " << std::flush;
-                }
-            });
 
-        httpResponseMessage = getAsync.get();
-        verboseOut << std::endl;
+    Stats::Scope stats(L"http_get");
+    Trace::Span span(L"http_get", L"download");
+    span.Arg(L"url", url);
+    std::wstring lastErrStr;
+    bool done = false;
+    bool restart = false;
+    for (uint32_t attempt = 0; attempt < maxAttempts && !done; ++attempt) {
+        uint64_t before = PartialSize(partialPath);
+        Stats::AddCount(L"http_get.requests");
+        try {
+            lastErrStr = Fetch(httpClient, requestUri, partialPath, done, restart);
+        }
+        catch (winrt::hresult_error const& ex) {
+            std::wstringstream ss;
+            ss << L"Catched an exception during HTTP get request: " << std::wstring(ex.message());
+            lastErrStr = ss.str();
+            done = false;
+            restart = false;
+        }
 
-        httpResponseMessage.EnsureSuccessStatusCode();
+        if (!done) {
+            Log::Warning([&](Log::Message& m) { m << L"[HttpGet] " << lastErrStr; m.Field(L"attempt", attempt + 1); });
 
-        bodyBuf = httpResponseMessage.Content().ReadAsBufferAsync().get();
+            // Don't retry when nothing has arrived. i.e. 404
+            if (!restart && PartialSize(partialPath) <= before) {
+                break;
+            }
+        }
     }
-    catch (winrt::hresult_error const& ex) {
-        httpResponseBody = ex.message();
-        std::wstringstream ss;
-        ss << L"Catched an exception during HTTP get request: " << httpResponseBody;
-        return ss.str();
+
+    stats.End();
+    span.Arg(L"bytes", PartialSize(partialPath));
+    span.End();
+
+    if (!done) {
+        Stats::AddCount(L"http_get.failures");
+        return lastErrStr;
     }
 
-     verboseOut << L"Received binary size: " << bodyBuf.Length() << std::endl;
-     verboseOut << L"Writing cache file %s\n" << dest.wstring() << std::endl;
+    Log::Info([&](Log::Message& m) { m << L"Received binary size: " << PartialSize(partialPath); });
 
-    {
-        auto parentPath = dest.parent_path();
-        if (! std::filesystem::exists(parentPath)) {
-            std::filesystem::create_directories(parentPath);
-        }
+    if (validator) {
+        auto errStr = validator(partialPath);
+        if (!errStr.empty()) {
+            // A corrupted body can't be resumed. Start from scratch next time.
+            std::error_code ec;
+            std::filesystem::remove(partialPath, ec);
 
-        std::ofstream fs(dest, std::ios::out | std::ios::binary | std::ios::app);
-        if (!fs) {
             std::wstringstream ss;
-            ss << L"Failed to open file to wirte: \"" << dest.wstring() << "\".";;
+            ss << L"Downloaded file was rejected. " << errStr;
             return ss.str();
         }
-        fs.write(reinterpret_cast<const char*>(bodyBuf.data()), bodyBuf.Length());
-        fs.close();
+    }
+
+    Log::Info([&](Log::Message& m) { m << L"Writing cache file " << dest.wstring(); });
+
+    // Publish atomically. Readers never see a partially written file in the cache. An entry which failed the
+    // validation is replaced. A reader which opened it with FILE_SHARE_DELETE keeps the old file. While another
+    // reader holds it, the rename fails and a later search downloads it again.
+    if (!MoveFileExW(partialPath.wstring().c_str(), dest.wstring().c_str(), MOVEFILE_REPLACE_EXISTING)) {
+        std::wstringstream ss;
+        ss << L"Failed to rename \"" << partialPath.wstring() << L"\" to \"" << dest.wstring() << "\". Error code: " << GetLastError();
+        return ss.str();
     }
 
     return std::wstring();
@@ -1,11 +1,16 @@
 #pragma once
 #include <string>
 #include <filesystem>
-#include <iostream>
+#include <functional>
 
 class HttpGet
 {
 public:
-	static std::wstring Get(const std::wstring& url, const std::filesystem::path& dest, std::wostream &verboseOut);
+	// Returns an empty string when the downloaded file is acceptable.
+	using Validator = std::function<std::wstring(const std::filesystem::path&)>;
+
+	// Download into "dest.partial" and rename it to "dest" after the validation, replacing a file at "dest".
+	// An interrupted download is resumed with a Range request from the partial file.
+	static std::wstring Get(const std::wstring& url, const std::filesystem::path& dest, const Validator& validator = nullptr);
 
 };
\ No newline at end of file
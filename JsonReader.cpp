@@ -0,0 +1,407 @@
+#include <string>
+#include <vector>
+#include <sstream>
+
+#include "JsonReader.h"
+
+std::wstring JsonReader::Parse(std::istream& is, Handler& handler)
+{
+    m_is = &is;
+    m_buffer.resize(s_bufferSize);
+    m_pos = m_end = 0;
+    m_eof = false;
+    m_offset = 0;
+    m_line = m_column = 1;
+    m_tokenLine = m_tokenColumn = 1;
+
+    enum class Scope : uint8_t {
+        Object,
+        Array,
+    };
+    enum class Expect {
+        Value,
+        FirstValue, // or the end of an empty array.
+        Key,
+        FirstKey,   // or the end of an empty object.
+        Separator,  // ',' or the end of the container.
+    };
+
+    std::vector<Scope> scopes;
+    Expect expect = Expect::Value;
+
+    auto call = [&](std::wstring&& errStr) -> std::wstring {
+        if (errStr.empty())
+            return errStr;
+        return Error(errStr);
+        };
+
+    for (;;) {
+        SkipWhitespace();
+        MarkToken();
+        const int c = Peek();
+
+        if (expect == Expect::Separator) {
+            if (scopes.empty()) {
+                if (c != -1)
+                    return Error(L"Unexpected data after the root value.");
+                return std::wstring();
+            }
+            if (c == ',') {
+                Get();
+                expect = scopes.back() == Scope::Object ? Expect::Key : Expect::Value;
+                continue;
+            }
+            if (scopes.back() == Scope::Object && c == '}') {
+                Get();
+                scopes.pop_back();
+                if (auto errStr = call(handler.EndObject()); !errStr.empty())
+                    return errStr;
+                continue;
+            }
+            if (scopes.back() == Scope::Array && c == ']') {
+                Get();
+                scopes.pop_back();
+                if (auto errStr = call(handler.EndArray()); !errStr.empty())
+                    return errStr;
+                continue;
+            }
+            return Error(scopes.back() == Scope::Object ? L"Expected ',' or '}'." : L"Expected ',' or ']'.");
+        }
+
+        if (expect == Expect::Key || expect == Expect::FirstKey) {
+            if (expect == Expect::FirstKey && c == '}') {
+                Get();
+                scopes.pop_back();
+                if (auto errStr = call(handler.EndObject()); !errStr.empty())
+                    return errStr;
+                expect = Expect::Separator;
+                continue;
+            }
+            if (c != '"')
+                return Error(L"Expected a string as the key of a member.");
+            if (auto errStr = ReadString(m_string); !errStr.empty())
+                return errStr;
+            if (auto errStr = call(handler.Key(m_string)); !errStr.empty())
+                return errStr;
+
+            SkipWhitespace();
+            MarkToken();
+            if (Get() != ':')
+                return Error(L"Expected ':' after the key of a member.");
+            expect = Expect::Value;
+            continue;
+        }
+
+        if (expect == Expect::FirstValue && c == ']') {
+            Get();
+            scopes.pop_back();
+            if (auto errStr = call(handler.EndArray()); !errStr.empty())
+                return errStr;
+            expect = Expect::Separator;
+            continue;
+        }
+
+        // A value.
+        std::wstring errStr;
+        switch (c) {
+        case '{':
+        case '[':
+            if (scopes.size() >= s_maxDepth)
+                return Error(L"Too deeply nested.");
+            Get();
+            if (c == '{') {
+                scopes.push_back(Scope::Object);
+                expect = Expect::FirstKey;
+                errStr = call(handler.StartObject());
+            }
+            else {
+                scopes.push_back(Scope::Array);
+                expect = Expect::FirstValue;
+                errStr = call(handler.StartArray());
+            }
+            if (!errStr.empty())
+                return errStr;
+            continue;
+        case '"':
+            errStr = ReadString(m_string);
+            if (errStr.empty()) {
+                errStr = call(handler.String(m_string));
+            }
+            break;
+        case 't':
+            errStr = ReadLiteral("true");
+            if (errStr.empty()) {
+                errStr = call(handler.Bool(true));
+            }
+            break;
+        case 'f':
+            errStr = ReadLiteral("false");
+            if (errStr.empty()) {
+                errStr = call(handler.Bool(false));
+            }
+            break;
+        case 'n':
+            errStr = ReadLiteral("null");
+            if (errStr.empty()) {
+                errStr = call(handler.Null());
+            }
+            break;
+        case -1:
+            return Error(L"Unexpected end of the input.");
+        default:
+            if (c != '-' && (c < '0' || c > '9'))
+                return Error(L"Unexpected character.");
+            errStr = ReadNumber(m_number);
+            if (errStr.empty()) {
+                errStr = call(handler.Number(m_number));
+            }
+            break;
+        }
+        if (!errStr.empty())
+            return errStr;
+        expect = Expect::Separator;
+    }
+}
+
+std::wstring JsonReader::Error(std::wstring_view message) const
+{
+    std::wstringstream ss;
+    ss << message << L" (line " << m_tokenLine << L", column " << m_tokenColumn << L")";
+    return ss.str();
+}
+
+bool JsonReader::Fill()
+{
+    if (m_eof)
+        return false;
+
+    m_is->read(m_buffer.data(), (std::streamsize)m_buffer.size());
+    m_pos = 0;
+    m_end = (size_t)m_is->gcount();
+    if (m_end == 0) {
+        m_eof = true;
+        return false;
+    }
+    return true;
+}
+
+int JsonReader::Peek()
+{
+    if (m_pos == m_end && !Fill())
+        return -1;
+    return (uint8_t)m_buffer[m_pos];
+}
+
+int JsonReader::Get()
+{
+    if (m_pos == m_end && !Fill())
+        return -1;
+
+    const int c = (uint8_t)m_buffer[m_pos++];
+    ++m_offset;
+    if (c == '\n') {
+        ++m_line;
+        m_column = 1;
+    }
+    else {
+        ++m_column;
+    }
+    return c;
+}
+
+void JsonReader::SkipWhitespace()
+{
+    for (;;) {
+        const int c = Peek();
+        if (c != ' ' && c != '\t' && c != '\n' && c != '\r')
+            return;
+        Get();
+    }
+}
+
+void JsonReader::MarkToken()
+{
+    m_tokenLine = m_line;
+    m_tokenColumn = m_column;
+}
+
+std::wstring JsonReader::ReadString(std::wstring& dst)
+{
+    dst.clear();
+    Get(); // '"'
+
+    auto hex4 = [&](uint32_t& v) -> bool {
+        v = 0;
+        for (int i = 0; i < 4; ++i) {
+            const int c = Get();
+            v <<= 4;
+            if (c >= '0' && c <= '9')
+                v |= c - '0';
+            else if (c >= 'a' && c <= 'f')
+                v |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F')
+                v |= c - 'A' + 10;
+            else
+                return false;
+        }
+        return true;
+        };
+
+    for (;;) {
+        // Runs of plain ASCII are copied from the buffer without going through Get().
+        {
+            size_t i = m_pos;
+            while (i < m_end) {
+                const uint8_t c = (uint8_t)m_buffer[i];
+                if (c < 0x20 || c >= 0x80 || c == '"' || c == '\\')
+                    break;
+                ++i;
+            }
+            if (i != m_pos) {
+                dst.append(m_buffer.begin() + m_pos, m_buffer.begin() + i);
+                m_offset += i - m_pos;
+                m_column += i - m_pos;
+                m_pos = i;
+            }
+        }
+
+        const int c = Get();
+        if (c == '"')
+            return std::wstring();
+        if (c == -1)
+            return Error(L"Unterminated string.");
+        if (c < 0x20)
+            return Error(L"Control character in a string.");
+
+        if (c == '\\') {
+            const int e = Get();
+            switch (e) {
+            case '"':   dst.push_back(L'"'); break;
+            case '\\':  dst.push_back(L'\\'); break;
+            case '/':   dst.push_back(L'/'); break;
+            case 'b':   dst.push_back(L'\b'); break;
+            case 'f':   dst.push_back(L'\f'); break;
+            case 'n':   dst.push_back(L'\n'); break;
+            case 'r':   dst.push_back(L'\r'); break;
+            case 't':   dst.push_back(L'\t'); break;
+            case 'u': {
+                uint32_t cp = 0;
+                if (!hex4(cp))
+                    return Error(L"Invalid \\u escape in a string.");
+                if (cp >= 0xDC00 && cp <= 0xDFFF)
+                    return Error(L"Invalid surrogate pair in a string.");
+                if (cp >= 0xD800 && cp <= 0xDBFF) {
+                    uint32_t low = 0;
+                    if (Get() != '\\' || Get() != 'u' || !hex4(low) || low < 0xDC00 || low > 0xDFFF)
+                        return Error(L"Invalid surrogate pair in a string.");
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                }
+                AppendCodePoint(dst, cp);
+                break;
+            }
+            default:
+                return Error(L"Invalid escape in a string.");
+            }
+            continue;
+        }
+
+        // UTF-8. An invalid sequence becomes U+FFFD, as MultiByteToWideChar does.
+        uint32_t cp = 0;
+        int following = 0;
+        if (c >= 0xC2 && c <= 0xDF) {
+            cp = c & 0x1F;
+            following = 1;
+        }
+        else if (c >= 0xE0 && c <= 0xEF) {
+            cp = c & 0x0F;
+            following = 2;
+        }
+        else if (c >= 0xF0 && c <= 0xF4) {
+            cp = c & 0x07;
+            following = 3;
+        }
+        else {
+            AppendCodePoint(dst, 0xFFFD);
+            continue;
+        }
+
+        bool valid = true;
+        for (int i = 0; i < following; ++i) {
+            const int t = Peek();
+            if (t < 0x80 || t > 0xBF) {
+                valid = false;
+                break;
+            }
+            Get();
+            cp = (cp << 6) | (t & 0x3F);
+        }
+        const bool overlong = (following == 2 && cp < 0x800) || (following == 3 && cp < 0x10000);
+        if (!valid || overlong || (cp >= 0xD800 && cp <= 0xDFFF) || cp > 0x10FFFF) {
+            cp = 0xFFFD;
+        }
+        AppendCodePoint(dst, cp);
+    }
+}
+
+std::wstring JsonReader::ReadNumber(std::string& dst)
+{
+    dst.clear();
+
+    auto digits = [&]() -> bool {
+        const int c = Peek();
+        if (c < '0' || c > '9')
+            return false;
+        while (Peek() >= '0' && Peek() <= '9') {
+            dst.push_back((char)Get());
+        }
+        return true;
+        };
+
+    if (Peek() == '-') {
+        dst.push_back((char)Get());
+    }
+    if (Peek() == '0') {
+        dst.push_back((char)Get());
+    }
+    else if (!digits()) {
+        return Error(L"Invalid number.");
+    }
+    if (Peek() == '.') {
+        dst.push_back((char)Get());
+        if (!digits())
+            return Error(L"Invalid number.");
+    }
+    if (Peek() == 'e' || Peek() == 'E') {
+        dst.push_back((char)Get());
+        if (Peek() == '+' || Peek() == '-') {
+            dst.push_back((char)Get());
+        }
+        if (!digits())
+            return Error(L"Invalid number.");
+    }
+
+    return std::wstring();
+}
+
+std::wstring JsonReader::ReadLiteral(std::string_view literal)
+{
+    for (char l : literal) {
+        if (Get() != l) {
+            std::wstringstream ss;
+            ss << L"Invalid literal. Expected \"" << std::wstring(literal.begin(), literal.end()) << L"\".";
+            return Error(ss.str());
+        }
+    }
+    return std::wstring();
+}
+
+void JsonReader::AppendCodePoint(std::wstring& dst, uint32_t cp)
+{
+    if (sizeof(wchar_t) == 2 && cp >= 0x10000) {
+        cp -= 0x10000;
+        dst.push_back((wchar_t)(0xD800 + (cp >> 10)));
+        dst.push_back((wchar_t)(0xDC00 + (cp & 0x3FF)));
+        return;
+    }
+    dst.push_back((wchar_t)cp);
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <istream>
+
+// Streaming JSON reader. The input is read in blocks and each value is reported to a Handler as soon as
+// it is parsed, so no tree of the document is built and the memory doesn't grow with the input.
+// Strings are decoded from UTF-8 straight into UTF-16, into a buffer which is reused for every string.
+//
+// Errors end the parse with their position, "line" and "column" from 1. Columns count bytes.
+class JsonReader
+{
+public:
+	// Each call returns an error to stop the parse, or an empty string to go on. The error is given the
+	// position. Members of an object are reported as Key() followed by the events of the value. The strings
+	// are valid during the call only.
+	class Handler {
+	public:
+		virtual ~Handler() = default;
+
+		virtual std::wstring StartObject() { return std::wstring(); }
+		virtual std::wstring Key(const std::wstring& key) { return std::wstring(); }
+		virtual std::wstring EndObject() { return std::wstring(); }
+		virtual std::wstring StartArray() { return std::wstring(); }
+		virtual std::wstring EndArray() { return std::wstring(); }
+		virtual std::wstring String(const std::wstring& value) { return std::wstring(); }
+		virtual std::wstring Number(std::string_view text) { return std::wstring(); } // as written in the input.
+		virtual std::wstring Bool(bool value) { return std::wstring(); }
+		virtual std::wstring Null() { return std::wstring(); }
+	};
+
+	static constexpr size_t     s_bufferSize = 1u << 20;
+	static constexpr size_t     s_maxDepth = 1024; // of nested objects and arrays.
+
+	std::istream*               m_is = nullptr;
+	std::vector<char>           m_buffer;
+	size_t                      m_pos = 0;
+	size_t                      m_end = 0;
+	bool                        m_eof = false;
+	uint64_t                    m_offset = 0; // bytes consumed so far.
+	uint64_t                    m_line = 1; // of the next byte.
+	uint64_t                    m_column = 1;
+	uint64_t                    m_tokenLine = 1; // where the last token started. Errors are reported here.
+	uint64_t                    m_tokenColumn = 1;
+	std::wstring                m_string; // reused for every string and key.
+	std::string                 m_number;
+
+public:
+	// Parse one JSON value, the whole stream. Trailing data other than whitespace is an error.
+	std::wstring Parse(std::istream& is, Handler& handler);
+
+	// "message" with the position of the last token.
+	std::wstring Error(std::wstring_view message) const;
+
+	// Used by Parse(). Peek() and Get() return -1 at the end of the input.
+	bool Fill();
+	int Peek();
+	int Get();
+	void SkipWhitespace();
+	void MarkToken();
+	std::wstring ReadString(std::wstring& dst);
+	std::wstring ReadNumber(std::string& dst);
+	std::wstring ReadLiteral(std::string_view literal);
+	static void AppendCodePoint(std::wstring& dst, uint32_t cp);
+};
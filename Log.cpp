@@ -0,0 +1,59 @@
+#include <iostream>
+
+#include "Log.h"
+
+std::atomic<Log::Level>             Log::s_level = Log::Level::Off;
+std::mutex                          Log::s_mutex;
+thread_local Log::Capture*          Log::s_capture = nullptr;
+
+Log::Capture::Capture() :
+    m_prev(s_capture)
+{
+    s_capture = this;
+}
+
+Log::Capture::~Capture()
+{
+    s_capture = m_prev;
+}
+
+std::optional<Log::Level> Log::ParseLevel(std::wstring_view name)
+{
+    constexpr std::pair<std::wstring_view, Level> levels[] = {
+        { L"error", Level::Error },
+        { L"warning", Level::Warning },
+        { L"info", Level::Info },
+        { L"debug", Level::Debug },
+    };
+    for (const auto& [n, level] : levels) {
+        if (n == name)
+            return level;
+    }
+    return std::nullopt;
+}
+
+void Log::WriteLine(const std::wstring& line)
+{
+    if (s_capture != nullptr) {
+        s_capture->m_text += line;
+        s_capture->m_text += L'\n';
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(s_mutex);
+    std::wcerr << line << L'\n';
+}
+
+void Log::WriteCaptured(const std::wstring& text)
+{
+    if (text.empty())
+        return;
+
+    if (s_capture != nullptr) {
+        s_capture->m_text += text;
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(s_mutex);
+    std::wcerr << text << std::flush;
+}
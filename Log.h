@@ -0,0 +1,91 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <sstream>
+#include <optional>
+#include <atomic>
+#include <mutex>
+#include <utility>
+
+// Leveled messages enabled by "--verbose" or "--log-level". A message is built by a function which is
+// called only when its level is enabled, so a disabled log site costs one branch:
+//
+//     Log::Info([&](Log::Message& m) { m << L"Loading PDB.. " << path; m.Field(L"size", size); });
+//
+// Each message is one line on the standard error stream, so that it never mixes into the result written to
+// the standard output stream.
+class Log
+{
+public:
+	enum class Level : int {
+		Off,
+		Error,
+		Warning,
+		Info,
+		Debug,
+	};
+
+	class Message {
+	public:
+		std::wostringstream     m_text;
+
+		template<typename T>
+		Message& operator<<(const T& v)
+		{
+			m_text << v;
+			return *this;
+		}
+
+		// A structured field written as " key=value" after the text.
+		template<typename T>
+		Message& Field(const wchar_t* key, const T& value)
+		{
+			m_text << L' ' << key << L'=' << value;
+			return *this;
+		}
+	};
+
+	// Collects the messages of the constructing thread until the destruction, instead of writing them.
+	// Worker threads write the collected messages in one piece so that they don't interleave.
+	class Capture {
+	public:
+		std::wstring    m_text;
+		Capture*        m_prev = nullptr;
+
+		Capture();
+		Capture(const Capture&) = delete;
+		Capture& operator=(const Capture&) = delete;
+		~Capture();
+
+		std::wstring Take() { return std::exchange(m_text, std::wstring()); }
+	};
+
+	static std::atomic<Level>           s_level;
+	static std::mutex                   s_mutex;
+	static thread_local Capture*        s_capture;
+
+public:
+	static void SetLevel(Level level) { s_level.store(level, std::memory_order_relaxed); }
+	static bool Enabled(Level level) { return level <= s_level.load(std::memory_order_relaxed); }
+	// "error", "warning", "info" or "debug".
+	static std::optional<Level> ParseLevel(std::wstring_view name);
+
+	template<typename F>
+	static void Write(Level level, F&& build)
+	{
+		if (!Enabled(level))
+			return;
+		Message m;
+		build(m);
+		WriteLine(m.m_text.str());
+	}
+
+	template<typename F> static void Error(F&& build) { Write(Level::Error, std::forward<F>(build)); }
+	template<typename F> static void Warning(F&& build) { Write(Level::Warning, std::forward<F>(build)); }
+	template<typename F> static void Info(F&& build) { Write(Level::Info, std::forward<F>(build)); }
+	template<typename F> static void Debug(F&& build) { Write(Level::Debug, std::forward<F>(build)); }
+
+	static void WriteLine(const std::wstring& line);
+	// Write lines collected by a Capture.
+	static void WriteCaptured(const std::wstring& text);
+};
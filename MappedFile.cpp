@@ -0,0 +1,64 @@
+#include <sstream>
+
+#include "MappedFile.h"
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+std::wstring MappedFile::Open(const std::filesystem::path& path)
+{
+    Close();
+
+    m_hFile = CreateFileW(path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (m_hFile == INVALID_HANDLE_VALUE) {
+        std::wstringstream ss;
+        ss << L"Failed to open \"" << path.wstring() << L"\".";
+        return ss.str();
+    }
+
+    LARGE_INTEGER fileSize = {};
+    if (!GetFileSizeEx(m_hFile, &fileSize) || fileSize.QuadPart == 0) {
+        Close();
+        std::wstringstream ss;
+        ss << L"\"" << path.wstring() << L"\" was empty.";
+        return ss.str();
+    }
+
+    m_hMapping = CreateFileMappingW(m_hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (m_hMapping == NULL) {
+        Close();
+        std::wstringstream ss;
+        ss << L"Failed to map \"" << path.wstring() << L"\".";
+        return ss.str();
+    }
+
+    m_data = reinterpret_cast<const uint8_t*>(MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0));
+    if (m_data == nullptr) {
+        Close();
+        std::wstringstream ss;
+        ss << L"Failed to map \"" << path.wstring() << L"\".";
+        return ss.str();
+    }
+    m_size = (uint64_t)fileSize.QuadPart;
+
+    return std::wstring();
+}
+
+void MappedFile::Close()
+{
+    if (m_data != nullptr) {
+        UnmapViewOfFile(m_data);
+        m_data = nullptr;
+    }
+    if (m_hMapping != NULL) {
+        CloseHandle(m_hMapping);
+        m_hMapping = NULL;
+    }
+    if (m_hFile != INVALID_HANDLE_VALUE) {
+        CloseHandle(m_hFile);
+        m_hFile = INVALID_HANDLE_VALUE;
+    }
+    m_size = 0;
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <Windows.h>
+
+#include <string>
+#include <filesystem>
+
+// A read-only view of a whole file. Pages are read by the OS on first access, so a file of
+// several GB costs only the address space until its contents are used.
+class MappedFile
+{
+public:
+	HANDLE                              m_hFile = INVALID_HANDLE_VALUE;
+	HANDLE                              m_hMapping = NULL;
+	const uint8_t*                      m_data = nullptr;
+	uint64_t                            m_size = 0;
+
+public:
+	MappedFile() = default;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	~MappedFile();
+
+	std::wstring Open(const std::filesystem::path& path);
+	void Close();
+
+	const uint8_t* Data() const { return m_data; }
+	uint64_t Size() const { return m_size; }
+
+	// nullptr unless [offset, offset + size) is in the file.
+	const uint8_t* At(uint64_t offset, uint64_t size) const
+	{
+		if (offset > m_size || size > m_size - offset)
+			return nullptr;
+		return m_data + offset;
+	}
+};
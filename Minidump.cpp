@@ -0,0 +1,390 @@
+#include <sstream>
+#include <cstring>
+#include <algorithm>
+
+#include "Minidump.h"
+
+namespace {
+    // Stream types and record sizes of the minidump format.
+    constexpr uint32_t  eThreadListStream = 3;
+    constexpr uint32_t  eModuleListStream = 4;
+    constexpr uint32_t  eMemoryListStream = 5;
+    constexpr uint32_t  eSystemInfoStream = 7;
+    constexpr uint32_t  eMemory64ListStream = 9;
+
+    constexpr uint64_t  s_headerSize = 32;
+    constexpr uint64_t  s_directorySize = 12;
+    constexpr uint64_t  s_moduleSize = 108;
+    constexpr uint64_t  s_threadSize = 48;
+    constexpr uint64_t  s_memoryDescriptorSize = 16;
+    constexpr uint64_t  s_memoryDescriptor64Size = 16;
+
+    constexpr uint32_t  s_rsdsSignature = 0x53445352u; // "RSDS"
+
+    template<typename T>
+    bool Get(const MappedFile& f, uint64_t offset, T& v)
+    {
+        const uint8_t* p = f.At(offset, sizeof(T));
+        if (p == nullptr)
+            return false;
+        memcpy(&v, p, sizeof(T));
+        return true;
+    }
+
+    // Count of a list stream which starts with a 32 bit count. Some writers pad the count to 8 bytes.
+    bool ListEntries(const MappedFile& f, uint64_t rva, uint64_t size, uint64_t entrySize, uint32_t& count, uint64_t& first)
+    {
+        if (!Get(f, rva, count))
+            return false;
+        first = rva + 4;
+        if (size == 8 + (uint64_t)count * entrySize) {
+            first = rva + 8;
+        }
+        else if (size < 4 + (uint64_t)count * entrySize) {
+            return false;
+        }
+        return f.At(first, (uint64_t)count * entrySize) != nullptr;
+    }
+
+    std::wstring Utf8ToUtf16(const char* u8, size_t len)
+    {
+        if (len == 0)
+            return std::wstring();
+
+        int u16Len = MultiByteToWideChar(CP_UTF8, 0, u8, (int)len, NULL, 0);
+        std::wstring u16(u16Len, L'\0');
+        MultiByteToWideChar(CP_UTF8, 0, u8, (int)len, u16.data(), u16Len);
+        return u16;
+    }
+};
+
+std::wstring Minidump::Open(const std::filesystem::path& path)
+{
+    {
+        auto errStr = m_file.Open(path);
+        if (!errStr.empty())
+            return errStr;
+    }
+
+    uint32_t signature = 0, numStreams = 0, directoryRva = 0;
+    if (!Get(m_file, 0, signature) || signature != s_signature ||
+        !Get(m_file, 8, numStreams) || !Get(m_file, 12, directoryRva) ||
+        m_file.At(directoryRva, (uint64_t)numStreams * s_directorySize) == nullptr) {
+        std::wstringstream ss;
+        ss << L"\"" << path.wstring() << L"\" was not a minidump.";
+        return ss.str();
+    }
+
+    struct Stream {
+        uint32_t    type = 0;
+        uint32_t    size = 0;
+        uint32_t    rva = 0;
+    };
+    std::vector<Stream> streams(numStreams);
+    for (uint32_t i = 0; i < numStreams; ++i) {
+        uint64_t entry = directoryRva + i * s_directorySize;
+        Get(m_file, entry, streams[i].type);
+        Get(m_file, entry + 4, streams[i].size);
+        Get(m_file, entry + 8, streams[i].rva);
+    }
+
+    // The system info goes first. The layout of the thread contexts depends on the architecture.
+    const uint32_t order[] = { eSystemInfoStream, eModuleListStream, eMemoryListStream, eMemory64ListStream, eThreadListStream };
+    for (auto type : order) {
+        for (const auto& s : streams) {
+            if (s.type != type)
+                continue;
+
+            std::wstring errStr;
+            switch (type) {
+            case eSystemInfoStream:
+                errStr = ReadSystemInfo(s.rva, s.size);
+                break;
+            case eModuleListStream:
+                errStr = ReadModuleList(s.rva, s.size);
+                break;
+            case eMemoryListStream:
+                errStr = ReadMemoryList(s.rva, s.size);
+                break;
+            case eMemory64ListStream:
+                errStr = ReadMemory64List(s.rva, s.size);
+                break;
+            case eThreadListStream:
+                errStr = ReadThreadList(s.rva, s.size);
+                break;
+            }
+            if (!errStr.empty()) {
+                std::wstringstream ss;
+                ss << L"\"" << path.wstring() << L"\" was broken. " << errStr;
+                return ss.str();
+            }
+        }
+    }
+
+    std::sort(m_modules.begin(), m_modules.end(), [](const Module& a, const Module& b) { return a.m_base < b.m_base; });
+    std::sort(m_memory.begin(), m_memory.end(), [](const MemoryRange& a, const MemoryRange& b) { return a.m_start < b.m_start; });
+
+    return std::wstring();
+}
+
+std::wstring Minidump::ReadSystemInfo(uint64_t rva, uint64_t size)
+{
+    uint16_t arch = 0;
+    if (size < sizeof(arch) || !Get(m_file, rva, arch))
+        return L"Invalid system info stream.";
+
+    switch (arch) {
+    case 0:  m_arch = Arch::X86; break;
+    case 9:  m_arch = Arch::Amd64; break;
+    case 12: m_arch = Arch::Arm64; break;
+    default: m_arch = Arch::Unknown; break;
+    }
+    return std::wstring();
+}
+
+std::wstring Minidump::ReadModuleList(uint64_t rva, uint64_t size)
+{
+    uint32_t count = 0;
+    uint64_t first = 0;
+    if (!ListEntries(m_file, rva, size, s_moduleSize, count, first))
+        return L"Invalid module list stream.";
+
+    m_modules.reserve(m_modules.size() + count);
+    for (uint32_t i = 0; i < count; ++i) {
+        const uint64_t entry = first + i * s_moduleSize;
+        Module m;
+        uint32_t sizeOfImage = 0, nameRva = 0, cvSize = 0, cvRva = 0;
+        Get(m_file, entry, m.m_base);
+        Get(m_file, entry + 8, sizeOfImage);
+        Get(m_file, entry + 20, nameRva);
+        Get(m_file, entry + 76, cvSize);
+        Get(m_file, entry + 80, cvRva);
+        m.m_size = sizeOfImage;
+
+        // MINIDUMP_STRING, a length in bytes followed by UTF-16.
+        uint32_t nameBytes = 0;
+        if (Get(m_file, nameRva, nameBytes)) {
+            if (const uint8_t* p = m_file.At((uint64_t)nameRva + 4, nameBytes); p != nullptr) {
+                m.m_path.resize(nameBytes / sizeof(wchar_t));
+                memcpy(m.m_path.data(), p, m.m_path.size() * sizeof(wchar_t));
+            }
+        }
+
+        // CodeView record: "RSDS", GUID, age and the PDB name in UTF-8.
+        uint32_t cvSignature = 0;
+        if (cvSize >= 24 && Get(m_file, cvRva, cvSignature) && cvSignature == s_rsdsSignature) {
+            if (const uint8_t* p = m_file.At(cvRva, cvSize); p != nullptr) {
+                memcpy(&m.m_guid, p + 4, sizeof(GUID));
+                memcpy(&m.m_age, p + 20, sizeof(uint32_t));
+                const char* name = reinterpret_cast<const char*>(p + 24);
+                m.m_pdbName = Utf8ToUtf16(name, strnlen(name, cvSize - 24));
+                m.m_hasCodeView = true;
+            }
+        }
+
+        m_modules.push_back(std::move(m));
+    }
+    return std::wstring();
+}
+
+std::wstring Minidump::ReadMemoryList(uint64_t rva, uint64_t size)
+{
+    uint32_t count = 0;
+    uint64_t first = 0;
+    if (!ListEntries(m_file, rva, size, s_memoryDescriptorSize, count, first))
+        return L"Invalid memory list stream.";
+
+    m_memory.reserve(m_memory.size() + count);
+    for (uint32_t i = 0; i < count; ++i) {
+        const uint64_t entry = first + i * s_memoryDescriptorSize;
+        MemoryRange r;
+        uint32_t dataSize = 0, dataRva = 0;
+        Get(m_file, entry, r.m_start);
+        Get(m_file, entry + 8, dataSize);
+        Get(m_file, entry + 12, dataRva);
+        r.m_size = dataSize;
+        r.m_rva = dataRva;
+        if (m_file.At(r.m_rva, r.m_size) != nullptr) {
+            m_memory.push_back(r);
+        }
+    }
+    return std::wstring();
+}
+
+std::wstring Minidump::ReadMemory64List(uint64_t rva, uint64_t size)
+{
+    // Full dumps. The ranges are stored back to back from a single base.
+    uint64_t count = 0, dataRva = 0;
+    if (size < 16 || !Get(m_file, rva, count) || !Get(m_file, rva + 8, dataRva) ||
+        count > (size - 16) / s_memoryDescriptor64Size)
+        return L"Invalid memory64 list stream.";
+
+    m_memory.reserve(m_memory.size() + count);
+    for (uint64_t i = 0; i < count; ++i) {
+        const uint64_t entry = rva + 16 + i * s_memoryDescriptor64Size;
+        MemoryRange r;
+        Get(m_file, entry, r.m_start);
+        Get(m_file, entry + 8, r.m_size);
+        r.m_rva = dataRva;
+        if (m_file.At(r.m_rva, r.m_size) == nullptr)
+            break; // truncated dump.
+        m_memory.push_back(r);
+        dataRva += r.m_size;
+    }
+    return std::wstring();
+}
+
+std::wstring Minidump::ReadThreadList(uint64_t rva, uint64_t size)
+{
+    uint32_t count = 0;
+    uint64_t first = 0;
+    if (!ListEntries(m_file, rva, size, s_threadSize, count, first))
+        return L"Invalid thread list stream.";
+
+    m_threads.reserve(m_threads.size() + count);
+    for (uint32_t i = 0; i < count; ++i) {
+        const uint64_t entry = first + i * s_threadSize;
+        Thread t;
+        uint32_t stackSize = 0, stackRva = 0, contextSize = 0, contextRva = 0;
+        Get(m_file, entry, t.m_id);
+        Get(m_file, entry + 24, t.m_stackStart);
+        Get(m_file, entry + 32, stackSize);
+        Get(m_file, entry + 36, stackRva);
+        Get(m_file, entry + 40, contextSize);
+        Get(m_file, entry + 44, contextRva);
+        t.m_stackSize = stackSize;
+
+        if (!ReadContext(contextRva, contextSize, t))
+            continue;
+
+        // Full dumps may leave the stack to the memory64 list.
+        if (stackRva != 0 && m_file.At(stackRva, stackSize) != nullptr) {
+            m_memory.push_back({ t.m_stackStart, stackSize, stackRva });
+        }
+        m_threads.push_back(t);
+    }
+    return std::wstring();
+}
+
+bool Minidump::ReadContext(uint64_t rva, uint64_t size, Thread& thread) const
+{
+    // Offsets of the registers in CONTEXT of each architecture.
+    switch (m_arch) {
+    case Arch::Amd64:
+        if (size < 0x100 || m_file.At(rva + 0x78, sizeof(thread.m_registers)) == nullptr)
+            return false;
+        // Rax to R15 are consecutive from 0x78.
+        memcpy(thread.m_registers, m_file.At(rva + 0x78, sizeof(thread.m_registers)), sizeof(thread.m_registers));
+        thread.m_sp = thread.m_registers[4];
+        thread.m_fp = thread.m_registers[5];
+        return Get(m_file, rva + 0xF8, thread.m_ip);
+    case Arch::Arm64:
+        return size >= 0x110 &&
+            Get(m_file, rva + 0xF0, thread.m_fp) &&
+            Get(m_file, rva + 0x100, thread.m_sp) &&
+            Get(m_file, rva + 0x108, thread.m_ip);
+    case Arch::X86:
+    {
+        uint32_t ebp = 0, eip = 0, esp = 0;
+        if (size < 0xC8 || !Get(m_file, rva + 0xB4, ebp) || !Get(m_file, rva + 0xB8, eip) || !Get(m_file, rva + 0xC4, esp))
+            return false;
+        thread.m_fp = ebp;
+        thread.m_ip = eip;
+        thread.m_sp = esp;
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+const Minidump::Module* Minidump::FindModule(uint64_t address) const
+{
+    auto itr = std::upper_bound(m_modules.begin(), m_modules.end(), address, [](uint64_t a, const Module& m) { return a < m.m_base; });
+    if (itr == m_modules.begin())
+        return nullptr;
+    --itr;
+
+    return address - itr->m_base < itr->m_size ? &*itr : nullptr;
+}
+
+const uint8_t* Minidump::ReadMemory(uint64_t address, uint64_t size) const
+{
+    auto itr = std::upper_bound(m_memory.begin(), m_memory.end(), address, [](uint64_t a, const MemoryRange& r) { return a < r.m_start; });
+    if (itr == m_memory.begin())
+        return nullptr;
+    --itr;
+
+    const uint64_t offset = address - itr->m_start;
+    if (offset > itr->m_size || size > itr->m_size - offset)
+        return nullptr;
+    return m_file.At(itr->m_rva + offset, size);
+}
+
+bool Minidump::FollowsCall(uint64_t returnAddress) const
+{
+    switch (m_arch) {
+    case Arch::X86:
+    case Arch::Amd64:
+    {
+        // c[7] is the return address.
+        const uint8_t* c = returnAddress >= 7 ? ReadMemory(returnAddress - 7, 7) : nullptr;
+        if (c == nullptr)
+            return true; // The code wasn't captured. Can't tell.
+
+        // FF /2 is an indirect call. "len" is the length of the instruction from FF.
+        auto indirectCall = [&](size_t len) {
+            const uint8_t op = c[7 - len], modrm = c[8 - len];
+            if (op != 0xFF || ((modrm >> 3) & 7) != 2)
+                return false;
+            const uint8_t mod = modrm >> 6, rm = modrm & 7;
+            switch (len) {
+            case 2: return mod == 3 || (mod == 0 && rm != 4 && rm != 5);    // call reg, call [reg]
+            case 3: return (mod == 1 && rm != 4) || (mod == 0 && rm == 4);  // call [reg+d8], call [sib]
+            case 4: return mod == 1 && rm == 4;                             // call [sib+d8]
+            case 6: return (mod == 2 && rm != 4) || (mod == 0 && rm == 5);  // call [reg+d32], call [rip+d32]
+            case 7: return mod == 2 && rm == 4;                             // call [sib+d32]
+            }
+            return false;
+            };
+        return c[2] == 0xE8 || indirectCall(2) || indirectCall(3) || indirectCall(4) || indirectCall(6) || indirectCall(7);
+    }
+    case Arch::Arm64:
+    {
+        const uint8_t* c = returnAddress >= 4 ? ReadMemory(returnAddress - 4, 4) : nullptr;
+        if (c == nullptr)
+            return true;
+        uint32_t insn;
+        memcpy(&insn, c, sizeof(insn));
+        return (insn & 0xFC000000u) == 0x94000000u ||  // BL
+            (insn & 0xFFFFFC1Fu) == 0xD63F0000u;        // BLR
+    }
+    default:
+        return true;
+    }
+}
+
+void Minidump::ScanStack(const Thread& thread, size_t maxFrames, std::vector<uint64_t>& frames) const
+{
+    if (maxFrames == 0)
+        return;
+    frames.push_back(thread.m_ip);
+
+    const size_t ptrSize = PointerSize();
+    const uint64_t stackEnd = thread.m_stackStart + thread.m_stackSize;
+    uint64_t sp = std::max<uint64_t>(thread.m_sp, thread.m_stackStart) & ~(uint64_t)(ptrSize - 1);
+    if (sp >= stackEnd)
+        return;
+
+    const uint8_t* stack = ReadMemory(sp, stackEnd - sp);
+    if (stack == nullptr)
+        return;
+
+    for (uint64_t pos = 0; pos + ptrSize <= stackEnd - sp && frames.size() < maxFrames; pos += ptrSize) {
+        uint64_t v = 0;
+        memcpy(&v, stack + pos, ptrSize);
+        if (FindModule(v) != nullptr && FollowsCall(v)) {
+            frames.push_back(v);
+        }
+    }
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include <Windows.h>
+
+#include <string>
+#include <vector>
+#include <filesystem>
+
+#include "MappedFile.h"
+
+// Reads the streams of a minidump (.dmp) which the resolver needs: the module list with the
+// CodeView GUID/age of each module, the threads with their registers, and the captured memory.
+// The file is mapped and the streams are decoded from the mapping with their own little endian
+// layouts, so neither dbghelp nor the image files are needed, and the memory of a full dump is
+// only touched where a stack is read.
+class Minidump
+{
+public:
+	static const uint32_t       s_signature = 0x504D444Du; // "MDMP"
+
+	enum class Arch {
+		Unknown,
+		X86,
+		Amd64,
+		Arm64,
+	};
+
+	class Module {
+	public:
+		uint64_t                            m_base = 0;
+		uint64_t                            m_size = 0;
+		std::wstring                        m_path;
+		bool                                m_hasCodeView = false; // a RSDS record. Older formats are ignored.
+		GUID                                m_guid = {};
+		uint32_t                            m_age = 0;
+		std::wstring                        m_pdbName; // as written in the image. May be a full path.
+	};
+
+	class Thread {
+	public:
+		uint32_t                            m_id = 0;
+		uint64_t                            m_ip = 0;
+		uint64_t                            m_sp = 0;
+		uint64_t                            m_fp = 0;
+		uint64_t                            m_stackStart = 0;
+		uint64_t                            m_stackSize = 0;
+		uint64_t                            m_registers[16] = {}; // rax to r15 of x64 threads.
+	};
+
+	class MemoryRange {
+	public:
+		uint64_t                            m_start = 0;
+		uint64_t                            m_size = 0;
+		uint64_t                            m_rva = 0;
+	};
+
+	MappedFile                              m_file;
+	Arch                                    m_arch = Arch::Unknown;
+	std::vector<Module>                     m_modules; // sorted by the base address.
+	std::vector<Thread>                     m_threads;
+	std::vector<MemoryRange>                m_memory; // sorted by the start address.
+
+public:
+	std::wstring Open(const std::filesystem::path& path);
+
+	// The module which has the address. nullptr when it's not in any module.
+	const Module* FindModule(uint64_t address) const;
+
+	// Captured memory at the address. nullptr unless the whole range was in the dump.
+	const uint8_t* ReadMemory(uint64_t address, uint64_t size) const;
+
+	// The instruction pointer and the return addresses found in the stack memory of a thread, from the top.
+	// A value in the stack is taken as a return address when it points into a module and, when the code
+	// was captured, it follows a call instruction.
+	void ScanStack(const Thread& thread, size_t maxFrames, std::vector<uint64_t>& frames) const;
+
+	size_t PointerSize() const { return m_arch == Arch::X86 ? 4 : 8; }
+
+	std::wstring ReadSystemInfo(uint64_t rva, uint64_t size);
+	std::wstring ReadModuleList(uint64_t rva, uint64_t size);
+	std::wstring ReadThreadList(uint64_t rva, uint64_t size);
+	std::wstring ReadMemoryList(uint64_t rva, uint64_t size);
+	std::wstring ReadMemory64List(uint64_t rva, uint64_t size);
+	bool ReadContext(uint64_t rva, uint64_t size, Thread& thread) const;
+	bool FollowsCall(uint64_t returnAddress) const;
+};
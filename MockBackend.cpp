@@ -0,0 +1,248 @@
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+#include "MockBackend.h"
+
+namespace {
+    // FNV-1a. Stable between runs and builds, unlike std::hash.
+    uint64_t Hash(std::wstring_view s, uint64_t h = 14695981039346656037ull)
+    {
+        for (wchar_t c : s) {
+            h ^= (uint64_t)c;
+            h *= 1099511628211ull;
+        }
+        return h;
+    }
+
+    uint64_t Mix(uint64_t a, uint64_t b)
+    {
+        uint64_t h = a * 0x9E3779B97F4A7C15ull ^ (b + 0x632BE59BD9B4E019ull + (a << 6) + (a >> 2));
+        h ^= h >> 31;
+        h *= 0xBF58476D1CE4E5B9ull;
+        h ^= h >> 27;
+        return h;
+    }
+
+    // Lines of a function are 4 to 31 bytes each.
+    uint32_t LineStep(size_t functionIdx, uint32_t k)
+    {
+        return 4 + (uint32_t)(Mix(functionIdx, k) % 28);
+    }
+
+    // The first line of a function in its file. Each file has 64 functions.
+    uint32_t FirstLineNo(size_t functionIdx)
+    {
+        return 1 + (uint32_t)(functionIdx % 64) * 40;
+    }
+
+    std::wstring FileName(const std::wstring& moduleName, size_t functionIdx)
+    {
+        return L"mock\\" + moduleName + L"\\file" + std::to_wstring(functionIdx / 64) + L".cpp";
+    }
+};
+
+MockBackend::MockBackend(size_t numFunctions, uint32_t seed) :
+    m_numFunctions(numFunctions), m_seed(seed)
+{
+}
+
+std::wstring MockBackend::Init()
+{
+    if (m_initialized) {
+        return L"Failed to initialize the mock backend. It has already been initialized.";
+    }
+    m_initialized = true;
+    return std::wstring();
+}
+
+std::wstring MockBackend::Finalize()
+{
+    m_initialized = false;
+    return std::wstring();
+}
+
+std::wstring MockBackend::ReadImageSignature(const std::filesystem::path& imagePath, std::wstring& pdbName, GUID& guid, uint32_t& age, size_t& imageSize)
+{
+    // The image file isn't read. The signature is derived from its name.
+    const auto fileName = imagePath.filename().wstring();
+    const uint64_t h0 = Mix(Hash(fileName), m_seed);
+    const uint64_t h1 = Mix(h0, 1);
+
+    guid.Data1 = (uint32_t)h0;
+    guid.Data2 = (uint16_t)(h0 >> 32);
+    guid.Data3 = (uint16_t)(h0 >> 48);
+    for (size_t i = 0; i < 8; ++i) {
+        guid.Data4[i] = (uint8_t)(h1 >> (i * 8));
+    }
+    age = 1;
+    imageSize = 0;
+    pdbName = imagePath.stem().wstring() + L".pdb";
+
+    return std::wstring();
+}
+
+std::wstring MockBackend::LoadModule(const std::filesystem::path& pdbPath, bool publicsOnly, bool lines, std::unique_ptr<Module>& module)
+{
+    auto loading = std::make_unique<MockModule>();
+    loading->m_pdbPath = pdbPath;
+    loading->m_name = pdbPath.stem().wstring();
+    loading->m_publicsOnly = publicsOnly;
+    loading->m_lines = lines;
+
+    std::mt19937_64 rng(m_seed ^ Hash(loading->m_name));
+    loading->m_functions.reserve(m_numFunctions);
+    uint64_t offset = 0x1000;
+    for (size_t i = 0; i < m_numFunctions; ++i) {
+        offset += (rng() % 4) * 16; // padding between functions.
+        const uint32_t size = 16 + (uint32_t)(rng() % 128) * 16;
+        if (offset + size > UINT32_MAX)
+            break;
+        loading->m_functions.push_back({ (uint32_t)offset, size });
+        offset += size;
+    }
+
+    module = std::move(loading);
+    return std::wstring();
+}
+
+std::wstring MockBackend::ReloadModule(Module& module, bool publicsOnly, bool lines)
+{
+    auto& m = static_cast<MockModule&>(module);
+    m.m_publicsOnly = publicsOnly;
+    m.m_lines = lines;
+    return std::wstring();
+}
+
+std::wstring MockBackend::UnloadModule(Module& module)
+{
+    return std::wstring();
+}
+
+const MockBackend::MockModule::Function* MockBackend::FindFunction(const MockModule& module, uint64_t offset)
+{
+    auto itr = std::upper_bound(module.m_functions.begin(), module.m_functions.end(), offset, [](uint64_t o, const MockModule::Function& f) {
+        return o < f.offset;
+        });
+    if (itr == module.m_functions.begin())
+        return nullptr;
+    --itr;
+    if (offset >= (uint64_t)itr->offset + itr->size)
+        return nullptr;
+    return &*itr;
+}
+
+uint32_t MockBackend::InlineDepth(const MockModule& module, const MockModule::Function& function, uint64_t offset)
+{
+    const size_t idx = &function - module.m_functions.data();
+    if (idx % 8 != 0 || offset >= (uint64_t)function.offset + function.size / 2)
+        return 0;
+    return 1 + (uint32_t)(idx % 3);
+}
+
+bool MockBackend::FindSymbol(Module& module, uint64_t offset, Symbol& symbol)
+{
+    auto& m = static_cast<MockModule&>(module);
+
+    const MockModule::Function* f = FindFunction(m, offset);
+    if (f == nullptr && m.m_publicsOnly) {
+        // A public symbol has no size, so the one before a gap is found as dbghelp does.
+        auto itr = std::upper_bound(m.m_functions.begin(), m.m_functions.end(), offset, [](uint64_t o, const MockModule::Function& f) {
+            return o < f.offset;
+            });
+        if (itr != m.m_functions.begin()) {
+            f = &*std::prev(itr);
+        }
+    }
+    if (f == nullptr)
+        return false;
+
+    const size_t idx = f - m.m_functions.data();
+    symbol.offset = f->offset;
+    symbol.size = m.m_publicsOnly ? 0 : f->size;
+    symbol.name = m.m_name + L"::Function" + std::to_wstring(idx);
+    return true;
+}
+
+bool MockBackend::FindLine(Module& module, uint64_t offset, Line& line)
+{
+    auto& m = static_cast<MockModule&>(module);
+    if (!m.m_lines)
+        return false;
+
+    const MockModule::Function* f = FindFunction(m, offset);
+    if (f == nullptr)
+        return false;
+
+    const size_t idx = f - m.m_functions.data();
+    const uint64_t end = (uint64_t)f->offset + f->size;
+    uint64_t lineOffset = f->offset;
+    uint32_t k = 0;
+    for (;;) {
+        const uint64_t next = lineOffset + LineStep(idx, k);
+        if (next > offset || next >= end)
+            break;
+        lineOffset = next;
+        ++k;
+    }
+
+    line.fileName = FileName(m.m_name, idx);
+    line.lineNo = FirstLineNo(idx) + 1 + k;
+    line.offset = lineOffset;
+    line.end = std::min<uint64_t>(lineOffset + LineStep(idx, k), end);
+    return true;
+}
+
+bool MockBackend::HasInlineFrames(Module& module, uint64_t offset)
+{
+    auto& m = static_cast<MockModule&>(module);
+    const MockModule::Function* f = FindFunction(m, offset);
+    return f != nullptr && !m.m_publicsOnly && InlineDepth(m, *f, offset) != 0;
+}
+
+bool MockBackend::FindInlineFrames(Module& module, uint64_t offset, std::vector<InlineFrame>& frames, std::optional<Line>& callSite)
+{
+    auto& m = static_cast<MockModule&>(module);
+
+    frames.clear();
+    callSite.reset();
+
+    const MockModule::Function* f = FindFunction(m, offset);
+    if (f == nullptr || m.m_publicsOnly)
+        return false;
+    const uint32_t depth = InlineDepth(m, *f, offset);
+    if (depth == 0)
+        return false;
+
+    const size_t idx = f - m.m_functions.data();
+    std::optional<Line> innermost;
+    if (m.m_lines) {
+        Line line;
+        if (FindLine(module, offset, line)) {
+            line.fileName = L"mock\\" + m.m_name + L"\\inline" + std::to_wstring(idx % 16) + L".h";
+            // The chain ends with the first half of the function.
+            line.end = std::min<uint64_t>(line.end, (uint64_t)f->offset + f->size / 2);
+            innermost = std::move(line);
+        }
+    }
+
+    for (uint32_t i = 0; i < depth; ++i) {
+        InlineFrame frame;
+        frame.name = m.m_name + L"::Inline" + std::to_wstring(idx) + L"_" + std::to_wstring(i);
+        if (innermost.has_value()) {
+            frame.line = innermost;
+            frame.line->lineNo = innermost->lineNo + i * 100;
+            if (i != 0) {
+                frame.line->end = 0;
+            }
+        }
+        frames.push_back(std::move(frame));
+    }
+
+    if (m.m_lines) {
+        callSite = Line{ FileName(m.m_name, idx), FirstLineNo(idx), f->offset, 0 };
+    }
+
+    return true;
+}
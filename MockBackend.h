@@ -0,0 +1,55 @@
+#pragma once
+#include <Windows.h>
+
+#include <string>
+#include <vector>
+
+#include "SymbolBackend.h"
+
+// Symbols generated in memory. A PDB is never opened, its functions are laid out from the seed and the
+// name of the PDB, so the same frame resolves to the same function, line and inline chain in every run.
+// Used to benchmark the resolver without dbghelp and without the PDBs.
+//
+// Functions start at 0x1000 with gaps between them. Every 8th function has an inline chain over its first
+// half, and its lines are a few bytes each.
+class MockBackend : public SymbolBackend
+{
+public:
+	class MockModule : public Module {
+	public:
+		struct Function {
+			uint32_t    offset;
+			uint32_t    size;
+		};
+
+		std::wstring            m_name; // the stem of the PDB. Prefixes the names of the functions.
+		std::vector<Function>   m_functions; // sorted by the offset.
+		bool                    m_publicsOnly = false;
+		bool                    m_lines = false;
+	};
+
+	size_t          m_numFunctions; // per PDB.
+	uint32_t        m_seed;
+	bool            m_initialized = false;
+
+public:
+	MockBackend(size_t numFunctions = 1u << 16, uint32_t seed = 20240401);
+
+	std::wstring Init() override;
+	std::wstring Finalize() override;
+	bool HasPdbFiles() const override { return false; }
+	std::wstring ReadImageSignature(const std::filesystem::path& imagePath, std::wstring& pdbName, GUID& guid, uint32_t& age, size_t& imageSize) override;
+	std::wstring LoadModule(const std::filesystem::path& pdbPath, bool publicsOnly, bool lines, std::unique_ptr<Module>& module) override;
+	std::wstring ReloadModule(Module& module, bool publicsOnly, bool lines) override;
+	std::wstring UnloadModule(Module& module) override;
+	bool FindSymbol(Module& module, uint64_t offset, Symbol& symbol) override;
+	bool FindLine(Module& module, uint64_t offset, Line& line) override;
+	bool HasInlineFrames(Module& module, uint64_t offset) override;
+	bool FindInlineFrames(Module& module, uint64_t offset, std::vector<InlineFrame>& frames, std::optional<Line>& callSite) override;
+
+	// The function which has the address. nullptr in a gap.
+	static const MockModule::Function* FindFunction(const MockModule& module, uint64_t offset);
+
+	// How many functions are inlined at the address. 0 when it isn't in inlined code.
+	static uint32_t InlineDepth(const MockModule& module, const MockModule::Function& function, uint64_t offset);
+};
@@ -0,0 +1,537 @@
+#include <Windows.h>
+
+#include <unordered_map>
+#include <cstring>
+
+#include "OutputFormatter.h"
+#include "ResultFormat.h"
+
+namespace {
+    using TextBuffer = OutputBuffer<wchar_t>;
+
+    constexpr std::wstring_view symbols_ws(L"symbols");
+    constexpr std::wstring_view paths_ws(L"paths");
+    constexpr std::wstring_view callstacks_ws(L"callstacks");
+    constexpr std::wstring_view resolved_callstacks_ws(L"resolved_callstacks");
+
+    std::wstring_view FileName(std::wstring_view path)
+    {
+        auto pos = path.find_last_of(L"\\/");
+        return pos == std::wstring_view::npos ? path : path.substr(pos + 1);
+    }
+
+    void PutIndent(TextBuffer& b, size_t indent)
+    {
+        for (size_t i = 0; i < indent; ++i) {
+            b.Put(L' ');
+        }
+    }
+
+    void PutJsonString(TextBuffer& b, std::wstring_view s)
+    {
+        constexpr wchar_t digits[] = L"0123456789abcdef";
+
+        b.Put(L'"');
+        // Copy the runs which need no escape at once.
+        size_t runBegin = 0;
+        for (size_t i = 0; i < s.size(); ++i) {
+            const wchar_t c = s[i];
+            if (c >= 0x20 && c != L'"' && c != L'\\')
+                continue;
+
+            b.Put(s.substr(runBegin, i - runBegin));
+            runBegin = i + 1;
+            switch (c) {
+            case L'"':  b.Put(L"\\\""); break;
+            case L'\\': b.Put(L"\\\\"); break;
+            case L'\n': b.Put(L"\\n"); break;
+            case L'\r': b.Put(L"\\r"); break;
+            case L'\t': b.Put(L"\\t"); break;
+            default:
+                b.Put(L"\\u00");
+                b.Put(digits[(c >> 4) & 0xF]);
+                b.Put(digits[c & 0xF]);
+                break;
+            }
+        }
+        b.Put(s.substr(runBegin));
+        b.Put(L'"');
+    }
+
+    // Members of a JSON object, one per line.
+    class JsonObject {
+    public:
+        TextBuffer&     m_b;
+        size_t          m_indent;
+        bool            m_empty = true;
+
+        JsonObject(TextBuffer& b, size_t indent) :
+            m_b(b), m_indent(indent)
+        {
+            PutIndent(m_b, m_indent);
+            m_b.Put(L"{\n");
+        }
+
+        void Key(std::wstring_view name)
+        {
+            if (!m_empty) {
+                m_b.Put(L",\n");
+            }
+            m_empty = false;
+            PutIndent(m_b, m_indent + 2);
+            PutJsonString(m_b, name);
+            m_b.Put(L" : ");
+        }
+
+        void String(std::wstring_view name, const std::optional<std::wstring>& v)
+        {
+            if (v.has_value()) {
+                Key(name);
+                PutJsonString(m_b, v.value());
+            }
+        }
+
+        // Numbers are written as strings as they have always been, hex with the "0x" prefix.
+        void Number(std::wstring_view name, const std::optional<uint64_t>& v, bool hex)
+        {
+            if (v.has_value()) {
+                Key(name);
+                m_b.Put(L'"');
+                if (hex)
+                    m_b.PutHex(v.value());
+                else
+                    m_b.PutDec(v.value());
+                m_b.Put(L'"');
+            }
+        }
+
+        void Bool(std::wstring_view name, const std::optional<bool>& v)
+        {
+            if (v.has_value()) {
+                Key(name);
+                m_b.Put(v.value() ? L"true" : L"false");
+            }
+        }
+
+        void Close()
+        {
+            if (!m_empty) {
+                m_b.Put(L'\n');
+            }
+            PutIndent(m_b, m_indent);
+            m_b.Put(L'}');
+        }
+    };
+
+    void PutJsonFrame(TextBuffer& b, size_t indent, const Context::resolved_callstack& c)
+    {
+        JsonObject obj(b, indent);
+
+        if (c.isComment) {
+            obj.String(L"comment", c.image);
+        }
+        else {
+            obj.String(L"image", c.image);
+            obj.String(L"pdb", c.pdb);
+            obj.String(L"pdb_signature", c.pdb_signature);
+            obj.Number(L"image_offset", c.values.image_offset, true);
+            obj.String(L"function", c.function);
+            obj.Number(L"function_offset", c.values.function_offset, true);
+            obj.String(L"line", c.line);
+            obj.Number(L"line_no", c.values.line_no, false);
+            obj.Number(L"line_offset", c.values.line_offset, true);
+
+            if (!c.inlines.empty()) {
+                obj.Key(L"inlines");
+                b.Put(L"[\n");
+                for (size_t i = 0; i < c.inlines.size(); ++i) {
+                    const auto& f = c.inlines[i];
+                    JsonObject inl(b, indent + 4);
+                    inl.String(L"function", f.function);
+                    inl.String(L"line", f.line);
+                    inl.Number(L"line_no", f.values.line_no, false);
+                    inl.Close();
+                    b.Put(i + 1 < c.inlines.size() ? L",\n" : L"\n");
+                }
+                PutIndent(b, indent + 2);
+                b.Put(L']');
+            }
+        }
+
+        obj.Close();
+    }
+
+    void PutCsvField(TextBuffer& b, std::wstring_view s)
+    {
+        if (s.find_first_of(L",\"\r\n") == std::wstring_view::npos) {
+            b.Put(s);
+            return;
+        }
+        b.Put(L'"');
+        for (wchar_t c : s) {
+            if (c == L'"')
+                b.Put(L'"');
+            b.Put(c);
+        }
+        b.Put(L'"');
+    }
+
+    // Interns the strings of a result for the binary form. The views point into the context.
+    class StringTable {
+    public:
+        std::unordered_map<std::wstring_view, uint64_t>  m_ids;
+        std::vector<std::wstring_view>                   m_strings;
+        std::vector<uint32_t>                            m_utf8Sizes; // of each string.
+        uint64_t                                         m_dataSize = 0;
+
+        void Add(const std::optional<std::wstring>& s)
+        {
+            if (!s.has_value())
+                return;
+
+            auto [itr, inserted] = m_ids.try_emplace(std::wstring_view(s.value()), (uint64_t)m_strings.size());
+            if (inserted) {
+                m_strings.push_back(itr->first);
+                m_utf8Sizes.push_back(Utf8Size(itr->first));
+                m_dataSize += m_utf8Sizes.back();
+            }
+        }
+
+        // The index of a string given to Add().
+        uint64_t Id(const std::optional<std::wstring>& s) const
+        {
+            return s.has_value() ? m_ids.find(std::wstring_view(s.value()))->second : ResultFile::s_noString;
+        }
+
+        static uint32_t Utf8Size(std::wstring_view s)
+        {
+            return s.empty() ? 0 : (uint32_t)WideCharToMultiByte(CP_UTF8, 0, s.data(), (int)s.size(), NULL, 0, NULL, NULL);
+        }
+    };
+
+    void PutRaw(OutputBuffer<char>& b, const void* data, size_t size)
+    {
+        b.Put(std::string_view(reinterpret_cast<const char*>(data), size));
+        b.FlushIfFull();
+    }
+};
+
+template<>
+size_t ResultFormatter<OutputFormat::Readable>::Write(std::wostream& os, const Context& ctx)
+{
+    TextBuffer b(os);
+    size_t numFrames = 0;
+
+    b.Put(L"--- Resolved Callstacks ---\n");
+
+    for (const auto& cs : ctx.resolved_callstacks) {
+        if (cs.isComment) {
+            if (cs.image.has_value()) {
+                b.Put(cs.image.value());
+            }
+            b.Put(L'\n');
+            continue;
+        }
+
+        std::wstring_view moduleName;
+        if (cs.image.has_value()) {
+            moduleName = FileName(cs.image.value());
+        }
+
+        // Inlined callees come first as they are deeper in the stack than the physical function.
+        for (const auto& i : cs.inlines) {
+            b.Put(moduleName);
+            b.Put(L'!');
+            b.Put(i.function.has_value() ? std::wstring_view(i.function.value()) : std::wstring_view(L"<unknown>"));
+            if (i.line.has_value()) {
+                b.Put(L" [");
+                b.Put(i.line.value());
+                b.Put(L" @ ");
+                b.PutDec(i.values.line_no.value_or(0));
+                b.Put(L']');
+            }
+            b.Put(L" (inlined)\n");
+        }
+
+        b.Put(moduleName);
+        b.Put(L'!');
+        if (cs.function.has_value()) {
+            b.Put(cs.function.value());
+            b.Put(L" + ");
+            b.PutHex(cs.values.function_offset.value_or(0));
+        }
+        else {
+            b.PutHex(cs.values.image_offset.value_or(0));
+        }
+        if (cs.line.has_value() && cs.function.has_value()) {
+            b.Put(L" [");
+            b.Put(cs.line.value());
+            b.Put(L" @ ");
+            b.PutDec(cs.values.line_no.value_or(0));
+            b.Put(L"] + ");
+            b.PutHex(cs.values.line_offset.value_or(0));
+        }
+        b.Put(L'\n');
+
+        ++numFrames;
+        b.FlushIfFull();
+    }
+
+    return numFrames;
+}
+
+template<>
+size_t ResultFormatter<OutputFormat::Json>::Write(std::wostream& os, const Context& ctx)
+{
+    TextBuffer b(os);
+    size_t numFrames = 0;
+
+    b.Put(L"{\n");
+
+    // symbols
+    {
+        PutIndent(b, 2);
+        PutJsonString(b, symbols_ws);
+        b.Put(L" : [\n");
+        for (size_t i = 0; i < ctx.symbols.size(); ++i) {
+            const auto& s = ctx.symbols[i];
+            JsonObject obj(b, 4);
+            obj.String(L"server", s.server);
+            obj.String(L"cache", s.cache);
+            obj.String(L"direct", s.direct);
+            obj.Bool(L"force_create_cache_dir", s.force_create_cache_dir);
+            obj.Bool(L"writable", s.writable);
+            obj.Close();
+            b.Put(i + 1 < ctx.symbols.size() ? L",\n" : L"\n");
+        }
+        PutIndent(b, 2);
+        b.Put(L"],\n");
+    }
+
+    // paths
+    {
+        PutIndent(b, 2);
+        PutJsonString(b, paths_ws);
+        b.Put(L" : [\n");
+        size_t idx = 0;
+        for (const auto& ip : ctx.paths) {
+            PutIndent(b, 4);
+            PutJsonString(b, ip.second);
+            b.Put(++idx < ctx.paths.size() ? L",\n" : L"\n");
+        }
+        PutIndent(b, 2);
+        b.Put(L"],\n");
+    }
+
+    // callstacks
+    {
+        PutIndent(b, 2);
+        PutJsonString(b, callstacks_ws);
+        b.Put(L" : [\n");
+        for (size_t i = 0; i < ctx.callstacks.size(); ++i) {
+            PutIndent(b, 4);
+            PutJsonString(b, ctx.callstacks[i]);
+            b.Put(i + 1 < ctx.callstacks.size() ? L",\n" : L"\n");
+            b.FlushIfFull();
+        }
+        PutIndent(b, 2);
+        b.Put(L"],\n");
+    }
+
+    // resolved_callstacks
+    {
+        PutIndent(b, 2);
+        PutJsonString(b, resolved_callstacks_ws);
+        b.Put(L" : [\n");
+        for (size_t i = 0; i < ctx.resolved_callstacks.size(); ++i) {
+            const auto& cs = ctx.resolved_callstacks[i];
+            PutJsonFrame(b, 4, cs);
+            b.Put(i + 1 < ctx.resolved_callstacks.size() ? L",\n" : L"\n");
+            if (!cs.isComment) {
+                ++numFrames;
+            }
+            b.FlushIfFull();
+        }
+        PutIndent(b, 2);
+        b.Put(L"]\n");
+    }
+
+    b.Put(L"}\n");
+
+    return numFrames;
+}
+
+template<>
+size_t ResultFormatter<OutputFormat::Csv>::Write(std::wostream& os, const Context& ctx)
+{
+    TextBuffer b(os);
+    size_t numFrames = 0;
+
+    // Comment lines are not written. Inlined callees are joined with '|', the innermost first.
+    b.Put(L"image,pdb,pdb_signature,image_offset,function,function_offset,line,line_no,line_offset,inlines\n");
+
+    auto putOptional = [&](const std::optional<std::wstring>& s) {
+        if (s.has_value()) {
+            PutCsvField(b, s.value());
+        }
+        b.Put(L',');
+        };
+    auto putNumber = [&](const std::optional<uint64_t>& v, bool hex) {
+        if (v.has_value()) {
+            if (hex)
+                b.PutHex(v.value());
+            else
+                b.PutDec(v.value());
+        }
+        b.Put(L',');
+        };
+
+    std::wstring inlines;
+    for (const auto& cs : ctx.resolved_callstacks) {
+        if (cs.isComment)
+            continue;
+
+        putOptional(cs.image);
+        putOptional(cs.pdb);
+        putOptional(cs.pdb_signature);
+        putNumber(cs.values.image_offset, true);
+        putOptional(cs.function);
+        putNumber(cs.values.function_offset, true);
+        putOptional(cs.line);
+        putNumber(cs.values.line_no, false);
+        putNumber(cs.values.line_offset, true);
+
+        inlines.clear();
+        for (const auto& i : cs.inlines) {
+            if (!inlines.empty())
+                inlines += L'|';
+            inlines += i.function.value_or(L"<unknown>");
+        }
+        PutCsvField(b, inlines);
+        b.Put(L'\n');
+
+        ++numFrames;
+        b.FlushIfFull();
+    }
+
+    return numFrames;
+}
+
+// Binary form. See ResultFile for the layout. The strings are interned first, so that the header has all the
+// offsets, and then the records are written as they are made. Only the string table is held in memory.
+template<>
+size_t ResultFormatter<OutputFormat::Binary>::Write(std::ostream& os, const Context& ctx)
+{
+    StringTable strings;
+    uint64_t numInlines = 0;
+    for (const auto& cs : ctx.resolved_callstacks) {
+        strings.Add(cs.image);
+        if (cs.isComment)
+            continue;
+        strings.Add(cs.pdb);
+        strings.Add(cs.pdb_signature);
+        strings.Add(cs.function);
+        strings.Add(cs.line);
+        for (const auto& i : cs.inlines) {
+            strings.Add(i.function);
+            strings.Add(i.line);
+        }
+        numInlines += cs.inlines.size();
+    }
+
+    ResultFile::Header header = {};
+    memcpy(header.magic, ResultFile::s_magic, sizeof(header.magic));
+    header.majorVersion = ResultFile::s_majorVersion;
+    header.minorVersion = ResultFile::s_minorVersion;
+    header.headerSize = sizeof(ResultFile::Header);
+    header.frameRecordSize = sizeof(ResultFile::FrameRecord);
+    header.inlineRecordSize = sizeof(ResultFile::InlineRecord);
+    header.stringEntrySize = sizeof(ResultFile::StringEntry);
+    header.numRecords = ctx.resolved_callstacks.size();
+    header.numInlines = numInlines;
+    header.numStrings = strings.m_strings.size();
+    header.recordsOffset = sizeof(ResultFile::Header);
+    header.inlinesOffset = header.recordsOffset + header.numRecords * sizeof(ResultFile::FrameRecord);
+    header.stringsOffset = header.inlinesOffset + header.numInlines * sizeof(ResultFile::InlineRecord);
+    header.stringDataOffset = header.stringsOffset + header.numStrings * sizeof(ResultFile::StringEntry);
+    header.stringDataSize = strings.m_dataSize;
+
+    OutputBuffer<char> b(os);
+    PutRaw(b, &header, sizeof(header));
+
+    size_t numFrames = 0;
+    uint64_t firstInline = 0;
+    for (const auto& cs : ctx.resolved_callstacks) {
+        ResultFile::FrameRecord r = {};
+        r.image = strings.Id(cs.image);
+        r.pdb = r.pdbSignature = r.function = r.line = ResultFile::s_noString;
+        r.firstInline = firstInline;
+
+        if (cs.isComment) {
+            r.flags = ResultFile::eComment;
+            PutRaw(b, &r, sizeof(r));
+            continue;
+        }
+
+        r.pdb = strings.Id(cs.pdb);
+        r.pdbSignature = strings.Id(cs.pdb_signature);
+        r.function = strings.Id(cs.function);
+        r.line = strings.Id(cs.line);
+        if (cs.values.image_offset.has_value()) {
+            r.flags |= ResultFile::eHasImageOffset;
+            r.imageOffset = cs.values.image_offset.value();
+        }
+        if (cs.values.function_offset.has_value()) {
+            r.flags |= ResultFile::eHasFunctionOffset;
+            r.functionOffset = cs.values.function_offset.value();
+        }
+        if (cs.values.line_no.has_value()) {
+            r.flags |= ResultFile::eHasLineNo;
+            r.lineNo = (uint32_t)cs.values.line_no.value();
+        }
+        if (cs.values.line_offset.has_value()) {
+            r.flags |= ResultFile::eHasLineOffset;
+            r.lineOffset = cs.values.line_offset.value();
+        }
+        r.numInlines = (uint32_t)cs.inlines.size();
+        firstInline += cs.inlines.size();
+
+        PutRaw(b, &r, sizeof(r));
+        ++numFrames;
+    }
+
+    for (const auto& cs : ctx.resolved_callstacks) {
+        if (cs.isComment)
+            continue;
+        for (const auto& i : cs.inlines) {
+            ResultFile::InlineRecord ir = {};
+            ir.function = strings.Id(i.function);
+            ir.line = strings.Id(i.line);
+            ir.lineNo = (uint32_t)i.values.line_no.value_or(0);
+            PutRaw(b, &ir, sizeof(ir));
+        }
+    }
+
+    uint64_t offset = 0;
+    for (auto len : strings.m_utf8Sizes) {
+        ResultFile::StringEntry e = {};
+        e.offset = offset;
+        e.length = len;
+        offset += len;
+        PutRaw(b, &e, sizeof(e));
+    }
+
+    // Encode the strings in UTF-8 straight into the buffer.
+    for (size_t i = 0; i < strings.m_strings.size(); ++i) {
+        const auto& s = strings.m_strings[i];
+        const int len = (int)strings.m_utf8Sizes[i];
+        if (len == 0)
+            continue;
+        const size_t pos = b.m_buf.size();
+        b.m_buf.resize(pos + len);
+        WideCharToMultiByte(CP_UTF8, 0, s.data(), (int)s.size(), b.m_buf.data() + pos, len, NULL, NULL);
+        b.FlushIfFull();
+    }
+
+    return numFrames;
+}
@@ -0,0 +1,109 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <iostream>
+
+#include "Context.h"
+
+enum class OutputFormat {
+	Readable,
+	Json,
+	Csv,
+	Binary,
+};
+
+// Output buffer reused for the whole result. Numbers and strings are written into it in place
+// and it is handed to the stream in large chunks.
+template<typename CharT>
+class OutputBuffer
+{
+public:
+	static const size_t                     s_flushSize = 64u * 1024u;
+
+	std::basic_ostream<CharT>&              m_os;
+	std::basic_string<CharT>                m_buf;
+
+public:
+	explicit OutputBuffer(std::basic_ostream<CharT>& os) :
+		m_os(os)
+	{
+		m_buf.reserve(s_flushSize + s_flushSize / 2);
+	}
+
+	~OutputBuffer()
+	{
+		Flush();
+	}
+
+	void Put(CharT c)
+	{
+		m_buf.push_back(c);
+	}
+
+	void Put(std::basic_string_view<CharT> s)
+	{
+		m_buf.append(s);
+	}
+
+	void PutDec(uint64_t v)
+	{
+		CharT tmp[20];
+		size_t n = 0;
+		do {
+			tmp[n++] = (CharT)('0' + v % 10);
+			v /= 10;
+		} while (v != 0);
+		while (n > 0) {
+			m_buf.push_back(tmp[--n]);
+		}
+	}
+
+	void PutHex(uint64_t v)
+	{
+		constexpr char digits[] = "0123456789abcdef";
+		CharT tmp[16];
+		size_t n = 0;
+		do {
+			tmp[n++] = (CharT)digits[v & 0xF];
+			v >>= 4;
+		} while (v != 0);
+		m_buf.push_back((CharT)'0');
+		m_buf.push_back((CharT)'x');
+		while (n > 0) {
+			m_buf.push_back(tmp[--n]);
+		}
+	}
+
+	void FlushIfFull()
+	{
+		if (m_buf.size() >= s_flushSize) {
+			Flush();
+		}
+	}
+
+	void Flush()
+	{
+		if (!m_buf.empty()) {
+			m_os.write(m_buf.data(), m_buf.size());
+			m_buf.clear();
+		}
+	}
+};
+
+// Writes a resolved context in one output format. Each format is a separate instantiation,
+// so the per frame code has no branches on the format.
+template<OutputFormat Format>
+class ResultFormatter
+{
+public:
+	using CharT = std::conditional_t<Format == OutputFormat::Binary, char, wchar_t>;
+
+	// Returns the number of frames written.
+	static size_t Write(std::basic_ostream<CharT>& os, const Context& ctx);
+};
+
+template<> size_t ResultFormatter<OutputFormat::Readable>::Write(std::wostream& os, const Context& ctx);
+template<> size_t ResultFormatter<OutputFormat::Json>::Write(std::wostream& os, const Context& ctx);
+template<> size_t ResultFormatter<OutputFormat::Csv>::Write(std::wostream& os, const Context& ctx);
+template<> size_t ResultFormatter<OutputFormat::Binary>::Write(std::ostream& os, const Context& ctx);
@@ -0,0 +1,298 @@
+#include <Windows.h>
+
+#include <sstream>
+#include <cstring>
+
+#include "PdbFile.h"
+
+namespace {
+    constexpr char msfMagic[] = "Microsoft C/C++ MSF 7.00\r\n\x1a" "DS\0\0";
+    constexpr uint32_t nilStreamSize = 0xFFFFFFFFu;
+
+#pragma pack(push, 1)
+    struct SuperBlock {
+        char        magic[32];
+        uint32_t    blockSize;
+        uint32_t    freeBlockMapBlock;
+        uint32_t    numBlocks;
+        uint32_t    numDirectoryBytes;
+        uint32_t    unknown;
+        uint32_t    blockMapAddr;
+    };
+
+    struct PDBStreamHeader {
+        uint32_t    version;
+        uint32_t    signature;
+        uint32_t    age;
+        GUID        guid;
+    };
+
+    // The beginning of the DBI stream header. The rest isn't needed here.
+    struct DBIStreamHeaderPrefix {
+        int32_t     versionSignature;
+        uint32_t    versionHeader;
+        uint32_t    age;
+    };
+#pragma pack(pop)
+
+    uint32_t NumBlocks(uint64_t size, uint32_t blockSize)
+    {
+        return (uint32_t)((size + blockSize - 1) / blockSize);
+    }
+};
+
+std::wstring PdbFile::Open(const std::filesystem::path& pdbPath)
+{
+    m_pdbPath = pdbPath;
+    m_fs.open(pdbPath, std::ios::in | std::ios::binary);
+    if (!m_fs) {
+        std::wstringstream ss;
+        ss << L"Failed to open a PDB file \"" << pdbPath.wstring() << L"\".";
+        return ss.str();
+    }
+
+    SuperBlock sb = {};
+    if (!m_fs.read(reinterpret_cast<char*>(&sb), sizeof(sb))) {
+        std::wstringstream ss;
+        ss << L"\"" << pdbPath.wstring() << L"\" was too small to be a PDB file.";
+        return ss.str();
+    }
+    if (memcmp(sb.magic, msfMagic, sizeof(sb.magic)) != 0) {
+        std::wstringstream ss;
+        ss << L"\"" << pdbPath.wstring() << L"\" didn't have a MSF 7.00 header.";
+        return ss.str();
+    }
+    if (sb.blockSize != 512 && sb.blockSize != 1024 && sb.blockSize != 2048 && sb.blockSize != 4096) {
+        std::wstringstream ss;
+        ss << L"\"" << pdbPath.wstring() << L"\" had an invalid block size " << sb.blockSize << L".";
+        return ss.str();
+    }
+    m_blockSize = sb.blockSize;
+    m_numBlocks = sb.numBlocks;
+
+    // A truncated download is detected here since the header knows the number of blocks.
+    {
+        std::error_code ec;
+        uint64_t fileSize = std::filesystem::file_size(pdbPath, ec);
+        if (ec || fileSize < (uint64_t)m_numBlocks * m_blockSize) {
+            std::wstringstream ss;
+            ss << L"\"" << pdbPath.wstring() << L"\" was truncated. Expected " << (uint64_t)m_numBlocks * m_blockSize << L" bytes but was " << fileSize << L" bytes.";
+            return ss.str();
+        }
+    }
+
+    // Read the stream directory through the block map.
+    std::vector<uint8_t> dir(sb.numDirectoryBytes);
+    {
+        uint32_t numDirBlocks = NumBlocks(sb.numDirectoryBytes, m_blockSize);
+        std::vector<uint32_t> dirBlocks(numDirBlocks);
+
+        m_fs.seekg((uint64_t)sb.blockMapAddr * m_blockSize);
+        if (!m_fs.read(reinterpret_cast<char*>(dirBlocks.data()), numDirBlocks * sizeof(uint32_t))) {
+            return L"Failed to read the block map of the stream directory.";
+        }
+
+        for (uint32_t i = 0; i < numDirBlocks; ++i) {
+            if (dirBlocks[i] >= m_numBlocks) {
+                return L"Stream directory referred to an invalid block.";
+            }
+            uint32_t chunk = std::min<uint32_t>(m_blockSize, sb.numDirectoryBytes - i * m_blockSize);
+            m_fs.seekg((uint64_t)dirBlocks[i] * m_blockSize);
+            if (!m_fs.read(reinterpret_cast<char*>(dir.data()) + (uint64_t)i * m_blockSize, chunk)) {
+                return L"Failed to read the stream directory.";
+            }
+        }
+    }
+
+    // Parse the directory. NumStreams, StreamSizes[NumStreams], and the block lists of each stream.
+    {
+        size_t pos = 0;
+        auto readU32 = [&](uint32_t& v) -> bool {
+            if (pos + sizeof(uint32_t) > dir.size())
+                return false;
+            memcpy(&v, dir.data() + pos, sizeof(uint32_t));
+            pos += sizeof(uint32_t);
+            return true;
+            };
+
+        uint32_t numStreams = 0;
+        if (!readU32(numStreams)) {
+            return L"Failed to read the number of streams.";
+        }
+        m_streamSizes.resize(numStreams);
+        for (auto& siz : m_streamSizes) {
+            if (!readU32(siz)) {
+                return L"Failed to read the stream sizes.";
+            }
+        }
+        m_streamBlocks.resize(numStreams);
+        for (uint32_t i = 0; i < numStreams; ++i) {
+            uint32_t siz = m_streamSizes[i] == nilStreamSize ? 0 : m_streamSizes[i];
+            m_streamBlocks[i].resize(NumBlocks(siz, m_blockSize));
+            for (auto& b : m_streamBlocks[i]) {
+                if (!readU32(b) || b >= m_numBlocks) {
+                    return L"Failed to read the block list of a stream.";
+                }
+            }
+        }
+    }
+
+    return std::wstring();
+}
+
+std::wstring PdbFile::ReadStream(uint32_t streamIdx, uint64_t offset, uint64_t size, void* dst)
+{
+    if (streamIdx >= m_streamSizes.size() || m_streamSizes[streamIdx] == nilStreamSize) {
+        std::wstringstream ss;
+        ss << L"Stream " << streamIdx << L" didn't exist in \"" << m_pdbPath.wstring() << L"\".";
+        return ss.str();
+    }
+    if (offset + size > m_streamSizes[streamIdx]) {
+        std::wstringstream ss;
+        ss << L"Tried to read beyond the end of stream " << streamIdx << L" in \"" << m_pdbPath.wstring() << L"\".";
+        return ss.str();
+    }
+
+    const auto& blocks = m_streamBlocks[streamIdx];
+    char* out = reinterpret_cast<char*>(dst);
+    while (size > 0) {
+        uint32_t blockIdx = (uint32_t)(offset / m_blockSize);
+        uint32_t inBlock = (uint32_t)(offset % m_blockSize);
+        uint32_t chunk = (uint32_t)std::min<uint64_t>(m_blockSize - inBlock, size);
+
+        m_fs.seekg((uint64_t)blocks[blockIdx] * m_blockSize + inBlock);
+        if (!m_fs.read(out, chunk)) {
+            std::wstringstream ss;
+            ss << L"Failed to read stream " << streamIdx << L" in \"" << m_pdbPath.wstring() << L"\".";
+            return ss.str();
+        }
+        out += chunk;
+        offset += chunk;
+        size -= chunk;
+    }
+
+    return std::wstring();
+}
+
+std::wstring PdbFile::ReadSignature(GUID& guid, uint32_t& age)
+{
+    PDBStreamHeader header = {};
+
+    auto errStr = ReadStream(ePDBStream, 0, sizeof(header), &header);
+    if (!errStr.empty()) {
+        return errStr;
+    }
+    guid = header.guid;
+
+    // The age in the CodeView record of an image is the one of the DBI stream. The age of the PDB stream
+    // is bumped separately by incremental links and pdbcopy, so it may differ for a matching PDB.
+    if (StreamSize(eDBIStream) < sizeof(DBIStreamHeaderPrefix)) {
+        age = header.age;
+        return std::wstring();
+    }
+    DBIStreamHeaderPrefix dbi = {};
+    errStr = ReadStream(eDBIStream, 0, sizeof(dbi), &dbi);
+    if (!errStr.empty()) {
+        return errStr;
+    }
+    age = dbi.age;
+
+    return std::wstring();
+}
+
+uint64_t PdbFile::StreamSize(uint32_t streamIdx) const
+{
+    if (streamIdx >= m_streamSizes.size() || m_streamSizes[streamIdx] == nilStreamSize)
+        return 0;
+    return m_streamSizes[streamIdx];
+}
+
+std::wstring PdbFile::FindNamedStream(const std::string& name, uint32_t& streamIdx)
+{
+    // The PDB stream header is followed by the names and a hash table of (name offset, stream index).
+    std::vector<uint8_t> buf(StreamSize(ePDBStream));
+    {
+        auto errStr = ReadStream(ePDBStream, 0, buf.size(), buf.data());
+        if (!errStr.empty()) {
+            return errStr;
+        }
+    }
+
+    size_t pos = sizeof(PDBStreamHeader);
+    auto readU32 = [&](uint32_t& v) -> bool {
+        if (pos + sizeof(uint32_t) > buf.size())
+            return false;
+        memcpy(&v, buf.data() + pos, sizeof(uint32_t));
+        pos += sizeof(uint32_t);
+        return true;
+        };
+
+    uint32_t stringsSize = 0;
+    if (!readU32(stringsSize) || pos + stringsSize > buf.size()) {
+        return L"Failed to read the names of the named streams.";
+    }
+    const size_t stringsPos = pos;
+    pos += stringsSize;
+
+    uint32_t numEntries = 0, capacity = 0, presentWords = 0;
+    if (!readU32(numEntries) || !readU32(capacity) || !readU32(presentWords)) {
+        return L"Failed to read the hash table of the named streams.";
+    }
+    std::vector<uint32_t> present(presentWords);
+    for (auto& w : present) {
+        if (!readU32(w)) {
+            return L"Failed to read the hash table of the named streams.";
+        }
+    }
+    uint32_t deletedWords = 0;
+    if (!readU32(deletedWords)) {
+        return L"Failed to read the hash table of the named streams.";
+    }
+    pos += (size_t)deletedWords * sizeof(uint32_t);
+
+    for (uint32_t bucket = 0; bucket < capacity && bucket / 32 < presentWords; ++bucket) {
+        if ((present[bucket / 32] & (1u << (bucket % 32))) == 0)
+            continue;
+
+        uint32_t nameOffset = 0, idx = 0;
+        if (!readU32(nameOffset) || !readU32(idx)) {
+            return L"Failed to read the hash table of the named streams.";
+        }
+        if (nameOffset >= stringsSize)
+            continue;
+
+        const char* str = reinterpret_cast<const char*>(buf.data() + stringsPos + nameOffset);
+        if (strnlen(str, stringsSize - nameOffset) == name.size() && name.compare(0, name.size(), str, name.size()) == 0) {
+            streamIdx = idx;
+            return std::wstring();
+        }
+    }
+
+    std::wstringstream ss;
+    ss << L"\"" << m_pdbPath.wstring() << L"\" didn't have a stream named \"" << std::wstring(name.begin(), name.end()) << L"\".";
+    return ss.str();
+}
+
+std::wstring PdbFile::Validate(const std::filesystem::path& pdbPath, const GUID& guid, uint32_t age)
+{
+    PdbFile pdb;
+    auto errStr = pdb.Open(pdbPath);
+    if (!errStr.empty()) {
+        return errStr;
+    }
+
+    GUID pdbGuid = {};
+    uint32_t pdbAge = 0;
+    errStr = pdb.ReadSignature(pdbGuid, pdbAge);
+    if (!errStr.empty()) {
+        return errStr;
+    }
+
+    if (memcmp(&pdbGuid, &guid, sizeof(GUID)) != 0 || pdbAge != age) {
+        std::wstringstream ss;
+        ss << L"\"" << pdbPath.wstring() << L"\" didn't match the GUID/age of the image.";
+        return ss.str();
+    }
+
+    return std::wstring();
+}
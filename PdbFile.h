@@ -0,0 +1,40 @@
+#pragma once
+#include <Windows.h>
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <filesystem>
+
+// Minimal reader of the MSF 7.00 container used by PDB files.
+class PdbFile
+{
+public:
+    enum StreamIndex : uint32_t {
+        ePDBStream = 1,
+        eTPIStream = 2,
+        eDBIStream = 3,
+        eIPIStream = 4,
+    };
+
+    std::filesystem::path               m_pdbPath;
+    std::ifstream                       m_fs;
+    uint32_t                            m_blockSize = 0;
+    uint32_t                            m_numBlocks = 0;
+    std::vector<uint32_t>               m_streamSizes;
+    std::vector<std::vector<uint32_t>>  m_streamBlocks;
+
+public:
+    std::wstring Open(const std::filesystem::path& pdbPath);
+    std::wstring ReadStream(uint32_t streamIdx, uint64_t offset, uint64_t size, void* dst);
+    // The GUID of the PDB stream and the age of the DBI stream, which are what an image refers to.
+    // The age of the PDB stream is used only when there is no DBI stream.
+    std::wstring ReadSignature(GUID& guid, uint32_t& age);
+    // 0 when the stream doesn't exist.
+    uint64_t StreamSize(uint32_t streamIdx) const;
+    // A stream listed by its name in the PDB stream, i.e. "/names".
+    std::wstring FindNamedStream(const std::string& name, uint32_t& streamIdx);
+
+    // Check that the file is a complete MSF file and matches the GUID and age of an image.
+    static std::wstring Validate(const std::filesystem::path& pdbPath, const GUID& guid, uint32_t age);
+};
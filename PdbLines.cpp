@@ -0,0 +1,609 @@
+#include <Windows.h>
+
+#include <sstream>
+#include <cstring>
+#include <algorithm>
+
+#include "PdbLines.h"
+#include "Stats.h"
+
+namespace {
+#pragma pack(push, 1)
+    struct DbiStreamHeader {
+        int32_t     versionSignature;
+        uint32_t    versionHeader;
+        uint32_t    age;
+        uint16_t    globalStreamIndex;
+        uint16_t    buildNumber;
+        uint16_t    publicStreamIndex;
+        uint16_t    pdbDllVersion;
+        uint16_t    symRecordStream;
+        uint16_t    pdbDllRbld;
+        int32_t     modInfoSize;
+        int32_t     sectionContributionSize;
+        int32_t     sectionMapSize;
+        int32_t     sourceInfoSize;
+        int32_t     typeServerMapSize;
+        uint32_t    mfcTypeServerIndex;
+        int32_t     optionalDbgHeaderSize;
+        int32_t     ecSubstreamSize;
+        uint16_t    flags;
+        uint16_t    machine;
+        uint32_t    padding;
+    };
+
+    struct SectionContribution {
+        uint16_t    section;
+        uint16_t    padding1;
+        int32_t     offset;
+        int32_t     size;
+        uint32_t    characteristics;
+        uint16_t    moduleIndex;
+        uint16_t    padding2;
+        uint32_t    dataCrc;
+        uint32_t    relocCrc;
+    };
+
+    // The module name and the object file name follow as null terminated strings. Entries are aligned to 4 bytes.
+    struct ModInfo {
+        uint32_t            unused1;
+        SectionContribution sectionContr;
+        uint16_t            flags;
+        uint16_t            moduleSymStream;
+        uint32_t            symByteSize;
+        uint32_t            c11ByteSize;
+        uint32_t            c13ByteSize;
+        uint16_t            sourceFileCount;
+        uint16_t            padding;
+        uint32_t            unused2;
+        uint32_t            sourceFileNameIndex;
+        uint32_t            pdbFilePathNameIndex;
+    };
+
+    struct LinesHeader {
+        uint32_t    offCon;
+        uint16_t    segCon;
+        uint16_t    flags;
+        uint32_t    cbCon;
+    };
+
+    struct LineBlockHeader {
+        uint32_t    fileId;     // offset of the entry in the file checksums subsection.
+        uint32_t    numLines;
+        uint32_t    blockSize;  // including this header.
+    };
+
+    struct LineEntry {
+        uint32_t    offset;
+        uint32_t    flags;      // linenumStart:24, deltaLineEnd:7, fStatement:1
+    };
+
+    struct NamesHeader {
+        uint32_t    signature;
+        uint32_t    hashVersion;
+        uint32_t    bufferSize;
+    };
+#pragma pack(pop)
+
+    constexpr uint32_t sectionContributionsV60 = 0xeffe0000u + 19970605u;
+    constexpr uint32_t sectionContributionsV2 = 0xeffe0000u + 20140516u;
+    constexpr uint32_t namesSignature = 0xEFFEEFFEu;
+
+    // Indices in the optional debug header of the DBI stream.
+    constexpr size_t dbgOmapFromSrc = 4;
+    constexpr size_t dbgSectionHdr = 5;
+
+    constexpr uint32_t debugSLines = 0xF2;
+    constexpr uint32_t debugSFileChecksums = 0xF4;
+    constexpr uint32_t debugSIgnore = 0x80000000u;
+    constexpr uint16_t linesHaveColumns = 0x0001;
+
+    // Line numbers of the code which the compiler hides from debuggers.
+    constexpr uint32_t hiddenLine = 0xFEEFEE;
+    constexpr uint32_t hiddenLine2 = 0xF00F00;
+
+    constexpr uint32_t imageScnCntCode = 0x00000020;
+    constexpr uint32_t imageScnMemExecute = 0x20000000;
+
+    constexpr size_t sectionHeaderSize = 40;
+    constexpr size_t sectionVirtualAddressPos = 12;
+
+    constexpr uint32_t contributionsPerRead = 4096;
+
+    uint32_t Align4(uint32_t v)
+    {
+        return (v + 3) & ~3u;
+    }
+
+    void PutVarint(std::vector<uint8_t>& out, uint64_t v)
+    {
+        while (v >= 0x80) {
+            out.push_back((uint8_t)(v | 0x80));
+            v >>= 7;
+        }
+        out.push_back((uint8_t)v);
+    }
+
+    uint64_t GetVarint(const uint8_t*& p)
+    {
+        uint64_t v = 0;
+        for (uint32_t shift = 0;; shift += 7) {
+            const uint8_t b = *p++;
+            v |= (uint64_t)(b & 0x7F) << shift;
+            if ((b & 0x80) == 0)
+                return v;
+        }
+    }
+};
+
+void PdbLines::LineTable::Build(const std::vector<Line>& lines)
+{
+    constexpr uint32_t noFile = 0xFFFFFFFFu;
+
+    m_blocks.clear();
+    m_data.clear();
+    m_numLines = lines.size();
+
+    Line prev = {};
+    uint32_t prevFile = noFile;
+    for (size_t i = 0; i < lines.size(); ++i) {
+        const Line& l = lines[i];
+        if (i % s_linesPerBlock == 0) {
+            m_blocks.push_back({ l.rva, (uint32_t)m_data.size() });
+            prev = { l.rva, 0, 0 };
+            prevFile = noFile;
+        }
+
+        // The end of a function keeps the file, so that it doesn't cost a file id.
+        const uint32_t file = (l.lineNo == s_noLine && prevFile != noFile) ? prevFile : l.file;
+        const int64_t lineDelta = (int64_t)l.lineNo - (int64_t)prev.lineNo;
+        const uint64_t zigzag = ((uint64_t)lineDelta << 1) ^ (uint64_t)(lineDelta >> 63);
+        const bool fileChanged = file != prevFile;
+
+        PutVarint(m_data, l.rva - prev.rva);
+        PutVarint(m_data, (zigzag << 1) | (fileChanged ? 1 : 0));
+        if (fileChanged) {
+            PutVarint(m_data, file);
+        }
+
+        prev = { l.rva, l.lineNo, file };
+        prevFile = file;
+    }
+
+    m_blocks.shrink_to_fit();
+    m_data.shrink_to_fit();
+}
+
+bool PdbLines::LineTable::Find(uint32_t rva, Line& line) const
+{
+    auto itr = std::upper_bound(m_blocks.begin(), m_blocks.end(), rva, [](uint32_t v, const Block& b) { return v < b.rva; });
+    if (itr == m_blocks.begin())
+        return false;
+    --itr;
+
+    const size_t first = (size_t)(itr - m_blocks.begin()) * s_linesPerBlock;
+    const size_t n = std::min<size_t>(s_linesPerBlock, m_numLines - first);
+    const uint8_t* p = m_data.data() + itr->offset;
+
+    Line cur = { itr->rva, 0, 0 };
+    for (size_t i = 0; i < n; ++i) {
+        Line next = cur;
+        next.rva += (uint32_t)GetVarint(p);
+        const uint64_t v = GetVarint(p);
+        const uint64_t zigzag = v >> 1;
+        const int64_t lineDelta = (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+        next.lineNo = (uint32_t)((int64_t)cur.lineNo + lineDelta);
+        if (v & 1) {
+            next.file = (uint32_t)GetVarint(p);
+        }
+        if (next.rva > rva)
+            break;
+        cur = next;
+    }
+
+    line = cur;
+    return true;
+}
+
+std::wstring PdbLines::Open(const std::filesystem::path& pdbPath)
+{
+    Stats::Scope stats(L"pdb_lines_open");
+
+    {
+        auto errStr = m_pdb.Open(pdbPath);
+        if (!errStr.empty()) {
+            return errStr;
+        }
+    }
+
+    DbiStreamHeader header = {};
+    {
+        auto errStr = m_pdb.ReadStream(PdbFile::eDBIStream, 0, sizeof(header), &header);
+        if (!errStr.empty()) {
+            return errStr;
+        }
+    }
+    if (header.versionSignature != -1) {
+        std::wstringstream ss;
+        ss << L"\"" << pdbPath.wstring() << L"\" had an unknown DBI stream version.";
+        return ss.str();
+    }
+
+    const int32_t substreamSizes[] = { header.modInfoSize, header.sectionContributionSize, header.sectionMapSize, header.sourceInfoSize,
+        header.typeServerMapSize, header.ecSubstreamSize, header.optionalDbgHeaderSize };
+    uint64_t total = sizeof(header);
+    for (auto siz : substreamSizes) {
+        if (siz < 0) {
+            return L"DBI stream had a negative substream size.";
+        }
+        total += (uint64_t)siz;
+    }
+    if (total > m_pdb.StreamSize(PdbFile::eDBIStream)) {
+        return L"DBI stream was smaller than its substreams.";
+    }
+
+    const uint64_t modInfoPos = sizeof(header);
+    const uint64_t sectionContributionPos = modInfoPos + header.modInfoSize;
+    const uint64_t dbgHeaderPos = sectionContributionPos + header.sectionContributionSize + header.sectionMapSize + header.sourceInfoSize
+        + header.typeServerMapSize + header.ecSubstreamSize;
+
+    {
+        auto errStr = ReadModuleInfo(modInfoPos, header.modInfoSize);
+        if (!errStr.empty()) {
+            return errStr;
+        }
+    }
+    {
+        auto errStr = ReadSectionHeaders(dbgHeaderPos, header.optionalDbgHeaderSize);
+        if (!errStr.empty()) {
+            return errStr;
+        }
+    }
+    {
+        auto errStr = ReadSectionContributions(sectionContributionPos, header.sectionContributionSize);
+        if (!errStr.empty()) {
+            return errStr;
+        }
+    }
+
+    {
+        auto errStr = m_pdb.FindNamedStream("/names", m_namesStream);
+        if (!errStr.empty()) {
+            return errStr;
+        }
+        NamesHeader namesHeader = {};
+        errStr = m_pdb.ReadStream(m_namesStream, 0, sizeof(namesHeader), &namesHeader);
+        if (!errStr.empty()) {
+            return errStr;
+        }
+        if (namesHeader.signature != namesSignature || sizeof(namesHeader) + (uint64_t)namesHeader.bufferSize > m_pdb.StreamSize(m_namesStream)) {
+            return L"/names stream had an invalid header.";
+        }
+        m_namesSize = namesHeader.bufferSize;
+    }
+
+    Stats::AddCount(L"pdb_lines.ranges", m_ranges.size());
+
+    return std::wstring();
+}
+
+std::wstring PdbLines::ReadModuleInfo(uint64_t offset, uint32_t size)
+{
+    std::vector<uint8_t> buf(size);
+    {
+        auto errStr = m_pdb.ReadStream(PdbFile::eDBIStream, offset, size, buf.data());
+        if (!errStr.empty()) {
+            return errStr;
+        }
+    }
+
+    uint32_t pos = 0;
+    while (pos + sizeof(ModInfo) <= size) {
+        ModInfo mi;
+        memcpy(&mi, buf.data() + pos, sizeof(mi));
+        pos += sizeof(mi);
+
+        // Skip the module name and the object file name.
+        for (int i = 0; i < 2; ++i) {
+            auto len = strnlen(reinterpret_cast<const char*>(buf.data() + pos), size - pos);
+            pos += (uint32_t)len + 1;
+            if (pos > size) {
+                return L"DBI stream had a truncated module info.";
+            }
+        }
+        pos = Align4(pos);
+
+        Module m;
+        m.stream = mi.moduleSymStream;
+        m.c13Offset = mi.symByteSize + mi.c11ByteSize;
+        m.c13Size = mi.c13ByteSize;
+        m_modules.push_back(std::move(m));
+    }
+
+    return std::wstring();
+}
+
+std::wstring PdbLines::ReadSectionHeaders(uint64_t dbgHeaderOffset, uint32_t dbgHeaderSize)
+{
+    std::vector<uint16_t> dbgStreams(dbgHeaderSize / sizeof(uint16_t), s_nilStream);
+    {
+        auto errStr = m_pdb.ReadStream(PdbFile::eDBIStream, dbgHeaderOffset, dbgStreams.size() * sizeof(uint16_t), dbgStreams.data());
+        if (!errStr.empty()) {
+            return errStr;
+        }
+    }
+
+    // Addresses of a PDB with an OMAP are of the image before it was reordered.
+    if (dbgStreams.size() > dbgOmapFromSrc && dbgStreams[dbgOmapFromSrc] != s_nilStream) {
+        return L"PDB had an OMAP, which is not supported.";
+    }
+    if (dbgStreams.size() <= dbgSectionHdr || dbgStreams[dbgSectionHdr] == s_nilStream) {
+        return L"PDB didn't have the section headers.";
+    }
+
+    const uint32_t stream = dbgStreams[dbgSectionHdr];
+    std::vector<uint8_t> buf(m_pdb.StreamSize(stream));
+    {
+        auto errStr = m_pdb.ReadStream(stream, 0, buf.size(), buf.data());
+        if (!errStr.empty()) {
+            return errStr;
+        }
+    }
+
+    for (size_t pos = 0; pos + sectionHeaderSize <= buf.size(); pos += sectionHeaderSize) {
+        uint32_t va = 0;
+        memcpy(&va, buf.data() + pos + sectionVirtualAddressPos, sizeof(va));
+        m_sectionRvas.push_back(va);
+    }
+
+    return std::wstring();
+}
+
+std::wstring PdbLines::ReadSectionContributions(uint64_t offset, uint32_t size)
+{
+    uint32_t version = 0;
+    if (size < sizeof(version)) {
+        return std::wstring();
+    }
+    {
+        auto errStr = m_pdb.ReadStream(PdbFile::eDBIStream, offset, sizeof(version), &version);
+        if (!errStr.empty()) {
+            return errStr;
+        }
+    }
+
+    uint32_t entrySize = 0;
+    switch (version) {
+    case sectionContributionsV60:
+        entrySize = sizeof(SectionContribution);
+        break;
+    case sectionContributionsV2:
+        // Followed by the section index in the COFF file.
+        entrySize = sizeof(SectionContribution) + sizeof(uint32_t);
+        break;
+    default:
+        {
+            std::wstringstream ss;
+            ss << L"Unknown section contribution version 0x" << std::hex << version << L".";
+            return ss.str();
+        }
+    }
+
+    // Read in chunks. A large PDB has hundreds of thousands of contributions and only those of code are kept.
+    const uint32_t numEntries = (size - sizeof(version)) / entrySize;
+    std::vector<uint8_t> buf;
+    for (uint32_t first = 0; first < numEntries; first += contributionsPerRead) {
+        const uint32_t n = std::min<uint32_t>(contributionsPerRead, numEntries - first);
+        buf.resize((size_t)n * entrySize);
+        auto errStr = m_pdb.ReadStream(PdbFile::eDBIStream, offset + sizeof(version) + (uint64_t)first * entrySize, buf.size(), buf.data());
+        if (!errStr.empty()) {
+            return errStr;
+        }
+
+        for (uint32_t i = 0; i < n; ++i) {
+            SectionContribution sc;
+            memcpy(&sc, buf.data() + (size_t)i * entrySize, sizeof(sc));
+            if ((sc.characteristics & (imageScnCntCode | imageScnMemExecute)) == 0)
+                continue;
+            if (sc.section == 0 || sc.section > m_sectionRvas.size() || sc.size <= 0 || sc.offset < 0 || sc.moduleIndex >= m_modules.size())
+                continue;
+
+            const uint32_t begin = m_sectionRvas[sc.section - 1] + (uint32_t)sc.offset;
+            m_ranges.push_back({ begin, begin + (uint32_t)sc.size, sc.moduleIndex });
+        }
+    }
+
+    std::sort(m_ranges.begin(), m_ranges.end(), [](const Range& a, const Range& b) { return a.begin < b.begin; });
+
+    // Functions of a compiland are mostly contiguous.
+    size_t n = 0;
+    for (size_t i = 0; i < m_ranges.size(); ++i) {
+        if (n > 0 && m_ranges[n - 1].moduleIdx == m_ranges[i].moduleIdx && m_ranges[n - 1].end == m_ranges[i].begin) {
+            m_ranges[n - 1].end = m_ranges[i].end;
+            continue;
+        }
+        m_ranges[n++] = m_ranges[i];
+    }
+    m_ranges.resize(n);
+    m_ranges.shrink_to_fit();
+
+    return std::wstring();
+}
+
+std::wstring PdbLines::DecodeModule(Module& m)
+{
+    m.decoded = true;
+    if (m.stream == s_nilStream || m.c13Size == 0)
+        return std::wstring();
+
+    Stats::Scope stats(L"pdb_lines_decode");
+    std::vector<uint8_t> buf(m.c13Size);
+    {
+        auto errStr = m_pdb.ReadStream(m.stream, m.c13Offset, m.c13Size, buf.data());
+        if (!errStr.empty()) {
+            return errStr;
+        }
+    }
+
+    std::vector<Line> lines;
+    auto forEachSubsection = [&](uint32_t kind, auto&& f) {
+        uint32_t pos = 0;
+        while (pos + 2 * sizeof(uint32_t) <= buf.size()) {
+            uint32_t k = 0, len = 0;
+            memcpy(&k, buf.data() + pos, sizeof(k));
+            memcpy(&len, buf.data() + pos + sizeof(k), sizeof(len));
+            pos += 2 * sizeof(uint32_t);
+            if (len > buf.size() - pos)
+                break;
+            if ((k & debugSIgnore) == 0 && k == kind) {
+                f(pos, len);
+            }
+            pos = Align4(pos + len);
+        }
+        };
+
+    // The blocks of lines refer to the files by the offset of their entries in the checksums subsection.
+    uint32_t checksumsPos = 0, checksumsSize = 0;
+    forEachSubsection(debugSFileChecksums, [&](uint32_t pos, uint32_t len) {
+        checksumsPos = pos;
+        checksumsSize = len;
+        });
+
+    forEachSubsection(debugSLines, [&](uint32_t pos, uint32_t len) {
+        LinesHeader lh;
+        if (len < sizeof(lh))
+            return;
+        memcpy(&lh, buf.data() + pos, sizeof(lh));
+        if (lh.segCon == 0 || lh.segCon > m_sectionRvas.size())
+            return;
+
+        const uint32_t base = m_sectionRvas[lh.segCon - 1] + lh.offCon;
+        const uint32_t entrySize = sizeof(LineEntry) + ((lh.flags & linesHaveColumns) ? 2 * sizeof(uint16_t) : 0);
+        const uint32_t end = pos + len;
+        uint32_t blockPos = pos + sizeof(lh);
+        while (blockPos + sizeof(LineBlockHeader) <= end) {
+            LineBlockHeader bh;
+            memcpy(&bh, buf.data() + blockPos, sizeof(bh));
+            if (bh.blockSize < sizeof(bh) || bh.blockSize > end - blockPos)
+                break;
+
+            uint32_t nameOffset = 0;
+            if (bh.fileId + sizeof(uint32_t) <= checksumsSize) {
+                memcpy(&nameOffset, buf.data() + checksumsPos + bh.fileId, sizeof(nameOffset));
+            }
+            const uint32_t file = FileId(nameOffset);
+
+            // The columns follow all the lines of the block.
+            const uint32_t numLines = std::min<uint32_t>(bh.numLines, (bh.blockSize - sizeof(bh)) / entrySize);
+            for (uint32_t i = 0; i < numLines; ++i) {
+                LineEntry le;
+                memcpy(&le, buf.data() + blockPos + sizeof(bh) + i * sizeof(le), sizeof(le));
+                uint32_t lineNo = le.flags & 0xFFFFFFu;
+                if (lineNo == hiddenLine || lineNo == hiddenLine2) {
+                    lineNo = s_noLine;
+                }
+                lines.push_back({ base + le.offset, lineNo, file });
+            }
+            blockPos += bh.blockSize;
+        }
+
+        // The end of the function.
+        lines.push_back({ base + lh.cbCon, s_noLine, 0 });
+        });
+
+    // A line starting where a function ends comes after the end of the function.
+    std::sort(lines.begin(), lines.end(), [](const Line& a, const Line& b) {
+        if (a.rva != b.rva)
+            return a.rva < b.rva;
+        return a.lineNo == s_noLine && b.lineNo != s_noLine;
+        });
+
+    // Keep the last one of each address and drop the repeats of the same line.
+    size_t n = 0;
+    for (size_t i = 0; i < lines.size(); ++i) {
+        if (n > 0 && lines[n - 1].rva == lines[i].rva) {
+            lines[n - 1] = lines[i];
+            continue;
+        }
+        if (n > 0 && lines[n - 1].lineNo == lines[i].lineNo && lines[n - 1].file == lines[i].file)
+            continue;
+        lines[n++] = lines[i];
+    }
+    lines.resize(n);
+    m.lines.Build(lines);
+
+    Stats::AddCount(L"pdb_lines.decoded_modules");
+    Stats::AddCount(L"pdb_lines.lines", n);
+    Stats::AddCount(L"pdb_lines.bytes", m.lines.Bytes());
+
+    return std::wstring();
+}
+
+bool PdbLines::Find(uint32_t rva, std::wstring& fileName, uint32_t& lineNo, uint32_t& lineRva)
+{
+    auto rangeItr = std::upper_bound(m_ranges.begin(), m_ranges.end(), rva, [](uint32_t v, const Range& r) { return v < r.begin; });
+    if (rangeItr == m_ranges.begin())
+        return false;
+    --rangeItr;
+    if (rva >= rangeItr->end)
+        return false;
+
+    Module& m = m_modules[rangeItr->moduleIdx];
+    if (!m.decoded) {
+        auto errStr = DecodeModule(m);
+        if (!errStr.empty()) {
+            Stats::AddCount(L"pdb_lines.decode_failures");
+            m.lines = LineTable();
+        }
+    }
+
+    Line line;
+    if (!m.lines.Find(rva, line) || line.lineNo == s_noLine)
+        return false;
+
+    fileName = FileName(m_fileNameOffsets[line.file]);
+    lineNo = line.lineNo;
+    lineRva = line.rva;
+    return true;
+}
+
+uint32_t PdbLines::FileId(uint32_t nameOffset)
+{
+    auto [itr, inserted] = m_fileIds.try_emplace(nameOffset, (uint32_t)m_fileNameOffsets.size());
+    if (inserted) {
+        m_fileNameOffsets.push_back(nameOffset);
+    }
+    return itr->second;
+}
+
+const std::wstring& PdbLines::FileName(uint32_t nameOffset)
+{
+    auto [itr, inserted] = m_fileNames.try_emplace(nameOffset);
+    if (!inserted || nameOffset >= m_namesSize)
+        return itr->second;
+
+    // Read until the terminator. Names are short, so a few hundred bytes are read at a time.
+    std::string u8;
+    uint64_t pos = sizeof(NamesHeader) + nameOffset;
+    const uint64_t end = sizeof(NamesHeader) + (uint64_t)m_namesSize;
+    char chunk[256];
+    while (pos < end) {
+        const uint32_t n = (uint32_t)std::min<uint64_t>(sizeof(chunk), end - pos);
+        if (!m_pdb.ReadStream(m_namesStream, pos, n, chunk).empty())
+            break;
+        const size_t len = strnlen(chunk, n);
+        u8.append(chunk, len);
+        if (len < n)
+            break;
+        pos += n;
+    }
+
+    if (!u8.empty()) {
+        int len = MultiByteToWideChar(CP_UTF8, 0, u8.data(), (int)u8.size(), nullptr, 0);
+        if (len > 0) {
+            itr->second.resize(len);
+            MultiByteToWideChar(CP_UTF8, 0, u8.data(), (int)u8.size(), itr->second.data(), len);
+        }
+    }
+    return itr->second;
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <Windows.h>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <filesystem>
+
+#include "PdbFile.h"
+
+// Source lines of a PDB read from the DBI stream and the C13 line subsections of the compilands.
+// Open() builds only the address ranges of the compilands from the section contributions. The lines of
+// a compiland are decoded the first time an address in it is looked up and kept, so the memory and the
+// time follow the compilands hit by the frames, not the size of the PDB.
+class PdbLines
+{
+public:
+    static constexpr uint32_t   s_noLine = 0;
+    static constexpr uint16_t   s_nilStream = 0xFFFFu;
+
+    struct Line {
+        uint32_t    rva;        // the first address of the line.
+        uint32_t    lineNo;     // s_noLine ends the line before without starting a new one.
+        uint32_t    file;       // interned id of the file name.
+    };
+
+    // Lines sorted by the address, packed in blocks of s_linesPerBlock. Each line is the delta of the address,
+    // the zigzag delta of the line number with a bit telling that the file changes, and then the file id, all
+    // as LEB128. A block starts from its address in m_blocks, so a lookup is a binary search over the blocks
+    // and a scan of one block. Most lines take 2 or 3 bytes instead of sizeof(Line).
+    class LineTable {
+    public:
+        static constexpr size_t     s_linesPerBlock = 16;
+
+        struct Block {
+            uint32_t    rva;
+            uint32_t    offset; // in m_data.
+        };
+
+        std::vector<Block>      m_blocks;
+        std::vector<uint8_t>    m_data;
+        size_t                  m_numLines = 0;
+
+    public:
+        void Build(const std::vector<Line>& lines);
+        // The last line starting at or before "rva". Returns false when there is none.
+        bool Find(uint32_t rva, Line& line) const;
+        size_t Bytes() const { return m_blocks.size() * sizeof(Block) + m_data.size(); }
+    };
+
+    struct Range {
+        uint32_t    begin;
+        uint32_t    end;
+        uint32_t    moduleIdx;
+    };
+
+    struct Module {
+        uint16_t            stream = s_nilStream;
+        uint32_t            c13Offset = 0;
+        uint32_t            c13Size = 0;
+        bool                decoded = false;
+        LineTable           lines;
+    };
+
+    PdbFile                             m_pdb;
+    uint32_t                            m_namesStream = 0;
+    uint32_t                            m_namesSize = 0;
+    std::vector<uint32_t>               m_sectionRvas; // by the section number - 1.
+    std::vector<Range>                  m_ranges; // code only, sorted by begin. Adjacent ranges of a compiland are merged.
+    std::vector<Module>                 m_modules;
+    std::unordered_map<uint32_t, uint32_t>  m_fileIds; // by the offset in the /names stream.
+    std::vector<uint32_t>               m_fileNameOffsets; // by the file id.
+    std::map<uint32_t, std::wstring>    m_fileNames; // by the offset in the /names stream.
+
+public:
+    std::wstring Open(const std::filesystem::path& pdbPath);
+
+    // The line which has the RVA. Returns false when the address has no line.
+    bool Find(uint32_t rva, std::wstring& fileName, uint32_t& lineNo, uint32_t& lineRva);
+
+    std::wstring ReadModuleInfo(uint64_t offset, uint32_t size);
+    std::wstring ReadSectionHeaders(uint64_t dbgHeaderOffset, uint32_t dbgHeaderSize);
+    std::wstring ReadSectionContributions(uint64_t offset, uint32_t size);
+    std::wstring DecodeModule(Module& m);
+    uint32_t FileId(uint32_t nameOffset);
+    const std::wstring& FileName(uint32_t nameOffset);
+};
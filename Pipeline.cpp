@@ -0,0 +1,140 @@
+#include <algorithm>
+#include <iomanip>
+
+#include "Pipeline.h"
+#include "Stats.h"
+
+namespace {
+    constexpr const wchar_t* stageNames[] = {
+        L"image_signature",
+        L"cache_probe",
+        L"download",
+        L"pdb_load",
+        L"symbol_lookup",
+        L"format",
+    };
+    static_assert(std::size(stageNames) == (size_t)StageTracer::Stage::Count);
+};
+
+WorkerPool::WorkerPool(size_t numThreads)
+{
+    for (size_t i = 0; i < numThreads; ++i) {
+        m_threads.emplace_back([this]() {
+            for (;;) {
+                std::function<void()> task;
+                {
+                    std::unique_lock<std::mutex> lock(m_mutex);
+                    m_cv.wait(lock, [this]() { return m_quit || !m_tasks.empty(); });
+                    if (m_tasks.empty())
+                        return;
+                    task = std::move(m_tasks.front());
+                    m_tasks.pop_front();
+                }
+                task();
+            }
+            });
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_cv.notify_all();
+    for (auto& t : m_threads) {
+        t.join();
+    }
+}
+
+void WorkerPool::Push(std::function<void()>&& task)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tasks.push_back(std::move(task));
+    }
+    m_cv.notify_one();
+}
+
+StageTracer::Scope::Scope(StageTracer* tracer, Stage stage, const wchar_t* name) :
+    m_tracer(tracer),
+    m_stage(stage),
+    m_statsName(Stats::Enabled() ? name : nullptr),
+    m_span(name, L"stage", name != nullptr)
+{
+    if (m_tracer != nullptr || m_statsName != nullptr) {
+        m_begin = Clock::now();
+    }
+}
+
+StageTracer::Scope::~Scope()
+{
+    End();
+}
+
+void StageTracer::Scope::End()
+{
+    m_span.End();
+    if (m_tracer == nullptr && m_statsName == nullptr)
+        return;
+
+    auto end = Clock::now();
+    if (m_statsName != nullptr) {
+        Stats::AddTime(m_statsName, m_begin, end);
+        m_statsName = nullptr;
+    }
+    if (m_tracer != nullptr) {
+        std::lock_guard<std::mutex> lock(m_tracer->m_mutex);
+        m_tracer->m_spans.push_back({ m_stage, m_begin, end });
+        m_tracer = nullptr;
+    }
+}
+
+void StageTracer::Enable()
+{
+    m_enabled = true;
+    m_start = Clock::now();
+}
+
+void StageTracer::Dump(std::wostream& os)
+{
+    if (!m_enabled)
+        return;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto wall = std::chrono::duration<double, std::milli>(Clock::now() - m_start).count();
+
+    os << L"--- Stage occupancy (wall " << std::fixed << std::setprecision(1) << wall << L" ms) ---" << std::endl;
+    os << std::left << std::setw(18) << L"stage" << std::right << std::setw(8) << L"tasks" << std::setw(12) << L"busy(ms)"
+        << std::setw(12) << L"occupancy" << std::setw(10) << L"peak" << std::endl;
+
+    for (size_t s = 0; s < (size_t)Stage::Count; ++s) {
+        // Sweep over the begin/end events to get the peak number of concurrent tasks.
+        std::vector<std::pair<Clock::time_point, int>> events;
+        double busy = 0.0;
+        size_t tasks = 0;
+        for (const auto& span : m_spans) {
+            if ((size_t)span.stage != s)
+                continue;
+            ++tasks;
+            busy += std::chrono::duration<double, std::milli>(span.end - span.begin).count();
+            events.push_back({ span.begin, 1 });
+            events.push_back({ span.end, -1 });
+        }
+        std::sort(events.begin(), events.end());
+        int concurrent = 0, peak = 0;
+        for (const auto& e : events) {
+            concurrent += e.second;
+            peak = std::max<int>(peak, concurrent);
+        }
+
+        // Average number of tasks running in the stage during the run.
+        double occupancy = wall > 0.0 ? busy / wall : 0.0;
+
+        os << std::left << std::setw(18) << stageNames[s] << std::right << std::setw(8) << tasks << std::setw(12) << busy
+            << std::setw(12) << std::setprecision(2) << occupancy << std::setw(10) << peak << std::setprecision(1) << std::endl;
+    }
+    os << std::defaultfloat;
+}
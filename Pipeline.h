@@ -0,0 +1,112 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <deque>
+#include <array>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <iostream>
+
+#include "Trace.h"
+
+// A fixed size thread pool which runs the I/O bound stages of the resolver.
+class WorkerPool
+{
+public:
+	std::vector<std::thread>                m_threads;
+	std::deque<std::function<void()>>       m_tasks;
+	std::mutex                              m_mutex;
+	std::condition_variable                 m_cv;
+	bool                                    m_quit = false;
+
+public:
+	explicit WorkerPool(size_t numThreads);
+	~WorkerPool(); // Waits for all pushed tasks.
+
+	void Push(std::function<void()>&& task);
+};
+
+// Hands finished items from the workers to the thread running the CPU bound stages.
+template<typename T>
+class CompletionQueue
+{
+public:
+	std::deque<T>                           m_items;
+	std::mutex                              m_mutex;
+	std::condition_variable                 m_cv;
+
+public:
+	// Notifies while holding the lock, so the queue may be destroyed as soon as the last item is popped
+	// even though the worker which pushed it lives on.
+	void Push(T&& item)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_items.push_back(std::move(item));
+		m_cv.notify_one();
+	}
+
+	T Pop()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_cv.wait(lock, [this]() { return !m_items.empty(); });
+		T item = std::move(m_items.front());
+		m_items.pop_front();
+		return item;
+	}
+};
+
+// Records when each stage was busy and reports the occupancy of the stages.
+// A scope given a name is also a Stats timer and a trace span of that name, so one scope measures a step for all
+// the reports. The scopes run per frame are left unnamed.
+class StageTracer
+{
+public:
+	enum class Stage : size_t {
+		ImageSignature = 0,
+		CacheProbe,
+		Download,
+		PDBLoad,
+		SymbolLookup,
+		Format,
+		Count
+	};
+
+	using Clock = std::chrono::steady_clock;
+
+	struct Span {
+		Stage               stage;
+		Clock::time_point   begin;
+		Clock::time_point   end;
+	};
+
+	class Scope {
+	public:
+		StageTracer*        m_tracer = nullptr;
+		Stage               m_stage = Stage::Count;
+		const wchar_t*      m_statsName = nullptr; // nullptr while Stats is disabled.
+		Clock::time_point   m_begin;
+		Trace::Span         m_span;
+
+		Scope(StageTracer* tracer, Stage stage, const wchar_t* name);
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+		~Scope();
+
+		void Arg(const wchar_t* key, const std::wstring& value) { m_span.Arg(key, value); }
+		void Arg(const wchar_t* key, uint64_t value) { m_span.Arg(key, value); }
+		void End();
+	};
+
+	bool                    m_enabled = false;
+	Clock::time_point       m_start;
+	std::vector<Span>       m_spans;
+	std::mutex              m_mutex;
+
+public:
+	void Enable();
+	Scope Begin(Stage stage, const wchar_t* name = nullptr) { return Scope(m_enabled ? this : nullptr, stage, name); }
+	void Dump(std::wostream& os);
+};
@@ -0,0 +1,1162 @@
+#include <Windows.h>
+#include <Psapi.h>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <iostream>
+#include <sstream>
+#include <filesystem>
+#include <future>
+#include <mutex>
+#include <chrono>
+#include <algorithm>
+
+#include "Resolver.h"
+#include "HttpGet.h"
+#include "PdbFile.h"
+#include "CacheLock.h"
+#include "Stats.h"
+#include "Trace.h"
+#include "Minidump.h"
+#include "X64Unwinder.h"
+#include "Log.h"
+
+std::mutex CallstackResolver::s_backendMutex;
+
+namespace {
+    // Counted per frame, so they are interned.
+    const Stats::Counter framesCounter(L"resolve.frames");
+    const Stats::Counter repeatsCounter(L"resolve.repeats");
+    const Stats::Counter symbolTableHitsCounter(L"resolve.symbol_table.hits");
+    const Stats::Counter inlineIndexHitsCounter(L"resolve.inline_index.hits");
+    const Stats::Counter inlineIndexMissesCounter(L"resolve.inline_index.misses");
+
+    // One of this many frames is recorded as a "resolve" span of the trace.
+    constexpr uint64_t resolveSpanSampleRate = 1024;
+    std::atomic<uint64_t> resolveSpanCalls = 0;
+
+    // Committed private memory of the process. The difference over a PDB load is the memory the backend keeps for it.
+    uint64_t PrivateBytes()
+    {
+        PROCESS_MEMORY_COUNTERS_EX pmc = { sizeof(PROCESS_MEMORY_COUNTERS_EX), };
+        if (!GetProcessMemoryInfo(GetCurrentProcess(), reinterpret_cast<PROCESS_MEMORY_COUNTERS*>(&pmc), sizeof(pmc)))
+            return 0;
+        return pmc.PrivateUsage;
+    }
+
+    // Place a PDB found in a slower tier into the cache directory of a faster tier.
+    // A hard link is tried first, and a copy is made when the tiers are on different volumes.
+    // The file is published with a rename so other readers never see a partially copied PDB.
+    std::wstring PromotePDB(const std::filesystem::path& srcPath, const std::filesystem::path& destPath)
+    {
+        std::error_code ec;
+
+        if (std::filesystem::exists(destPath, ec)) {
+            return std::wstring();
+        }
+
+        std::filesystem::create_directories(destPath.parent_path(), ec);
+        if (ec) {
+            std::wstringstream ss;
+            ss << L"Failed to create a directory \"" << destPath.parent_path().wstring() << L"\" to promote a PDB.";
+            return ss.str();
+        }
+
+        std::filesystem::path tmpPath = destPath;
+        tmpPath += L"." + std::to_wstring(GetCurrentProcessId()) + L".promoting"; // unique among processes sharing the cache.
+        std::filesystem::remove(tmpPath, ec);
+
+        std::filesystem::create_hard_link(srcPath, tmpPath, ec);
+        if (ec) {
+            ec.clear();
+            std::filesystem::copy_file(srcPath, tmpPath, std::filesystem::copy_options::overwrite_existing, ec);
+            if (ec) {
+                std::wstringstream ss;
+                ss << L"Failed to copy \"" << srcPath.wstring() << L"\" to \"" << tmpPath.wstring() << L"\".";
+                std::filesystem::remove(tmpPath, ec);
+                return ss.str();
+            }
+        }
+
+        std::filesystem::rename(tmpPath, destPath, ec);
+        if (ec) {
+            std::filesystem::remove(tmpPath, ec);
+            if (std::filesystem::exists(destPath, ec)) {
+                // Another promotion has won the race.
+                return std::wstring();
+            }
+            std::wstringstream ss;
+            ss << L"Failed to publish the promoted PDB \"" << destPath.wstring() << L"\".";
+            return ss.str();
+        }
+
+        return std::wstring();
+    }
+};
+
+std::wstring CallstackResolver::Init(const std::vector<Context::symbol>& symbols)
+{
+    if (m_backend == nullptr) {
+        auto errStr = SymbolBackend::Create(L"dbghelp", m_backend);
+        if (!errStr.empty()) {
+            return errStr;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> backendLock(s_backendMutex);
+        auto errStr = m_backend->Init();
+        if (!errStr.empty()) {
+            return errStr;
+        }
+    }
+
+    for (const auto& s : symbols) {
+        auto addTier = [&](SymbolTier&& tier) {
+            if (std::find(m_tiers.begin(), m_tiers.end(), tier) == m_tiers.end()) {
+                m_tiers.push_back(std::move(tier));
+            }
+            };
+
+        if (s.cache.has_value()) {
+            SymbolTier tier;
+            tier.m_kind = SymbolTier::Kind::Cache;
+            tier.m_path = s.cache.value();
+            tier.m_writable = s.writable.value_or(true);
+            addTier(std::move(tier));
+        }
+        if (s.direct.has_value()) {
+            SymbolTier tier;
+            tier.m_kind = SymbolTier::Kind::Direct;
+            tier.m_path = s.direct.value();
+            addTier(std::move(tier));
+        }
+        if (s.server.has_value() && s.cache.has_value()) {
+            SymbolTier tier;
+            tier.m_kind = SymbolTier::Kind::Server;
+            tier.m_path = s.cache.value();
+            tier.m_url = s.server.value();
+            tier.m_writable = true;
+            addTier(std::move(tier));
+        }
+    }
+    for (size_t i = 0; i < m_tiers.size(); ++i) {
+        if (m_tiers[i].m_kind == SymbolTier::Kind::Cache && m_tiers[i].m_writable) {
+            m_promotionTierIdx = i;
+            break;
+        }
+    }
+    m_searchPool = std::make_unique<WorkerPool>(m_numSearchThreads);
+
+    return std::wstring();
+}
+
+std::wstring CallstackResolver::Finalize()
+{
+    std::wstringstream ss;
+
+    // ResolveAll() waits for the searches it pushes, so nothing is left to run.
+    m_searchPool.reset();
+
+    // Wait for background promotions so that the next run finds the PDBs in the fastest tier.
+    for (auto& p : m_promotions) {
+        auto errStr = p.get();
+        if (!errStr.empty()) {
+            Log::Warning([&](Log::Message& m) { m << L"Failed to promote a PDB. " << errStr; });
+        }
+    }
+    m_promotions.clear();
+
+    if (m_backend != nullptr) {
+        std::lock_guard<std::mutex> backendLock(s_backendMutex);
+        for (auto& itr : m_loadedPDBList) {
+            auto errStr = m_backend->UnloadModule(*itr.second->m_module);
+            if (!errStr.empty()) {
+                ss << errStr << L" ";
+            }
+        }
+        m_loadedPDBList.clear();
+        m_unloadedPDBs.clear();
+
+        auto errStr = m_backend->Finalize();
+        if (!errStr.empty()) {
+            ss << errStr;
+        }
+    }
+
+    return ss.str();
+}
+
+std::unique_ptr<PdbLines> CallstackResolver::OpenLines(const std::filesystem::path& pdbPath)
+{
+    auto lines = std::make_unique<PdbLines>();
+    auto errStr = lines->Open(pdbPath);
+    if (!errStr.empty()) {
+        Log::Warning([&](Log::Message& m) { m << L"Lines of " << pdbPath << L" are read by the backend. " << errStr; });
+        return nullptr;
+    }
+    return lines;
+}
+
+std::wstring CallstackResolver::LoadPDB(const std::filesystem::path& pdbFilePath_arg, bool withLines, PDBInfo*& pdb)
+{
+    pdb = nullptr;
+
+    auto pdbFilePath = pdbFilePath_arg;
+    pdbFilePath = pdbFilePath.make_preferred().lexically_normal();
+
+    if (pdbFilePath.extension() != L".pdb" && pdbFilePath.extension() != L".PDB") {
+        std::wstringstream ss;
+        ss << L"Invalid pdb/PDB file name detected. \"" << pdbFilePath << L"\". ";
+        return ss.str();
+    }
+
+    // Already have loaded the PDB.
+    const std::wstring key = pdbFilePath.replace_extension(L".pdb").wstring();
+    {
+        std::lock_guard<std::mutex> backendLock(s_backendMutex);
+        auto errStr = FindLoadedPDB(key, withLines, pdb);
+        if (!errStr.empty() || pdb != nullptr) {
+            return errStr;
+        }
+    }
+
+    auto stageScope = m_stageTracer.Begin(StageTracer::Stage::PDBLoad, withLines ? L"load_pdb" : L"load_pdb_publics");
+    stageScope.Arg(L"path", pdbFilePath.native());
+
+    // Lines are decoded per compiland when a frame hits it, instead of the backend reading all of them now.
+    std::unique_ptr<PdbLines> lines;
+    if (withLines && m_backend->HasPdbFiles()) {
+        lines = OpenLines(pdbFilePath);
+    }
+    const bool backendLines = withLines && lines == nullptr;
+
+    std::lock_guard<std::mutex> backendLock(s_backendMutex);
+
+    // Another call may have loaded it meanwhile.
+    {
+        auto errStr = FindLoadedPDB(key, withLines, pdb);
+        if (!errStr.empty() || pdb != nullptr) {
+            return errStr;
+        }
+    }
+
+    Log::Info([&](Log::Message& m) { m << L"Loading PDB..  " << pdbFilePath; m.Field(L"lines", withLines ? L"yes" : L"no"); });
+
+    std::unique_ptr<PDBInfo> loadingPDB = std::make_unique<PDBInfo>();
+    loadingPDB->m_pdbPath = pdbFilePath;
+    loadingPDB->m_publicsOnly = !withLines;
+    loadingPDB->m_backendLines = backendLines;
+    loadingPDB->m_lines = std::move(lines);
+
+    {
+        const uint64_t privateBytes = Stats::Enabled() ? PrivateBytes() : 0;
+        auto errStr = m_backend->LoadModule(pdbFilePath, !withLines, backendLines, loadingPDB->m_module);
+        if (!errStr.empty()) {
+            return errStr;
+        }
+        if (Stats::Enabled()) {
+            const uint64_t loaded = PrivateBytes();
+            Stats::AddCount(withLines ? L"load_pdb.private_bytes" : L"load_pdb_publics.private_bytes", loaded > privateBytes ? loaded - privateBytes : 0);
+        }
+    }
+
+    pdb = loadingPDB.get();
+    m_loadedPDBList.insert({ loadingPDB->m_pdbPath.replace_extension(L".pdb"), std::move(loadingPDB) });
+
+    return std::wstring();
+}
+
+std::wstring CallstackResolver::FindLoadedPDB(const std::wstring& key, bool withLines, PDBInfo*& pdb)
+{
+    pdb = nullptr;
+
+    auto itr = m_loadedPDBList.find(key);
+    if (itr == m_loadedPDBList.end()) {
+        return std::wstring();
+    }
+    if (withLines && itr->second->m_publicsOnly) {
+        auto errStr = UpgradePDB(*itr->second, false);
+        if (!errStr.empty()) {
+            // The module has been unloaded. The next request loads it from scratch.
+            m_unloadedPDBs.push_back(std::move(itr->second));
+            m_loadedPDBList.erase(itr);
+            return errStr;
+        }
+    }
+    pdb = itr->second.get();
+
+    return std::wstring();
+}
+
+std::wstring CallstackResolver::UpgradePDB(PDBInfo& pdb, bool backendLines)
+{
+    auto stageScope = m_stageTracer.Begin(StageTracer::Stage::PDBLoad, L"upgrade_pdb");
+    stageScope.Arg(L"path", pdb.m_pdbPath.native());
+
+    const bool wasPublicsOnly = pdb.m_publicsOnly;
+    if (wasPublicsOnly) {
+        pdb.m_lines = OpenLines(pdb.m_pdbPath);
+    }
+    backendLines |= pdb.m_lines == nullptr;
+
+    Log::Info([&](Log::Message& m) { m << L"Reloading PDB..  " << pdb.m_pdbPath; m.Field(L"backend_lines", backendLines ? L"yes" : L"no"); });
+
+    {
+        auto errStr = m_backend->ReloadModule(*pdb.m_module, false, backendLines);
+        if (!errStr.empty()) {
+            return errStr;
+        }
+    }
+
+    if (wasPublicsOnly) {
+        // Public symbols have decorated names and no sizes. Look the symbols up again.
+        pdb.m_symbolTable.clear();
+    }
+    pdb.m_inlineIndex.clear();
+    pdb.m_publicsOnly = false;
+    pdb.m_backendLines = backendLines;
+    Stats::AddCount(L"load_pdb.upgrades");
+
+    return std::wstring();
+}
+
+std::wstring CallstackResolver::LoadImage(const std::wstring& imageName)
+{
+    auto stageScope = m_stageTracer.Begin(StageTracer::Stage::ImageSignature, L"load_image");
+    stageScope.Arg(L"path", imageName);
+
+    std::filesystem::path imageFilePath(imageName);
+    imageFilePath = imageFilePath.make_preferred().lexically_normal();
+
+    std::unique_ptr<ImageInfo> imageInfo = std::make_unique<ImageInfo>();
+    imageInfo->m_imagePath = imageFilePath;
+
+    {
+        std::lock_guard<std::mutex> backendLock(s_backendMutex);
+        auto errStr = m_backend->ReadImageSignature(imageFilePath, imageInfo->m_pdbPathString, imageInfo->m_guid, imageInfo->m_age, imageInfo->m_imageSize);
+        if (!errStr.empty()) {
+            return errStr;
+        }
+    }
+
+    imageInfo->m_pdbSignature = PdbSignature(imageInfo->m_guid, imageInfo->m_age);
+
+    {
+        std::lock_guard<std::mutex> lock(m_imageListMutex);
+        m_imageList.insert({ imageName, std::move(imageInfo) });
+    }
+
+    return std::wstring();
+}
+
+std::wstring CallstackResolver::PdbSignature(const GUID& gid, uint32_t age)
+{
+    std::vector<wchar_t>    u16buf(1024, L'\0');
+    swprintf_s(u16buf.data(), u16buf.size(), L"%08X%04X%04X%02X%02X%02X%02X%02X%02X%02X%02X%X",
+        gid.Data1, gid.Data2, gid.Data3,
+        gid.Data4[0], gid.Data4[1], gid.Data4[2], gid.Data4[3],
+        gid.Data4[4], gid.Data4[5], gid.Data4[6], gid.Data4[7], age);
+
+    return u16buf.data();
+}
+
+bool CallstackResolver::ParsePdbSignature(const std::wstring& signature, GUID& gid, uint32_t& age)
+{
+    if (signature.size() < 33 || signature.size() > 40 || signature.find_first_not_of(L"0123456789abcdefABCDEF") != std::wstring::npos)
+        return false;
+
+    auto hex = [&](size_t pos, size_t len) {
+        return std::stoull(signature.substr(pos, len), nullptr, 16);
+        };
+    gid.Data1 = (uint32_t)hex(0, 8);
+    gid.Data2 = (uint16_t)hex(8, 4);
+    gid.Data3 = (uint16_t)hex(12, 4);
+    for (size_t i = 0; i < 8; ++i) {
+        gid.Data4[i] = (uint8_t)hex(16 + i * 2, 2);
+    }
+    age = (uint32_t)hex(32, std::wstring::npos);
+
+    return true;
+}
+
+std::wstring CallstackResolver::ImageKey(const std::wstring& imageName, const std::optional<std::wstring>& pdbSignature)
+{
+    if (!pdbSignature.has_value())
+        return imageName;
+    return imageName + L"{" + pdbSignature.value() + L"}";
+}
+
+void CallstackResolver::RegisterImage(const std::wstring& imageKey, const std::wstring& pdbName, const GUID& gid, uint32_t age, size_t imageSize)
+{
+    std::unique_ptr<ImageInfo> imageInfo = std::make_unique<ImageInfo>();
+    imageInfo->m_imageSize = imageSize;
+    imageInfo->m_pdbPathString = pdbName;
+    imageInfo->m_guid = gid;
+    imageInfo->m_age = age;
+    imageInfo->m_pdbSignature = PdbSignature(gid, age);
+    imageInfo->m_knownSignature = true;
+
+    std::lock_guard<std::mutex> lock(m_imageListMutex);
+    m_imageList.insert({ imageKey, std::move(imageInfo) });
+}
+
+CallstackResolver::ImageInfo* CallstackResolver::FindImage(const std::wstring& imageName)
+{
+    std::lock_guard<std::mutex> lock(m_imageListMutex);
+
+    auto ilItr = m_imageList.find(imageName);
+    if (ilItr == m_imageList.end())
+        return nullptr;
+    return ilItr->second.get();
+}
+
+std::wstring CallstackResolver::SearchPDB(const std::wstring& imageName)
+{
+    // load image if needed.
+    ImageInfo* imageInfo = FindImage(imageName);
+    if (imageInfo == nullptr) {
+        auto errStr = LoadImage(imageName);
+        if (!errStr.empty()) {
+            return errStr;
+        }
+        imageInfo = FindImage(imageName);
+    }
+    std::lock_guard<std::mutex> searchLock(imageInfo->m_searchMutex);
+
+    // Already have the PDB information.
+    if (!imageInfo->m_serchedPDBPathString.empty()) {
+        return std::wstring();
+    }
+    // A failed server search isn't repeated until its wait has passed, so a long lived resolver retries a PDB
+    // which wasn't on the servers yet without asking them for every frame.
+    const auto now = std::chrono::steady_clock::now();
+    const bool searchServers = now >= imageInfo->m_nextServerSearch;
+    if (searchServers) {
+        const uint32_t shift = std::min<uint32_t>(imageInfo->m_serverFailures, 31);
+        const uint64_t waitMs = std::min<uint64_t>((uint64_t)m_serverRetryMinMs << shift, m_serverRetryMaxMs);
+        imageInfo->m_nextServerSearch = now + std::chrono::milliseconds(waitMs);
+        ++imageInfo->m_serverFailures; // moot once the PDB is found.
+    }
+
+    std::filesystem::path pdbName(imageName);
+    if (imageInfo->m_knownSignature && !imageInfo->m_pdbPathString.empty()) {
+        // The name in the CodeView record is the name the PDB is stored with.
+        pdbName = std::filesystem::path(imageInfo->m_pdbPathString).filename();
+    }
+    else {
+        pdbName = pdbName.filename().replace_extension(L".pdb");
+    }
+
+    std::filesystem::path symbolCacheDirName = pdbName / std::filesystem::path(imageInfo->m_pdbSignature) / pdbName;
+
+    auto foundPDB = [&](const std::filesystem::path& pdbFullpath) {
+        imageInfo->m_serchedPDBPathString = pdbFullpath.wstring();
+    };
+
+    // 1. Search under the local tiers in the declared order.
+    auto probeScope = m_stageTracer.Begin(StageTracer::Stage::CacheProbe);
+    for (size_t tierIdx = 0; tierIdx < m_tiers.size(); ++tierIdx) {
+        const auto& tier = m_tiers[tierIdx];
+        if (tier.m_kind == SymbolTier::Kind::Server)
+            continue;
+
+        std::filesystem::path pdbFullpath = tier.m_path;
+        if (tier.m_kind == SymbolTier::Kind::Cache) {
+            pdbFullpath /= symbolCacheDirName;
+        }
+        else {
+            pdbFullpath /= pdbName;
+        }
+
+        Stats::Scope probeStats(L"cache_probe");
+        Trace::Span probeSpan(L"cache_probe", L"search");
+        probeSpan.Arg(L"path", pdbFullpath.native());
+        if (std::filesystem::exists(pdbFullpath)) {
+            // A PDB without a signature directory can't be validated nor promoted.
+            if (tier.m_kind == SymbolTier::Kind::Cache) {
+                auto errStr = PdbFile::Validate(pdbFullpath, imageInfo->m_guid, imageInfo->m_age);
+                if (!errStr.empty()) {
+                    Stats::AddCount(L"cache_probe.rejected");
+                    Log::Info([&](Log::Message& m) { m << L"Checking PDB.. " << pdbFullpath << L". Ignored. " << errStr; });
+                    continue;
+                }
+                Stats::AddCount(L"cache_probe.hit");
+                Log::Info([&](Log::Message& m) { m << L"Checking PDB.. " << pdbFullpath << L". Found."; m.Field(L"tier", tierIdx); });
+                Promote(tierIdx, pdbFullpath, symbolCacheDirName);
+            }
+            else {
+                Stats::AddCount(L"cache_probe.hit");
+                Log::Info([&](Log::Message& m) { m << L"Checking PDB.. " << pdbFullpath << L". Found."; m.Field(L"tier", tierIdx); });
+            }
+            foundPDB(pdbFullpath);
+            return std::wstring();
+        }
+        else {
+            // Not found.
+            Stats::AddCount(L"cache_probe.miss");
+            Log::Debug([&](Log::Message& m) { m << L"Checking PDB.. " << pdbFullpath << L". Not found."; m.Field(L"tier", tierIdx); });
+        }
+    }
+
+    probeScope.End();
+
+    if (searchServers) {
+        // 2. server
+        auto downloadScope = m_stageTracer.Begin(StageTracer::Stage::Download);
+        for (size_t tierIdx = 0; tierIdx < m_tiers.size(); ++tierIdx) {
+            const auto& tier = m_tiers[tierIdx];
+            if (tier.m_kind != SymbolTier::Kind::Server)
+                continue;
+
+            std::wstring getReqURL = tier.m_url;
+            getReqURL += L"/";
+            getReqURL += pdbName;
+            getReqURL += L"/";
+            getReqURL += imageInfo->m_pdbSignature;
+            getReqURL += L"/";
+            getReqURL += pdbName;
+
+            std::filesystem::path destPath = tier.m_path;
+
+            if (!std::filesystem::exists(destPath)) {
+                std::wstringstream ss;
+                ss << L"Invalid synbol server cache detected.. \"" << destPath.wstring() << "\".";
+                return ss.str();
+            }
+            destPath /= symbolCacheDirName;
+
+            // Only one process downloads a cache entry. The others wait for it and reuse the PDB.
+            auto validator = [&imageInfo](const std::filesystem::path& p) -> std::wstring {
+                return PdbFile::Validate(p, imageInfo->m_guid, imageInfo->m_age);
+                };
+            CacheLock::Outcome outcome = CacheLock::Outcome::DownloadFailed;
+            auto errStr = CacheLock::Download(getReqURL, destPath, m_downloadLockTimeoutMs, validator, outcome);
+            switch (outcome) {
+            case CacheLock::Outcome::Reused:
+                Log::Info([&](Log::Message& m) { m << L"Downloaded by another process. " << destPath; });
+                Promote(tierIdx, destPath, symbolCacheDirName);
+                foundPDB(destPath);
+                return std::wstring();
+            case CacheLock::Outcome::Replaced:
+                Stats::AddCount(L"cache_probe.replaced");
+                break;
+            case CacheLock::Outcome::LockFailed:
+                Log::Warning([&](Log::Message& m) { m << L"[CacheLock] Failed. " << errStr; });
+                continue;
+            case CacheLock::Outcome::DownloadFailed:
+                // Ignoring errors of HTTP Get request. i.e. 404
+                Log::Info([&](Log::Message& m) { m << L"[HttpGet] Failed. " << errStr; });
+                continue;
+            case CacheLock::Outcome::Downloaded:
+                break;
+            }
+
+            // 3. Check the downloaded PDB.
+            if (std::filesystem::exists(destPath)) {
+                Log::Info([&](Log::Message& m) { m << L"Checking PDB.. " << destPath << L". Found."; m.Field(L"tier", tierIdx); });
+                Promote(tierIdx, destPath, symbolCacheDirName);
+                foundPDB(destPath);
+                return std::wstring();
+            }
+            Log::Debug([&](Log::Message& m) { m << L"Checking PDB.. " << destPath << L". Not found."; m.Field(L"tier", tierIdx); });
+        }
+    }
+
+    std::wstringstream ss;
+    ss << L"Failed to find the PDB for \"" << imageName << "\".";
+    return ss.str();
+}
+
+std::wstring CallstackResolver::SearchPDBfromImage(Context::resolved_callstack& cs)
+{
+    if (cs.pdb.has_value())
+        return std::wstring();
+
+    const auto imageName = ImageKey(cs.image.value(), cs.pdb_signature);
+
+    auto errStr = SearchPDB(imageName);
+    if (!errStr.empty()) {
+        return errStr;
+    }
+
+    const ImageInfo* imageInfo = FindImage(imageName);
+    cs.pdb = imageInfo->m_serchedPDBPathString;
+    cs.pdb_signature = imageInfo->m_pdbSignature;
+
+    return std::wstring();
+}
+
+void CallstackResolver::Promote(size_t foundTierIdx, const std::filesystem::path& foundPath, const std::filesystem::path& symbolCacheDirName)
+{
+    if (!m_promotionTierIdx.has_value() || m_promotionTierIdx.value() >= foundTierIdx)
+        return;
+
+    std::filesystem::path destPath = m_tiers[m_promotionTierIdx.value()].m_path / symbolCacheDirName;
+    if (destPath == foundPath)
+        return;
+
+    Log::Info([&](Log::Message& m) { m << L"Promoting PDB.. " << foundPath << L" -> " << destPath; });
+
+    std::lock_guard<std::mutex> lock(m_promotionsMutex);
+    // A resolver of the library lives long. Drop the promotions which have finished.
+    m_promotions.remove_if([](std::future<std::wstring>& p) {
+        if (p.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            return false;
+        auto errStr = p.get();
+        if (!errStr.empty()) {
+            Log::Warning([&](Log::Message& m) { m << L"Failed to promote a PDB. " << errStr; });
+        }
+        return true;
+        });
+    m_promotions.push_back(std::async(std::launch::async, PromotePDB, foundPath, destPath));
+}
+
+const CallstackResolver::InlineRange* CallstackResolver::FindInlineRange(PDBInfo& pdb, uint64_t offsetAddr)
+{
+    // Look up the interval index first. Hot frames hit the same few ranges again and again.
+    {
+        auto itr = pdb.m_inlineIndex.upper_bound(offsetAddr);
+        if (itr != pdb.m_inlineIndex.begin()) {
+            --itr;
+            if (offsetAddr < itr->second.m_end) {
+                inlineIndexHitsCounter.Add();
+                return &itr->second;
+            }
+        }
+    }
+
+    if (!m_backend->HasInlineFrames(*pdb.m_module, offsetAddr))
+        return nullptr;
+
+    // The lines of inlined functions come from the backend. It reads the line tables on the first inlined frame of the PDB.
+    if (!pdb.m_backendLines) {
+        auto errStr = UpgradePDB(pdb, true);
+        if (!errStr.empty()) {
+            Log::Warning([&](Log::Message& m) { m << errStr; });
+            return nullptr;
+        }
+    }
+
+    std::vector<SymbolBackend::InlineFrame> frames;
+    std::optional<SymbolBackend::Line> callSite;
+    if (!m_backend->FindInlineFrames(*pdb.m_module, offsetAddr, frames, callSite))
+        return nullptr;
+
+    inlineIndexMissesCounter.Add();
+
+    InlineRange range;
+    uint64_t rangeBegin = offsetAddr;
+    range.m_end = offsetAddr + 1;
+
+    for (size_t i = 0; i < frames.size(); ++i) {
+        const auto& f = frames[i];
+        Context::inline_frame frame;
+        if (!f.name.empty()) {
+            frame.function = m_symbolNames.Undecorate(f.name);
+        }
+        if (f.line.has_value()) {
+            frame.line = f.line->fileName;
+            frame.values.line_no = f.line->lineNo;
+
+            if (i == 0) {
+                // The line record of the innermost inlinee bounds the range.
+                rangeBegin = f.line->offset;
+                if (f.line->end > offsetAddr) {
+                    range.m_end = f.line->end;
+                }
+            }
+        }
+        range.m_frames.push_back(std::move(frame));
+    }
+
+    // The call site in the physical function.
+    if (callSite.has_value()) {
+        range.m_callSiteLine = callSite->fileName;
+        range.m_callSiteLineNo = callSite->lineNo;
+        range.m_callSiteLineAddr = callSite->offset;
+    }
+
+    if (range.m_end <= offsetAddr + 1) {
+        // Unknown extent. Only this address is indexed.
+        rangeBegin = offsetAddr;
+    }
+
+    auto [itr, inserted] = pdb.m_inlineIndex.insert({ rangeBegin, std::move(range) });
+    return &itr->second;
+}
+
+std::wstring CallstackResolver::Resolve(Context::resolved_callstack& cs, bool withLines)
+{
+    if (cs.isComment)
+        return std::wstring();
+
+    Stats::Scope stats(L"resolve");
+    framesCounter.Add();
+
+    PDBInfo* pdb = nullptr;
+    {
+        auto errStr = PreparePDB(cs, withLines, pdb);
+        if (!errStr.empty()) {
+            return errStr;
+        }
+    }
+
+    auto stageScope = m_stageTracer.Begin(StageTracer::Stage::SymbolLookup);
+    std::lock_guard<std::mutex> backendLock(s_backendMutex);
+    return ResolveInPDB(cs, *pdb, withLines, nullptr);
+}
+
+void CallstackResolver::ResolveBatch(Context& ctx, const std::vector<size_t>& frames, bool withLines, FrameErrors& errors)
+{
+    Stats::Scope stats(L"resolve");
+    Trace::Span span(L"resolve_batch", L"resolve");
+    span.Arg(L"frames", frames.size());
+
+    struct Pending {
+        PDBInfo*    pdb;
+        uint64_t    offset;
+        size_t      idx;
+    };
+    std::vector<Pending> pending;
+    pending.reserve(frames.size());
+
+    // The images have been searched, so this only loads the PDBs. Frames of an image mostly come in a row.
+    {
+        std::wstring lastKey;
+        const Context::resolved_callstack* last = nullptr;
+        PDBInfo* lastPdb = nullptr;
+        uint64_t numFrames = 0;
+        for (auto idx : frames) {
+            auto& cs = ctx.resolved_callstacks[idx];
+            if (cs.isComment)
+                continue;
+            ++numFrames;
+
+            auto key = cs.pdb.has_value() ? cs.pdb.value() : ImageKey(cs.image.value(), cs.pdb_signature);
+            if (last != nullptr && key == lastKey) {
+                cs.pdb = last->pdb;
+                cs.pdb_signature = last->pdb_signature;
+            }
+            else {
+                auto errStr = PreparePDB(cs, withLines, lastPdb);
+                if (!errStr.empty()) {
+                    errors.emplace_back(idx, std::move(errStr));
+                    last = nullptr;
+                    continue;
+                }
+                lastKey = std::move(key);
+                last = &cs;
+            }
+            pending.push_back({ lastPdb, cs.values.image_offset.value(), idx });
+        }
+        framesCounter.Add(numFrames);
+    }
+
+    std::sort(pending.begin(), pending.end(), [](const Pending& a, const Pending& b) {
+        if (a.pdb != b.pdb)
+            return std::less<PDBInfo*>()(a.pdb, b.pdb);
+        if (a.offset != b.offset)
+            return a.offset < b.offset;
+        return a.idx < b.idx;
+        });
+
+    {
+        auto stageScope = m_stageTracer.Begin(StageTracer::Stage::SymbolLookup);
+        std::lock_guard<std::mutex> backendLock(s_backendMutex);
+
+        PDBInfo* pdb = nullptr;
+        SymbolTable::iterator cursor;
+        const Context::resolved_callstack* prev = nullptr;
+        for (const auto& p : pending) {
+            auto& cs = ctx.resolved_callstacks[p.idx];
+            if (p.pdb != pdb) {
+                pdb = p.pdb;
+                cursor = pdb->m_symbolTable.end();
+                prev = nullptr;
+            }
+
+            if (prev != nullptr && prev->values.image_offset == cs.values.image_offset) {
+                cs.function = prev->function;
+                cs.line = prev->line;
+                cs.inlines = prev->inlines;
+                cs.values.function_offset = prev->values.function_offset;
+                cs.values.line_no = prev->values.line_no;
+                cs.values.line_offset = prev->values.line_offset;
+                repeatsCounter.Add();
+                continue;
+            }
+
+            auto errStr = ResolveInPDB(cs, *pdb, withLines, &cursor);
+            if (!errStr.empty()) {
+                errors.emplace_back(p.idx, std::move(errStr));
+                prev = nullptr;
+                continue;
+            }
+            prev = &cs;
+        }
+    }
+}
+
+std::wstring CallstackResolver::PreparePDB(Context::resolved_callstack& cs, bool withLines, PDBInfo*& pdb)
+{
+    // Search and load the PDB.
+    if (!cs.pdb.has_value()) {
+        auto errStr = SearchPDBfromImage(cs);
+        if (!errStr.empty()) {
+            return errStr;
+        }
+    }
+
+    return LoadPDB(cs.pdb.value(), withLines, pdb);
+}
+
+std::wstring CallstackResolver::ResolveInPDB(Context::resolved_callstack& cs, PDBInfo& pdb, bool withLines, SymbolTable::iterator* cursor)
+{
+    // A span of every frame would be most of the trace. Batches have spans of their own.
+    Trace::Span span(L"resolve", L"resolve", Trace::Sample(resolveSpanCalls, resolveSpanSampleRate));
+    if (span.Active()) {
+        span.Arg(L"image", cs.image.value_or(cs.pdb.value_or(std::wstring())));
+        span.Arg(L"offset", cs.values.image_offset.value_or(0));
+        span.Arg(L"sampled_every", resolveSpanSampleRate);
+    }
+
+    const auto& offsetAddr = cs.values.image_offset.value();
+
+    // Search the address. Symbols found before are looked up in the symbol table of the PDB first.
+    {
+        auto& symbolTable = pdb.m_symbolTable;
+        auto contains = [&](SymbolTable::iterator i) {
+            return offsetAddr >= i->first && offsetAddr < i->first + i->second.m_size;
+            };
+
+        SymbolTable::iterator itr;
+        if (cursor != nullptr && *cursor != symbolTable.end() && contains(*cursor)) {
+            itr = *cursor;
+            symbolTableHitsCounter.Add();
+        }
+        else if (itr = symbolTable.upper_bound(offsetAddr); itr != symbolTable.begin() && contains(std::prev(itr))) {
+            --itr;
+            symbolTableHitsCounter.Add();
+        }
+        else {
+            SymbolBackend::Symbol symbol;
+            if (!m_backend->FindSymbol(*pdb.m_module, offsetAddr, symbol)) {
+                std::wstringstream ss;
+                ss << L"Failed to get a symbol info in \"" << pdb.m_pdbPath.wstring() << L"\" with offset" << std::hex << L"0x" << offsetAddr << L". ";
+                return ss.str();
+            }
+
+            SymbolEntry entry;
+            entry.m_size = symbol.size;
+            entry.m_decoratedName = std::move(symbol.name);
+            itr = symbolTable.insert_or_assign(symbol.offset, std::move(entry)).first;
+        }
+        if (cursor != nullptr) {
+            *cursor = itr;
+        }
+
+        if (!itr->second.m_decoratedName.empty()) {
+            cs.function = m_symbolNames.Undecorate(itr->second.m_decoratedName);
+            cs.values.function_offset = offsetAddr - itr->first;
+        }
+    }
+
+    if (!withLines) {
+        cs.inlines.clear();
+        cs.line.reset();
+        cs.values.line_no.reset();
+        cs.values.line_offset.reset();
+        return std::wstring();
+    }
+
+    // Expand inlined callees. The line of the physical function is the call site of the outermost inlinee.
+    if (auto inlineRange = FindInlineRange(pdb, offsetAddr); inlineRange != nullptr) {
+        cs.inlines = inlineRange->m_frames;
+        if (inlineRange->m_callSiteLine.has_value()) {
+            cs.line = inlineRange->m_callSiteLine;
+            cs.values.line_no = inlineRange->m_callSiteLineNo;
+            cs.values.line_offset = offsetAddr - inlineRange->m_callSiteLineAddr;
+        }
+        else {
+            cs.line.reset();
+            cs.values.line_no.reset();
+            cs.values.line_offset.reset();
+        }
+        return std::wstring();
+    }
+
+    // Search line info if available.
+    if (const auto& lines = pdb.m_lines; lines != nullptr) {
+        std::wstring fileName;
+        uint32_t lineNo = 0, lineRva = 0;
+        if (lines->Find((uint32_t)offsetAddr, fileName, lineNo, lineRva)) {
+            cs.line = std::move(fileName);
+            cs.values.line_no = lineNo;
+            cs.values.line_offset = offsetAddr - lineRva;
+        }
+        else {
+            cs.line.reset();
+            cs.values.line_no.reset();
+            cs.values.line_offset.reset();
+        }
+    }
+    else {
+        SymbolBackend::Line line;
+        if (!m_backend->FindLine(*pdb.m_module, offsetAddr, line)) {
+            // A PDB which doesn't have line info.  
+            cs.line.reset();
+            cs.values.line_no.reset();
+            cs.values.line_offset.reset();
+        }
+        else {
+            cs.line = std::move(line.fileName);
+            cs.values.line_no = line.lineNo;
+            cs.values.line_offset = offsetAddr - line.offset;
+        }
+    }
+
+    return std::wstring();
+}
+
+std::filesystem::path CallstackResolver::LocalImagePath(const Context& ctx, const std::wstring& modulePath)
+{
+    std::filesystem::path p(modulePath);
+    auto itr = ctx.paths.find(p.filename().wstring());
+    if (itr != ctx.paths.end())
+        return itr->second;
+
+    std::error_code ec;
+    if (p.is_absolute() && std::filesystem::exists(p, ec))
+        return p;
+    return std::filesystem::path();
+}
+
+std::wstring CallstackResolver::UnwindStacks(Context& ctx)
+{
+    {
+        auto errStr = ctx.SortModules();
+        if (!errStr.empty()) {
+            return errStr;
+        }
+    }
+
+    X64Unwinder unwinder;
+    for (const auto& m : ctx.modules) {
+        auto localPath = LocalImagePath(ctx, m.path);
+        if (localPath.empty()) {
+            Log::Warning([&](Log::Message& msg) { msg << L"[Unwind] No image for \"" << m.path << L"\"."; });
+            continue;
+        }
+        auto errStr = unwinder.AddModule(m.base, m.size, localPath);
+        if (!errStr.empty()) {
+            Log::Warning([&](Log::Message& msg) { msg << L"[Unwind] " << errStr; });
+        }
+    }
+
+    std::vector<uint64_t> frames;
+    for (size_t i = 0; i < ctx.stacks.size(); ++i) {
+        const auto& s = ctx.stacks[i];
+
+        X64Unwinder::Registers regs;
+        for (const auto& [name, value] : s.registers) {
+            auto idx = X64Unwinder::RegisterIndex(name);
+            if (!idx.has_value()) {
+                std::wstringstream ss;
+                ss << L"Unknown register \"" << name << L"\" in a stack.";
+                return ss.str();
+            }
+            if (idx.value() == X64Unwinder::NumRegisters) {
+                regs.rip = value;
+            }
+            else {
+                regs.gpr[idx.value()] = value;
+            }
+        }
+
+        frames.clear();
+        unwinder.Unwind(regs, { s.stack_base, s.stack.data(), s.stack.size() }, m_maxStackFrames, frames);
+
+        ctx.callstacks.push_back(L"--- stack " + std::to_wstring(i));
+        for (auto addr : frames) {
+            wchar_t buf[24];
+            swprintf_s(buf, std::size(buf), L"0x%llx", (unsigned long long)addr);
+            ctx.callstacks.push_back(buf);
+        }
+        Stats::AddCount(L"unwind.frames", frames.size());
+    }
+    Stats::AddCount(L"unwind.stacks", ctx.stacks.size());
+
+    return std::wstring();
+}
+
+std::wstring CallstackResolver::AddDumpCallstacks(Context& ctx, const std::filesystem::path& dumpPath)
+{
+    Minidump dump;
+    {
+        auto errStr = dump.Open(dumpPath);
+        if (!errStr.empty()) {
+            return errStr;
+        }
+    }
+
+    // A local copy is used for the modules without a CodeView record.
+    auto imageName = [&](const Minidump::Module& m) -> std::wstring {
+        if (!m.m_hasCodeView) {
+            auto localPath = LocalImagePath(ctx, m.m_path);
+            if (!localPath.empty())
+                return localPath.wstring();
+        }
+        return m.m_path;
+        };
+
+    // x64 threads are walked with the unwind data of the images found locally. Others are scanned.
+    X64Unwinder unwinder;
+    if (dump.m_arch == Minidump::Arch::Amd64) {
+        for (const auto& m : dump.m_modules) {
+            auto localPath = LocalImagePath(ctx, m.m_path);
+            if (localPath.empty())
+                continue;
+            auto errStr = unwinder.AddModule(m.m_base, m.m_size, localPath);
+            if (!errStr.empty()) {
+                Log::Warning([&](Log::Message& msg) { msg << L"[Unwind] " << errStr; });
+            }
+        }
+    }
+
+    for (const auto& m : dump.m_modules) {
+        if (!m.m_hasCodeView)
+            continue;
+        auto imageKey = ImageKey(m.m_path, PdbSignature(m.m_guid, m.m_age));
+        if (FindImage(imageKey) == nullptr) {
+            RegisterImage(imageKey, m.m_pdbName, m.m_guid, m.m_age, m.m_size);
+        }
+    }
+
+    std::vector<uint64_t> frames;
+    for (const auto& t : dump.m_threads) {
+        {
+            std::wstringstream ss;
+            ss << L"--- thread 0x" << std::hex << t.m_id;
+            Context::resolved_callstack rcs;
+            rcs.isComment = true;
+            rcs.image = ss.str();
+            ctx.resolved_callstacks.push_back(std::move(rcs));
+        }
+
+        frames.clear();
+        if (!unwinder.m_modules.empty()) {
+            const uint8_t* stackData = dump.ReadMemory(t.m_stackStart, t.m_stackSize);
+            if (stackData != nullptr) {
+                X64Unwinder::Registers regs;
+                regs.rip = t.m_ip;
+                std::copy(std::begin(t.m_registers), std::end(t.m_registers), regs.gpr);
+                unwinder.Unwind(regs, { t.m_stackStart, stackData, t.m_stackSize }, m_maxStackFrames, frames);
+            }
+        }
+        if (frames.size() < 2) {
+            // The top frame isn't in an image with unwind data.
+            frames.clear();
+            dump.ScanStack(t, m_maxStackFrames, frames);
+        }
+        for (auto addr : frames) {
+            Context::resolved_callstack rcs;
+            const Minidump::Module* m = dump.FindModule(addr);
+            if (m == nullptr) {
+                std::wstringstream ss;
+                ss << L"0x" << std::hex << addr << L" (not in a module)";
+                rcs.isComment = true;
+                rcs.image = ss.str();
+            }
+            else {
+                rcs.image = imageName(*m);
+                rcs.values.image_offset = addr - m->m_base;
+                if (m->m_hasCodeView) {
+                    rcs.pdb_signature = PdbSignature(m->m_guid, m->m_age);
+                }
+            }
+            ctx.resolved_callstacks.push_back(std::move(rcs));
+        }
+        Stats::AddCount(L"parse_dump.frames", frames.size());
+    }
+
+    return std::wstring();
+}
+
+void CallstackResolver::ResolveAll(Context& ctx, FrameErrors& errors)
+{
+    const size_t firstError = errors.size();
+    auto resolveFrames = [&](const std::vector<size_t>& frames) {
+        ResolveBatch(ctx, frames, m_withLines, errors);
+        };
+
+    // Group the frames by image so that each image is searched once.
+    std::map<std::wstring, std::vector<size_t>> framesByImage;
+    std::vector<size_t> readyFrames;
+    for (size_t i = 0; i < ctx.resolved_callstacks.size(); ++i) {
+        const auto& cs = ctx.resolved_callstacks[i];
+        if (cs.isComment)
+            continue;
+        if (cs.pdb.has_value()) {
+            readyFrames.push_back(i);
+            continue;
+        }
+
+        auto imageKey = ImageKey(cs.image.value(), cs.pdb_signature);
+        if (cs.pdb_signature.has_value() && FindImage(imageKey) == nullptr) {
+            // "name.pdb{signature}". Nothing of the image is read, the PDB is searched by the signature.
+            GUID gid = {};
+            uint32_t age = 0;
+            if (!ParsePdbSignature(cs.pdb_signature.value(), gid, age)) {
+                std::wstringstream ss;
+                ss << L"Invalid PDB signature \"" << cs.pdb_signature.value() << L"\".";
+                errors.emplace_back(i, ss.str());
+                continue;
+            }
+            std::filesystem::path pdbName = std::filesystem::path(cs.image.value()).filename().replace_extension(L".pdb");
+            RegisterImage(imageKey, pdbName.wstring(), gid, age, 0);
+        }
+        framesByImage[imageKey].push_back(i);
+    }
+
+    struct SearchResult {
+        std::wstring    imageName;
+        std::wstring    errStr;
+        std::wstring    log;
+    };
+    CompletionQueue<SearchResult> searched;
+
+    for (const auto& [imageName, frames] : framesByImage) {
+        m_searchPool->Push([this, &searched, imageName]() {
+            // Capture the messages of each image so that they don't interleave.
+            Log::Capture capture;
+
+            SearchResult r;
+            r.imageName = imageName;
+            r.errStr = SearchPDB(imageName);
+            r.log = capture.Take();
+            searched.Push(std::move(r));
+            });
+    }
+
+    // Frames given with a PDB don't need the I/O bound stages.
+    resolveFrames(readyFrames);
+
+    for (size_t n = 0; n < framesByImage.size(); ++n) {
+        auto r = searched.Pop();
+        Log::WriteCaptured(r.log);
+
+        const auto& frames = framesByImage[r.imageName];
+        if (!r.errStr.empty()) {
+            for (auto idx : frames) {
+                errors.emplace_back(idx, r.errStr);
+            }
+            continue;
+        }
+        resolveFrames(frames);
+    }
+
+    std::stable_sort(errors.begin() + firstError, errors.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+    Stats::AddCount(L"resolve.failures", errors.size() - firstError);
+}
@@ -0,0 +1,206 @@
+#pragma once
+#include <Windows.h>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <list>
+#include <memory>
+#include <optional>
+#include <filesystem>
+#include <future>
+#include <chrono>
+#include <mutex>
+
+#include "Context.h"
+#include "PdbLines.h"
+#include "Pipeline.h"
+#include "SymbolNames.h"
+#include "SymbolBackend.h"
+
+// Resolves frames of "image + offset" to functions and source lines with the PDBs found in the symbol tiers.
+// The command line tool and the library of ResolverApi.h share it. After Init(), ResolveAll() may be called
+// from several threads at once. The calls search the images on the worker pool of the resolver, and all the
+// calls of the symbol backend in the process are serialized by s_backendMutex.
+class CallstackResolver
+{
+public:
+	class ImageInfo {
+	public:
+		std::filesystem::path               m_imagePath;
+		size_t                              m_imageSize = 0;
+		std::wstring                        m_pdbPathString;
+		GUID                                m_guid = {};
+		uint32_t                            m_age = 0;
+		std::wstring                        m_pdbSignature;
+		std::wstring                        m_serchedPDBPathString;
+		// The symbol servers are tried again after a failed search once this has passed. The wait doubles with
+		// each failure, from m_serverRetryMinMs up to m_serverRetryMaxMs.
+		std::chrono::steady_clock::time_point m_nextServerSearch;
+		uint32_t                            m_serverFailures = 0;
+		bool                                m_knownSignature = false; // m_pdbPathString, GUID and age were given, not read from the image.
+		std::mutex                          m_searchMutex; // held by SearchPDB() so that concurrent calls search an image once.
+	};
+
+	// A symbol storage declared by an entry of "symbols" in the config.
+	// Tiers are probed in the declared order, and the local tiers are always probed before the servers.
+	class SymbolTier {
+	public:
+		enum class Kind {
+			Cache,      // name.pdb/<signature>/name.pdb layout.
+			Direct,     // name.pdb without a signature.
+			Server,     // downloads into m_path with the cache layout.
+		};
+
+		Kind                                m_kind = Kind::Cache;
+		std::filesystem::path               m_path;
+		std::wstring                        m_url;
+		bool                                m_writable = false;
+
+		bool operator==(const SymbolTier& rhs) const
+		{
+			return m_kind == rhs.m_kind && m_path == rhs.m_path && m_url == rhs.m_url;
+		}
+	};
+
+	// Inline chain shared by an address range. The range is a line record of the innermost inlinee,
+	// so every address in it has the same chain and the same call site in the physical function.
+	class InlineRange {
+	public:
+		uint64_t                            m_end = 0; // image offset, exclusive.
+		std::vector<Context::inline_frame>  m_frames;
+		std::optional<std::wstring>         m_callSiteLine;
+		uint64_t                            m_callSiteLineNo = 0;
+		uint64_t                            m_callSiteLineAddr = 0; // image offset.
+	};
+
+	// A symbol found so far. The name is decorated and kept once per symbol.
+	class SymbolEntry {
+	public:
+		uint64_t                            m_size = 0;
+		std::wstring                        m_decoratedName;
+	};
+	using SymbolTable = std::map<uint64_t, SymbolEntry>;
+	using FrameErrors = std::vector<std::pair<size_t, std::wstring>>; // the index of the frame and the reason.
+
+	class PDBInfo {
+	public:
+		std::filesystem::path               m_pdbPath;
+		std::unique_ptr<SymbolBackend::Module> m_module;
+		SymbolTable                         m_symbolTable; // keyed by the image offset of each symbol.
+		std::map<uint64_t, InlineRange>     m_inlineIndex; // keyed by the first image offset of each range.
+		bool                                m_publicsOnly = false; // loaded for the frames without lines.
+		bool                                m_backendLines = false; // the backend has read the line tables. The lines of inlined functions need them.
+		std::unique_ptr<PdbLines>           m_lines; // lines of the physical functions. nullptr when the backend gives them.
+	};
+
+public:
+	static const uint32_t	m_downloadLockTimeoutMs = 10u * 60u * 1000u; // 10 min.
+	static const size_t		m_numSearchThreads = 8; // threads for the image signature, cache probe and download stages.
+	static const uint32_t	m_serverRetryMinMs = 30u * 1000u; // 30 sec. The wait after the first failed server search of an image.
+	static const uint32_t	m_serverRetryMaxMs = 60u * 60u * 1000u; // 1 hour.
+	static const size_t		m_maxStackFrames = 256; // per raw stack and per thread of a minidump.
+
+	// dbghelp is single threaded, and its state is shared by the resolvers of a process. Every call of a backend is made while holding this.
+	static std::mutex	s_backendMutex;
+	std::mutex			m_imageListMutex;
+	std::mutex			m_promotionsMutex;
+	StageTracer			m_stageTracer;
+	SymbolNames			m_symbolNames; // used while holding s_backendMutex.
+	std::unique_ptr<SymbolBackend>	m_backend; // dbghelp unless set before Init().
+	bool				m_withLines = true; // false with "--no-lines". Frames get the function names only.
+	std::unique_ptr<WorkerPool>	m_searchPool; // created by Init(), shared by the calls of ResolveAll().
+
+	std::map<std::wstring, std::unique_ptr<ImageInfo>>      m_imageList;
+	std::map<std::wstring, std::unique_ptr<PDBInfo>>        m_loadedPDBList;
+	std::vector<std::unique_ptr<PDBInfo>>                   m_unloadedPDBs; // failed to reload. Frames being resolved may still point to them.
+	std::vector<SymbolTier>                                  m_tiers;
+	std::optional<size_t>                                   m_promotionTierIdx; // the fastest writable cache tier.
+	std::list<std::future<std::wstring>>                    m_promotions;
+
+public:
+	CallstackResolver() = default;
+
+	// Initialize the symbol backend and the symbol tiers of "symbols" in the declared order.
+	std::wstring Init(const std::vector<Context::symbol>& symbols);
+
+	std::wstring Finalize();
+
+	// Index the compilands of a PDB for the lines of the physical functions. nullptr when the PDB can't be read
+	// natively, i.e. it has an OMAP. The backend reads the lines of such a PDB.
+	static std::unique_ptr<PdbLines> OpenLines(const std::filesystem::path& pdbPath);
+
+	// "withLines" false loads the public symbols only. A PDB loaded so is reloaded when lines are needed later.
+	std::wstring LoadPDB(const std::filesystem::path& pdbFilePath_arg, bool withLines, PDBInfo*& pdb);
+
+	// The PDB loaded at "key", reloaded with the lines if "withLines" and it has the public symbols only.
+	// "pdb" is nullptr when it hasn't been loaded. Must be called while holding s_backendMutex.
+	std::wstring FindLoadedPDB(const std::wstring& key, bool withLines, PDBInfo*& pdb);
+
+	// Reload a PDB with the private symbols, and with the line tables when "backendLines". A PDB which was
+	// loaded with the public symbols only gets the index of its lines too.
+	// Must be called while holding s_backendMutex.
+	std::wstring UpgradePDB(PDBInfo& pdb, bool backendLines);
+
+	std::wstring LoadImage(const std::wstring& imageName);
+
+	// The name of the signature directory in a symbol storage.
+	static std::wstring PdbSignature(const GUID& gid, uint32_t age);
+
+	// The inverse of PdbSignature(). "signature" is 32 hex digits of the GUID followed by the age in hex.
+	static bool ParsePdbSignature(const std::wstring& signature, GUID& gid, uint32_t& age);
+
+	// Images are keyed by the name and, when it was given with the frame, the PDB signature. The same
+	// name can be different builds of the image.
+	static std::wstring ImageKey(const std::wstring& imageName, const std::optional<std::wstring>& pdbSignature);
+
+	// Add an image whose PDB is known by its name, GUID and age. The image file is never read.
+	void RegisterImage(const std::wstring& imageKey, const std::wstring& pdbName, const GUID& gid, uint32_t age, size_t imageSize);
+
+	ImageInfo* FindImage(const std::wstring& imageName);
+
+	// Find the PDB of an image and keep it in the ImageInfo.
+	// This runs on a worker thread of the pipeline. The caller captures the messages of each image.
+	std::wstring SearchPDB(const std::wstring& imageName);
+
+	std::wstring SearchPDBfromImage(Context::resolved_callstack& cs);
+
+	void Promote(size_t foundTierIdx, const std::filesystem::path& foundPath, const std::filesystem::path& symbolCacheDirName);
+
+	// Find the inline chain of an address. Returns nullptr when the address isn't in inlined code.
+	// Must be called while holding s_backendMutex.
+	const InlineRange* FindInlineRange(PDBInfo& pdb, uint64_t offsetAddr);
+
+	// "withLines" false gives the function name only. The PDB is loaded with the public symbols then.
+	std::wstring Resolve(Context::resolved_callstack& cs, bool withLines);
+
+	// Resolve frames together. They are sorted by the PDB and the offset, so that the symbol and the line
+	// tables of each PDB are walked once in the address order under one lock, and a repeated address is
+	// looked up once. The results are written to the frames in place. Errors are reported in the input order.
+	void ResolveBatch(Context& ctx, const std::vector<size_t>& frames, bool withLines, FrameErrors& errors);
+
+	// Find and load the PDB of a frame.
+	std::wstring PreparePDB(Context::resolved_callstack& cs, bool withLines, PDBInfo*& pdb);
+
+	// Resolve a frame in its loaded PDB. "cursor" is the symbol of the frame before when frames come in the address
+	// order, and is checked before searching the symbol table. Must be called while holding s_backendMutex.
+	std::wstring ResolveInPDB(Context::resolved_callstack& cs, PDBInfo& pdb, bool withLines, SymbolTable::iterator* cursor);
+
+	// A local copy of a module of another machine. A file of the same name in "paths" comes first, then the
+	// path itself. Empty when neither exists.
+	static std::filesystem::path LocalImagePath(const Context& ctx, const std::wstring& modulePath);
+
+	// Walk the raw stacks with the unwind data of the images of "modules". The frames are added to
+	// "callstacks" as raw addresses, which ParseCallstacks maps to the modules.
+	std::wstring UnwindStacks(Context& ctx);
+
+	// Add the threads of a minidump as call stacks. The modules with a CodeView record are registered with
+	// their GUID and age, so their PDBs are searched without the image files.
+	std::wstring AddDumpCallstacks(Context& ctx, const std::filesystem::path& dumpPath);
+
+	// Resolve all frames as a staged pipeline.
+	// Image signature, cache probe and download of each image run on the worker pool, and the CPU bound
+	// PDB load and symbol lookup run on this thread for the images whose PDB has been found so far.
+	// The frames which failed are added to "errors" in the order of the frames.
+	void ResolveAll(Context& ctx, FrameErrors& errors);
+};
@@ -0,0 +1,263 @@
+#include <string>
+#include <vector>
+#include <optional>
+#include <memory>
+#include <algorithm>
+#include <sstream>
+#include <fstream>
+#include <filesystem>
+#include <new>
+
+#include "ResolverApi.h"
+#include "Resolver.h"
+#include "Context.h"
+
+struct csr_resolver {
+    Context             m_config; // "symbols" and "paths".
+    CallstackResolver   m_resolver;
+};
+
+namespace {
+    thread_local std::wstring   s_lastError;
+
+    int32_t Fail(int32_t status, std::wstring message)
+    {
+        s_lastError = std::move(message);
+        return status;
+    }
+
+    // Same as a frame of the input text. A relative image is looked up in "paths", then in the current directory.
+    std::filesystem::path ImagePath(const Context& config, const std::filesystem::path& image)
+    {
+        if (!image.is_relative())
+            return image;
+
+        auto itr = config.paths.find(image.wstring());
+        if (itr != config.paths.end())
+            return itr->second;
+        return std::filesystem::current_path() / image;
+    }
+
+    Context::resolved_callstack ToCallstack(const Context& config, const csr_frame& frame)
+    {
+        Context::resolved_callstack rcs;
+        rcs.values.image_offset = frame.offset;
+
+        if (frame.pdb_signature != nullptr) {
+            // Nothing of the image is read.
+            rcs.image = frame.image;
+            rcs.pdb_signature = frame.pdb_signature;
+            return rcs;
+        }
+
+        std::filesystem::path p(frame.image);
+        auto ext = p.extension().wstring();
+        if (ext == L".pdb" || ext == L".PDB") {
+            rcs.pdb = ImagePath(config, p).wstring();
+        }
+        else {
+            rcs.image = ImagePath(config, p).wstring();
+        }
+        return rcs;
+    }
+
+    // Writes the strings into the text of the caller while they fit. Once a string doesn't fit, nothing is
+    // written after it, so a retry with the needed size gets all of them.
+    class TextWriter {
+    public:
+        wchar_t*    m_text;
+        size_t      m_capacity;
+        size_t      m_size = 0;
+        bool        m_full = false;
+
+        TextWriter(wchar_t* text, size_t capacity) :
+            m_text(text), m_capacity(text != nullptr ? capacity : 0)
+        {
+        }
+
+        uint32_t Put(const std::optional<std::wstring>& s)
+        {
+            if (!s.has_value())
+                return CSR_NO_TEXT;
+
+            const size_t offset = m_size;
+            m_size += s->size() + 1;
+            if (m_full || m_size > m_capacity || offset >= CSR_NO_TEXT) {
+                m_full = true;
+                return CSR_NO_TEXT;
+            }
+            std::copy(s->begin(), s->end(), m_text + offset);
+            m_text[offset + s->size()] = L'\0';
+            return (uint32_t)offset;
+        }
+    };
+};
+
+uint32_t csr_api_version(void)
+{
+    return CSR_API_VERSION;
+}
+
+int32_t csr_create(const char* config, size_t configSize, const wchar_t* rootDir, uint32_t flags, csr_resolver** resolver)
+{
+    if (resolver == nullptr || (config == nullptr && configSize != 0)) {
+        return Fail(CSR_ERROR_INVALID_ARGUMENT, L"Invalid argument to csr_create.");
+    }
+    *resolver = nullptr;
+
+    try {
+        auto r = std::make_unique<csr_resolver>();
+        {
+            std::istringstream is(std::string(config, configSize));
+            std::filesystem::path root = rootDir != nullptr ? std::filesystem::path(rootDir) : std::filesystem::current_path();
+            auto errStr = r->m_config.ParseInputConfig(is, root);
+            if (!errStr.empty()) {
+                return Fail(CSR_ERROR_CONFIG, L"Failed to parse the config. " + errStr);
+            }
+        }
+        if (r->m_config.symbols.empty()) {
+            return Fail(CSR_ERROR_CONFIG, L"There was no symbol storage in the configuration.");
+        }
+
+        r->m_resolver.m_symbolNames.m_simplify = (flags & CSR_FLAG_SIMPLIFY_NAMES) != 0;
+        r->m_resolver.m_withLines = (flags & CSR_FLAG_NO_LINES) == 0;
+        {
+            auto errStr = r->m_resolver.Init(r->m_config.symbols);
+            if (!errStr.empty()) {
+                return Fail(CSR_ERROR_INIT, errStr);
+            }
+        }
+
+        *resolver = r.release();
+        return CSR_OK;
+    }
+    catch (const std::bad_alloc&) {
+        return Fail(CSR_ERROR_INTERNAL, L"Out of memory.");
+    }
+    catch (...) {
+        return Fail(CSR_ERROR_INTERNAL, L"Failed to create a resolver.");
+    }
+}
+
+int32_t csr_create_from_file(const wchar_t* configPath, uint32_t flags, csr_resolver** resolver)
+{
+    if (configPath == nullptr || resolver == nullptr) {
+        return Fail(CSR_ERROR_INVALID_ARGUMENT, L"Invalid argument to csr_create_from_file.");
+    }
+
+    std::string config;
+    std::filesystem::path path(configPath);
+    {
+        std::ifstream is(path, std::ios_base::in | std::ios_base::binary);
+        if (!is) {
+            std::wstringstream ss;
+            ss << L"Failed to open file \"" << path.wstring() << L"\".";
+            return Fail(CSR_ERROR_CONFIG, ss.str());
+        }
+        std::ostringstream os;
+        os << is.rdbuf();
+        config = os.str();
+    }
+    return csr_create(config.data(), config.size(), path.parent_path().wstring().c_str(), flags, resolver);
+}
+
+int32_t csr_resolve(csr_resolver* resolver, const csr_frame* frames, size_t numFrames, csr_output* output)
+{
+    if (resolver == nullptr || output == nullptr || (numFrames != 0 && (frames == nullptr || output->results == nullptr))) {
+        return Fail(CSR_ERROR_INVALID_ARGUMENT, L"Invalid argument to csr_resolve.");
+    }
+
+    try {
+        Context ctx;
+        ctx.resolved_callstacks.reserve(numFrames);
+        for (size_t i = 0; i < numFrames; ++i) {
+            if (frames[i].image == nullptr) {
+                Context::resolved_callstack rcs;
+                rcs.isComment = true;
+                ctx.resolved_callstacks.push_back(std::move(rcs));
+                continue;
+            }
+            ctx.resolved_callstacks.push_back(ToCallstack(resolver->m_config, frames[i]));
+        }
+
+        CallstackResolver::FrameErrors errors;
+        resolver->m_resolver.ResolveAll(ctx, errors);
+
+        TextWriter text(output->text, output->text_capacity);
+        const size_t inlinesCapacity = output->inlines != nullptr ? output->inlines_capacity : 0;
+        size_t numInlines = 0;
+        auto error = errors.begin();
+        for (size_t i = 0; i < numFrames; ++i) {
+            const auto& cs = ctx.resolved_callstacks[i];
+            csr_result& r = output->results[i];
+            r = csr_result();
+            r.status = CSR_OK;
+            r.message = r.function = r.line = CSR_NO_TEXT;
+
+            if (cs.isComment) {
+                r.status = CSR_ERROR_NOT_RESOLVED;
+                r.message = text.Put(std::wstring(L"The frame has no image."));
+                continue;
+            }
+            if (error != errors.end() && error->first == i) {
+                r.status = CSR_ERROR_NOT_RESOLVED;
+                r.message = text.Put(error->second);
+                ++error;
+                continue;
+            }
+
+            r.function = text.Put(cs.function);
+            r.line = text.Put(cs.line);
+            r.line_no = (uint32_t)cs.values.line_no.value_or(0);
+            r.function_offset = cs.values.function_offset.value_or(0);
+            r.line_offset = cs.values.line_offset.value_or(0);
+
+            // The inlined frames of a result are all written or none.
+            if (!cs.inlines.empty()) {
+                const size_t first = numInlines;
+                numInlines += cs.inlines.size();
+                if (numInlines <= inlinesCapacity) {
+                    r.first_inline = (uint32_t)first;
+                    r.num_inlines = (uint32_t)cs.inlines.size();
+                    for (size_t n = 0; n < cs.inlines.size(); ++n) {
+                        const auto& f = cs.inlines[n];
+                        csr_inline_frame& out = output->inlines[first + n];
+                        out.function = text.Put(f.function);
+                        out.line = text.Put(f.line);
+                        out.line_no = (uint32_t)f.values.line_no.value_or(0);
+                    }
+                }
+            }
+        }
+
+        output->inlines_size = numInlines;
+        output->text_size = text.m_size;
+        if (text.m_full || numInlines > inlinesCapacity) {
+            return Fail(CSR_ERROR_BUFFER_TOO_SMALL, L"The output buffers are too small for the frames.");
+        }
+        return CSR_OK;
+    }
+    catch (const std::bad_alloc&) {
+        return Fail(CSR_ERROR_INTERNAL, L"Out of memory.");
+    }
+    catch (...) {
+        return Fail(CSR_ERROR_INTERNAL, L"Failed to resolve the frames.");
+    }
+}
+
+void csr_destroy(csr_resolver* resolver)
+{
+    if (resolver == nullptr)
+        return;
+
+    auto errStr = resolver->m_resolver.Finalize();
+    if (!errStr.empty()) {
+        Fail(CSR_ERROR_INTERNAL, errStr);
+    }
+    delete resolver;
+}
+
+const wchar_t* csr_last_error(void)
+{
+    return s_lastError.c_str();
+}
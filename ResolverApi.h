@@ -0,0 +1,115 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <wchar.h>
+
+// C interface of the resolver for the processes which link it instead of running the tool per request.
+//
+//     csr_resolver* r = NULL;
+//     if (csr_create(configJson, configSize, L"C:\\symbols", 0, &r) != CSR_OK) { fwprintf(stderr, L"%ls\n", csr_last_error()); }
+//     csr_frame frames[] = { { L"C:\\app\\app.exe", NULL, 0x1234 }, };
+//     csr_result results[1]; csr_inline_frame inlines[16]; wchar_t text[4096];
+//     csr_output out = { results, inlines, 16, text, 4096, };
+//     int32_t status = csr_resolve(r, frames, 1, &out);
+//     ...
+//     csr_destroy(r);
+//
+// A resolver keeps the PDBs it has loaded until it is destroyed, so later calls only look the symbols up.
+// csr_resolve() may be called from several threads at once on the same resolver. csr_destroy() must not
+// overlap the other calls on the resolver.
+
+#if defined(CALLSTACKRESOLVER_STATIC)
+#define CSR_API
+#elif defined(CALLSTACKRESOLVER_EXPORTS)
+#define CSR_API __declspec(dllexport)
+#else
+#define CSR_API __declspec(dllimport)
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Changes when a struct or a function of this file changes incompatibly.
+#define CSR_API_VERSION         1
+
+// An offset in csr_output.text which has no string.
+#define CSR_NO_TEXT             0xFFFFFFFFu
+
+// Flags of csr_create().
+#define CSR_FLAG_NO_LINES       0x1u    // function names only, as "--no-lines".
+#define CSR_FLAG_SIMPLIFY_NAMES 0x2u    // as "--simplify-names".
+
+typedef enum csr_status {
+	CSR_OK = 0,
+	CSR_ERROR_INVALID_ARGUMENT,
+	CSR_ERROR_CONFIG,               // the config can't be parsed or has no symbol storage.
+	CSR_ERROR_INIT,                 // dbghelp can't be initialized.
+	CSR_ERROR_NOT_RESOLVED,         // a frame which failed. The reason is in csr_result.message.
+	CSR_ERROR_BUFFER_TOO_SMALL,     // see csr_resolve().
+	CSR_ERROR_INTERNAL,
+} csr_status;
+
+typedef struct csr_resolver csr_resolver;
+
+typedef struct csr_frame {
+	const wchar_t*      image;          // path or name of the image, or of the PDB when it ends with ".pdb". Names are looked up in "paths" of the config.
+	const wchar_t*      pdb_signature;  // GUID and age as in "name.pdb{signature}", so that no image file is read. NULL to read them from the image.
+	uint64_t            offset;         // from the base of the image.
+} csr_frame;
+
+// A function inlined into a frame, the innermost first. The strings are offsets in csr_output.text.
+typedef struct csr_inline_frame {
+	uint32_t            function;
+	uint32_t            line;
+	uint32_t            line_no;        // 0 when unknown.
+} csr_inline_frame;
+
+// The strings are offsets in csr_output.text, CSR_NO_TEXT when unknown. With inlined callees, "function"
+// and "line" are the call site in the physical function as in the output of the tool.
+typedef struct csr_result {
+	int32_t             status;         // CSR_OK or CSR_ERROR_NOT_RESOLVED.
+	uint32_t            message;        // the reason of CSR_ERROR_NOT_RESOLVED.
+	uint32_t            function;
+	uint32_t            line;
+	uint32_t            line_no;        // 0 when unknown.
+	uint32_t            first_inline;   // index in csr_output.inlines.
+	uint32_t            num_inlines;
+	uint64_t            function_offset;
+	uint64_t            line_offset;
+} csr_result;
+
+// Buffers of the caller which csr_resolve() fills.
+typedef struct csr_output {
+	csr_result*         results;        // one per frame.
+	csr_inline_frame*   inlines;
+	size_t              inlines_capacity;
+	wchar_t*            text;           // null terminated strings.
+	size_t              text_capacity;  // in characters.
+	size_t              inlines_size;   // [out] the entries of "inlines" the whole batch needs.
+	size_t              text_size;      // [out] the characters of "text" the whole batch needs.
+} csr_output;
+
+CSR_API uint32_t csr_api_version(void);
+
+// Create a resolver from the JSON of a config file, UTF-8 and "configSize" bytes. "symbols" and "paths" are
+// used, and relative paths in them are from "rootDir", or the current directory when NULL.
+CSR_API int32_t csr_create(const char* config, size_t configSize, const wchar_t* rootDir, uint32_t flags, csr_resolver** resolver);
+
+// Create a resolver from a config file.
+CSR_API int32_t csr_create_from_file(const wchar_t* configPath, uint32_t flags, csr_resolver** resolver);
+
+// Resolve "numFrames" frames into "output". Returns CSR_OK even if some frames failed, see the status of each
+// result. When the text or the inlined frames don't fit, the results are still filled without the strings
+// and the inlined frames which didn't fit, and CSR_ERROR_BUFFER_TOO_SMALL is returned. The sizes which
+// the batch needs are in text_size and inlines_size then.
+CSR_API int32_t csr_resolve(csr_resolver* resolver, const csr_frame* frames, size_t numFrames, csr_output* output);
+
+CSR_API void csr_destroy(csr_resolver* resolver);
+
+// The message of the last call of this thread which failed. Valid until the next call of this thread.
+CSR_API const wchar_t* csr_last_error(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,83 @@
+#pragma once
+#include <cstdint>
+
+// Layout of the "--binary" output. Everything is little endian and 8 byte aligned, so a consumer
+// can map the file and use the records in place.
+//
+//   Header
+//   FrameRecord[numRecords]         a record per line of the input, comments included.
+//   InlineRecord[numInlines]        inlined callees of the frames, the innermost first.
+//   StringEntry[numStrings]         offset and length of each string in the string data.
+//   string data                     UTF-8, not null terminated.
+//
+// Strings are referred by their index in the string table. Each string is stored once. Counts, indices and
+// offsets are 64 bits, so a result of any size is written without truncation.
+// Readers must reject a major version they don't know. A newer minor version only appends fields
+// to the header, which older readers skip with headerSize.
+struct ResultFile
+{
+	static constexpr char       s_magic[4] = { 'C', 'S', 'R', 'B' };
+	static constexpr uint16_t   s_majorVersion = 2; // 1 had 32 bit counts, indices and string offsets.
+	static constexpr uint16_t   s_minorVersion = 0;
+	static constexpr uint64_t   s_noString = UINT64_MAX;
+
+	enum FrameFlags : uint32_t {
+		eComment            = 1u << 0, // "image" is the comment text.
+		eHasImageOffset     = 1u << 1,
+		eHasFunctionOffset  = 1u << 2,
+		eHasLineNo          = 1u << 3,
+		eHasLineOffset      = 1u << 4,
+	};
+
+	struct Header {
+		char        magic[4];
+		uint16_t    majorVersion;
+		uint16_t    minorVersion;
+		uint32_t    headerSize;
+		uint32_t    frameRecordSize;
+		uint32_t    inlineRecordSize;
+		uint32_t    stringEntrySize;
+		uint64_t    numRecords;
+		uint64_t    numInlines;
+		uint64_t    numStrings;
+		uint64_t    recordsOffset;
+		uint64_t    inlinesOffset;
+		uint64_t    stringsOffset;
+		uint64_t    stringDataOffset;
+		uint64_t    stringDataSize;
+	};
+
+	struct FrameRecord {
+		uint32_t    flags;
+		uint32_t    lineNo;
+		uint64_t    image;
+		uint64_t    pdb;
+		uint64_t    pdbSignature;
+		uint64_t    function;
+		uint64_t    line;
+		uint64_t    firstInline;
+		uint32_t    numInlines;
+		uint32_t    reserved;
+		uint64_t    imageOffset;
+		uint64_t    functionOffset;
+		uint64_t    lineOffset;
+	};
+
+	struct InlineRecord {
+		uint64_t    function;
+		uint64_t    line;
+		uint32_t    lineNo; // 0 when unknown.
+		uint32_t    reserved;
+	};
+
+	struct StringEntry {
+		uint64_t    offset; // from stringDataOffset.
+		uint32_t    length; // in bytes.
+		uint32_t    reserved;
+	};
+};
+
+static_assert(sizeof(ResultFile::Header) == 88);
+static_assert(sizeof(ResultFile::FrameRecord) == 88);
+static_assert(sizeof(ResultFile::InlineRecord) == 24);
+static_assert(sizeof(ResultFile::StringEntry) == 16);
@@ -0,0 +1,132 @@
+#include <sstream>
+#include <cstring>
+
+#include "ResultReader.h"
+
+namespace {
+    bool InRange(uint64_t offset, uint64_t count, uint64_t elementSize, uint64_t totalSize)
+    {
+        if (offset > totalSize)
+            return false;
+        if (elementSize != 0 && count > (totalSize - offset) / elementSize)
+            return false;
+        return true;
+    }
+};
+
+ResultReader::~ResultReader()
+{
+    Close();
+}
+
+std::wstring ResultReader::Open(const std::filesystem::path& path)
+{
+    Close();
+
+    if (auto errStr = m_file.Open(path); !errStr.empty())
+        return errStr;
+
+    auto errStr = Attach(m_file.Data(), m_file.Size());
+    if (!errStr.empty()) {
+        Close();
+        std::wstringstream ss;
+        ss << L"\"" << path.wstring() << L"\" was not a valid result file. " << errStr;
+        return ss.str();
+    }
+
+    return std::wstring();
+}
+
+std::wstring ResultReader::Attach(const void* data, uint64_t size)
+{
+    m_base = reinterpret_cast<const uint8_t*>(data);
+    m_size = size;
+
+    if (size < sizeof(ResultFile::Header)) {
+        return L"Too small to have a header.";
+    }
+
+    const auto* header = reinterpret_cast<const ResultFile::Header*>(m_base);
+    if (memcmp(header->magic, ResultFile::s_magic, sizeof(header->magic)) != 0) {
+        return L"Invalid magic.";
+    }
+    if (header->majorVersion != ResultFile::s_majorVersion) {
+        std::wstringstream ss;
+        ss << L"Unsupported version " << header->majorVersion << L"." << header->minorVersion << L".";
+        return ss.str();
+    }
+    // A newer minor version may only extend the header. The records are read as arrays.
+    if (header->headerSize < sizeof(ResultFile::Header) ||
+        header->frameRecordSize != sizeof(ResultFile::FrameRecord) ||
+        header->inlineRecordSize != sizeof(ResultFile::InlineRecord) ||
+        header->stringEntrySize != sizeof(ResultFile::StringEntry)) {
+        return L"Unsupported record sizes.";
+    }
+
+    if (!InRange(header->recordsOffset, header->numRecords, header->frameRecordSize, size) ||
+        !InRange(header->inlinesOffset, header->numInlines, header->inlineRecordSize, size) ||
+        !InRange(header->stringsOffset, header->numStrings, header->stringEntrySize, size) ||
+        !InRange(header->stringDataOffset, header->stringDataSize, 1, size)) {
+        return L"A section was out of the file.";
+    }
+
+    m_header = header;
+    m_records = reinterpret_cast<const ResultFile::FrameRecord*>(m_base + header->recordsOffset);
+    m_inlines = reinterpret_cast<const ResultFile::InlineRecord*>(m_base + header->inlinesOffset);
+    m_strings = reinterpret_cast<const ResultFile::StringEntry*>(m_base + header->stringsOffset);
+    m_stringData = reinterpret_cast<const char*>(m_base + header->stringDataOffset);
+
+    // Validate the references once so that the accessors don't need to.
+    for (uint64_t i = 0; i < header->numStrings; ++i) {
+        if (m_strings[i].offset > header->stringDataSize || m_strings[i].length > header->stringDataSize - m_strings[i].offset) {
+            m_header = nullptr;
+            return L"A string was out of the string data.";
+        }
+    }
+    auto validString = [&](uint64_t id) {
+        return id == ResultFile::s_noString || id < header->numStrings;
+        };
+    for (uint64_t i = 0; i < header->numRecords; ++i) {
+        const auto& r = m_records[i];
+        if (!validString(r.image) || !validString(r.pdb) || !validString(r.pdbSignature) || !validString(r.function) || !validString(r.line) ||
+            r.firstInline > header->numInlines || r.numInlines > header->numInlines - r.firstInline) {
+            m_header = nullptr;
+            return L"A frame record had an invalid reference.";
+        }
+    }
+    for (uint64_t i = 0; i < header->numInlines; ++i) {
+        if (!validString(m_inlines[i].function) || !validString(m_inlines[i].line)) {
+            m_header = nullptr;
+            return L"An inline record had an invalid reference.";
+        }
+    }
+
+    return std::wstring();
+}
+
+void ResultReader::Close()
+{
+    m_file.Close();
+    m_base = nullptr;
+    m_size = 0;
+    m_header = nullptr;
+    m_records = nullptr;
+    m_inlines = nullptr;
+    m_strings = nullptr;
+    m_stringData = nullptr;
+}
+
+const ResultFile::InlineRecord* ResultReader::Inlines(const ResultFile::FrameRecord& rec, uint32_t& count) const
+{
+    count = rec.numInlines;
+    return m_inlines + rec.firstInline;
+}
+
+std::string_view ResultReader::String(uint64_t id) const
+{
+    if (id == ResultFile::s_noString)
+        return std::string_view();
+
+    const auto& e = m_strings[id];
+    return std::string_view(m_stringData + e.offset, e.length);
+}
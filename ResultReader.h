@@ -0,0 +1,52 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <filesystem>
+
+#include "ResultFormat.h"
+#include "MappedFile.h"
+
+// Reads the "--binary" output of the resolver in place. The file is mapped, and Open() validates the
+// header and every reference of the records once, so the accessors index the arrays without checks.
+//
+//   ResultReader r;
+//   auto errStr = r.Open(L"result.bin");
+//   for (uint64_t i = 0; i < r.NumRecords(); ++i) {
+//       const auto& f = r.Record(i);
+//       if (!(f.flags & ResultFile::eComment))
+//           count[r.String(f.function)]++;
+//   }
+class ResultReader
+{
+public:
+	MappedFile                          m_file; // open unless attached to memory.
+	const uint8_t*                      m_base = nullptr;
+	uint64_t                            m_size = 0;
+
+	const ResultFile::Header*           m_header = nullptr;
+	const ResultFile::FrameRecord*      m_records = nullptr;
+	const ResultFile::InlineRecord*     m_inlines = nullptr;
+	const ResultFile::StringEntry*      m_strings = nullptr;
+	const char*                         m_stringData = nullptr;
+
+public:
+	ResultReader() = default;
+	ResultReader(const ResultReader&) = delete;
+	ResultReader& operator=(const ResultReader&) = delete;
+	~ResultReader();
+
+	// Map a file written with "--binary".
+	std::wstring Open(const std::filesystem::path& path);
+	// Use a result already in memory, i.e. read from a pipe. The memory must outlive the reader.
+	std::wstring Attach(const void* data, uint64_t size);
+	void Close();
+
+	uint64_t NumRecords() const { return m_header != nullptr ? m_header->numRecords : 0; }
+	const ResultFile::FrameRecord& Record(uint64_t idx) const { return m_records[idx]; }
+
+	// Inlined callees of a frame, the innermost first. "count" is set to the number of them.
+	const ResultFile::InlineRecord* Inlines(const ResultFile::FrameRecord& rec, uint32_t& count) const;
+
+	// UTF-8. Empty for ResultFile::s_noString.
+	std::string_view String(uint64_t id) const;
+};
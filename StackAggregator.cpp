@@ -0,0 +1,353 @@
+#include <Windows.h>
+
+#include <fstream>
+#include <sstream>
+#include <semaphore>
+#include <charconv>
+#include <algorithm>
+#include <map>
+#include <optional>
+#include <cwchar>
+
+#include "StackAggregator.h"
+#include "Pipeline.h"
+#include "OutputFormatter.h"
+#include "Stats.h"
+
+namespace {
+    size_t HashCombine(size_t h, uint64_t v)
+    {
+        return h ^ (std::hash<uint64_t>()(v) + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2));
+    }
+
+    std::string_view Trim(std::string_view s, const char* chars = " \t")
+    {
+        auto b = s.find_first_not_of(chars);
+        if (b == std::string_view::npos)
+            return std::string_view();
+        auto e = s.find_last_not_of(chars);
+        return s.substr(b, e - b + 1);
+    }
+
+    std::optional<uint64_t> ParseOffset(std::string_view s)
+    {
+        s = Trim(s);
+        int base = 10;
+        if (s.size() > 2 && s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {
+            s.remove_prefix(2);
+            base = 16;
+        }
+        if (s.empty())
+            return std::nullopt;
+
+        uint64_t v = 0;
+        auto [ptr, ec] = std::from_chars(s.data(), s.data() + s.size(), v, base);
+        if (ec != std::errc() || ptr != s.data() + s.size())
+            return std::nullopt;
+        return v;
+    }
+
+    bool IsCount(std::string_view s)
+    {
+        return !s.empty() && std::all_of(s.begin(), s.end(), [](char c) { return c >= '0' && c <= '9'; });
+    }
+
+    std::wstring Utf8ToUtf16(std::string_view u8)
+    {
+        if (u8.empty())
+            return std::wstring();
+
+        int len = MultiByteToWideChar(CP_UTF8, 0, u8.data(), (int)u8.size(), NULL, 0);
+        std::wstring u16(len, L'\0');
+        MultiByteToWideChar(CP_UTF8, 0, u8.data(), (int)u8.size(), u16.data(), len);
+        return u16;
+    }
+
+    std::wstring HexOffset(uint64_t v)
+    {
+        wchar_t buf[24];
+        swprintf(buf, std::size(buf), L"0x%llx", (unsigned long long)v);
+        return buf;
+    }
+
+    // ';' separates the frames in the folded format.
+    std::wstring FoldedName(std::wstring_view module, std::wstring_view function)
+    {
+        std::wstring name;
+        name.reserve(module.size() + function.size() + 1);
+        name += module;
+        name += L'!';
+        name += function;
+        std::replace(name.begin() + module.size(), name.end(), L';', L':');
+        return name;
+    }
+};
+
+size_t StackAggregator::AddressKeyHash::operator()(const AddressKey& k) const
+{
+    return HashCombine(k.image, k.offset);
+}
+
+size_t StackAggregator::StackHash::operator()(const std::vector<uint32_t>& s) const
+{
+    size_t h = s.size();
+    for (auto v : s) {
+        h = HashCombine(h, v);
+    }
+    return h;
+}
+
+uint32_t StackAggregator::ImageId(std::string_view image)
+{
+    std::lock_guard<std::mutex> lock(m_imageMutex);
+
+    auto [itr, inserted] = m_imageIds.try_emplace(std::string(image), (uint32_t)m_images.size());
+    if (inserted) {
+        m_images.push_back(Utf8ToUtf16(image));
+    }
+    return itr->second;
+}
+
+uint32_t StackAggregator::AddressId(const AddressKey& key)
+{
+    auto& shard = m_addressShards[AddressKeyHash()(key) % s_numShards];
+    std::lock_guard<std::mutex> lock(shard.m_mutex);
+
+    auto [itr, inserted] = shard.m_ids.try_emplace(key, 0);
+    if (inserted) {
+        itr->second = m_numAddresses++;
+    }
+    return itr->second;
+}
+
+void StackAggregator::ParseBlock(const char* begin, const char* end)
+{
+    // Caches local to the block keep the shared maps off the per frame path.
+    std::unordered_map<std::string_view, uint32_t>              imageIds;
+    std::unordered_map<AddressKey, uint32_t, AddressKeyHash>    addressIds;
+    StackCounts                                                 counts;
+    std::vector<uint32_t>                                       stack;
+    uint64_t numSamples = 0, numBadFrames = 0;
+
+    for (const char* p = begin; p < end;) {
+        const char* eol = std::find(p, end, '\n');
+        std::string_view line = Trim(std::string_view(p, eol - p), " \t\r");
+        p = eol == end ? end : eol + 1;
+
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        // An optional sample count after the last space. "image + 1234" is an offset, not a count.
+        uint64_t count = 1;
+        {
+            auto sp = line.find_last_of(' ');
+            if (sp != std::string_view::npos) {
+                auto last = line.substr(sp + 1);
+                auto head = Trim(line.substr(0, sp));
+                if (IsCount(last) && !head.empty() && head.back() != '+') {
+                    std::from_chars(last.data(), last.data() + last.size(), count);
+                    line = head;
+                }
+            }
+        }
+
+        stack.clear();
+        for (size_t pos = 0; pos <= line.size();) {
+            auto semi = line.find(';', pos);
+            if (semi == std::string_view::npos)
+                semi = line.size();
+            auto frame = Trim(line.substr(pos, semi - pos));
+            pos = semi + 1;
+            if (frame.empty())
+                continue;
+
+            uint32_t addr = s_unknownAddr;
+            auto plus = frame.find('+');
+            if (plus != std::string_view::npos) {
+                auto image = Trim(frame.substr(0, plus), " \t\"");
+                auto offset = ParseOffset(frame.substr(plus + 1));
+                if (!image.empty() && offset.has_value()) {
+                    auto [imageItr, newImage] = imageIds.try_emplace(image, 0);
+                    if (newImage) {
+                        imageItr->second = ImageId(image);
+                    }
+                    AddressKey key{ imageItr->second, offset.value() };
+                    auto [addrItr, newAddr] = addressIds.try_emplace(key, 0);
+                    if (newAddr) {
+                        addrItr->second = AddressId(key);
+                    }
+                    addr = addrItr->second;
+                }
+            }
+            if (addr == s_unknownAddr) {
+                ++numBadFrames;
+            }
+            stack.push_back(addr);
+        }
+
+        counts[stack] += count;
+        numSamples += count;
+    }
+
+    for (auto& [s, c] : counts) {
+        auto& shard = m_stackShards[StackHash()(s) % s_numShards];
+        std::lock_guard<std::mutex> lock(shard.m_mutex);
+        shard.m_counts[s] += c;
+    }
+    m_numSamples += numSamples;
+    m_numBadFrames += numBadFrames;
+}
+
+std::wstring StackAggregator::Ingest(const std::filesystem::path& samplesPath, size_t numThreads)
+{
+    std::ifstream fs(samplesPath, std::ios::in | std::ios::binary);
+    if (!fs) {
+        std::wstringstream ss;
+        ss << L"Failed to open a sample file \"" << samplesPath.wstring() << L"\".";
+        return ss.str();
+    }
+
+    numThreads = std::max<size_t>(numThreads, 1);
+    {
+        // Bound the blocks in flight so that the memory doesn't grow with the input.
+        std::counting_semaphore<> inFlight((std::ptrdiff_t)numThreads * 2);
+        WorkerPool pool(numThreads);
+
+        std::string carry;
+        for (;;) {
+            std::string block = std::move(carry);
+            carry = std::string();
+
+            size_t filled = block.size();
+            block.resize(filled + s_blockSize);
+            fs.read(block.data() + filled, s_blockSize);
+            block.resize(filled + (size_t)fs.gcount());
+            if (block.empty())
+                break;
+
+            const bool eof = !fs;
+            if (!eof) {
+                // Carry the incomplete last line over to the next block.
+                auto lastEol = block.find_last_of('\n');
+                if (lastEol == std::string::npos) {
+                    // A line longer than a block.
+                    carry = std::move(block);
+                    continue;
+                }
+                carry.assign(block, lastEol + 1);
+                block.resize(lastEol + 1);
+            }
+
+            inFlight.acquire();
+            pool.Push([this, &inFlight, block = std::move(block)]() {
+                ParseBlock(block.data(), block.data() + block.size());
+                inFlight.release();
+                });
+
+            if (eof)
+                break;
+        }
+    }
+
+    if (fs.bad()) {
+        std::wstringstream ss;
+        ss << L"Failed to read a sample file \"" << samplesPath.wstring() << L"\".";
+        return ss.str();
+    }
+
+    // Index the addresses by id. The lookup maps are not needed anymore.
+    m_addresses.resize(m_numAddresses);
+    for (auto& shard : m_addressShards) {
+        for (const auto& [key, id] : shard.m_ids) {
+            m_addresses[id] = key;
+        }
+        shard.m_ids = {};
+    }
+
+    size_t numStacks = 0;
+    for (const auto& shard : m_stackShards) {
+        numStacks += shard.m_counts.size();
+    }
+    Stats::AddCount(L"fold.samples", m_numSamples);
+    Stats::AddCount(L"fold.distinct_stacks", numStacks);
+    Stats::AddCount(L"fold.distinct_addresses", m_addresses.size());
+    Stats::AddCount(L"fold.bad_frames", m_numBadFrames);
+
+    return std::wstring();
+}
+
+void StackAggregator::AddressStrings(std::vector<std::wstring>& out) const
+{
+    out.reserve(out.size() + m_addresses.size());
+    for (const auto& k : m_addresses) {
+        out.push_back(m_images[k.image] + L" + " + HexOffset(k.offset));
+    }
+}
+
+size_t StackAggregator::WriteFolded(std::wostream& os, const std::vector<Context::resolved_callstack>& resolved)
+{
+    // Name each address once. Inlined callees become frames of their own, below the physical function.
+    std::vector<std::wstring> names(m_addresses.size());
+    for (size_t i = 0; i < names.size(); ++i) {
+        const auto& key = m_addresses[i];
+        const Context::resolved_callstack* cs = i < resolved.size() ? &resolved[i] : nullptr;
+
+        if (cs == nullptr || cs->isComment || !cs->function.has_value()) {
+            names[i] = m_images[key.image] + L"+" + HexOffset(key.offset);
+            continue;
+        }
+
+        std::wstring module = std::filesystem::path(cs->image.value_or(cs->pdb.value_or(m_images[key.image]))).filename().wstring();
+        names[i] = FoldedName(module, cs->function.value());
+        for (auto itr = cs->inlines.rbegin(); itr != cs->inlines.rend(); ++itr) {
+            names[i] += L';';
+            names[i] += FoldedName(module, itr->function.value_or(L"<unknown>"));
+        }
+    }
+
+    // Number the distinct names in sorted order, so that stacks sorted by the name ids are sorted by the names.
+    std::vector<uint32_t> nameIds(names.size());
+    std::vector<uint32_t> nameIdx; // name id to an index of "names".
+    {
+        std::vector<uint32_t> order(names.size());
+        for (uint32_t i = 0; i < (uint32_t)order.size(); ++i) {
+            order[i] = i;
+        }
+        std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return names[a] < names[b]; });
+        for (size_t k = 0; k < order.size(); ++k) {
+            if (k == 0 || names[order[k]] != names[order[k - 1]]) {
+                nameIdx.push_back(order[k]);
+            }
+            nameIds[order[k]] = (uint32_t)nameIdx.size() - 1;
+        }
+    }
+
+    // Stacks of different addresses in the same functions fold into one line.
+    // The counts by address are released shard by shard while folding.
+    std::map<std::vector<uint32_t>, uint64_t> folded;
+    for (auto& shard : m_stackShards) {
+        for (const auto& [stack, count] : shard.m_counts) {
+            std::vector<uint32_t> ids(stack.size());
+            for (size_t i = 0; i < stack.size(); ++i) {
+                ids[i] = stack[i] == s_unknownAddr ? s_unknownAddr : nameIds[stack[i]];
+            }
+            folded[std::move(ids)] += count;
+        }
+        shard.m_counts = {};
+    }
+
+    OutputBuffer<wchar_t> b(os);
+    for (const auto& [ids, count] : folded) {
+        for (size_t i = 0; i < ids.size(); ++i) {
+            if (i > 0)
+                b.Put(L';');
+            b.Put(ids[i] == s_unknownAddr ? std::wstring_view(L"[unknown]") : std::wstring_view(names[nameIdx[ids[i]]]));
+        }
+        b.Put(L' ');
+        b.PutDec(count);
+        b.Put(L'\n');
+        b.FlushIfFull();
+    }
+
+    return folded.size();
+}
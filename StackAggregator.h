@@ -0,0 +1,74 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <array>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <filesystem>
+#include <iostream>
+
+#include "Context.h"
+
+// Aggregates sampled call stacks for "--fold".
+// Each line of the input is a sample, frames of "image + offset" separated by ';' from the root to
+// the leaf, optionally followed by a space and the number of samples. Identical stacks are counted
+// while reading, so the memory is bounded by the distinct stacks and addresses, not by the samples.
+class StackAggregator
+{
+public:
+	static const size_t         s_numShards = 64;
+	static const size_t         s_blockSize = 4u * 1024u * 1024u;
+	static const uint32_t       s_unknownAddr = 0xFFFFFFFFu; // a frame which failed to parse.
+
+	struct AddressKey {
+		uint32_t    image = 0;
+		uint64_t    offset = 0;
+
+		bool operator==(const AddressKey& rhs) const = default;
+	};
+	struct AddressKeyHash {
+		size_t operator()(const AddressKey& k) const;
+	};
+	struct StackHash {
+		size_t operator()(const std::vector<uint32_t>& s) const;
+	};
+
+	using StackCounts = std::unordered_map<std::vector<uint32_t>, uint64_t, StackHash>;
+
+	struct AddressShard {
+		std::mutex                                                  m_mutex;
+		std::unordered_map<AddressKey, uint32_t, AddressKeyHash>    m_ids;
+	};
+	struct StackShard {
+		std::mutex                                                  m_mutex;
+		StackCounts                                                 m_counts;
+	};
+
+	std::mutex                                  m_imageMutex;
+	std::unordered_map<std::string, uint32_t>   m_imageIds;
+	std::vector<std::wstring>                   m_images;
+	std::atomic<uint32_t>                       m_numAddresses = 0;
+	std::array<AddressShard, s_numShards>       m_addressShards;
+	std::array<StackShard, s_numShards>         m_stackShards;
+	std::vector<AddressKey>                     m_addresses; // indexed by the address id after Ingest().
+	std::atomic<uint64_t>                       m_numSamples = 0;
+	std::atomic<uint64_t>                       m_numBadFrames = 0;
+
+public:
+	// Read and count the samples. Blocks of lines are parsed on "numThreads" threads.
+	std::wstring Ingest(const std::filesystem::path& samplesPath, size_t numThreads);
+
+	// "image + 0xoffset" of each distinct address in the order of the address ids.
+	void AddressStrings(std::vector<std::wstring>& out) const;
+
+	// Write "a;b;c count" lines sorted by the frames. "resolved" has the resolved frame of each address id.
+	// Stacks whose frames resolve to the same functions are merged. The counts are consumed.
+	// Returns the number of lines.
+	size_t WriteFolded(std::wostream& os, const std::vector<Context::resolved_callstack>& resolved);
+
+	void ParseBlock(const char* begin, const char* end);
+	uint32_t ImageId(std::string_view image);
+	uint32_t AddressId(const AddressKey& key);
+};
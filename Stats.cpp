@@ -0,0 +1,248 @@
+#include <Windows.h>
+#include <Psapi.h>
+
+#include <iomanip>
+#include <algorithm>
+#include <cwchar>
+
+#include "Stats.h"
+
+#pragma comment(lib, "psapi.lib")
+
+std::atomic<bool>                   Stats::s_enabled = false;
+Stats::Clock::time_point            Stats::s_start;
+std::mutex                          Stats::s_mutex;
+std::map<std::wstring, Stats::Timer>    Stats::s_timers;
+std::map<std::wstring, uint64_t>    Stats::s_counters;
+thread_local Stats::ThreadCounters  Stats::s_threadCounters;
+
+namespace {
+    // A timer and a counter which make a throughput together. Bytes per second is derived in the report.
+    constexpr std::pair<const wchar_t*, const wchar_t*> throughputs[] = {
+        { L"http_get", L"http_get.bytes" },
+        { L"parse_input_config", L"parse_input_config.bytes" },
+        { L"parse_input_text", L"parse_input_text.bytes" },
+        { L"decompress", L"decompress.bytes" },
+        { L"compress", L"compress.bytes" },
+    };
+    // A timer and a counter of processed items. Items per second is derived in the report.
+    constexpr std::pair<const wchar_t*, const wchar_t*> rates[] = {
+        { L"resolve", L"resolve.frames" },
+        { L"fold_ingest", L"fold.samples" },
+        { L"unwind", L"unwind.stacks" },
+    };
+    // A timer and a counter of processed items. Milliseconds per million items is derived in the report.
+    constexpr std::pair<const wchar_t*, const wchar_t*> costs[] = {
+        { L"format", L"format.frames" },
+    };
+};
+
+Stats::Scope::Scope(const wchar_t* name)
+{
+    if (Stats::Enabled()) {
+        m_name = name;
+        m_begin = Clock::now();
+    }
+}
+
+Stats::Scope::~Scope()
+{
+    End();
+}
+
+void Stats::Scope::End()
+{
+    if (m_name != nullptr) {
+        Stats::AddTime(m_name, m_begin, Clock::now());
+        m_name = nullptr;
+    }
+}
+
+Stats::Counter::Counter(const wchar_t* name) :
+    m_name(name)
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    auto& names = CounterNames();
+    for (m_index = 0; m_index < names.size(); ++m_index) {
+        if (wcscmp(names[m_index], name) == 0)
+            return;
+    }
+    names.push_back(name);
+}
+
+void Stats::Counter::Add(uint64_t v) const
+{
+    if (!Enabled())
+        return;
+
+    if (m_index >= s_maxCounters) {
+        AddCount(m_name, v);
+        return;
+    }
+
+    // Only this thread writes the slot. DumpJson() may read it meanwhile.
+    auto& slot = s_threadCounters.values[m_index];
+    slot.store(slot.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+}
+
+Stats::ThreadCounters::ThreadCounters()
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    LiveThreadCounters().push_back(this);
+}
+
+Stats::ThreadCounters::~ThreadCounters()
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    const auto& names = CounterNames();
+    for (size_t i = 0; i < names.size() && i < s_maxCounters; ++i) {
+        uint64_t v = values[i].load(std::memory_order_relaxed);
+        if (v > 0)
+            s_counters[names[i]] += v;
+    }
+    auto& live = LiveThreadCounters();
+    live.erase(std::find(live.begin(), live.end(), this));
+}
+
+std::vector<const wchar_t*>& Stats::CounterNames()
+{
+    static std::vector<const wchar_t*> names;
+    return names;
+}
+
+std::vector<Stats::ThreadCounters*>& Stats::LiveThreadCounters()
+{
+    static std::vector<ThreadCounters*> live;
+    return live;
+}
+
+void Stats::Enable()
+{
+    s_start = Clock::now();
+    s_enabled = true;
+}
+
+void Stats::AddTime(const wchar_t* name, double ms)
+{
+    if (!Enabled())
+        return;
+
+    std::lock_guard<std::mutex> lock(s_mutex);
+    auto& t = s_timers[name];
+    if (t.count == 0) {
+        t.minMs = t.maxMs = ms;
+    }
+    else {
+        t.minMs = std::min<double>(t.minMs, ms);
+        t.maxMs = std::max<double>(t.maxMs, ms);
+    }
+    t.totalMs += ms;
+    ++t.count;
+}
+
+void Stats::AddTime(const wchar_t* name, Clock::time_point begin, Clock::time_point end)
+{
+    AddTime(name, std::chrono::duration<double, std::milli>(end - begin).count());
+}
+
+void Stats::AddCount(const wchar_t* name, uint64_t v)
+{
+    if (!Enabled())
+        return;
+
+    std::lock_guard<std::mutex> lock(s_mutex);
+    s_counters[name] += v;
+}
+
+void Stats::DumpJson(std::wostream& os)
+{
+    if (!Enabled())
+        return;
+
+    std::lock_guard<std::mutex> lock(s_mutex);
+
+    auto wall = std::chrono::duration<double, std::milli>(Clock::now() - s_start).count();
+
+    // The counters of AddCount() and the interned ones of the running threads.
+    std::map<std::wstring, uint64_t> counters = s_counters;
+    {
+        const auto& names = CounterNames();
+        for (size_t i = 0; i < names.size() && i < s_maxCounters; ++i) {
+            uint64_t v = 0;
+            for (const auto* t : LiveThreadCounters()) {
+                v += t->values[i].load(std::memory_order_relaxed);
+            }
+            if (v > 0)
+                counters[names[i]] += v;
+        }
+    }
+
+    os << std::fixed << std::setprecision(3);
+    os << L"{" << std::endl;
+    os << L"  \"wall_ms\" : " << wall << L"," << std::endl;
+    {
+        PROCESS_MEMORY_COUNTERS pmc = { sizeof(PROCESS_MEMORY_COUNTERS), };
+        if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) {
+            os << L"  \"peak_working_set_bytes\" : " << (uint64_t)pmc.PeakWorkingSetSize << L"," << std::endl;
+        }
+    }
+
+    os << L"  \"timers\" : {";
+    {
+        bool first = true;
+        for (const auto& [name, t] : s_timers) {
+            os << (first ? L"" : L",") << std::endl;
+            os << L"    \"" << name << L"\" : { \"count\" : " << t.count << L", \"total_ms\" : " << t.totalMs
+                << L", \"avg_ms\" : " << t.totalMs / (double)t.count << L", \"min_ms\" : " << t.minMs << L", \"max_ms\" : " << t.maxMs << L" }";
+            first = false;
+        }
+        os << std::endl << L"  }," << std::endl;
+    }
+
+    os << L"  \"counters\" : {";
+    {
+        bool first = true;
+        for (const auto& [name, v] : counters) {
+            os << (first ? L"" : L",") << std::endl;
+            os << L"    \"" << name << L"\" : " << v;
+            first = false;
+        }
+        os << std::endl << L"  }," << std::endl;
+    }
+
+    os << L"  \"derived\" : {";
+    {
+        bool first = true;
+        auto outPerSec = [&](const wchar_t* timerName, const wchar_t* counterName, const wchar_t* suffix) {
+            auto t = s_timers.find(timerName);
+            auto c = counters.find(counterName);
+            if (t == s_timers.end() || c == counters.end() || t->second.totalMs <= 0.0)
+                return;
+            os << (first ? L"" : L",") << std::endl;
+            os << L"    \"" << timerName << suffix << L"\" : " << (double)c->second * 1000.0 / t->second.totalMs;
+            first = false;
+            };
+        auto outPerMillion = [&](const wchar_t* timerName, const wchar_t* counterName, const wchar_t* suffix) {
+            auto t = s_timers.find(timerName);
+            auto c = counters.find(counterName);
+            if (t == s_timers.end() || c == counters.end() || c->second == 0)
+                return;
+            os << (first ? L"" : L",") << std::endl;
+            os << L"    \"" << timerName << suffix << L"\" : " << t->second.totalMs * 1000000.0 / (double)c->second;
+            first = false;
+            };
+        for (const auto& [timerName, counterName] : throughputs) {
+            outPerSec(timerName, counterName, L".bytes_per_sec");
+        }
+        for (const auto& [timerName, counterName] : rates) {
+            outPerSec(timerName, counterName, L".per_sec");
+        }
+        for (const auto& [timerName, counterName] : costs) {
+            outPerMillion(timerName, counterName, L".ms_per_million");
+        }
+        os << std::endl << L"  }" << std::endl;
+    }
+
+    os << L"}" << std::endl;
+    os << std::defaultfloat;
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include <string>
+#include <map>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+
+// Process wide timers and counters reported by "--stats json".
+// Nothing is recorded until Enable() is called.
+class Stats
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	struct Timer {
+		uint64_t    count = 0;
+		double      totalMs = 0.0;
+		double      minMs = 0.0;
+		double      maxMs = 0.0;
+	};
+
+	// Measures the time until the end of the scope and adds it to the timer "name".
+	class Scope {
+	public:
+		const wchar_t*      m_name = nullptr;
+		Clock::time_point   m_begin;
+
+		explicit Scope(const wchar_t* name);
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+		~Scope();
+
+		void End();
+	};
+
+	// A counter whose name is interned once, for the counters added per frame. Add() touches only a slot of the
+	// calling thread, without the lock and the map lookup of AddCount(). The slots are summed up by DumpJson()
+	// and folded into the counters of AddCount() when the thread ends.
+	//
+	//     static const Stats::Counter s_frames(L"resolve.frames");
+	//     s_frames.Add();
+	class Counter {
+	public:
+		size_t              m_index = 0;
+		const wchar_t*      m_name = nullptr;
+
+		explicit Counter(const wchar_t* name);
+
+		void Add(uint64_t v = 1) const;
+	};
+
+	static constexpr size_t s_maxCounters = 64; // interned counters. Beyond it, Add() falls back to AddCount().
+
+	// The slots of the interned counters of a thread.
+	struct ThreadCounters {
+		std::atomic<uint64_t>   values[s_maxCounters] = {};
+
+		ThreadCounters();
+		~ThreadCounters();
+	};
+
+	static std::atomic<bool>                s_enabled;
+	static Clock::time_point                s_start;
+	static std::mutex                       s_mutex;
+	static std::map<std::wstring, Timer>    s_timers;
+	static std::map<std::wstring, uint64_t> s_counters;
+	static thread_local ThreadCounters      s_threadCounters;
+
+public:
+	static void Enable();
+	static bool Enabled() { return s_enabled.load(std::memory_order_relaxed); }
+
+	static void AddTime(const wchar_t* name, double ms);
+	static void AddTime(const wchar_t* name, Clock::time_point begin, Clock::time_point end);
+	static void AddCount(const wchar_t* name, uint64_t v = 1);
+
+	static void DumpJson(std::wostream& os);
+
+	// Used by Counter and ThreadCounters. Function local, since Counters are constructed during the static
+	// initialization of the other files.
+	static std::vector<const wchar_t*>& CounterNames();
+	static std::vector<ThreadCounters*>& LiveThreadCounters();
+};
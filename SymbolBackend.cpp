@@ -0,0 +1,19 @@
+#include <string>
+#include <memory>
+
+#include "SymbolBackend.h"
+#include "DbgHelpBackend.h"
+#include "MockBackend.h"
+
+std::wstring SymbolBackend::Create(std::wstring_view name, std::unique_ptr<SymbolBackend>& backend)
+{
+    if (name == L"dbghelp") {
+        backend = std::make_unique<DbgHelpBackend>();
+        return std::wstring();
+    }
+    if (name == L"mock") {
+        backend = std::make_unique<MockBackend>();
+        return std::wstring();
+    }
+    return L"Unknown symbol backend \"" + std::wstring(name) + L"\". It must be dbghelp or mock.";
+}
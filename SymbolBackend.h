@@ -0,0 +1,74 @@
+#pragma once
+#include <Windows.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <optional>
+#include <memory>
+#include <filesystem>
+
+// Access to the symbols of the PDBs, for CallstackResolver. "dbghelp" reads them with dbghelp, and "mock"
+// generates them in memory so that the rest of the pipeline can be measured without any PDB. The resolver
+// makes every call while holding its backend mutex, so a backend needs no locking of its own.
+// Addresses are offsets from the base of the image.
+class SymbolBackend
+{
+public:
+	// A loaded PDB. Each backend derives its own.
+	class Module {
+	public:
+		std::filesystem::path   m_pdbPath;
+
+		virtual ~Module() = default;
+	};
+
+	struct Symbol {
+		uint64_t        offset = 0;
+		uint64_t        size = 0; // 0 for a public symbol.
+		std::wstring    name; // decorated.
+	};
+
+	struct Line {
+		std::wstring    fileName;
+		uint32_t        lineNo = 0;
+		uint64_t        offset = 0; // the first address of the line.
+		uint64_t        end = 0; // the address after the line. 0 when unknown.
+	};
+
+	// A function inlined at an address.
+	struct InlineFrame {
+		std::wstring            name; // decorated. empty when unknown.
+		std::optional<Line>     line;
+	};
+
+public:
+	virtual ~SymbolBackend() = default;
+
+	// "dbghelp" or "mock".
+	static std::wstring Create(std::wstring_view name, std::unique_ptr<SymbolBackend>& backend);
+
+	virtual std::wstring Init() = 0;
+	virtual std::wstring Finalize() = 0;
+
+	// Whether the modules are read from the PDB files, so that the resolver can read their lines natively.
+	virtual bool HasPdbFiles() const { return true; }
+
+	// The PDB name, GUID and age in the CodeView record of an image file.
+	virtual std::wstring ReadImageSignature(const std::filesystem::path& imagePath, std::wstring& pdbName, GUID& guid, uint32_t& age, size_t& imageSize) = 0;
+
+	// "publicsOnly" reads the public symbols only, and "lines" false skips the line tables of all the compilands.
+	virtual std::wstring LoadModule(const std::filesystem::path& pdbPath, bool publicsOnly, bool lines, std::unique_ptr<Module>& module) = 0;
+	virtual std::wstring ReloadModule(Module& module, bool publicsOnly, bool lines) = 0;
+	virtual std::wstring UnloadModule(Module& module) = 0;
+
+	// The symbol which has the address. Returns false when there is none.
+	virtual bool FindSymbol(Module& module, uint64_t offset, Symbol& symbol) = 0;
+	// The line which has the address. The module needs to have been loaded with the lines.
+	virtual bool FindLine(Module& module, uint64_t offset, Line& line) = 0;
+	// Whether the address is in inlined code. Cheaper than FindInlineFrames().
+	virtual bool HasInlineFrames(Module& module, uint64_t offset) = 0;
+	// The functions inlined at the address, the innermost first, and the call site in the physical function.
+	// The line of the innermost one has its "end", so that the address range which shares the chain is known.
+	virtual bool FindInlineFrames(Module& module, uint64_t offset, std::vector<InlineFrame>& frames, std::optional<Line>& callSite) = 0;
+};
@@ -0,0 +1,95 @@
+#include <Windows.h>
+#include <DbgHelp.h>
+
+#include <cwctype>
+
+#include "SymbolNames.h"
+#include "Stats.h"
+
+namespace {
+    const Stats::Counter hitsCounter(L"symbol_names.hits");
+    const Stats::Counter missesCounter(L"symbol_names.misses");
+};
+
+const std::wstring& SymbolNames::Undecorate(const std::wstring& decorated)
+{
+    auto [itr, inserted] = m_names.try_emplace(decorated);
+    if (!inserted) {
+        hitsCounter.Add();
+        return itr->second;
+    }
+    missesCounter.Add();
+
+    std::wstring name;
+    // Only MSVC decorated names start with '?'. C names are shown as they are.
+    if (decorated.starts_with(L'?')) {
+        size_t bufLen = std::max<size_t>(decorated.size() * 4, 1024);
+        for (;;) {
+            m_buffer.resize(bufLen);
+            // The qualified name only, as SYMOPT_UNDNAME gives it. The private symbols are named so by the PDB.
+            DWORD len = UnDecorateSymbolNameW(decorated.c_str(), m_buffer.data(), (DWORD)m_buffer.size(), UNDNAME_NAME_ONLY);
+            if (len == 0) {
+                // Not a name the undecorator knows.
+                name = decorated;
+                break;
+            }
+            // A result which fills the buffer may have been truncated.
+            if (len + 1 < m_buffer.size() || bufLen >= s_maxNameLen) {
+                name.assign(m_buffer.data(), len);
+                break;
+            }
+            bufLen *= 4;
+        }
+    }
+    else {
+        name = decorated;
+    }
+
+    itr->second = m_simplify ? SimplifyTemplates(name) : std::move(name);
+    return itr->second;
+}
+
+std::wstring SymbolNames::SimplifyTemplates(std::wstring_view name)
+{
+    constexpr std::wstring_view op(L"operator");
+    // The longest first.
+    constexpr std::wstring_view opTokens[] = { L"<=>", L"<<=", L">>=", L"->*", L"<<", L">>", L"<=", L">=", L"->", L"<", L">" };
+
+    std::wstring out;
+    out.reserve(name.size());
+
+    size_t depth = 0;
+    for (size_t i = 0; i < name.size(); ++i) {
+        // operator<, operator<<=, operator->, operator<=> and so on are not template arguments.
+        if (name.compare(i, op.size(), op) == 0 && (i == 0 || !(std::iswalnum(name[i - 1]) || name[i - 1] == L'_'))) {
+            size_t k = i + op.size();
+            for (auto t : opTokens) {
+                if (name.compare(k, t.size(), t) == 0) {
+                    k += t.size();
+                    break;
+                }
+            }
+            if (depth == 0) {
+                out.append(name.substr(i, k - i));
+            }
+            i = k - 1;
+            continue;
+        }
+
+        const wchar_t c = name[i];
+        if (c == L'<') {
+            if (depth == 0) {
+                out += L"<...>";
+            }
+            ++depth;
+        }
+        else if (c == L'>' && depth > 0) {
+            --depth;
+        }
+        else if (depth == 0) {
+            out += c;
+        }
+    }
+
+    return out;
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+
+// Turns the decorated names returned by dbghelp into the names to show, i.e. "Foo::Bar" without the signature.
+// Each distinct name is undecorated once and memoized, since hot frames hit the same few symbols.
+// Not thread safe. UnDecorateSymbolNameW belongs to dbghelp, so the caller serializes the calls.
+class SymbolNames
+{
+public:
+	static const size_t                             s_maxNameLen = 256u * 1024u;
+
+	bool                                            m_simplify = false; // collapse template arguments.
+	std::unordered_map<std::wstring, std::wstring>  m_names;
+	std::vector<wchar_t>                            m_buffer;
+
+public:
+	// The returned reference stays valid for the lifetime of this object.
+	const std::wstring& Undecorate(const std::wstring& decorated);
+
+	// Collapse template argument lists to "<...>".
+	// i.e. "std::vector<int,std::allocator<int> >::push_back" -> "std::vector<...>::push_back"
+	static std::wstring SimplifyTemplates(std::wstring_view name);
+};
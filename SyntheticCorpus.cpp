@@ -0,0 +1,116 @@
+#include <vector>
+#include <random>
+#include <sstream>
+#include <filesystem>
+#include <algorithm>
+#include <cmath>
+
+#include "SyntheticCorpus.h"
+
+namespace {
+    constexpr size_t    functionsPerImage = 4096;
+    constexpr size_t    minStackDepth = 8;
+    constexpr size_t    maxStackDepth = 48;
+    constexpr uint64_t  firstCodeOffset = 0x1000;
+    constexpr double    zipfExponent = 1.1;
+
+    // Cumulative weights of ranks 1..n following 1/rank^s.
+    std::vector<double> ZipfTable(size_t n, double s)
+    {
+        std::vector<double> cdf(n);
+        double sum = 0.0;
+        for (size_t i = 0; i < n; ++i) {
+            sum += 1.0 / std::pow((double)(i + 1), s);
+            cdf[i] = sum;
+        }
+        for (auto& c : cdf) {
+            c /= sum;
+        }
+        return cdf;
+    }
+
+    size_t SampleZipf(const std::vector<double>& cdf, std::mt19937_64& rng)
+    {
+        double u = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+        auto itr = std::lower_bound(cdf.begin(), cdf.end(), u);
+        return std::min<size_t>(itr - cdf.begin(), cdf.size() - 1);
+    }
+
+    struct SyntheticImage {
+        std::wstring            name;
+        std::vector<uint64_t>   functionOffsets; // in the order of the popularity.
+        std::vector<uint64_t>   functionSizes;
+    };
+};
+
+std::wstring SyntheticCorpus::Generate(const std::map<std::wstring, std::wstring>& paths, size_t numFrames, uint32_t seed, std::wostream& os)
+{
+    if (paths.empty()) {
+        return L"Synthetic corpus needs at least one image in \"paths\".";
+    }
+
+    std::mt19937_64 rng(seed);
+
+    std::vector<SyntheticImage> images;
+    for (const auto& [name, path] : paths) {
+        std::error_code ec;
+        uint64_t imageSize = std::filesystem::file_size(path, ec);
+        if (ec || imageSize <= firstCodeOffset * 2) {
+            std::wstringstream ss;
+            ss << L"Failed to get the size of an image \"" << path << L"\".";
+            return ss.str();
+        }
+
+        // Function starts are uniform in the image. Their popularity is a random permutation.
+        std::uniform_int_distribution<uint64_t> offsetDist(firstCodeOffset, imageSize - 1);
+        std::vector<uint64_t> starts(functionsPerImage);
+        for (auto& s : starts) {
+            s = offsetDist(rng) & ~0xFull;
+        }
+        std::sort(starts.begin(), starts.end());
+        starts.erase(std::unique(starts.begin(), starts.end()), starts.end());
+
+        std::vector<size_t> order(starts.size());
+        for (size_t i = 0; i < order.size(); ++i) {
+            order[i] = i;
+        }
+        std::shuffle(order.begin(), order.end(), rng);
+
+        SyntheticImage img;
+        img.name = name;
+        for (auto i : order) {
+            uint64_t end = i + 1 < starts.size() ? starts[i + 1] : imageSize;
+            img.functionOffsets.push_back(starts[i]);
+            img.functionSizes.push_back(std::max<uint64_t>(end - starts[i], 1));
+        }
+        images.push_back(std::move(img));
+    }
+
+    auto imageCdf = ZipfTable(images.size(), zipfExponent);
+    auto functionCdf = ZipfTable(functionsPerImage, zipfExponent);
+    std::uniform_int_distribution<size_t> depthDist(minStackDepth, maxStackDepth);
+
+    os << L"--- paths" << std::endl;
+    for (const auto& [name, path] : paths) {
+        os << path << std::endl;
+    }
+    os << std::endl << L"--- callstacks" << std::endl;
+
+    size_t generated = 0;
+    for (size_t stackIdx = 0; generated < numFrames; ++stackIdx) {
+        // A comment line separates stacks. It is kept as a comment in the output.
+        os << L"stack " << stackIdx << std::endl;
+
+        size_t depth = std::min<size_t>(depthDist(rng), numFrames - generated);
+        for (size_t d = 0; d < depth; ++d) {
+            const auto& img = images[SampleZipf(imageCdf, rng)];
+            size_t fn = std::min<size_t>(SampleZipf(functionCdf, rng), img.functionOffsets.size() - 1);
+            uint64_t offset = img.functionOffsets[fn] + std::uniform_int_distribution<uint64_t>(0, img.functionSizes[fn] - 1)(rng);
+
+            os << img.name << L" + 0x" << std::hex << offset << std::dec << std::endl;
+        }
+        generated += depth;
+    }
+
+    return std::wstring();
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include <string>
+#include <map>
+#include <iostream>
+
+// Generates a callstack corpus in the callstacks.txt format for benchmarking.
+// Frames are spread over the images in "paths" with a Zipf skew on both the images and the
+// functions inside them, so that a few hot modules and functions dominate like real captures.
+class SyntheticCorpus
+{
+public:
+	static const uint32_t	s_defaultSeed = 20240401; // fixed so that generated corpora are comparable between runs.
+
+	static std::wstring Generate(const std::map<std::wstring, std::wstring>& paths, size_t numFrames, uint32_t seed, std::wostream& os);
+};
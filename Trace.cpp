@@ -0,0 +1,215 @@
+#include <Windows.h>
+
+#include <fstream>
+#include <sstream>
+
+#include "Trace.h"
+
+std::atomic<bool>               Trace::s_enabled = false;
+Trace::Clock::time_point        Trace::s_start;
+std::filesystem::path           Trace::s_path;
+std::mutex                      Trace::s_mutex;
+std::vector<Trace::Event>       Trace::s_events;
+std::mutex                      Trace::s_fileMutex;
+std::ofstream                   Trace::s_file;
+std::wstring                    Trace::s_errStr;
+
+namespace {
+    std::wstring EscapeJson(const std::wstring& s)
+    {
+        std::wstring r;
+        r.reserve(s.size());
+        for (auto c : s) {
+            switch (c) {
+            case L'\\': r += L"\\\\"; break;
+            case L'\"': r += L"\\\""; break;
+            case L'\n': r += L"\\n"; break;
+            case L'\r': r += L"\\r"; break;
+            case L'\t': r += L"\\t"; break;
+            default:
+                if (c < 0x20) {
+                    wchar_t buf[8];
+                    swprintf_s(buf, L"\\u%04x", (unsigned)c);
+                    r += buf;
+                }
+                else {
+                    r += c;
+                }
+            }
+        }
+        return r;
+    }
+
+    std::string Utf16ToUtf8(const std::wstring& u16)
+    {
+        if (u16.empty())
+            return std::string();
+
+        int len = WideCharToMultiByte(CP_UTF8, 0, u16.c_str(), (int)u16.size(), NULL, 0, NULL, NULL);
+        std::string u8(len, '\0');
+        WideCharToMultiByte(CP_UTF8, 0, u16.c_str(), (int)u16.size(), u8.data(), len, NULL, NULL);
+        return u8;
+    }
+
+    uint64_t ToUs(Trace::Clock::time_point t)
+    {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(t - Trace::s_start).count();
+    }
+};
+
+Trace::Span::Span(const wchar_t* name, const wchar_t* category, bool record)
+{
+    if (record && Trace::Enabled()) {
+        m_name = name;
+        m_category = category;
+        m_begin = Clock::now();
+    }
+}
+
+Trace::Span::~Span()
+{
+    End();
+}
+
+void Trace::Span::Arg(const wchar_t* key, const std::wstring& value)
+{
+    if (!Active())
+        return;
+
+    if (!m_args.empty())
+        m_args += L",";
+    m_args += L"\"";
+    m_args += key;
+    m_args += L"\":\"";
+    m_args += EscapeJson(value);
+    m_args += L"\"";
+}
+
+void Trace::Span::Arg(const wchar_t* key, uint64_t value)
+{
+    if (!Active())
+        return;
+
+    if (!m_args.empty())
+        m_args += L",";
+    m_args += L"\"";
+    m_args += key;
+    m_args += L"\":";
+    m_args += std::to_wstring(value);
+}
+
+void Trace::Span::End()
+{
+    if (!Active())
+        return;
+
+    auto end = Clock::now();
+    Record({ m_name, m_category, L'X', ToUs(m_begin), ToUs(end) - ToUs(m_begin), GetCurrentThreadId(), std::move(m_args) });
+    m_name = nullptr;
+}
+
+std::wstring Trace::Enable(const std::filesystem::path& tracePath)
+{
+    s_path = tracePath;
+    s_file.open(s_path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!s_file) {
+        std::wstringstream ss;
+        ss << L"Failed to open a trace file \"" << s_path.wstring() << L"\".";
+        return ss.str();
+    }
+
+    std::wstringstream ss;
+    ss << L"{\"displayTimeUnit\":\"ms\",\"traceEvents\":[" << std::endl;
+    ss << L"{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << GetCurrentProcessId() << L",\"args\":{\"name\":\"CallstackResolver\"}}";
+    auto u8 = Utf16ToUtf8(ss.str());
+    s_file.write(u8.data(), u8.size());
+
+    s_events.reserve(s_flushEvents);
+    s_start = Clock::now();
+    s_enabled = true;
+    return std::wstring();
+}
+
+void Trace::Counter(const wchar_t* name, const std::wstring& series, uint64_t value)
+{
+    if (!Enabled())
+        return;
+
+    std::wstring args = L"\"";
+    args += EscapeJson(series);
+    args += L"\":";
+    args += std::to_wstring(value);
+
+    Record({ name, L"counter", L'C', ToUs(Clock::now()), 0, GetCurrentThreadId(), std::move(args) });
+}
+
+void Trace::Record(Event&& e)
+{
+    std::vector<Event> full;
+    {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        s_events.push_back(std::move(e));
+        if (s_events.size() < s_flushEvents)
+            return;
+        full.swap(s_events);
+        s_events.reserve(s_flushEvents);
+    }
+
+    // Written out of s_mutex, so the other threads keep recording meanwhile. The viewers sort the events by time.
+    std::lock_guard<std::mutex> lock(s_fileMutex);
+    WriteEvents(full);
+}
+
+void Trace::WriteEvents(const std::vector<Event>& events)
+{
+    if (!s_errStr.empty())
+        return;
+
+    const DWORD pid = GetCurrentProcessId();
+
+    std::wstringstream ss;
+    for (const auto& e : events) {
+        ss << L"," << std::endl;
+        ss << L"{\"name\":\"" << e.name << L"\",\"cat\":\"" << e.category << L"\",\"ph\":\"" << e.phase
+            << L"\",\"ts\":" << e.tsUs;
+        if (e.phase == L'X') {
+            ss << L",\"dur\":" << e.durUs;
+        }
+        ss << L",\"pid\":" << pid << L",\"tid\":" << e.tid << L",\"args\":{" << e.args << L"}}";
+    }
+
+    auto u8 = Utf16ToUtf8(ss.str());
+    s_file.write(u8.data(), u8.size());
+    if (!s_file) {
+        std::wstringstream es;
+        es << L"Failed to write a trace file \"" << s_path.wstring() << L"\".";
+        s_errStr = es.str();
+    }
+}
+
+std::wstring Trace::Write()
+{
+    if (!Enabled())
+        return std::wstring();
+    s_enabled = false;
+
+    std::vector<Event> rest;
+    {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        rest.swap(s_events);
+    }
+
+    std::lock_guard<std::mutex> lock(s_fileMutex);
+    WriteEvents(rest);
+    if (s_errStr.empty()) {
+        s_file << std::endl << "]}" << std::endl;
+        s_file.close();
+        if (!s_file) {
+            std::wstringstream es;
+            es << L"Failed to write a trace file \"" << s_path.wstring() << L"\".";
+            s_errStr = es.str();
+        }
+    }
+
+    return s_errStr;
+}
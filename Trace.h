@@ -0,0 +1,76 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+
+// Chrome/Perfetto trace-event recorder written by "--trace filename".
+// While it is disabled, a span or a counter costs one branch. The events are written to the file every
+// s_flushEvents events, so a long run doesn't keep them in memory.
+class Trace
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	struct Event {
+		const wchar_t*      name;
+		const wchar_t*      category;
+		wchar_t             phase;      // 'X': complete span, 'C': counter.
+		uint64_t            tsUs;
+		uint64_t            durUs;
+		uint32_t            tid;
+		std::wstring        args;       // JSON object members.
+	};
+
+	// A complete event from the construction to the end of the scope.
+	class Span {
+	public:
+		const wchar_t*      m_name = nullptr;
+		const wchar_t*      m_category = nullptr;
+		Clock::time_point   m_begin;
+		std::wstring        m_args;
+
+		Span(const wchar_t* name, const wchar_t* category, bool record = true);
+		Span(const Span&) = delete;
+		Span& operator=(const Span&) = delete;
+		~Span();
+
+		bool Active() const { return m_name != nullptr; }
+		void Arg(const wchar_t* key, const std::wstring& value);
+		void Arg(const wchar_t* key, uint64_t value);
+		void End();
+	};
+
+	static constexpr size_t         s_flushEvents = 4096;
+
+	static std::atomic<bool>        s_enabled;
+	static Clock::time_point        s_start;
+	static std::filesystem::path    s_path;
+	static std::mutex               s_mutex; // guards s_events.
+	static std::vector<Event>       s_events;
+	static std::mutex               s_fileMutex; // guards s_file and s_errStr. Never taken while holding s_mutex.
+	static std::ofstream            s_file;
+	static std::wstring             s_errStr; // the first failed write.
+
+public:
+	static bool Enabled() { return s_enabled.load(std::memory_order_relaxed); }
+
+	// Creates the file and starts recording.
+	static std::wstring Enable(const std::filesystem::path& tracePath);
+	static void Counter(const wchar_t* name, const std::wstring& series, uint64_t value);
+	// True for one of every "every" calls counted by "calls", for the events too many to record each time.
+	static bool Sample(std::atomic<uint64_t>& calls, uint64_t every)
+	{
+		return Enabled() && calls.fetch_add(1, std::memory_order_relaxed) % every == 0;
+	}
+
+	// Write the remaining events and finish the file given to Enable().
+	static std::wstring Write();
+
+	// Used by Span and Counter().
+	static void Record(Event&& e);
+	static void WriteEvents(const std::vector<Event>& events);
+};
@@ -0,0 +1,531 @@
+#include <sstream>
+#include <cstring>
+#include <algorithm>
+
+#include "X64Unwinder.h"
+
+namespace {
+    template<typename T>
+    bool Get(const MappedFile& f, uint64_t offset, T& v)
+    {
+        const uint8_t* p = f.At(offset, sizeof(T));
+        if (p == nullptr)
+            return false;
+        memcpy(&v, p, sizeof(T));
+        return true;
+    }
+
+    template<typename T>
+    bool GetCode(const X64Unwinder::PeImage& image, uint32_t rva, T& v)
+    {
+        const uint8_t* p = image.AtRva(rva, sizeof(T));
+        if (p == nullptr)
+            return false;
+        memcpy(&v, p, sizeof(T));
+        return true;
+    }
+
+    // Number of 16 bit slots used by an unwind code.
+    size_t CodeSlots(uint8_t op, uint8_t info)
+    {
+        switch (op) {
+        case X64Unwinder::UWOP_ALLOC_LARGE:
+            return info == 0 ? 2 : 3;
+        case X64Unwinder::UWOP_SAVE_NONVOL:
+        case X64Unwinder::UWOP_EPILOG:
+        case X64Unwinder::UWOP_SAVE_XMM128:
+            return 2;
+        case X64Unwinder::UWOP_SAVE_NONVOL_FAR:
+        case X64Unwinder::UWOP_SPARE_CODE:
+        case X64Unwinder::UWOP_SAVE_XMM128_FAR:
+            return 3;
+        default:
+            return 1;
+        }
+    }
+};
+
+bool X64Unwinder::StackMemory::Read(uint64_t address, uint64_t& v) const
+{
+    if (address < m_base || address - m_base > m_size || m_size - (address - m_base) < sizeof(v))
+        return false;
+    memcpy(&v, m_data + (address - m_base), sizeof(v));
+    return true;
+}
+
+std::wstring X64Unwinder::PeImage::Open(const std::filesystem::path& path)
+{
+    {
+        auto errStr = m_file.Open(path);
+        if (!errStr.empty())
+            return errStr;
+    }
+
+    auto invalid = [&](const wchar_t* reason) {
+        std::wstringstream ss;
+        ss << L"\"" << path.wstring() << L"\" was not a x64 PE image. " << reason;
+        return ss.str();
+        };
+
+    uint16_t mz = 0, machine = 0, numSections = 0, optSize = 0, optMagic = 0;
+    uint32_t peOffset = 0, peSignature = 0;
+    if (!Get(m_file, 0, mz) || mz != 0x5A4D || !Get(m_file, 0x3C, peOffset) ||
+        !Get(m_file, peOffset, peSignature) || peSignature != 0x00004550)
+        return invalid(L"(No PE header.)");
+
+    const uint64_t fileHeader = (uint64_t)peOffset + 4;
+    const uint64_t optHeader = fileHeader + 20;
+    Get(m_file, fileHeader, machine);
+    Get(m_file, fileHeader + 2, numSections);
+    Get(m_file, fileHeader + 16, optSize);
+    if (machine != 0x8664 || !Get(m_file, optHeader, optMagic) || optMagic != 0x20B || optSize < 112 + 4 * 8)
+        return invalid(L"(Not PE32+ for AMD64.)");
+
+    uint32_t pdataRva = 0, pdataSize = 0;
+    Get(m_file, optHeader + 56, m_sizeOfImage);
+    Get(m_file, optHeader + 112 + 3 * 8, pdataRva); // IMAGE_DIRECTORY_ENTRY_EXCEPTION
+    Get(m_file, optHeader + 112 + 3 * 8 + 4, pdataSize);
+
+    const uint64_t sectionTable = optHeader + optSize;
+    if (m_file.At(sectionTable, (uint64_t)numSections * 40) == nullptr)
+        return invalid(L"(Broken section table.)");
+    m_sections.resize(numSections);
+    for (uint16_t i = 0; i < numSections; ++i) {
+        auto& s = m_sections[i];
+        const uint64_t entry = sectionTable + i * 40;
+        Get(m_file, entry + 8, s.size);
+        Get(m_file, entry + 12, s.rva);
+        Get(m_file, entry + 16, s.fileSize);
+        Get(m_file, entry + 20, s.fileOffset);
+    }
+
+    // The table is sorted by the linker. It's copied once so that lookups don't depend on the alignment.
+    const uint8_t* pdata = AtRva(pdataRva, pdataSize);
+    if (pdata == nullptr && pdataSize != 0)
+        return invalid(L"(Broken exception directory.)");
+    m_functions.resize(pdataSize / sizeof(RuntimeFunction));
+    if (!m_functions.empty()) {
+        memcpy(m_functions.data(), pdata, m_functions.size() * sizeof(RuntimeFunction));
+    }
+    if (!std::is_sorted(m_functions.begin(), m_functions.end(), [](const RuntimeFunction& a, const RuntimeFunction& b) { return a.begin < b.begin; })) {
+        std::sort(m_functions.begin(), m_functions.end(), [](const RuntimeFunction& a, const RuntimeFunction& b) { return a.begin < b.begin; });
+    }
+
+    return std::wstring();
+}
+
+const uint8_t* X64Unwinder::PeImage::AtRva(uint32_t rva, uint32_t size) const
+{
+    for (const auto& s : m_sections) {
+        if (rva >= s.rva && (uint64_t)rva + size <= (uint64_t)s.rva + std::min<uint32_t>(s.size, s.fileSize)) {
+            return m_file.At((uint64_t)s.fileOffset + (rva - s.rva), size);
+        }
+    }
+    return nullptr;
+}
+
+const X64Unwinder::RuntimeFunction* X64Unwinder::PeImage::FindFunction(uint32_t rva) const
+{
+    auto itr = std::upper_bound(m_functions.begin(), m_functions.end(), rva, [](uint32_t a, const RuntimeFunction& f) { return a < f.begin; });
+    if (itr == m_functions.begin())
+        return nullptr;
+    --itr;
+
+    return rva < itr->end ? &*itr : nullptr;
+}
+
+std::optional<size_t> X64Unwinder::RegisterIndex(std::wstring_view name)
+{
+    constexpr std::wstring_view names[] = {
+        L"rax", L"rcx", L"rdx", L"rbx", L"rsp", L"rbp", L"rsi", L"rdi",
+        L"r8", L"r9", L"r10", L"r11", L"r12", L"r13", L"r14", L"r15",
+    };
+    for (size_t i = 0; i < std::size(names); ++i) {
+        if (name == names[i])
+            return i;
+    }
+    if (name == L"rip")
+        return NumRegisters;
+    return std::nullopt;
+}
+
+std::wstring X64Unwinder::AddModule(uint64_t base, uint64_t size, const std::filesystem::path& imagePath)
+{
+    Module m;
+    m.m_base = base;
+    m.m_size = size;
+
+    std::wstring errStr;
+    auto [itr, inserted] = m_images.try_emplace(imagePath.wstring());
+    if (inserted) {
+        auto image = std::make_unique<PeImage>();
+        errStr = image->Open(imagePath);
+        if (errStr.empty()) {
+            itr->second = std::move(image);
+        }
+    }
+    if (itr->second != nullptr) {
+        // Another build of the image would give wrong frames.
+        if (itr->second->m_sizeOfImage == size) {
+            m.m_image = itr->second.get();
+        }
+        else {
+            std::wstringstream ss;
+            ss << L"\"" << imagePath.wstring() << L"\" didn't match the loaded module. (SizeOfImage 0x" << std::hex << itr->second->m_sizeOfImage << L" != 0x" << size << L")";
+            errStr = ss.str();
+        }
+    }
+    else if (errStr.empty()) {
+        std::wstringstream ss;
+        ss << L"\"" << imagePath.wstring() << L"\" couldn't be read.";
+        errStr = ss.str();
+    }
+
+    auto pos = std::upper_bound(m_modules.begin(), m_modules.end(), base, [](uint64_t a, const Module& mod) { return a < mod.m_base; });
+    m_modules.insert(pos, m);
+
+    return errStr;
+}
+
+const X64Unwinder::Module* X64Unwinder::FindModule(uint64_t address) const
+{
+    auto itr = std::upper_bound(m_modules.begin(), m_modules.end(), address, [](uint64_t a, const Module& m) { return a < m.m_base; });
+    if (itr == m_modules.begin())
+        return nullptr;
+    --itr;
+
+    return address - itr->m_base < itr->m_size ? &*itr : nullptr;
+}
+
+bool X64Unwinder::Step(Registers& regs, const StackMemory& stack, bool topFrame) const
+{
+    const Module* m = FindModule(regs.rip);
+    if (m == nullptr || m->m_image == nullptr)
+        return false;
+    const PeImage& image = *m->m_image;
+
+    const uint32_t rva = (uint32_t)(regs.rip - m->m_base);
+    const RuntimeFunction* f = image.FindFunction(rva);
+    uint64_t& rsp = regs.gpr[RSP];
+
+    if (topFrame && f != nullptr && IsInEpilog(image, *f, rva)) {
+        return UnwindEpilog(image, rva, regs, stack);
+    }
+
+    if (f == nullptr) {
+        // A leaf function. The return address is at the top of the stack.
+        uint64_t ret = 0;
+        if (!stack.Read(rsp, ret))
+            return false;
+        regs.rip = ret;
+        rsp += 8;
+        return true;
+    }
+
+    RuntimeFunction func = *f;
+    bool machFrame = false;
+    for (size_t depth = 0; depth < s_maxChainDepth; ++depth) {
+        // An entry may point to another entry instead of unwind info.
+        if (func.unwindData & 1) {
+            const uint8_t* p = image.AtRva(func.unwindData & ~1u, sizeof(RuntimeFunction));
+            if (p == nullptr)
+                return false;
+            memcpy(&func, p, sizeof(func));
+            continue;
+        }
+
+        const uint8_t* info = image.AtRva(func.unwindData, 4);
+        if (info == nullptr)
+            return false;
+        const uint8_t flags = info[0] >> 3;
+        const uint8_t prologSize = info[1];
+        const uint8_t numCodes = info[2];
+        const uint8_t frameReg = info[3] & 0xF;
+        const uint8_t frameOffset = info[3] >> 4;
+        const uint8_t* codes = image.AtRva(func.unwindData + 4, (uint32_t)numCodes * 2);
+        if (codes == nullptr && numCodes > 0)
+            return false;
+
+        // Only the function which has the address can be in the middle of its prolog. The codes of
+        // chained entries are all executed.
+        const uint64_t prologOffset = depth == 0 ? rva - func.begin : UINT64_MAX;
+        const bool inProlog = prologOffset < prologSize;
+        auto executed = [&](size_t slot) {
+            return !inProlog || codes[slot * 2] <= prologOffset;
+            };
+
+        // The frame register is the base of the saved registers once it has been set.
+        uint64_t frame = rsp;
+        if (frameReg != 0) {
+            bool established = true;
+            for (size_t i = 0; i < numCodes; i += CodeSlots(codes[i * 2 + 1] & 0xF, codes[i * 2 + 1] >> 4)) {
+                if ((codes[i * 2 + 1] & 0xF) == UWOP_SET_FPREG) {
+                    established = executed(i);
+                    break;
+                }
+            }
+            if (established) {
+                frame = regs.gpr[frameReg] - (uint64_t)frameOffset * 16;
+            }
+        }
+
+        for (size_t i = 0; i < numCodes;) {
+            const uint8_t op = codes[i * 2 + 1] & 0xF;
+            const uint8_t opInfo = codes[i * 2 + 1] >> 4;
+            const size_t slots = CodeSlots(op, opInfo);
+            if (i + slots > numCodes)
+                return false;
+            auto slotU16 = [&](size_t k) { return (uint32_t)codes[(i + k) * 2] | ((uint32_t)codes[(i + k) * 2 + 1] << 8); };
+            if (!executed(i)) {
+                i += slots;
+                continue;
+            }
+
+            switch (op) {
+            case UWOP_PUSH_NONVOL:
+                if (!stack.Read(rsp, regs.gpr[opInfo]))
+                    return false;
+                rsp += 8;
+                break;
+            case UWOP_ALLOC_LARGE:
+                rsp += opInfo == 0 ? (uint64_t)slotU16(1) * 8 : (uint64_t)(slotU16(1) | (slotU16(2) << 16));
+                break;
+            case UWOP_ALLOC_SMALL:
+                rsp += (uint64_t)opInfo * 8 + 8;
+                break;
+            case UWOP_SET_FPREG:
+                rsp = frame;
+                break;
+            case UWOP_SAVE_NONVOL:
+                if (!stack.Read(frame + (uint64_t)slotU16(1) * 8, regs.gpr[opInfo]))
+                    return false;
+                break;
+            case UWOP_SAVE_NONVOL_FAR:
+                if (!stack.Read(frame + (uint64_t)(slotU16(1) | (slotU16(2) << 16)), regs.gpr[opInfo]))
+                    return false;
+                break;
+            case UWOP_PUSH_MACHFRAME:
+                // An interrupt or exception frame. The return address and the old rsp were pushed by the CPU.
+                if (opInfo != 0)
+                    rsp += 8; // error code.
+                if (!stack.Read(rsp, regs.rip) || !stack.Read(rsp + 24, rsp))
+                    return false;
+                machFrame = true;
+                break;
+            default:
+                // XMM registers and epilog descriptions don't change the integer registers.
+                break;
+            }
+            i += slots;
+        }
+
+        if (!(flags & s_flagChainInfo))
+            break;
+
+        // The chained entry follows the codes, aligned to an even number of slots.
+        const uint8_t* chained = image.AtRva(func.unwindData + 4 + (((uint32_t)numCodes + 1) & ~1u) * 2, sizeof(RuntimeFunction));
+        if (chained == nullptr)
+            return false;
+        memcpy(&func, chained, sizeof(func));
+    }
+
+    if (!machFrame) {
+        if (!stack.Read(rsp, regs.rip))
+            return false;
+        rsp += 8;
+    }
+    return true;
+}
+
+bool X64Unwinder::IsInEpilog(const PeImage& image, const RuntimeFunction& f, uint32_t rva)
+{
+    // Not in the prolog of the function. A chained entry has no prolog of its own at "f".
+    if (!(f.unwindData & 1)) {
+        uint8_t prologSize = 0;
+        if (!GetCode(image, f.unwindData + 1, prologSize))
+            return false;
+        if (rva - f.begin < prologSize)
+            return false;
+    }
+
+    uint32_t pc = rva;
+    uint8_t b[3] = {};
+    // "add rsp, imm" or "lea rsp, [reg + disp]" may come first, always with REX.W.
+    if (GetCode(image, pc, b) && (b[0] & 0xF8) == 0x48) {
+        if (b[0] == 0x48 && b[1] == 0x81 && b[2] == 0xC4) {
+            pc += 7;
+        }
+        else if (b[0] == 0x48 && b[1] == 0x83 && b[2] == 0xC4) {
+            pc += 4;
+        }
+        else if (b[1] == 0x8D) {
+            // REX.R and REX.X clear, rsp as the destination and no SIB byte.
+            if ((b[0] & 0x06) != 0 || ((b[2] >> 3) & 7) != 4 || (b[2] & 7) == 4)
+                return false;
+            if ((b[2] >> 6) == 1)
+                pc += 4;
+            else if ((b[2] >> 6) == 2)
+                pc += 7;
+            else
+                return false;
+        }
+    }
+
+    for (size_t n = 0; n < s_maxEpilogInstructions; ++n) {
+        uint8_t op = 0;
+        if (!GetCode(image, pc, op))
+            return false;
+        if ((op & 0xF0) == 0x40) {
+            // REX prefix.
+            if (!GetCode(image, ++pc, op))
+                return false;
+        }
+
+        if (op >= 0x58 && op <= 0x5F) {
+            // pop reg
+            ++pc;
+            continue;
+        }
+        if (op == 0xC2 || op == 0xC3) {
+            // ret, ret imm16
+            return true;
+        }
+        if (op == 0xF3) {
+            // rep ret
+            uint8_t next = 0;
+            return GetCode(image, pc + 1, next) && next == 0xC3;
+        }
+        if (op == 0xE9 || op == 0xEB) {
+            // jmp rel32, jmp rel8. Only a jump to the rest of the epilog within the function.
+            int32_t disp = 0;
+            if (op == 0xE9) {
+                if (!GetCode(image, pc + 1, disp))
+                    return false;
+                pc += 5 + disp;
+            }
+            else {
+                int8_t disp8 = 0;
+                if (!GetCode(image, pc + 1, disp8))
+                    return false;
+                pc += 2 + disp8;
+            }
+            if (pc >= f.begin && pc < f.end)
+                continue;
+        }
+        return false;
+    }
+    return false;
+}
+
+bool X64Unwinder::UnwindEpilog(const PeImage& image, uint32_t rva, Registers& regs, const StackMemory& stack)
+{
+    uint64_t& rsp = regs.gpr[RSP];
+    uint32_t pc = rva;
+    for (size_t n = 0; n < s_maxEpilogInstructions; ++n) {
+        uint8_t rex = 0;
+        uint8_t op = 0;
+        if (!GetCode(image, pc, op))
+            return false;
+        if ((op & 0xF0) == 0x40) {
+            rex = op & 0x0F;
+            if (!GetCode(image, ++pc, op))
+                return false;
+        }
+
+        switch (op) {
+        case 0x58: case 0x59: case 0x5A: case 0x5B: case 0x5C: case 0x5D: case 0x5E: case 0x5F:
+            // pop reg
+            if (!stack.Read(rsp, regs.gpr[(op - 0x58) + (rex & 1) * 8]))
+                return false;
+            rsp += 8;
+            pc += 1;
+            continue;
+        case 0x81: {
+            // add rsp, imm32
+            int32_t imm = 0;
+            if (!GetCode(image, pc + 2, imm))
+                return false;
+            rsp += (int64_t)imm;
+            pc += 6;
+            continue;
+        }
+        case 0x83: {
+            // add rsp, imm8
+            int8_t imm = 0;
+            if (!GetCode(image, pc + 2, imm))
+                return false;
+            rsp += (int64_t)imm;
+            pc += 3;
+            continue;
+        }
+        case 0x8D: {
+            // lea rsp, [reg + disp8] or [reg + disp32]
+            uint8_t modrm = 0;
+            if (!GetCode(image, pc + 1, modrm))
+                return false;
+            const uint64_t base = regs.gpr[(modrm & 7) + (rex & 1) * 8];
+            if ((modrm >> 6) == 1) {
+                int8_t disp = 0;
+                if (!GetCode(image, pc + 2, disp))
+                    return false;
+                rsp = base + (int64_t)disp;
+                pc += 3;
+            }
+            else {
+                int32_t disp = 0;
+                if (!GetCode(image, pc + 2, disp))
+                    return false;
+                rsp = base + (int64_t)disp;
+                pc += 6;
+            }
+            continue;
+        }
+        case 0xC2: {
+            // ret imm16
+            uint16_t imm = 0;
+            if (!GetCode(image, pc + 1, imm) || !stack.Read(rsp, regs.rip))
+                return false;
+            rsp += 8 + imm;
+            return true;
+        }
+        case 0xC3:
+        case 0xF3:
+            // ret, rep ret
+            if (!stack.Read(rsp, regs.rip))
+                return false;
+            rsp += 8;
+            return true;
+        case 0xE9: {
+            int32_t disp = 0;
+            if (!GetCode(image, pc + 1, disp))
+                return false;
+            pc += 5 + disp;
+            continue;
+        }
+        case 0xEB: {
+            int8_t disp = 0;
+            if (!GetCode(image, pc + 1, disp))
+                return false;
+            pc += 2 + disp;
+            continue;
+        }
+        default:
+            return false;
+        }
+    }
+    return false;
+}
+
+void X64Unwinder::Unwind(Registers regs, const StackMemory& stack, size_t maxFrames, std::vector<uint64_t>& frames) const
+{
+    for (size_t n = 0; n < maxFrames; ++n) {
+        frames.push_back(regs.rip);
+
+        const uint64_t prevRsp = regs.gpr[RSP];
+        if (!Step(regs, stack, n == 0))
+            break;
+        // The stack only grows toward lower addresses. Anything else is a broken frame.
+        if (regs.rip == 0 || regs.gpr[RSP] <= prevRsp)
+            break;
+    }
+}
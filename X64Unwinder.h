@@ -0,0 +1,118 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <memory>
+#include <optional>
+#include <filesystem>
+
+#include "MappedFile.h"
+
+// Walks x64 stacks with the unwind data (.pdata/.xdata) of the PE images, the same way
+// RtlVirtualUnwind does, without dbghelp or the process. Images are mapped once and their function
+// tables are kept sorted by RVA, so a stack costs a binary search and a few reads per frame.
+//
+// The top frame may have stopped in a prolog or an epilog. A prolog is unwound by the codes executed so
+// far. An epilog is recognized by its instructions, as RtlVirtualUnwind does: an optional "add rsp" or
+// "lea rsp", pops, then "ret" or a "jmp" within the function. The rest of it is executed on the registers.
+// An epilog ending with a tail call to another function isn't recognized, and is unwound as the body.
+class X64Unwinder
+{
+public:
+	enum UnwindOp : uint8_t {
+		UWOP_PUSH_NONVOL = 0,
+		UWOP_ALLOC_LARGE = 1,
+		UWOP_ALLOC_SMALL = 2,
+		UWOP_SET_FPREG = 3,
+		UWOP_SAVE_NONVOL = 4,
+		UWOP_SAVE_NONVOL_FAR = 5,
+		UWOP_EPILOG = 6,
+		UWOP_SPARE_CODE = 7,
+		UWOP_SAVE_XMM128 = 8,
+		UWOP_SAVE_XMM128_FAR = 9,
+		UWOP_PUSH_MACHFRAME = 10,
+	};
+	static const uint8_t        s_flagChainInfo = 0x4;
+	static const size_t         s_maxChainDepth = 32;
+	static const size_t         s_maxEpilogInstructions = 32; // bounds the jumps of a broken epilog.
+
+	enum Register : uint8_t {
+		RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+		R8, R9, R10, R11, R12, R13, R14, R15,
+		NumRegisters,
+	};
+
+	struct Registers {
+		uint64_t    rip = 0;
+		uint64_t    gpr[NumRegisters] = {};
+	};
+
+	// Captured stack bytes starting at m_base.
+	struct StackMemory {
+		uint64_t        m_base = 0;
+		const uint8_t*  m_data = nullptr;
+		uint64_t        m_size = 0;
+
+		bool Read(uint64_t address, uint64_t& v) const;
+	};
+
+	struct RuntimeFunction {
+		uint32_t    begin;
+		uint32_t    end;
+		uint32_t    unwindData;
+	};
+
+	// A mapped PE32+ image and its function table.
+	class PeImage {
+	public:
+		struct Section {
+			uint32_t    rva;
+			uint32_t    size;
+			uint32_t    fileOffset;
+			uint32_t    fileSize;
+		};
+
+		MappedFile                      m_file;
+		uint32_t                        m_sizeOfImage = 0;
+		std::vector<Section>            m_sections;
+		std::vector<RuntimeFunction>    m_functions; // sorted by begin.
+
+	public:
+		std::wstring Open(const std::filesystem::path& path);
+		// nullptr unless [rva, rva + size) is in the raw data of a section.
+		const uint8_t* AtRva(uint32_t rva, uint32_t size) const;
+		const RuntimeFunction* FindFunction(uint32_t rva) const;
+	};
+
+	struct Module {
+		uint64_t        m_base = 0;
+		uint64_t        m_size = 0;
+		const PeImage*  m_image = nullptr; // nullptr when the image isn't available.
+	};
+
+	std::map<std::wstring, std::unique_ptr<PeImage>>    m_images; // by path. Kept across SetModules().
+	std::vector<Module>                                  m_modules; // sorted by the base address.
+
+public:
+	// Register name to the index in Registers::gpr. "rip" is not in gpr and gives NumRegisters.
+	static std::optional<size_t> RegisterIndex(std::wstring_view name);
+
+	void ClearModules() { m_modules.clear(); }
+	// Add a module loaded at "base". The image is mapped on the first use of the path and reused.
+	// Returns an error when the image can't be used. The module is added anyway, without unwind data.
+	std::wstring AddModule(uint64_t base, uint64_t size, const std::filesystem::path& imagePath);
+
+	// Walk from the registers. The instruction pointer of each frame is added to "frames", from the top.
+	void Unwind(Registers regs, const StackMemory& stack, size_t maxFrames, std::vector<uint64_t>& frames) const;
+
+	const Module* FindModule(uint64_t address) const;
+	// Restore the registers of the caller. Returns false when the frame can't be unwound. "topFrame" is the frame
+	// whose instruction pointer was captured, which is the only one that can be in an epilog.
+	bool Step(Registers& regs, const StackMemory& stack, bool topFrame = false) const;
+
+	// Used by Step(). Whether the instructions at "rva" are the rest of an epilog of "f".
+	static bool IsInEpilog(const PeImage& image, const RuntimeFunction& f, uint32_t rva);
+	// Execute the rest of an epilog found by IsInEpilog(), up to and including its return.
+	static bool UnwindEpilog(const PeImage& image, uint32_t rva, Registers& regs, const StackMemory& stack);
+};
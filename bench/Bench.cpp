@@ -0,0 +1,329 @@
+#include <Windows.h>
+#include <Psapi.h>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+#include <filesystem>
+
+#include "FixtureBackend.h"
+#include "../tests/Fixtures.h"
+#include "../tests/LocalHttpServer.h"
+#include "../CompressedStream.h"
+#include "../SyntheticCorpus.h"
+#include "../Resolver.h"
+#include "../Log.h"
+
+#pragma comment(lib, "psapi.lib")
+
+// Resolves a synthetic corpus over generated images and PDBs, which a local stand-in of a symbol server serves,
+// and writes the parse throughput, the cold and the warm cache latency, the frames per second and the peak
+// working set as JSON, so that the numbers of two builds can be compared. The warm cache is also resolved one
+// frame at a time with Resolve(), to compare with the batches of ResolveAll().
+//
+// CallstackResolverBench.exe [--images N] [--functions N] [--frames N] [--runs N] [--dir path] [--out path]
+namespace {
+    struct Options {
+        size_t                  numImages = 8;
+        size_t                  numFunctions = 8192; // per image.
+        size_t                  numFrames = 200000;
+        size_t                  numRuns = 5; // of each of the cold and the warm cache.
+        std::filesystem::path   dir = std::filesystem::temp_directory_path() / L"CallstackResolverBench";
+        std::filesystem::path   out = L"bench_results.json";
+    };
+
+    struct Run {
+        double      seconds = 0.0;
+        size_t      numFrames = 0;
+        size_t      numFailures = 0;
+        size_t      numDownloads = 0;
+    };
+
+    using Clock = std::chrono::steady_clock;
+
+    double Seconds(Clock::time_point start)
+    {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    std::wstring ParseArguments(int argc, wchar_t** argv, Options& options)
+    {
+        for (int i = 1; i < argc; ++i) {
+            const std::wstring_view arg = argv[i];
+            if (i + 1 >= argc) {
+                return L"\"" + std::wstring(arg) + L"\" needs a value.";
+            }
+            const std::wstring value = argv[++i];
+
+            size_t* count = nullptr;
+            if (arg == L"--images")
+                count = &options.numImages;
+            else if (arg == L"--functions")
+                count = &options.numFunctions;
+            else if (arg == L"--frames")
+                count = &options.numFrames;
+            else if (arg == L"--runs")
+                count = &options.numRuns;
+            else if (arg == L"--dir")
+                options.dir = value;
+            else if (arg == L"--out")
+                options.out = value;
+            else
+                return L"Unknown argument \"" + std::wstring(arg) + L"\".";
+
+            if (count != nullptr) {
+                try {
+                    *count = std::stoull(value);
+                }
+                catch (...) {
+                    return L"\"" + std::wstring(arg) + L"\" needs a number. \"" + value + L"\".";
+                }
+                if (*count == 0) {
+                    return L"\"" + std::wstring(arg) + L"\" needs to be at least 1.";
+                }
+            }
+        }
+        return std::wstring();
+    }
+
+    std::wstring WriteFile(const std::filesystem::path& path, const std::vector<char>& data)
+    {
+        std::ofstream fs(path, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!fs.write(data.data(), data.size())) {
+            return L"Failed to write \"" + path.wstring() + L"\".";
+        }
+        return std::wstring();
+    }
+
+    // The images in the bench directory and their PDBs on the server. The functions of each PDB are those of
+    // the mock backend, so that the symbols and the lines agree.
+    std::wstring MakeFixtures(const Options& options, LocalHttpServer& server, std::map<std::wstring, std::wstring>& paths, uint64_t& pdbBytes)
+    {
+        FixtureBackend backend(options.numFunctions);
+        for (size_t i = 0; i < options.numImages; ++i) {
+            const std::wstring name = L"bench" + std::to_wstring(i);
+            const std::wstring pdbName = name + L".pdb";
+            GUID guid = { 0xbe4c0000u + (uint32_t)i, 0x5f60, 0x7182, { 0x93, 0xa4, 0xb5, 0xc6, 0xd7, 0xe8, 0xf9, 0x0a } };
+            const uint32_t age = 1;
+
+            const auto functions = backend.Functions(pdbName);
+            const uint32_t codeSize = functions.back().rva + functions.back().size - Fixtures::s_textRva;
+            const auto imagePath = options.dir / (name + L".dll");
+            auto errStr = WriteFile(imagePath, Fixtures::MakeImage(guid, age, std::string(pdbName.begin(), pdbName.end()), codeSize));
+            if (!errStr.empty()) {
+                return errStr;
+            }
+            paths.insert({ name + L".dll", imagePath.wstring() });
+
+            auto pdb = Fixtures::MakePdbWithLines(guid, age, name, functions);
+            pdbBytes += pdb.size();
+            const std::wstring serverPath = L"/" + pdbName + L"/" + CallstackResolver::PdbSignature(guid, age) + L"/" + pdbName;
+            server.AddFile(std::string(serverPath.begin(), serverPath.end()), std::move(pdb));
+        }
+        return std::wstring();
+    }
+
+    // Resolves the corpus with a new resolver. The cache is emptied first for a cold run. "perFrame" resolves the
+    // frames one by one in the input order instead of with ResolveAll().
+    std::wstring Resolve(const std::filesystem::path& corpusPath, const std::filesystem::path& cacheDir, const Options& options, LocalHttpServer& server, bool cold, bool perFrame, Run& run)
+    {
+        if (cold) {
+            std::error_code ec;
+            std::filesystem::remove_all(cacheDir, ec);
+            if (!std::filesystem::create_directories(cacheDir, ec)) {
+                return L"Failed to create the cache directory \"" + cacheDir.wstring() + L"\".";
+            }
+        }
+        const size_t numRequests = server.Requests().size();
+
+        Context ctx;
+        auto errStr = ctx.ParseInputText(corpusPath);
+        if (!errStr.empty()) {
+            return errStr;
+        }
+        errStr = ctx.ParseCallstacks(false);
+        if (!errStr.empty()) {
+            return errStr;
+        }
+        Context::symbol s;
+        s.server = server.Url();
+        s.cache = cacheDir.wstring();
+        ctx.symbols.push_back(std::move(s));
+
+        const auto start = Clock::now();
+        CallstackResolver cr;
+        cr.m_backend = std::make_unique<FixtureBackend>(options.numFunctions);
+        errStr = cr.Init(ctx.symbols);
+        if (!errStr.empty()) {
+            return errStr;
+        }
+        if (perFrame) {
+            for (auto& cs : ctx.resolved_callstacks) {
+                cr.Resolve(cs, true);
+            }
+        }
+        else {
+            CallstackResolver::FrameErrors errors;
+            cr.ResolveAll(ctx, errors);
+        }
+        errStr = cr.Finalize();
+        run.seconds = Seconds(start);
+        if (!errStr.empty()) {
+            return errStr;
+        }
+
+        for (const auto& cs : ctx.resolved_callstacks) {
+            if (cs.isComment)
+                continue;
+            ++run.numFrames;
+            if (!cs.function.has_value())
+                ++run.numFailures;
+        }
+        run.numDownloads = server.Requests().size() - numRequests;
+        return std::wstring();
+    }
+
+    double Median(std::vector<double> v)
+    {
+        std::sort(v.begin(), v.end());
+        return v.size() % 2 == 1 ? v[v.size() / 2] : (v[v.size() / 2 - 1] + v[v.size() / 2]) / 2.0;
+    }
+
+    void WriteRuns(std::ofstream& fs, const char* name, const std::vector<Run>& runs)
+    {
+        std::vector<double> ms;
+        for (const auto& r : runs) {
+            ms.push_back(r.seconds * 1000.0);
+        }
+        const double median = Median(ms);
+
+        fs << "  \"" << name << "\" : {" << std::endl;
+        fs << "    \"median_ms\" : " << median << "," << std::endl;
+        fs << "    \"frames_per_sec\" : " << (median > 0.0 ? runs.front().numFrames * 1000.0 / median : 0.0) << "," << std::endl;
+        fs << "    \"failures\" : " << runs.front().numFailures << "," << std::endl;
+        fs << "    \"runs\" : [" << std::endl;
+        for (size_t i = 0; i < runs.size(); ++i) {
+            fs << "      { \"ms\" : " << ms[i] << ", \"downloads\" : " << runs[i].numDownloads << " }" << (i + 1 < runs.size() ? "," : "") << std::endl;
+        }
+        fs << "    ]" << std::endl;
+        fs << "  }," << std::endl;
+    }
+};
+
+int wmain(int argc, wchar_t** argv)
+{
+    Options options;
+    {
+        auto errStr = ParseArguments(argc, argv, options);
+        if (!errStr.empty()) {
+            std::wcerr << errStr << std::endl;
+            return 1;
+        }
+    }
+    Log::SetLevel(Log::Level::Error);
+
+    std::error_code ec;
+    std::filesystem::remove_all(options.dir, ec);
+    std::filesystem::create_directories(options.dir, ec);
+    const auto corpusPath = options.dir / L"callstacks.txt";
+    const auto cacheDir = options.dir / L"cache";
+
+    // The fixtures, the server and the corpus.
+    LocalHttpServer server;
+    std::map<std::wstring, std::wstring> paths;
+    uint64_t pdbBytes = 0;
+    {
+        auto errStr = MakeFixtures(options, server, paths, pdbBytes);
+        if (errStr.empty()) {
+            errStr = server.Start();
+        }
+        if (errStr.empty()) {
+            CompressedOutput corpus;
+            errStr = corpus.Open(corpusPath);
+            if (errStr.empty()) {
+                errStr = SyntheticCorpus::Generate(paths, options.numFrames, SyntheticCorpus::s_defaultSeed, corpus.WideStream());
+                auto closeErrStr = corpus.Close();
+                if (errStr.empty()) {
+                    errStr = closeErrStr;
+                }
+            }
+        }
+        if (!errStr.empty()) {
+            std::wcerr << L"Failed to make the fixtures. " << errStr << std::endl;
+            return 1;
+        }
+    }
+
+    // The parse throughput of the input text, best of the runs.
+    const uint64_t corpusBytes = std::filesystem::file_size(corpusPath, ec);
+    double parseSeconds = 0.0;
+    size_t parsedFrames = 0;
+    for (size_t i = 0; i < options.numRuns; ++i) {
+        Context ctx;
+        const auto start = Clock::now();
+        auto errStr = ctx.ParseInputText(corpusPath);
+        if (errStr.empty()) {
+            errStr = ctx.ParseCallstacks(false);
+        }
+        const double seconds = Seconds(start);
+        if (!errStr.empty()) {
+            std::wcerr << L"Failed to parse the corpus. " << errStr << std::endl;
+            return 1;
+        }
+        parseSeconds = i == 0 ? seconds : std::min<double>(parseSeconds, seconds);
+        parsedFrames = std::count_if(ctx.resolved_callstacks.begin(), ctx.resolved_callstacks.end(), [](const auto& cs) { return !cs.isComment; });
+    }
+
+    // A cold run downloads every PDB. The warm runs after it find them in the cache, and are made once with the
+    // batches and once frame by frame.
+    std::vector<Run> coldRuns(options.numRuns), warmRuns(options.numRuns), perFrameRuns(options.numRuns);
+    for (size_t i = 0; i < options.numRuns; ++i) {
+        for (int pass = 0; pass < 3; ++pass) {
+            const bool cold = pass == 0;
+            const bool perFrame = pass == 2;
+            auto& run = cold ? coldRuns[i] : perFrame ? perFrameRuns[i] : warmRuns[i];
+            auto errStr = Resolve(corpusPath, cacheDir, options, server, cold, perFrame, run);
+            if (!errStr.empty()) {
+                std::wcerr << L"Failed to resolve the corpus. " << errStr << std::endl;
+                return 1;
+            }
+            std::wcout << (cold ? L"cold " : perFrame ? L"warm per frame " : L"warm ") << i << L": " << run.seconds * 1000.0 << L" ms, "
+                << run.numFrames << L" frames, " << run.numFailures << L" failures, " << run.numDownloads << L" downloads" << std::endl;
+        }
+    }
+    server.Stop();
+
+    // Of the whole process, which includes the PDBs held by the server.
+    PROCESS_MEMORY_COUNTERS pmc = { sizeof(PROCESS_MEMORY_COUNTERS), };
+    GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc));
+
+    std::ofstream fs(options.out, std::ios::out | std::ios::trunc);
+    fs << "{" << std::endl;
+    fs << "  \"images\" : " << options.numImages << "," << std::endl;
+    fs << "  \"functions_per_image\" : " << options.numFunctions << "," << std::endl;
+    fs << "  \"frames\" : " << options.numFrames << "," << std::endl;
+    fs << "  \"runs\" : " << options.numRuns << "," << std::endl;
+    fs << "  \"pdb_bytes\" : " << pdbBytes << "," << std::endl;
+    fs << "  \"parse\" : {" << std::endl;
+    fs << "    \"bytes\" : " << corpusBytes << "," << std::endl;
+    fs << "    \"ms\" : " << parseSeconds * 1000.0 << "," << std::endl;
+    fs << "    \"mb_per_sec\" : " << (parseSeconds > 0.0 ? corpusBytes / parseSeconds / (1024.0 * 1024.0) : 0.0) << "," << std::endl;
+    fs << "    \"frames_per_sec\" : " << (parseSeconds > 0.0 ? parsedFrames / parseSeconds : 0.0) << std::endl;
+    fs << "  }," << std::endl;
+    WriteRuns(fs, "cold", coldRuns);
+    WriteRuns(fs, "warm", warmRuns);
+    WriteRuns(fs, "warm_per_frame", perFrameRuns);
+    fs << "  \"peak_working_set_bytes\" : " << (uint64_t)pmc.PeakWorkingSetSize << std::endl;
+    fs << "}" << std::endl;
+    if (!fs) {
+        std::wcerr << L"Failed to write the results \"" << options.out.wstring() << L"\"." << std::endl;
+        return 1;
+    }
+
+    std::wcout << L"Wrote " << options.out.wstring() << std::endl;
+    return 0;
+}
@@ -0,0 +1,98 @@
+#include <Windows.h>
+
+#include <sstream>
+#include <fstream>
+
+#include "FixtureBackend.h"
+
+namespace {
+    constexpr uint32_t rsdsSignature = 0x53445352u; // "RSDS"
+    constexpr uint32_t debugTypeCodeView = 2;
+    constexpr uint32_t debugDataDirectory = 6;
+    constexpr uint16_t pe32PlusMagic = 0x20B;
+
+    template<typename T>
+    bool Get(std::ifstream& fs, uint64_t pos, T& v)
+    {
+        fs.seekg(pos);
+        return (bool)fs.read(reinterpret_cast<char*>(&v), sizeof(T));
+    }
+};
+
+std::wstring FixtureBackend::ReadImageSignature(const std::filesystem::path& imagePath, std::wstring& pdbName, GUID& guid, uint32_t& age, size_t& imageSize)
+{
+    std::ifstream fs(imagePath, std::ios::in | std::ios::binary);
+    if (!fs) {
+        std::wstringstream ss;
+        ss << L"Failed to open an image file \"" << imagePath.wstring() << L"\".";
+        return ss.str();
+    }
+
+    auto invalid = [&]() {
+        std::wstringstream ss;
+        ss << L"\"" << imagePath.wstring() << L"\" didn't have a CodeView record.";
+        return ss.str();
+        };
+
+    // The headers of a PE32+ file. The optional header follows the signature and the file header.
+    uint32_t peHeaderPos = 0, peSignature = 0;
+    uint16_t numSections = 0, optionalHeaderSize = 0, magic = 0;
+    if (!Get(fs, 0x3C, peHeaderPos) || !Get(fs, peHeaderPos, peSignature) || peSignature != 0x00004550u)
+        return invalid();
+    if (!Get(fs, peHeaderPos + 6, numSections) || !Get(fs, peHeaderPos + 20, optionalHeaderSize))
+        return invalid();
+    const uint64_t optionalHeaderPos = (uint64_t)peHeaderPos + 24;
+    if (!Get(fs, optionalHeaderPos, magic) || magic != pe32PlusMagic)
+        return invalid();
+
+    uint32_t sizeOfImage = 0, debugRva = 0, debugSize = 0;
+    if (!Get(fs, optionalHeaderPos + 56, sizeOfImage) || !Get(fs, optionalHeaderPos + 112 + debugDataDirectory * 8, debugRva)
+        || !Get(fs, optionalHeaderPos + 116 + debugDataDirectory * 8, debugSize))
+        return invalid();
+
+    // The file offset of the debug directory from the section which has it.
+    uint64_t debugPos = 0;
+    for (uint16_t i = 0; i < numSections && debugPos == 0; ++i) {
+        const uint64_t pos = optionalHeaderPos + optionalHeaderSize + i * 40ull;
+        uint32_t virtualSize = 0, rva = 0, rawPos = 0;
+        if (!Get(fs, pos + 8, virtualSize) || !Get(fs, pos + 12, rva) || !Get(fs, pos + 20, rawPos))
+            return invalid();
+        if (debugRva >= rva && debugRva < rva + virtualSize) {
+            debugPos = (uint64_t)rawPos + (debugRva - rva);
+        }
+    }
+    if (debugPos == 0)
+        return invalid();
+
+    for (uint32_t entry = 0; entry + 28 <= debugSize; entry += 28) {
+        uint32_t type = 0, cvSize = 0, cvPos = 0, cvSignature = 0;
+        if (!Get(fs, debugPos + entry + 12, type) || !Get(fs, debugPos + entry + 16, cvSize) || !Get(fs, debugPos + entry + 24, cvPos))
+            return invalid();
+        if (type != debugTypeCodeView || cvSize <= 24 || !Get(fs, cvPos, cvSignature) || cvSignature != rsdsSignature)
+            continue;
+
+        std::string name(cvSize - 24, '\0');
+        if (!Get(fs, cvPos + 4, guid) || !Get(fs, cvPos + 20, age) || !fs.read(name.data(), name.size()))
+            return invalid();
+        name.resize(strnlen(name.c_str(), name.size()));
+
+        pdbName.assign(name.begin(), name.end());
+        imageSize = sizeOfImage;
+        return std::wstring();
+    }
+
+    return invalid();
+}
+
+std::vector<Fixtures::Function> FixtureBackend::Functions(const std::wstring& pdbName)
+{
+    std::unique_ptr<Module> module;
+    LoadModule(pdbName, false, true, module);
+
+    // Functions of the mock start at the RVA of .text of the fixture image.
+    std::vector<Fixtures::Function> functions;
+    for (const auto& f : static_cast<MockModule&>(*module).m_functions) {
+        functions.push_back({ f.offset, f.size });
+    }
+    return functions;
+}
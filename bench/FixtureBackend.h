@@ -0,0 +1,22 @@
+#pragma once
+#include <Windows.h>
+
+#include <string>
+#include <vector>
+
+#include "../MockBackend.h"
+#include "../tests/Fixtures.h"
+
+// The mock symbols over the fixture files of the benchmark. The signature is read from the CodeView record of
+// the image like dbghelp does, so that the PDB is searched and downloaded, and the lines are read from the PDB.
+class FixtureBackend : public MockBackend
+{
+public:
+	using MockBackend::MockBackend;
+
+	bool HasPdbFiles() const override { return true; }
+	std::wstring ReadImageSignature(const std::filesystem::path& imagePath, std::wstring& pdbName, GUID& guid, uint32_t& age, size_t& imageSize) override;
+
+	// The functions which LoadModule() lays out for a PDB, to make its fixture.
+	std::vector<Fixtures::Function> Functions(const std::wstring& pdbName);
+};
@@ -0,0 +1,136 @@
+#include <fstream>
+#include <iterator>
+
+#include "Test.h"
+#include "Fixtures.h"
+#include "LocalHttpServer.h"
+#include "../CacheLock.h"
+#include "../PdbFile.h"
+
+namespace {
+    constexpr GUID pdbGuid = { 0x1b2c3d4e, 0x5f60, 0x7182, { 0x93, 0xa4, 0xb5, 0xc6, 0xd7, 0xe8, 0xf9, 0x0a } };
+    constexpr GUID otherGuid = { 0x0a0b0c0d, 0x1111, 0x2222, { 0x33, 0x33, 0x44, 0x44, 0x55, 0x55, 0x66, 0x66 } };
+    constexpr uint32_t pdbAge = 3;
+    constexpr uint32_t lockTimeoutMs = 60u * 1000u;
+    constexpr uint32_t numProcesses = 6;
+    const std::string filePath = "/test.pdb/1B2C3D4E5F60718293A4B5C6D7E8F90A3/test.pdb";
+
+    std::vector<char> ReadFile(const std::filesystem::path& path)
+    {
+        std::ifstream fs(path, std::ios::binary);
+        return std::vector<char>(std::istreambuf_iterator<char>(fs), std::istreambuf_iterator<char>());
+    }
+
+    std::wstring Validate(const std::filesystem::path& p)
+    {
+        return PdbFile::Validate(p, pdbGuid, pdbAge);
+    }
+};
+
+// CacheLock_Download <url> <entry path>
+TEST_CHILD(CacheLock_Download)
+{
+    if (argc != 2)
+        return 100;
+
+    CacheLock::Outcome outcome = CacheLock::Outcome::DownloadFailed;
+    CacheLock::Download(argv[0], argv[1], lockTimeoutMs, Validate, outcome);
+    return (int)outcome;
+}
+
+TEST(CacheLock_OneProcessDownloadsForAll)
+{
+    const auto body = Fixtures::MakePdb(pdbGuid, pdbAge, 2u * 1024u * 1024u);
+    LocalHttpServer server;
+    server.AddFile(filePath, body);
+    // Slow enough that the processes started together all find the entry missing and wait on the lock.
+    server.m_faults.delayMs = 500;
+    CHECK(server.Start().empty());
+
+    const auto entry = Test::TempDir() / L"test.pdb" / L"1B2C3D4E5F60718293A4B5C6D7E8F90A3" / L"test.pdb";
+    const std::wstring url = server.Url(std::wstring(filePath.begin(), filePath.end()));
+
+    std::vector<HANDLE> children;
+    for (uint32_t i = 0; i < numProcesses; ++i) {
+        HANDLE h = Test::StartChild("CacheLock_Download", { url, entry.wstring() });
+        CHECK(h != NULL);
+        if (h != NULL)
+            children.push_back(h);
+    }
+
+    uint32_t numDownloaded = 0;
+    uint32_t numReused = 0;
+    for (HANDLE h : children) {
+        int exitCode = Test::WaitChild(h);
+        if (exitCode == (int)CacheLock::Outcome::Downloaded)
+            ++numDownloaded;
+        else if (exitCode == (int)CacheLock::Outcome::Reused)
+            ++numReused;
+    }
+
+    CHECK(numDownloaded == 1);
+    CHECK(numReused == numProcesses - 1);
+    CHECK(server.Requests().size() == 1);
+    CHECK(ReadFile(entry) == body);
+    CHECK(Validate(entry).empty());
+
+    auto partial = entry;
+    partial += L".partial";
+    CHECK(!std::filesystem::exists(partial));
+}
+
+TEST(CacheLock_ReplacesPublishedEntryWhichFailsValidation)
+{
+    const auto body = Fixtures::MakePdb(pdbGuid, pdbAge);
+    LocalHttpServer server;
+    server.AddFile(filePath, body);
+    CHECK(server.Start().empty());
+
+    // A truncated PDB, as an older version of the tool wrote into the cache in place, and a PDB of another build
+    // published under the same name.
+    auto truncated = body;
+    truncated.resize(truncated.size() / 2);
+    for (const auto& published : { truncated, Fixtures::MakePdb(otherGuid, pdbAge) }) {
+        const auto entry = Test::TempDir() / L"test.pdb" / L"1B2C3D4E5F60718293A4B5C6D7E8F90A3" / L"test.pdb";
+        std::filesystem::create_directories(entry.parent_path());
+        {
+            std::ofstream fs(entry, std::ios::binary | std::ios::trunc);
+            fs.write(published.data(), published.size());
+        }
+        // A reader of the old entry, which keeps it through the replacement.
+        HANDLE reader = CreateFileW(entry.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+            NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        CHECK(reader != INVALID_HANDLE_VALUE);
+
+        const size_t numRequests = server.Requests().size();
+        CacheLock::Outcome outcome = CacheLock::Outcome::Downloaded;
+        auto errStr = CacheLock::Download(server.Url(std::wstring(filePath.begin(), filePath.end())), entry, lockTimeoutMs, Validate, outcome);
+        CHECK(errStr.empty());
+        CHECK(outcome == CacheLock::Outcome::Replaced);
+        CHECK(server.Requests().size() == numRequests + 1);
+        CHECK(ReadFile(entry) == body);
+        CHECK(Validate(entry).empty());
+
+        if (reader != INVALID_HANDLE_VALUE)
+            CloseHandle(reader);
+    }
+}
+
+TEST(CacheLock_ReusesPublishedEntry)
+{
+    LocalHttpServer server;
+    CHECK(server.Start().empty());
+
+    const auto entry = Test::TempDir() / L"test.pdb" / L"1B2C3D4E5F60718293A4B5C6D7E8F90A3" / L"test.pdb";
+    const auto published = Fixtures::MakePdb(pdbGuid, pdbAge);
+    std::filesystem::create_directories(entry.parent_path());
+    {
+        std::ofstream fs(entry, std::ios::binary);
+        fs.write(published.data(), published.size());
+    }
+
+    CacheLock::Outcome outcome = CacheLock::Outcome::Downloaded;
+    CHECK(CacheLock::Download(server.Url(std::wstring(filePath.begin(), filePath.end())), entry, lockTimeoutMs, Validate, outcome).empty());
+    CHECK(outcome == CacheLock::Outcome::Reused);
+    CHECK(server.Requests().empty());
+}
@@ -0,0 +1,428 @@
+#include <Windows.h>
+
+#include <cstring>
+#include <algorithm>
+
+#include "Fixtures.h"
+
+namespace {
+    constexpr char msfMagic[] = "Microsoft C/C++ MSF 7.00\r\n\x1a" "DS\0\0";
+    constexpr uint32_t pdbVersionVC70 = 20000404;
+    constexpr uint32_t dbiVersionV70 = 19990903;
+    constexpr uint32_t sectionContributionsV60 = 0xeffe0000u + 19970605u;
+    constexpr uint32_t namesSignature = 0xEFFEEFFEu;
+    constexpr uint32_t cvSignatureC13 = 4;
+    constexpr uint32_t debugSLines = 0xF2;
+    constexpr uint32_t debugSFileChecksums = 0xF4;
+    constexpr uint32_t codeCharacteristics = 0x60000020; // code, execute and read.
+    constexpr uint16_t nilStream = 0xFFFF;
+    constexpr size_t dbgSectionHdr = 5;
+    constexpr size_t numDbgStreams = 11;
+
+    // Fixed streams of a PDB. The compilands follow.
+    constexpr uint32_t pdbStream = 1;
+    constexpr uint32_t dbiStream = 3;
+    constexpr uint32_t sectionHeaderStream = 5;
+    constexpr uint32_t namesStream = 6;
+    constexpr uint32_t firstModuleStream = 7;
+
+    constexpr uint32_t fileAlignment = 0x200;
+    constexpr uint32_t sectionAlignment = 0x1000;
+    constexpr uint32_t headersSize = 0x400;
+
+    template<typename T>
+    void Put(std::vector<char>& out, const T& v)
+    {
+        const char* p = reinterpret_cast<const char*>(&v);
+        out.insert(out.end(), p, p + sizeof(T));
+    }
+
+    template<typename T>
+    void PutAt(std::vector<char>& out, size_t pos, const T& v)
+    {
+        memcpy(out.data() + pos, &v, sizeof(T));
+    }
+
+    void PutString(std::vector<char>& out, const std::string& s)
+    {
+        out.insert(out.end(), s.begin(), s.end());
+        out.push_back('\0');
+    }
+
+    void Align(std::vector<char>& out, size_t alignment)
+    {
+        out.resize((out.size() + alignment - 1) / alignment * alignment, '\0');
+    }
+
+    uint32_t AlignUp(uint32_t v, uint32_t alignment)
+    {
+        return (v + alignment - 1) / alignment * alignment;
+    }
+
+    uint32_t NumBlocks(size_t size)
+    {
+        return (uint32_t)((size + Fixtures::s_blockSize - 1) / Fixtures::s_blockSize);
+    }
+
+    std::string Narrow(const std::wstring& s)
+    {
+        return std::string(s.begin(), s.end());
+    }
+
+    // The lines of a function are 4 to 31 bytes each.
+    uint32_t LineStep(size_t functionIdx, uint32_t k)
+    {
+        uint64_t h = (uint64_t)functionIdx * 0x9E3779B97F4A7C15ull ^ ((uint64_t)k + 0x632BE59BD9B4E019ull);
+        h ^= h >> 31;
+        h *= 0xBF58476D1CE4E5B9ull;
+        h ^= h >> 27;
+        return 4 + (uint32_t)(h % 28);
+    }
+
+    // The first line of a function in the file of its compiland.
+    uint32_t FirstLineNo(size_t functionIdx)
+    {
+        return 1 + (uint32_t)(functionIdx % Fixtures::s_functionsPerCompiland) * 40;
+    }
+
+    // A subsection of the C13 debug info. Subsections are aligned to 4 bytes.
+    void PutSubsection(std::vector<char>& out, uint32_t kind, const std::vector<char>& data)
+    {
+        Put(out, kind);
+        Put(out, (uint32_t)data.size());
+        out.insert(out.end(), data.begin(), data.end());
+        Align(out, 4);
+    }
+};
+
+std::vector<char> Fixtures::MakeMsf(const std::vector<std::vector<char>>& streams, size_t minSize)
+{
+    // Block 0 is the super block and 1, 2 the free block maps, which PdbFile doesn't read.
+    // The streams follow, then the stream directory and the block map of the directory.
+    uint32_t nextBlock = 3;
+    std::vector<uint32_t> directory;
+    directory.push_back((uint32_t)streams.size());
+    for (const auto& s : streams)
+        directory.push_back((uint32_t)s.size());
+    std::vector<uint32_t> streamBlocks;
+    for (const auto& s : streams) {
+        streamBlocks.push_back(nextBlock);
+        for (uint32_t i = 0; i < NumBlocks(s.size()); ++i)
+            directory.push_back(nextBlock++);
+    }
+
+    const size_t directorySize = directory.size() * sizeof(uint32_t);
+    const uint32_t directoryBlock = nextBlock;
+    nextBlock += NumBlocks(directorySize);
+    const uint32_t blockMapBlock = nextBlock++;
+
+    const uint32_t numBlocks = std::max<uint32_t>(nextBlock, NumBlocks(minSize));
+    std::vector<char> file((size_t)numBlocks * s_blockSize);
+
+    memcpy(file.data(), msfMagic, 32);
+    PutAt(file, 32, s_blockSize);
+    PutAt(file, 36, (uint32_t)1); // the free block map.
+    PutAt(file, 40, numBlocks);
+    PutAt(file, 44, (uint32_t)directorySize);
+    PutAt(file, 48, (uint32_t)0);
+    PutAt(file, 52, blockMapBlock);
+
+    for (size_t i = 0; i < streams.size(); ++i) {
+        if (!streams[i].empty())
+            memcpy(file.data() + (size_t)streamBlocks[i] * s_blockSize, streams[i].data(), streams[i].size());
+    }
+    memcpy(file.data() + (size_t)directoryBlock * s_blockSize, directory.data(), directorySize);
+    for (uint32_t i = 0; i < NumBlocks(directorySize); ++i)
+        PutAt(file, (size_t)blockMapBlock * s_blockSize + i * sizeof(uint32_t), directoryBlock + i);
+
+    return file;
+}
+
+std::vector<char> Fixtures::MakePdbStream(const GUID& guid, uint32_t age, const std::vector<std::pair<std::string, uint32_t>>& namedStreams)
+{
+    std::vector<char> s;
+    Put(s, pdbVersionVC70);
+    Put(s, (uint32_t)0x5f3a9c01u); // the time stamp of the link.
+    Put(s, age);
+    Put(s, guid);
+
+    // The names of the named streams and a hash table of (name offset, stream index) in buckets 0..n-1.
+    std::vector<char> names;
+    std::vector<uint32_t> nameOffsets;
+    for (const auto& [name, idx] : namedStreams) {
+        nameOffsets.push_back((uint32_t)names.size());
+        PutString(names, name);
+    }
+    Put(s, (uint32_t)names.size());
+    s.insert(s.end(), names.begin(), names.end());
+
+    const uint32_t n = (uint32_t)namedStreams.size();
+    Put(s, n); // the number of entries.
+    Put(s, std::max<uint32_t>(n, 1)); // the capacity.
+    Put(s, (uint32_t)1); // the words of the present bits.
+    Put(s, n >= 32 ? 0xFFFFFFFFu : (1u << n) - 1);
+    Put(s, (uint32_t)0); // the words of the deleted bits.
+    for (uint32_t i = 0; i < n; ++i) {
+        Put(s, nameOffsets[i]);
+        Put(s, namedStreams[i].second);
+    }
+    Put(s, (uint32_t)0); // no feature codes.
+    return s;
+}
+
+std::vector<char> Fixtures::MakePdb(const GUID& guid, uint32_t age, size_t minSize)
+{
+    std::vector<std::vector<char>> streams(4);
+    streams[pdbStream] = MakePdbStream(guid, age, {});
+
+    // The DBI stream header. The version signature, VC70 and the age. The rest is empty.
+    auto& dbi = streams[dbiStream];
+    dbi.resize(64);
+    PutAt(dbi, 0, (int32_t)-1);
+    PutAt(dbi, 4, dbiVersionV70);
+    PutAt(dbi, 8, age);
+
+    return MakeMsf(streams, minSize);
+}
+
+std::vector<char> Fixtures::MakePdbWithLines(const GUID& guid, uint32_t age, const std::wstring& moduleName, const std::vector<Function>& functions)
+{
+    const size_t numCompilands = (functions.size() + s_functionsPerCompiland - 1) / s_functionsPerCompiland;
+    const uint32_t textSize = functions.empty() ? 0 : functions.back().rva + functions.back().size - s_textRva;
+
+    std::vector<std::vector<char>> streams(firstModuleStream + numCompilands);
+    streams[pdbStream] = MakePdbStream(guid, age, { { "/names", namesStream } });
+
+    // /names: a file name per compiland. Offset 0 is the empty name.
+    std::vector<uint32_t> fileNameOffsets;
+    {
+        std::vector<char> buffer(1, '\0');
+        for (size_t c = 0; c < numCompilands; ++c) {
+            fileNameOffsets.push_back((uint32_t)buffer.size());
+            PutString(buffer, "bench\\" + Narrow(moduleName) + "\\file" + std::to_string(c) + ".cpp");
+        }
+        auto& names = streams[namesStream];
+        Put(names, namesSignature);
+        Put(names, (uint32_t)1); // the hash version.
+        Put(names, (uint32_t)buffer.size());
+        names.insert(names.end(), buffer.begin(), buffer.end());
+        Put(names, (uint32_t)0); // no hash buckets.
+        Put(names, (uint32_t)numCompilands);
+    }
+
+    // The section headers of the image. Only the virtual address of .text is read.
+    {
+        auto& sections = streams[sectionHeaderStream];
+        sections.resize(40);
+        memcpy(sections.data(), ".text", 5);
+        PutAt(sections, 8, textSize);
+        PutAt(sections, 12, s_textRva);
+        PutAt(sections, 36, codeCharacteristics);
+    }
+
+    // The C13 lines of each compiland. A line every 4 to 31 bytes of a function, and the file of the compiland.
+    std::vector<uint32_t> c13Sizes(numCompilands);
+    for (size_t c = 0; c < numCompilands; ++c) {
+        auto& m = streams[firstModuleStream + c];
+        Put(m, cvSignatureC13);
+
+        std::vector<char> checksums;
+        Put(checksums, fileNameOffsets[c]);
+        Put(checksums, (uint8_t)0); // no checksum.
+        Put(checksums, (uint8_t)0);
+        Align(checksums, 4);
+        PutSubsection(m, debugSFileChecksums, checksums);
+
+        const size_t end = std::min<size_t>(functions.size(), (c + 1) * s_functionsPerCompiland);
+        for (size_t f = c * s_functionsPerCompiland; f < end; ++f) {
+            std::vector<uint32_t> offsets;
+            for (uint32_t k = 0, offset = 0; offset < functions[f].size; ++k) {
+                offsets.push_back(offset);
+                offset += LineStep(f, k);
+            }
+
+            std::vector<char> lines;
+            Put(lines, functions[f].rva - s_textRva);
+            Put(lines, (uint16_t)1); // the section of .text.
+            Put(lines, (uint16_t)0); // no columns.
+            Put(lines, functions[f].size);
+            Put(lines, (uint32_t)0); // the file, by the offset of its checksum entry.
+            Put(lines, (uint32_t)offsets.size());
+            Put(lines, (uint32_t)(12 + 8 * offsets.size()));
+            for (size_t k = 0; k < offsets.size(); ++k) {
+                Put(lines, offsets[k]);
+                Put(lines, (FirstLineNo(f) + (uint32_t)k) | 0x80000000u); // a statement.
+            }
+            PutSubsection(m, debugSLines, lines);
+        }
+        c13Sizes[c] = (uint32_t)m.size() - sizeof(cvSignatureC13);
+    }
+
+    // The DBI stream. The header, the module infos, the section contributions and the optional debug header.
+    std::vector<char> modInfos;
+    for (size_t c = 0; c < numCompilands; ++c) {
+        const Function& first = functions[c * s_functionsPerCompiland];
+        const Function& last = functions[std::min<size_t>(functions.size(), (c + 1) * s_functionsPerCompiland) - 1];
+        const size_t pos = modInfos.size();
+        modInfos.resize(pos + 64);
+        PutAt(modInfos, pos + 4, (uint16_t)1); // the first contribution of the compiland.
+        PutAt(modInfos, pos + 8, first.rva - s_textRva);
+        PutAt(modInfos, pos + 12, last.rva + last.size - first.rva);
+        PutAt(modInfos, pos + 16, codeCharacteristics);
+        PutAt(modInfos, pos + 20, (uint16_t)c);
+        PutAt(modInfos, pos + 34, (uint16_t)(firstModuleStream + c));
+        PutAt(modInfos, pos + 36, (uint32_t)sizeof(cvSignatureC13)); // the symbols, which are only the signature.
+        PutAt(modInfos, pos + 44, c13Sizes[c]);
+        const std::string objName = "file" + std::to_string(c) + ".obj";
+        PutString(modInfos, objName);
+        PutString(modInfos, objName);
+        Align(modInfos, 4);
+    }
+
+    // A contribution per function, so that the gaps between them are no code.
+    std::vector<char> contributions;
+    Put(contributions, sectionContributionsV60);
+    for (size_t f = 0; f < functions.size(); ++f) {
+        const size_t pos = contributions.size();
+        contributions.resize(pos + 28);
+        PutAt(contributions, pos, (uint16_t)1);
+        PutAt(contributions, pos + 4, functions[f].rva - s_textRva);
+        PutAt(contributions, pos + 8, functions[f].size);
+        PutAt(contributions, pos + 12, codeCharacteristics);
+        PutAt(contributions, pos + 16, (uint16_t)(f / s_functionsPerCompiland));
+    }
+
+    std::vector<uint16_t> dbgStreams(numDbgStreams, nilStream);
+    dbgStreams[dbgSectionHdr] = (uint16_t)sectionHeaderStream;
+
+    auto& dbi = streams[dbiStream];
+    dbi.resize(64);
+    PutAt(dbi, 0, (int32_t)-1);
+    PutAt(dbi, 4, dbiVersionV70);
+    PutAt(dbi, 8, age);
+    PutAt(dbi, 12, nilStream); // no globals, publics or symbol records.
+    PutAt(dbi, 16, nilStream);
+    PutAt(dbi, 20, nilStream);
+    PutAt(dbi, 24, (int32_t)modInfos.size());
+    PutAt(dbi, 28, (int32_t)contributions.size());
+    PutAt(dbi, 48, (int32_t)(dbgStreams.size() * sizeof(uint16_t)));
+    PutAt(dbi, 58, (uint16_t)0x8664); // x64.
+    dbi.insert(dbi.end(), modInfos.begin(), modInfos.end());
+    dbi.insert(dbi.end(), contributions.begin(), contributions.end());
+    for (auto s : dbgStreams)
+        Put(dbi, s);
+
+    return MakeMsf(streams);
+}
+
+std::vector<char> Fixtures::MakePe(const std::vector<Section>& sections, const std::vector<DataDirectory>& directories)
+{
+    constexpr uint32_t peHeaderPos = 0x40;
+    constexpr uint32_t optionalHeaderPos = peHeaderPos + 4 + 20;
+    constexpr uint32_t optionalHeaderSize = 240;
+    constexpr uint32_t sectionHeadersPos = optionalHeaderPos + optionalHeaderSize;
+
+    uint32_t fileSize = headersSize;
+    uint32_t imageSize = headersSize;
+    for (const auto& section : sections) {
+        fileSize += AlignUp((uint32_t)section.data.size(), fileAlignment);
+        imageSize = std::max<uint32_t>(imageSize, AlignUp(section.rva + (uint32_t)section.data.size(), sectionAlignment));
+    }
+
+    std::vector<char> file(fileSize);
+    file[0] = 'M';
+    file[1] = 'Z';
+    PutAt(file, 0x3C, peHeaderPos);
+    memcpy(file.data() + peHeaderPos, "PE\0\0", 4);
+
+    // The file header. x64, an executable DLL.
+    PutAt(file, peHeaderPos + 4, (uint16_t)0x8664);
+    PutAt(file, peHeaderPos + 6, (uint16_t)sections.size());
+    PutAt(file, peHeaderPos + 8, (uint32_t)0x5f3a9c01u);
+    PutAt(file, peHeaderPos + 20, (uint16_t)optionalHeaderSize);
+    PutAt(file, peHeaderPos + 22, (uint16_t)0x2022);
+
+    // The PE32+ optional header.
+    PutAt(file, optionalHeaderPos, (uint16_t)0x20B);
+    PutAt(file, optionalHeaderPos + 4, AlignUp((uint32_t)sections.front().data.size(), fileAlignment));
+    PutAt(file, optionalHeaderPos + 20, s_textRva);
+    PutAt(file, optionalHeaderPos + 24, (uint64_t)0x180000000ull);
+    PutAt(file, optionalHeaderPos + 32, sectionAlignment);
+    PutAt(file, optionalHeaderPos + 36, fileAlignment);
+    PutAt(file, optionalHeaderPos + 40, (uint16_t)6);
+    PutAt(file, optionalHeaderPos + 48, (uint16_t)6);
+    PutAt(file, optionalHeaderPos + 56, imageSize);
+    PutAt(file, optionalHeaderPos + 60, headersSize);
+    PutAt(file, optionalHeaderPos + 68, (uint16_t)2); // the GUI subsystem.
+    PutAt(file, optionalHeaderPos + 108, (uint32_t)16); // the data directories.
+    for (const auto& d : directories) {
+        PutAt(file, optionalHeaderPos + 112 + d.index * 8, d.rva);
+        PutAt(file, optionalHeaderPos + 112 + d.index * 8 + 4, d.size);
+    }
+
+    uint32_t rawPos = headersSize;
+    for (size_t i = 0; i < sections.size(); ++i) {
+        const auto& section = sections[i];
+        const uint32_t pos = sectionHeadersPos + (uint32_t)i * 40;
+        const uint32_t rawSize = AlignUp((uint32_t)section.data.size(), fileAlignment);
+        memcpy(file.data() + pos, section.name, strlen(section.name));
+        PutAt(file, pos + 8, (uint32_t)section.data.size());
+        PutAt(file, pos + 12, section.rva);
+        PutAt(file, pos + 16, rawSize);
+        PutAt(file, pos + 20, rawPos);
+        PutAt(file, pos + 36, section.characteristics);
+        memcpy(file.data() + rawPos, section.data.data(), section.data.size());
+        rawPos += rawSize;
+    }
+    return file;
+}
+
+uint32_t Fixtures::RdataRva(uint32_t codeSize)
+{
+    return AlignUp(s_textRva + codeSize, sectionAlignment);
+}
+
+std::vector<char> Fixtures::MakeImage(const GUID& guid, uint32_t age, const std::string& pdbName, uint32_t codeSize)
+{
+    // .text with the code and .rdata with the debug directory and the CodeView record.
+    constexpr uint32_t debugDirectorySize = 28;
+    constexpr uint32_t debugDataDirectory = 6;
+
+    const uint32_t rdataRva = RdataRva(codeSize);
+    const uint32_t cvSize = 24 + (uint32_t)pdbName.size() + 1;
+
+    // int3 as the code.
+    Section text = { ".text", s_textRva, std::vector<char>(codeSize, (char)0xCC), codeCharacteristics };
+
+    // IMAGE_DEBUG_DIRECTORY of the CodeView type and the "RSDS" record after it. The file offset of the
+    // record is the one MakePe() gives the second section.
+    Section rdata = { ".rdata", rdataRva, std::vector<char>(debugDirectorySize + cvSize), 0x40000040 }; // initialized data, read.
+    PutAt(rdata.data, 12, (uint32_t)2);
+    PutAt(rdata.data, 16, cvSize);
+    PutAt(rdata.data, 20, rdataRva + debugDirectorySize);
+    PutAt(rdata.data, 24, headersSize + AlignUp(codeSize, fileAlignment) + debugDirectorySize);
+    const uint32_t cvPos = debugDirectorySize;
+    memcpy(rdata.data.data() + cvPos, "RSDS", 4);
+    PutAt(rdata.data, cvPos + 4, guid);
+    PutAt(rdata.data, cvPos + 20, age);
+    memcpy(rdata.data.data() + cvPos + 24, pdbName.data(), pdbName.size());
+
+    return MakePe({ std::move(text), std::move(rdata) }, { { debugDataDirectory, rdataRva, debugDirectorySize } });
+}
+
+std::vector<char> Fixtures::MakeUnwindImage(const std::vector<uint8_t>& code, const std::vector<uint8_t>& xdata, const std::vector<RuntimeFunction>& functions)
+{
+    constexpr uint32_t exceptionDataDirectory = 3;
+
+    // .rdata has the unwind info, then the function table.
+    const uint32_t rdataRva = RdataRva((uint32_t)code.size());
+    Section text = { ".text", s_textRva, std::vector<char>(code.begin(), code.end()), codeCharacteristics };
+    Section rdata = { ".rdata", rdataRva, std::vector<char>(xdata.begin(), xdata.end()), 0x40000040 };
+    Align(rdata.data, 4);
+    const uint32_t pdataRva = rdataRva + (uint32_t)rdata.data.size();
+    for (const auto& f : functions) {
+        Put(rdata.data, f);
+    }
+
+    return MakePe({ std::move(text), std::move(rdata) }, { { exceptionDataDirectory, pdataRva, (uint32_t)(functions.size() * sizeof(RuntimeFunction)) } });
+}
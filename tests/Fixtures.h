@@ -0,0 +1,66 @@
+#pragma once
+#include <Windows.h>
+
+#include <string>
+#include <vector>
+
+// Synthetic symbol files for the tests and the benchmark, made in memory so that no binaries are checked in.
+class Fixtures
+{
+public:
+	static constexpr uint32_t   s_blockSize = 4096;
+	static constexpr uint32_t   s_textRva = 0x1000; // the first section of the images.
+	static constexpr size_t     s_functionsPerCompiland = 64;
+
+	// A function in the .text section of an image.
+	struct Function {
+		uint32_t    rva;
+		uint32_t    size;
+	};
+
+	// An entry of the exception directory of an x64 image.
+	struct RuntimeFunction {
+		uint32_t    begin;
+		uint32_t    end;
+		uint32_t    unwindData;
+	};
+
+	struct Section {
+		const char*         name;
+		uint32_t            rva;
+		std::vector<char>   data;
+		uint32_t            characteristics;
+	};
+
+	struct DataDirectory {
+		size_t      index;
+		uint32_t    rva;
+		uint32_t    size;
+	};
+
+	// An MSF 7.00 file of the streams. Padded with empty blocks up to "minSize" bytes.
+	static std::vector<char> MakeMsf(const std::vector<std::vector<char>>& streams, size_t minSize = 0);
+
+	// A PDB with the PDB stream and a DBI stream carrying the GUID and age, which PdbFile::Validate() accepts.
+	static std::vector<char> MakePdb(const GUID& guid, uint32_t age, size_t minSize = 0);
+
+	// A PDB which PdbLines reads. The functions, sorted by the RVA, are grouped into compilands of
+	// s_functionsPerCompiland, each with a source file of its own and a line every few bytes.
+	static std::vector<char> MakePdbWithLines(const GUID& guid, uint32_t age, const std::wstring& moduleName, const std::vector<Function>& functions);
+
+	// An x64 DLL with a .text section of "codeSize" bytes of int3 and a CodeView record naming the PDB.
+	static std::vector<char> MakeImage(const GUID& guid, uint32_t age, const std::string& pdbName, uint32_t codeSize);
+
+	// An x64 DLL with "code" as its .text section, and "xdata" followed by the function table in .rdata.
+	// The unwind info of the functions is at RdataRva() + its offset in "xdata".
+	static std::vector<char> MakeUnwindImage(const std::vector<uint8_t>& code, const std::vector<uint8_t>& xdata, const std::vector<RuntimeFunction>& functions);
+	// The RVA of the section after a .text of "codeSize" bytes.
+	static uint32_t RdataRva(uint32_t codeSize);
+
+	// A PE32+ file of the sections, the first of which is the code at s_textRva. Used by MakeImage() and
+	// MakeUnwindImage().
+	static std::vector<char> MakePe(const std::vector<Section>& sections, const std::vector<DataDirectory>& directories);
+
+	// Used by MakePdb() and MakePdbWithLines().
+	static std::vector<char> MakePdbStream(const GUID& guid, uint32_t age, const std::vector<std::pair<std::string, uint32_t>>& namedStreams);
+};
@@ -0,0 +1,136 @@
+#include <fstream>
+#include <iterator>
+
+#include "Test.h"
+#include "LocalHttpServer.h"
+#include "../HttpGet.h"
+
+namespace {
+    const std::string filePath = "/test.pdb/0123456789ABCDEF0123456789ABCDEF1/test.pdb";
+    constexpr size_t fileSize = 3u * 1024u * 1024u + 123u;
+
+    // Bytes which differ at every offset, so that a body appended at a wrong position doesn't compare equal.
+    std::vector<char> MakeBody(size_t size)
+    {
+        std::vector<char> body(size);
+        uint32_t x = 0x12345678u;
+        for (auto& c : body) {
+            x = x * 1664525u + 1013904223u;
+            c = (char)(x >> 24);
+        }
+        return body;
+    }
+
+    std::vector<char> ReadFile(const std::filesystem::path& path)
+    {
+        std::ifstream fs(path, std::ios::binary);
+        return std::vector<char>(std::istreambuf_iterator<char>(fs), std::istreambuf_iterator<char>());
+    }
+
+    std::filesystem::path PartialPath(const std::filesystem::path& dest)
+    {
+        std::filesystem::path p = dest;
+        p += L".partial";
+        return p;
+    }
+};
+
+TEST(HttpGet_Downloads)
+{
+    const auto body = MakeBody(fileSize);
+    LocalHttpServer server;
+    server.AddFile(filePath, body);
+    CHECK(server.Start().empty());
+
+    const auto dest = Test::TempDir() / L"test.pdb";
+    CHECK(HttpGet::Get(server.Url(L"/test.pdb/0123456789ABCDEF0123456789ABCDEF1/test.pdb"), dest).empty());
+    CHECK(ReadFile(dest) == body);
+    CHECK(!std::filesystem::exists(PartialPath(dest)));
+    CHECK(server.Requests().size() == 1);
+}
+
+TEST(HttpGet_ResumesAfterDroppedConnections)
+{
+    const auto body = MakeBody(fileSize);
+    LocalHttpServer server;
+    server.AddFile(filePath, body);
+    server.m_faults.dropAfterBytes = fileSize / 3;
+    server.m_faults.numDrops = 2;
+    CHECK(server.Start().empty());
+
+    const auto dest = Test::TempDir() / L"test.pdb";
+    CHECK(HttpGet::Get(server.Url(L"/test.pdb/0123456789ABCDEF0123456789ABCDEF1/test.pdb"), dest).empty());
+    CHECK(ReadFile(dest) == body);
+    CHECK(!std::filesystem::exists(PartialPath(dest)));
+
+    // Each retry continues from where the previous response was cut.
+    auto requests = server.Requests();
+    CHECK(requests.size() == 3);
+    if (requests.size() == 3) {
+        CHECK(requests[0].range.empty());
+        CHECK(!requests[1].range.empty());
+        CHECK(!requests[2].range.empty());
+        CHECK(requests[1].range != requests[2].range);
+    }
+}
+
+TEST(HttpGet_RestartsWhenServerIgnoresRange)
+{
+    const auto body = MakeBody(fileSize);
+    LocalHttpServer server;
+    server.AddFile(filePath, body);
+    server.m_faults.dropAfterBytes = fileSize / 2;
+    server.m_faults.ignoreRange = true;
+    CHECK(server.Start().empty());
+
+    const auto dest = Test::TempDir() / L"test.pdb";
+    CHECK(HttpGet::Get(server.Url(L"/test.pdb/0123456789ABCDEF0123456789ABCDEF1/test.pdb"), dest).empty());
+    CHECK(ReadFile(dest) == body);
+    CHECK(server.Requests().size() == 2);
+}
+
+TEST(HttpGet_RestartsOnMisalignedContentRange)
+{
+    const auto body = MakeBody(fileSize);
+    LocalHttpServer server;
+    server.AddFile(filePath, body);
+    server.m_faults.dropAfterBytes = fileSize / 2;
+    server.m_faults.rangeShift = 4096; // the resumed body starts 4KB after the end of the partial file.
+    CHECK(server.Start().empty());
+
+    const auto dest = Test::TempDir() / L"test.pdb";
+    CHECK(HttpGet::Get(server.Url(L"/test.pdb/0123456789ABCDEF0123456789ABCDEF1/test.pdb"), dest).empty());
+    CHECK(ReadFile(dest) == body);
+
+    // Cut, misaligned and dropped, then the whole body again without a Range.
+    auto requests = server.Requests();
+    CHECK(requests.size() == 3);
+    if (requests.size() == 3) {
+        CHECK(!requests[1].range.empty());
+        CHECK(requests[2].range.empty());
+    }
+}
+
+TEST(HttpGet_RejectedDownloadIsNotPublished)
+{
+    LocalHttpServer server;
+    server.AddFile(filePath, MakeBody(fileSize));
+    CHECK(server.Start().empty());
+
+    const auto dest = Test::TempDir() / L"test.pdb";
+    auto validator = [](const std::filesystem::path&) -> std::wstring { return L"Signature mismatch."; };
+    CHECK(!HttpGet::Get(server.Url(L"/test.pdb/0123456789ABCDEF0123456789ABCDEF1/test.pdb"), dest, validator).empty());
+    CHECK(!std::filesystem::exists(dest));
+    CHECK(!std::filesystem::exists(PartialPath(dest)));
+}
+
+TEST(HttpGet_NotFoundIsNotRetried)
+{
+    LocalHttpServer server;
+    CHECK(server.Start().empty());
+
+    const auto dest = Test::TempDir() / L"test.pdb";
+    CHECK(!HttpGet::Get(server.Url(L"/missing.pdb/0/missing.pdb"), dest).empty());
+    CHECK(!std::filesystem::exists(dest));
+    CHECK(server.Requests().size() == 1);
+}
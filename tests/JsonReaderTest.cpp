@@ -0,0 +1,126 @@
+#include <sstream>
+
+#include "Test.h"
+#include "../JsonReader.h"
+
+namespace {
+    // Records the events as text, "[ { k:key s:string n:1 b:1 null } ]".
+    class Recorder : public JsonReader::Handler {
+    public:
+        std::wstring    m_events;
+        std::wstring    m_failOn; // an event which returns an error.
+
+        std::wstring Event(const std::wstring& e)
+        {
+            if (!m_events.empty()) {
+                m_events += L' ';
+            }
+            m_events += e;
+            return e == m_failOn ? L"Refused." : std::wstring();
+        }
+
+        std::wstring StartObject() override { return Event(L"{"); }
+        std::wstring Key(const std::wstring& key) override { return Event(L"k:" + key); }
+        std::wstring EndObject() override { return Event(L"}"); }
+        std::wstring StartArray() override { return Event(L"["); }
+        std::wstring EndArray() override { return Event(L"]"); }
+        std::wstring String(const std::wstring& value) override { return Event(L"s:" + value); }
+        std::wstring Number(std::string_view text) override { return Event(L"n:" + std::wstring(text.begin(), text.end())); }
+        std::wstring Bool(bool value) override { return Event(value ? L"b:1" : L"b:0"); }
+        std::wstring Null() override { return Event(L"null"); }
+    };
+
+    std::wstring Parse(const std::string& text, Recorder& recorder)
+    {
+        std::istringstream is(text);
+        JsonReader reader;
+        return reader.Parse(is, recorder);
+    }
+
+    std::wstring Parse(const std::string& text)
+    {
+        Recorder recorder;
+        return Parse(text, recorder);
+    }
+
+    std::wstring ParseString(const std::string& text, std::wstring& value)
+    {
+        Recorder recorder;
+        const auto errStr = Parse(text, recorder);
+        value = recorder.m_events.substr(recorder.m_events.find(L':') + 1);
+        return errStr;
+    }
+};
+
+TEST(JsonReader_ReportsValues)
+{
+    Recorder recorder;
+    CHECK(Parse(" {\"a\": [1, -2.5e+3, true, false, null, {}, []], \"b\": \"x\"}\r\n", recorder).empty());
+    CHECK(recorder.m_events == L"{ k:a [ n:1 n:-2.5e+3 b:1 b:0 null { } [ ] ] k:b s:x }");
+}
+
+TEST(JsonReader_DecodesEscapes)
+{
+    std::wstring value;
+    CHECK(ParseString("\"\\\"\\\\\\/\\b\\f\\n\\r\\t\"", value).empty());
+    CHECK(value == L"\"\\/\b\f\n\r\t");
+
+    // \u, with a surrogate pair, and the same characters in UTF-8.
+    std::wstring expected = L"a\u00e9\u20ac";
+    JsonReader::AppendCodePoint(expected, 0x1F600);
+    CHECK(ParseString("\"a\\u00e9\\u20AC\\ud83d\\ude00\"", value).empty());
+    CHECK(value == expected);
+    CHECK(ParseString("\"a\xC3\xA9\xE2\x82\xAC\xF0\x9F\x98\x80\"", value).empty());
+    CHECK(value == expected);
+
+    // Invalid UTF-8 is replaced, as MultiByteToWideChar does.
+    CHECK(ParseString("\"\xC0\xAF|\xED\xA0\x80|\xE2\x82\"", value).empty());
+    CHECK(value == L"\ufffd\ufffd|\ufffd|\ufffd");
+
+    // An escape split by the end of the read buffer.
+    const std::string padding(JsonReader::s_bufferSize - 4, ' ');
+    CHECK(ParseString(padding + "\"ab\\u00e9\"", value).empty());
+    CHECK(value == L"ab\u00e9");
+
+    CHECK(Parse("\"\\x\"") == L"Invalid escape in a string. (line 1, column 1)");
+    CHECK(Parse("\"\\u12g4\"") == L"Invalid \\u escape in a string. (line 1, column 1)");
+    CHECK(Parse("\"\\udc00\"") == L"Invalid surrogate pair in a string. (line 1, column 1)");
+    CHECK(Parse("\"\\ud83dx\"") == L"Invalid surrogate pair in a string. (line 1, column 1)");
+    CHECK(Parse("\"\\ud83d\\u0041\"") == L"Invalid surrogate pair in a string. (line 1, column 1)");
+    CHECK(Parse("\"a\tb\"") == L"Control character in a string. (line 1, column 1)");
+    CHECK(Parse("\"abc") == L"Unterminated string. (line 1, column 1)");
+}
+
+TEST(JsonReader_LimitsDepth)
+{
+    const size_t depth = JsonReader::s_maxDepth;
+    CHECK(Parse(std::string(depth, '[') + std::string(depth, ']')).empty());
+    CHECK(Parse(std::string(depth - 1, '[') + "{\"a\":1}" + std::string(depth - 1, ']')).empty());
+
+    const auto errStr = Parse(std::string(depth + 1, '[') + std::string(depth + 1, ']'));
+    CHECK(errStr == L"Too deeply nested. (line 1, column " + std::to_wstring(depth + 1) + L")");
+}
+
+TEST(JsonReader_ReportsPositionOfErrors)
+{
+    // The position is where the token starts, after whitespace and newlines.
+    CHECK(Parse("{\n  \"a\": 1,\n  \"b\" 2\n}") == L"Expected ':' after the key of a member. (line 3, column 7)");
+    CHECK(Parse("[1,\n 2\n 3]") == L"Expected ',' or ']'. (line 3, column 2)");
+    CHECK(Parse("{\"a\": 1\n\n   x}") == L"Expected ',' or '}'. (line 3, column 4)");
+    CHECK(Parse("{\n\t1: 2}") == L"Expected a string as the key of a member. (line 2, column 2)");
+    CHECK(Parse("[tru]") == L"Invalid literal. Expected \"true\". (line 1, column 2)");
+    CHECK(Parse("[1, -]") == L"Invalid number. (line 1, column 5)");
+    CHECK(Parse("[01]") == L"Expected ',' or ']'. (line 1, column 3)");
+    CHECK(Parse("[1,") == L"Unexpected end of the input. (line 1, column 4)");
+    CHECK(Parse("  ") == L"Unexpected end of the input. (line 1, column 3)");
+    CHECK(Parse("{}\n {}") == L"Unexpected data after the root value. (line 2, column 2)");
+
+    // Columns count bytes, so a character in UTF-8 counts as many columns as it has bytes.
+    CHECK(Parse("[\"\xC3\xA9\" x]") == L"Expected ',' or ']'. (line 1, column 7)");
+
+    // An error of the handler gets the position of the value.
+    Recorder recorder;
+    recorder.m_failOn = L"n:42";
+    CHECK(Parse("{\"a\":\n  [1, 42]}", recorder) == L"Refused. (line 2, column 7)");
+    CHECK(recorder.m_events == L"{ k:a [ n:1 n:42");
+}
@@ -0,0 +1,209 @@
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+
+#include <sstream>
+#include <chrono>
+
+#include "LocalHttpServer.h"
+
+#pragma comment(lib, "ws2_32.lib")
+
+namespace {
+    constexpr size_t maxRequestHeaderSize = 64u * 1024u;
+    constexpr size_t sendChunkSize = 16u * 1024u;
+
+    // The value of a header in the request, matched case insensitively. Empty when it isn't there.
+    std::string HeaderValue(const std::string& request, const std::string& name)
+    {
+        std::istringstream is(request);
+        std::string line;
+        while (std::getline(is, line)) {
+            if (!line.empty() && line.back() == '\r')
+                line.pop_back();
+            auto colon = line.find(':');
+            if (colon != name.size() || _strnicmp(line.c_str(), name.c_str(), name.size()) != 0)
+                continue;
+            auto value = line.substr(colon + 1);
+            value.erase(0, value.find_first_not_of(' '));
+            return value;
+        }
+        return std::string();
+    }
+};
+
+LocalHttpServer::~LocalHttpServer()
+{
+    Stop();
+}
+
+void LocalHttpServer::AddFile(const std::string& path, std::vector<char> body)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_files[path] = std::move(body);
+}
+
+std::wstring LocalHttpServer::Start()
+{
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+        return L"WSAStartup failed.";
+
+    m_listenSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (m_listenSocket == INVALID_SOCKET)
+        return L"Failed to create a socket.";
+
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    if (bind(m_listenSocket, (const sockaddr*)&addr, sizeof(addr)) != 0 || listen(m_listenSocket, SOMAXCONN) != 0) {
+        std::wstringstream ss;
+        ss << L"Failed to listen on 127.0.0.1. Error: " << WSAGetLastError();
+        return ss.str();
+    }
+
+    int addrLen = sizeof(addr);
+    getsockname(m_listenSocket, (sockaddr*)&addr, &addrLen);
+    m_port = ntohs(addr.sin_port);
+
+    m_acceptThread = std::thread([this]() { AcceptLoop(); });
+    return std::wstring();
+}
+
+void LocalHttpServer::Stop()
+{
+    if (m_listenSocket == INVALID_SOCKET)
+        return;
+
+    m_stopping = true;
+    closesocket(m_listenSocket); // wakes accept().
+    m_listenSocket = INVALID_SOCKET;
+    if (m_acceptThread.joinable())
+        m_acceptThread.join();
+    for (auto& t : m_connectionThreads)
+        t.join();
+    m_connectionThreads.clear();
+    WSACleanup();
+}
+
+std::wstring LocalHttpServer::Url(const std::wstring& path) const
+{
+    std::wstringstream ss;
+    ss << L"http://127.0.0.1:" << m_port << path;
+    return ss.str();
+}
+
+std::vector<LocalHttpServer::Request> LocalHttpServer::Requests()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_requests;
+}
+
+void LocalHttpServer::AcceptLoop()
+{
+    for (;;) {
+        SOCKET s = accept(m_listenSocket, nullptr, nullptr);
+        if (s == INVALID_SOCKET) {
+            if (m_stopping)
+                return;
+            continue;
+        }
+        m_connectionThreads.emplace_back([this, s]() { Serve(s); });
+    }
+}
+
+void LocalHttpServer::Serve(SOCKET s)
+{
+    std::string request;
+    {
+        char buf[4096];
+        while (request.find("\r\n\r\n") == std::string::npos && request.size() < maxRequestHeaderSize) {
+            int n = recv(s, buf, sizeof(buf), 0);
+            if (n <= 0) {
+                closesocket(s);
+                return;
+            }
+            request.append(buf, n);
+        }
+    }
+
+    std::string path;
+    {
+        std::istringstream is(request);
+        std::string method;
+        is >> method >> path;
+    }
+    const std::string range = HeaderValue(request, "Range");
+
+    const std::vector<char>* body = nullptr;
+    Faults faults;
+    bool drop = false;
+    bool shift = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_requests.push_back({ path, range });
+        auto it = m_files.find(path);
+        if (it != m_files.end())
+            body = &it->second;
+        faults = m_faults;
+        if (body != nullptr && faults.dropAfterBytes > 0 && m_numDropped < faults.numDrops) {
+            ++m_numDropped;
+            drop = true;
+        }
+        if (body != nullptr && !range.empty() && faults.rangeShift != 0 && m_numShifted < faults.numRangeShifts) {
+            ++m_numShifted;
+            shift = true;
+        }
+    }
+
+    if (faults.delayMs > 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(faults.delayMs));
+
+    std::ostringstream header;
+    size_t first = 0;
+    size_t size = 0;
+    if (body == nullptr) {
+        header << "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n";
+    }
+    else {
+        size = body->size();
+        if (range.rfind("bytes=", 0) == 0 && !faults.ignoreRange) {
+            first = std::strtoull(range.c_str() + 6, nullptr, 10);
+            if (shift)
+                first = (size_t)std::max<int64_t>(0, (int64_t)first + faults.rangeShift);
+        }
+        if (first >= size && first > 0) {
+            header << "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Range: bytes */" << size << "\r\nContent-Length: 0\r\n";
+            first = size = 0;
+        }
+        else if (!range.empty() && !faults.ignoreRange) {
+            header << "HTTP/1.1 206 Partial Content\r\nContent-Range: bytes " << first << "-" << size - 1 << "/" << size << "\r\n";
+            header << "Content-Length: " << size - first << "\r\n";
+        }
+        else {
+            header << "HTTP/1.1 200 OK\r\nContent-Length: " << size << "\r\n";
+        }
+    }
+    header << "Content-Type: application/octet-stream\r\nCache-Control: no-store\r\nConnection: close\r\n\r\n";
+
+    const std::string headerStr = header.str();
+    if (SendAll(s, headerStr.data(), headerStr.size()) && body != nullptr && first < size) {
+        size_t end = drop ? std::min<size_t>(size, first + faults.dropAfterBytes) : size;
+        // A dropped response ends before its Content-Length. What was sent still reaches the client.
+        SendAll(s, body->data() + first, end - first);
+    }
+    shutdown(s, SD_SEND);
+    closesocket(s);
+}
+
+bool LocalHttpServer::SendAll(SOCKET s, const char* data, size_t size)
+{
+    while (size > 0) {
+        int n = send(s, data, (int)std::min<size_t>(size, sendChunkSize), 0);
+        if (n <= 0)
+            return false;
+        data += n;
+        size -= n;
+    }
+    return true;
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <WinSock2.h>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <atomic>
+
+// A stand-in for a symbol server on 127.0.0.1, serving files from memory with HTTP/1.1 and "Range: bytes=N-".
+// The faults of real servers and networks are injected by m_faults:
+//
+//     LocalHttpServer server;
+//     server.AddFile("/a.pdb/<signature>/a.pdb", body);
+//     server.m_faults.dropAfterBytes = 4096; // the first response is cut after 4KB.
+//     server.Start();
+//     HttpGet::Get(server.Url(L"/a.pdb/<signature>/a.pdb"), dest);
+//
+// Each connection is served by a thread of its own and closed after one response.
+class LocalHttpServer
+{
+public:
+	struct Faults {
+		size_t      dropAfterBytes = 0; // the body is cut after this many bytes. 0 for never.
+		uint32_t    numDrops = 1; // responses cut before the rest are sent whole.
+		bool        ignoreRange = false; // "200 OK" with the whole body to Range requests.
+		int64_t     rangeShift = 0; // a 206 starts this many bytes away from the requested position.
+		uint32_t    numRangeShifts = 1;
+		uint32_t    delayMs = 0; // before each response, to keep the downloaders of a test overlapping.
+	};
+
+	struct Request {
+		std::string     path;
+		std::string     range; // the value of the Range header. Empty for none.
+	};
+
+	SOCKET                                  m_listenSocket = INVALID_SOCKET;
+	uint16_t                                m_port = 0;
+	std::thread                             m_acceptThread;
+	std::vector<std::thread>                m_connectionThreads;
+	std::atomic<bool>                       m_stopping = false;
+	std::mutex                              m_mutex;
+	std::map<std::string, std::vector<char>> m_files;
+	std::vector<Request>                    m_requests;
+	Faults                                  m_faults;
+	uint32_t                                m_numDropped = 0;
+	uint32_t                                m_numShifted = 0;
+
+public:
+	LocalHttpServer() = default;
+	LocalHttpServer(const LocalHttpServer&) = delete;
+	LocalHttpServer& operator=(const LocalHttpServer&) = delete;
+	~LocalHttpServer();
+
+	void AddFile(const std::string& path, std::vector<char> body);
+	// Listens on an ephemeral port.
+	std::wstring Start();
+	void Stop();
+
+	std::wstring Url(const std::wstring& path = std::wstring()) const;
+	std::vector<Request> Requests();
+
+	// Used by Start().
+	void AcceptLoop();
+	void Serve(SOCKET s);
+	static bool SendAll(SOCKET s, const char* data, size_t size);
+};
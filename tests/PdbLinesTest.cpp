@@ -0,0 +1,59 @@
+#include <fstream>
+
+#include "Test.h"
+#include "Fixtures.h"
+#include "../PdbLines.h"
+
+namespace {
+    constexpr GUID pdbGuid = { 0x2c3d4e5f, 0x6071, 0x8293, { 0xa4, 0xb5, 0xc6, 0xd7, 0xe8, 0xf9, 0x0a, 0x1b } };
+    constexpr size_t numFunctions = 200;
+
+    // Functions of 0x40 to 0x400 bytes with a gap of 0x10 after every 3rd.
+    std::vector<Fixtures::Function> Functions()
+    {
+        std::vector<Fixtures::Function> functions;
+        uint32_t rva = Fixtures::s_textRva;
+        for (size_t i = 0; i < numFunctions; ++i) {
+            const uint32_t size = 0x40 * (1 + (uint32_t)(i % 16));
+            functions.push_back({ rva, size });
+            rva += size + (i % 3 == 0 ? 0x10 : 0);
+        }
+        return functions;
+    }
+};
+
+TEST(PdbLines_ReadsFixtureLines)
+{
+    const auto functions = Functions();
+    const auto pdbPath = Test::TempDir() / L"lines.pdb";
+    {
+        const auto body = Fixtures::MakePdbWithLines(pdbGuid, 1, L"lines", functions);
+        std::ofstream fs(pdbPath, std::ios::binary);
+        fs.write(body.data(), body.size());
+    }
+    CHECK(PdbFile::Validate(pdbPath, pdbGuid, 1).empty());
+
+    PdbLines lines;
+    CHECK(lines.Open(pdbPath).empty());
+    CHECK(lines.m_modules.size() == (numFunctions + Fixtures::s_functionsPerCompiland - 1) / Fixtures::s_functionsPerCompiland);
+
+    for (size_t i = 0; i < functions.size(); ++i) {
+        const auto& f = functions[i];
+        std::wstring fileName;
+        uint32_t lineNo = 0, lineRva = 0;
+
+        // The first line of each function, in the file of its compiland.
+        CHECK(lines.Find(f.rva, fileName, lineNo, lineRva));
+        CHECK(lineRva == f.rva);
+        CHECK(lineNo == 1 + (uint32_t)(i % Fixtures::s_functionsPerCompiland) * 40);
+        CHECK(fileName == L"bench\\lines\\file" + std::to_wstring(i / Fixtures::s_functionsPerCompiland) + L".cpp");
+
+        // A later line of the same function.
+        CHECK(lines.Find(f.rva + f.size - 1, fileName, lineNo, lineRva));
+        CHECK(lineRva > f.rva && lineRva < f.rva + f.size);
+
+        // No line in the gaps.
+        if (i % 3 == 0)
+            CHECK(!lines.Find(f.rva + f.size, fileName, lineNo, lineRva));
+    }
+}
@@ -0,0 +1,127 @@
+#include <Windows.h>
+#include <iostream>
+#include <sstream>
+#include <string_view>
+#include <cstring>
+
+#include "Test.h"
+#include "../Log.h"
+
+namespace {
+    const Test::Case* s_running = nullptr;
+    uint32_t s_failures = 0;
+};
+
+std::vector<Test::Case>& Test::Cases()
+{
+    static std::vector<Case> cases;
+    return cases;
+}
+
+void Test::Fail(const char* file, int line, const char* expr)
+{
+    ++s_failures;
+    std::cout << file << "(" << line << "): " << (s_running ? s_running->name : "") << ": CHECK(" << expr << ") failed." << std::endl;
+}
+
+std::vector<Test::Child>& Test::Children()
+{
+    static std::vector<Child> children;
+    return children;
+}
+
+std::filesystem::path Test::TempDir()
+{
+    std::filesystem::path dir = std::filesystem::temp_directory_path() / L"CallstackResolverTests";
+    if (s_running != nullptr)
+        dir /= s_running->name;
+
+    std::error_code ec;
+    std::filesystem::remove_all(dir, ec);
+    std::filesystem::create_directories(dir, ec);
+    return dir;
+}
+
+std::filesystem::path Test::ExePath()
+{
+    std::vector<wchar_t> buf(MAX_PATH);
+    for (;;) {
+        DWORD len = GetModuleFileNameW(nullptr, buf.data(), (DWORD)buf.size());
+        if (len < buf.size())
+            return std::filesystem::path(std::wstring(buf.data(), len));
+        buf.resize(buf.size() * 2);
+    }
+}
+
+HANDLE Test::StartChild(const char* name, const std::vector<std::wstring>& args)
+{
+    std::wstringstream ss;
+    ss << L"\"" << ExePath().wstring() << L"\" --child " << std::wstring(name, name + strlen(name));
+    for (const auto& arg : args)
+        ss << L" \"" << arg << L"\"";
+    std::wstring cmdLine = ss.str();
+
+    STARTUPINFOW si = { sizeof(si) };
+    PROCESS_INFORMATION pi = {};
+    if (!CreateProcessW(nullptr, cmdLine.data(), nullptr, nullptr, FALSE, 0, nullptr, nullptr, &si, &pi))
+        return NULL;
+    CloseHandle(pi.hThread);
+    return pi.hProcess;
+}
+
+int Test::WaitChild(HANDLE hProcess)
+{
+    DWORD exitCode = (DWORD)-1;
+    WaitForSingleObject(hProcess, INFINITE);
+    GetExitCodeProcess(hProcess, &exitCode);
+    CloseHandle(hProcess);
+    return (int)exitCode;
+}
+
+int Test::Run(int argc, wchar_t** argv)
+{
+    if (argc >= 3 && std::wstring_view(argv[1]) == L"--child") {
+        Log::SetLevel(Log::Level::Off);
+        for (const auto& c : Children()) {
+            if (std::wstring_view(argv[2]) == std::wstring(c.name, c.name + strlen(c.name)))
+                return c.fn(argc - 3, argv + 3);
+        }
+        std::wcout << L"Unknown child \"" << argv[2] << L"\"." << std::endl;
+        return -1;
+    }
+
+    std::wstring_view filter = argc > 1 ? argv[1] : L"";
+
+    // The messages of the code under test are noise unless a case fails.
+    Log::SetLevel(Log::Level::Off);
+
+    uint32_t numRun = 0;
+    uint32_t numFailed = 0;
+    for (const auto& c : Cases()) {
+        std::wstring name(c.name, c.name + strlen(c.name));
+        if (!filter.empty() && name.find(filter) == std::wstring::npos)
+            continue;
+
+        std::cout << "[ RUN  ] " << c.name << std::endl;
+        s_running = &c;
+        uint32_t before = s_failures;
+        c.fn();
+        s_running = nullptr;
+        ++numRun;
+        if (s_failures != before) {
+            ++numFailed;
+            std::cout << "[ FAIL ] " << c.name << std::endl;
+        }
+        else {
+            std::cout << "[  OK  ] " << c.name << std::endl;
+        }
+    }
+
+    std::cout << numRun - numFailed << " of " << numRun << " tests passed." << std::endl;
+    return numFailed == 0 && numRun > 0 ? 0 : 1;
+}
+
+int wmain(int argc, wchar_t** argv)
+{
+    return Test::Run(argc, argv);
+}
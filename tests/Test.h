@@ -0,0 +1,68 @@
+#pragma once
+#include <Windows.h>
+
+#include <string>
+#include <vector>
+#include <filesystem>
+
+// A minimal runner for the tests of CallstackResolverTests.exe. TEST() registers a case and CHECK() records a
+// failure of it and goes on:
+//
+//     TEST(HttpGet_ResumesAfterDrop)
+//     {
+//         CHECK(errStr.empty());
+//     }
+//
+// The cases run in the order of registration. A command line argument runs only the cases whose names contain it.
+// TEST_CHILD() registers the body of a child process which a case starts with StartChild(), for the behaviors
+// across processes. Its return value is the exit code of the process.
+class Test
+{
+public:
+	using Fn = void(*)();
+
+	struct Case {
+		const char*     name;
+		Fn              fn;
+	};
+
+	using ChildFn = int(*)(int argc, wchar_t** argv);
+
+	struct Child {
+		const char*     name;
+		ChildFn         fn;
+	};
+
+	class Registrar {
+	public:
+		Registrar(const char* name, Fn fn) { Cases().push_back({ name, fn }); }
+		Registrar(const char* name, ChildFn fn) { Children().push_back({ name, fn }); }
+	};
+
+	static std::vector<Case>& Cases();
+	static std::vector<Child>& Children();
+	static void Fail(const char* file, int line, const char* expr);
+	// A directory emptied for the running case.
+	static std::filesystem::path TempDir();
+	// The path of this executable, to start child processes with.
+	static std::filesystem::path ExePath();
+	// Runs this executable as "--child <name> <args>". Returns the process handle, or NULL on failure.
+	static HANDLE StartChild(const char* name, const std::vector<std::wstring>& args);
+	// The exit code of the child, after waiting for it. Closes the handle.
+	static int WaitChild(HANDLE hProcess);
+
+	static int Run(int argc, wchar_t** argv);
+};
+
+#define TEST(name) \
+	static void Test_##name(); \
+	static Test::Registrar s_testRegistrar_##name(#name, &Test_##name); \
+	static void Test_##name()
+
+#define CHECK(expr) \
+	do { if (!(expr)) Test::Fail(__FILE__, __LINE__, #expr); } while (false)
+
+#define TEST_CHILD(name) \
+	static int TestChild_##name(int argc, wchar_t** argv); \
+	static Test::Registrar s_testChildRegistrar_##name(#name, &TestChild_##name); \
+	static int TestChild_##name(int argc, wchar_t** argv)
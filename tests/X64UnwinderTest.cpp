@@ -0,0 +1,223 @@
+#include <fstream>
+
+#include "Test.h"
+#include "Fixtures.h"
+#include "../X64Unwinder.h"
+
+namespace {
+    constexpr uint64_t imageBase = 0x7ff612340000ull;
+    constexpr uint64_t stackBase = 0x10000;
+    constexpr uint64_t stackTop = stackBase + 0x1000; // rsp before the outermost call.
+    constexpr uint64_t externalCaller = 0x7ff0000a1234ull; // in no module.
+
+    // Code of the functions, at their RVAs.
+    constexpr uint32_t f1Rva = Fixtures::s_textRva; // push rbp, push r12, sub rsp 0x200, lea rbp [rsp + 0x20].
+    constexpr uint32_t f1Body = 15;
+    constexpr uint32_t f1Return = 24; // after the call of F2.
+    constexpr uint32_t f1Epilog = 25;
+    constexpr uint32_t f1Size = 36;
+    constexpr uint32_t f2Rva = f1Rva + 0x100; // push rbx, sub rsp 0x20, then jumps to its fragment.
+    constexpr uint32_t f2Size = 0x20;
+    constexpr uint32_t f2bRva = f1Rva + 0x200; // push rsi, chained to F2, calls F3.
+    constexpr uint32_t f2bReturn = 6;
+    constexpr uint32_t f2bSize = 0x20;
+    constexpr uint32_t f3Rva = f1Rva + 0x300; // a leaf without unwind info.
+    constexpr uint32_t codeSize = 0x400;
+
+    constexpr uint64_t rbp0 = 0x1111, r12_0 = 0x2222, rbx0 = 0x3333, rsi0 = 0x4444;
+
+    void PutCode(std::vector<uint8_t>& code, uint32_t rva, std::initializer_list<uint8_t> bytes)
+    {
+        std::copy(bytes.begin(), bytes.end(), code.begin() + (rva - Fixtures::s_textRva));
+    }
+
+    // Unwind info with the codes given as { prolog offset, op | info << 4 } slots, in the order of the image.
+    uint32_t PutUnwindInfo(std::vector<uint8_t>& xdata, uint8_t flags, uint8_t prologSize, uint8_t frame, const std::vector<std::pair<uint8_t, uint8_t>>& codes)
+    {
+        const uint32_t offset = (uint32_t)xdata.size();
+        xdata.push_back((uint8_t)(1 | (flags << 3)));
+        xdata.push_back(prologSize);
+        xdata.push_back((uint8_t)codes.size());
+        xdata.push_back(frame);
+        for (const auto& [first, second] : codes) {
+            xdata.push_back(first);
+            xdata.push_back(second);
+        }
+        if (codes.size() % 2 != 0) {
+            xdata.push_back(0);
+            xdata.push_back(0);
+        }
+        return offset;
+    }
+
+    std::filesystem::path MakeImage()
+    {
+        std::vector<uint8_t> code(codeSize, 0xCC);
+        PutCode(code, f1Rva, {
+            0x55,                                       // push rbp
+            0x41, 0x54,                                 // push r12
+            0x48, 0x81, 0xEC, 0x00, 0x02, 0x00, 0x00,   // sub rsp, 0x200
+            0x48, 0x8D, 0x6C, 0x24, 0x20,               // lea rbp, [rsp + 0x20]
+            0x48, 0x83, 0xEC, 0x40,                     // sub rsp, 0x40 (alloca)
+            0xE8, 0xDB, 0x00, 0x00, 0x00,               // call F2
+            0x90,                                       // nop
+            0x48, 0x8D, 0xA5, 0xE0, 0x01, 0x00, 0x00,   // lea rsp, [rbp + 0x1e0]
+            0x41, 0x5C,                                 // pop r12
+            0x5D,                                       // pop rbp
+            0xC3,                                       // ret
+            });
+        PutCode(code, f2Rva, {
+            0x53,                                       // push rbx
+            0x48, 0x83, 0xEC, 0x20,                     // sub rsp, 0x20
+            0xE9, 0xF6, 0x00, 0x00, 0x00,               // jmp F2b
+            });
+        PutCode(code, f2bRva, {
+            0x56,                                       // push rsi
+            0xE8, 0xFA, 0x00, 0x00, 0x00,               // call F3
+            0x90,                                       // nop
+            });
+        PutCode(code, f3Rva, { 0x90, 0x90, 0xC3 });
+
+        const uint32_t xdataRva = Fixtures::RdataRva(codeSize);
+        std::vector<uint8_t> xdata;
+        // Frame register rbp at rsp + 2 * 16.
+        const uint32_t f1Info = xdataRva + PutUnwindInfo(xdata, 0, f1Body, X64Unwinder::RBP | (2 << 4), {
+            { 15, X64Unwinder::UWOP_SET_FPREG },
+            { 10, X64Unwinder::UWOP_ALLOC_LARGE }, { 0x200 / 8, 0 },
+            { 3, X64Unwinder::UWOP_PUSH_NONVOL | (X64Unwinder::R12 << 4) },
+            { 1, X64Unwinder::UWOP_PUSH_NONVOL | (X64Unwinder::RBP << 4) },
+            });
+        const uint32_t f2Info = xdataRva + PutUnwindInfo(xdata, 0, 5, 0, {
+            { 5, X64Unwinder::UWOP_ALLOC_SMALL | (((0x20 - 8) / 8) << 4) },
+            { 1, X64Unwinder::UWOP_PUSH_NONVOL | (X64Unwinder::RBX << 4) },
+            });
+        const Fixtures::RuntimeFunction f2 = { f2Rva, f2Rva + f2Size, f2Info };
+        const uint32_t f2bInfo = xdataRva + PutUnwindInfo(xdata, X64Unwinder::s_flagChainInfo, 1, 0, {
+            { 1, X64Unwinder::UWOP_PUSH_NONVOL | (X64Unwinder::RSI << 4) },
+            });
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(&f2);
+        xdata.insert(xdata.end(), p, p + sizeof(f2));
+
+        const auto image = Fixtures::MakeUnwindImage(code, xdata, {
+            { f1Rva, f1Rva + f1Size, f1Info },
+            f2,
+            { f2bRva, f2bRva + f2bSize, f2bInfo },
+            });
+        const auto path = Test::TempDir() / L"unwind.dll";
+        std::ofstream fs(path, std::ios::binary);
+        fs.write(image.data(), image.size());
+        return path;
+    }
+
+    // The stack as F1, F2 and its fragment F2b have built it, up to the call of F3.
+    struct Stack {
+        std::vector<uint64_t>   slots = std::vector<uint64_t>((stackTop - stackBase) / 8);
+        uint64_t                rsp = stackTop;
+
+        void Push(uint64_t v)
+        {
+            rsp -= 8;
+            slots[(rsp - stackBase) / 8] = v;
+        }
+
+        X64Unwinder::StackMemory Memory() const { return { stackBase, reinterpret_cast<const uint8_t*>(slots.data()), slots.size() * 8 }; }
+    };
+
+    struct Fixture {
+        X64Unwinder     unwinder;
+        Stack           stack;
+        uint64_t        f1Rbp = 0; // rbp set by the prolog of F1.
+
+        Fixture()
+        {
+            const auto path = MakeImage();
+            X64Unwinder::PeImage image;
+            CHECK(image.Open(path).empty());
+            CHECK(unwinder.AddModule(imageBase, image.m_sizeOfImage, path).empty());
+
+            stack.Push(externalCaller);
+            stack.Push(rbp0);
+            stack.Push(r12_0);
+            stack.rsp -= 0x200;
+            f1Rbp = stack.rsp + 0x20;
+        }
+    };
+};
+
+TEST(X64Unwinder_WalksPushAllocFrameRegisterAndChainedInfo)
+{
+    Fixture fx;
+    auto& stack = fx.stack;
+    stack.rsp -= 0x40; // the alloca of F1, which only the frame register gets over.
+    stack.Push(imageBase + f1Rva + f1Return);
+    stack.Push(rbx0);
+    stack.rsp -= 0x20;
+    stack.Push(rsi0);
+    stack.Push(imageBase + f2bRva + f2bReturn);
+
+    // Stopped in the leaf F3, with the nonvolatile registers in use by it.
+    X64Unwinder::Registers regs;
+    regs.rip = imageBase + f3Rva + 1;
+    regs.gpr[X64Unwinder::RSP] = stack.rsp;
+    regs.gpr[X64Unwinder::RBP] = fx.f1Rbp;
+    regs.gpr[X64Unwinder::RBX] = 0xdead;
+    regs.gpr[X64Unwinder::RSI] = 0xbeef;
+    regs.gpr[X64Unwinder::R12] = 0xcafe;
+
+    const auto memory = stack.Memory();
+    auto r = regs;
+    CHECK(fx.unwinder.Step(r, memory, true));
+    CHECK(r.rip == imageBase + f2bRva + f2bReturn);
+
+    // F2b restores rsi, then the chained F2 its stack and rbx.
+    CHECK(fx.unwinder.Step(r, memory));
+    CHECK(r.rip == imageBase + f1Rva + f1Return);
+    CHECK(r.gpr[X64Unwinder::RSI] == rsi0);
+    CHECK(r.gpr[X64Unwinder::RBX] == rbx0);
+
+    // F1 unwinds from its frame register over the alloca.
+    CHECK(fx.unwinder.Step(r, memory));
+    CHECK(r.rip == externalCaller);
+    CHECK(r.gpr[X64Unwinder::RSP] == stackTop);
+    CHECK(r.gpr[X64Unwinder::RBP] == rbp0);
+    CHECK(r.gpr[X64Unwinder::R12] == r12_0);
+
+    std::vector<uint64_t> frames;
+    fx.unwinder.Unwind(regs, memory, 16, frames);
+    const std::vector<uint64_t> expected = { imageBase + f3Rva + 1, imageBase + f2bRva + f2bReturn, imageBase + f1Rva + f1Return, externalCaller };
+    CHECK(frames == expected);
+}
+
+TEST(X64Unwinder_TopFrameInPrologOrEpilog)
+{
+    struct Case {
+        uint32_t    offset; // in F1.
+        uint64_t    rsp;
+        uint64_t    rbp;
+        uint64_t    r12;
+    };
+    Fixture fx;
+    const uint64_t garbage = 0x5555;
+    const Case cases[] = {
+        { 1, stackTop - 16, garbage, garbage },                         // after push rbp.
+        { f1Epilog, fx.f1Rbp - 0x20 - 0x40, fx.f1Rbp, garbage },        // lea rsp, [rbp + 0x1e0]
+        { f1Epilog + 7, stackTop - 24, garbage, garbage },              // pop r12
+        { f1Epilog + 9, stackTop - 16, garbage, r12_0 },                // pop rbp
+        { f1Epilog + 10, stackTop - 8, rbp0, r12_0 },                   // ret
+    };
+    const auto memory = fx.stack.Memory();
+    for (const auto& c : cases) {
+        X64Unwinder::Registers r;
+        r.rip = imageBase + f1Rva + c.offset;
+        r.gpr[X64Unwinder::RSP] = c.rsp;
+        r.gpr[X64Unwinder::RBP] = c.rbp;
+        r.gpr[X64Unwinder::R12] = c.r12;
+        CHECK(fx.unwinder.Step(r, memory, true));
+        CHECK(r.rip == externalCaller);
+        CHECK(r.gpr[X64Unwinder::RSP] == stackTop);
+        CHECK(r.gpr[X64Unwinder::RBP] == rbp0);
+        if (c.offset != 1) {
+            CHECK(r.gpr[X64Unwinder::R12] == r12_0);
+        }
+    }
+}